@@ -0,0 +1,287 @@
+/*
+ * accesslog.c - 비동기 접근 로그. 요청을 처리한 스레드는 자기 링
+ *     (single-producer/single-consumer)에 레코드를 복사하고 돌아가며,
+ *     잠금도 시스템 호출도 하지 않는다. 쓰는 스레드 하나가 모든 링을 돌며
+ *     레코드를 한 줄씩 글자로 바꿔 writev 한 번에 ACCESS_BATCH 줄씩 쓴다.
+ *     링이 가득 차면 기다리지 않고 버린 뒤 개수만 센다.
+ *
+ *     링은 metrics.c의 칸과 같이 스레드가 끝나면 빈 목록으로 돌아가
+ *     다음 스레드가 이어서 쓴다. tiny도 같은 파일을 쓰므로 csapp.h에
+ *     기대지 않는다.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/uio.h>
+#include "accesslog.h"
+
+#define ACCESS_LINE_MAX 640
+
+typedef struct ring {
+  access_rec recs[ACCESS_RING_SIZE];
+  unsigned head;                // 다음에 넣을 자리 (넣는 스레드만 씀)
+  unsigned tail;                // 다음에 꺼낼 자리 (쓰는 스레드만 씀)
+  unsigned long dropped;        // 가득 차서 버린 레코드 (넣는 스레드만 씀)
+  struct ring *next;            // 모든 링의 목록
+  struct ring *next_free;       // 넣는 스레드가 없는 링의 목록
+} ring;
+
+static int out_fd = -1;         // -1이면 로그를 남기지 않음
+static int closing;             // access_log_close(): 남은 것을 쓰고 끝내라
+static pthread_mutex_t closed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t closed = PTHREAD_COND_INITIALIZER;
+static ring *rings, *free_rings;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t key;
+static __thread ring *mine;
+
+static void *writer(void *arg);
+
+/* 스레드가 끝나면 링을 빈 목록에 돌려준다 (남은 레코드는 쓰는 스레드가 마저 씀) */
+static void ring_release(void *p) {
+  ring *r = p;
+
+  pthread_mutex_lock(&lock);
+  r->next_free = free_rings;
+  free_rings = r;
+  pthread_mutex_unlock(&lock);
+}
+
+/*
+ * access_log_open - path에 접근 로그를 이어 쓰고 쓰는 스레드를 시작한다.
+ *     "-"면 표준 출력.
+ *
+ *     반환값: 0, 실패하면 -1
+ */
+int access_log_open(const char *path) {
+  pthread_t tid;
+  int fd;
+
+  if (!strcmp(path, "-"))
+    fd = STDOUT_FILENO;
+  else if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0)
+    return -1;
+  if (pthread_key_create(&key, ring_release) != 0) {
+    if (fd != STDOUT_FILENO)
+      close(fd);
+    return -1;
+  }
+  out_fd = fd;
+  if (pthread_create(&tid, NULL, writer, NULL) != 0) {
+    out_fd = -1;
+    return -1;
+  }
+  pthread_detach(tid);
+  return 0;
+}
+
+/* fork한 자식에서 쓰는 스레드를 다시 시작한다 (스레드는 fork로 따라오지 않는다).
+ * 반환값: 0, 실패하면 -1 */
+int access_log_restart(void) {
+  pthread_t tid;
+
+  if (out_fd < 0)
+    return 0;
+  if (pthread_create(&tid, NULL, writer, NULL) != 0)
+    return -1;
+  pthread_detach(tid);
+  return 0;
+}
+
+int access_log_enabled(void) {
+  return out_fd >= 0;
+}
+
+/* 클라이언트 주소를 레코드에 복사 (IPv4/IPv6만) */
+void access_log_set_addr(access_rec *r, const struct sockaddr *sa, socklen_t len) {
+  if (len > sizeof(r->addr))
+    len = sizeof(r->addr);
+  memcpy(&r->addr, sa, len);
+}
+
+/* 지금 스레드의 링. 처음 부르면 빈 링을 받거나 새로 만든다. 메모리가 없으면 NULL */
+static ring *ring_get(void) {
+  ring *r;
+
+  if (mine)
+    return mine;
+  pthread_mutex_lock(&lock);
+  if ((r = free_rings))
+    free_rings = r->next_free;
+  else if ((r = calloc(1, sizeof(ring)))) {
+    r->next = rings;
+    __atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&lock);
+  if (r) {
+    pthread_setspecific(key, r);
+    mine = r;
+  }
+  return r;
+}
+
+/* 레코드 하나를 지금 스레드의 링에 넣는다. 가득 찼으면 버리고 센다 */
+void access_log_put(const access_rec *rec) {
+  ring *r;
+  unsigned head;
+
+  if (out_fd < 0 || !(r = ring_get()))
+    return;
+  head = r->head;
+  if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == ACCESS_RING_SIZE) {
+    __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+  r->recs[head & (ACCESS_RING_SIZE - 1)] = *rec;
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* 지금까지 버린 레코드 수 */
+unsigned long access_log_dropped(void) {
+  unsigned long n = 0;
+  ring *r;
+
+  for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+    n += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+  return n;
+}
+
+long long access_log_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* -1이면 "-", 아니면 ms로 */
+static void fmt_ms(char *buf, long long us) {
+  if (us < 0)
+    strcpy(buf, "-");
+  else
+    sprintf(buf, "%.3f", us / 1000.0);
+}
+
+/* 레코드를 한 줄(logfmt)로. 반환값: 길이 */
+static int format(char *line, const access_rec *r) {
+  char host[NI_MAXHOST] = "-", ts[32], total[32], hdr[32], cch[32], dns[32], conn[32];
+  char fb[32], relay[32];
+  static const char *cache[] = { "-", "HIT", "MISS" };
+  time_t sec = r->time_us / 1000000;
+  struct tm tm;
+  int n;
+
+  if (r->addr.sa.sa_family == AF_INET || r->addr.sa.sa_family == AF_INET6)
+    getnameinfo(&r->addr.sa, r->addr.sa.sa_family == AF_INET ? sizeof(r->addr.in)
+                : sizeof(r->addr.in6), host, sizeof(host), NULL, 0, NI_NUMERICHOST);
+  gmtime_r(&sec, &tm);
+  strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+  fmt_ms(total, r->total_us);
+  fmt_ms(hdr, r->header_us);
+  fmt_ms(cch, r->cache_us);
+  fmt_ms(dns, r->dns_us);
+  fmt_ms(conn, r->connect_us);
+  fmt_ms(fb, r->first_byte_us);
+  fmt_ms(relay, r->relay_us);
+  n = snprintf(line, ACCESS_LINE_MAX, "time=%s.%06lldZ client=%s method=%s uri=\"%s\" "
+               "status=%d bytes=%lld cache=%s total_ms=%s header_ms=%s cache_ms=%s dns_ms=%s "
+               "connect_ms=%s first_byte_ms=%s relay_ms=%s%s%s\n",
+               ts, r->time_us % 1000000, host, r->method[0] ? r->method : "-", r->uri,
+               r->status, r->bytes, cache[r->cache], total, hdr, cch, dns, conn, fb, relay,
+               r->error[0] ? " error=" : "", r->error);
+  return n < ACCESS_LINE_MAX ? n : ACCESS_LINE_MAX - 1;
+}
+
+/* iov를 끝까지 쓴다. 실패하면 나머지는 버린다 */
+static void write_all(struct iovec *iov, int n) {
+  ssize_t w;
+
+  while (n > 0) {
+    if ((w = writev(out_fd, iov, n)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    while (n > 0 && (size_t)w >= iov->iov_len) {
+      w -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+}
+
+/* 모든 링에서 쌓인 레코드를 꺼내 쓴다. 버린 수가 늘었으면 그것도 한 줄 남긴다.
+ * 반환값: 쓴 레코드 수 */
+static int drain(unsigned long *reported) {
+  static char lines[ACCESS_BATCH][ACCESS_LINE_MAX];
+  struct iovec iov[ACCESS_BATCH];
+  unsigned head, tail;
+  unsigned long dropped;
+  int n = 0, total = 0;
+  ring *r;
+
+  for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+    tail = r->tail;
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    for (; tail != head; tail++) {
+      iov[n].iov_base = lines[n];
+      iov[n].iov_len = format(lines[n], &r->recs[tail & (ACCESS_RING_SIZE - 1)]);
+      if (++n == ACCESS_BATCH) {
+        __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+        write_all(iov, n);
+        total += n;
+        n = 0;
+      }
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);   // 글자로 바꿨으니 자리를 돌려줌
+  }
+  if ((dropped = access_log_dropped()) != *reported) {
+    iov[n].iov_base = lines[n];
+    iov[n].iov_len = sprintf(lines[n], "dropped=%lu\n", dropped);
+    n++;
+    *reported = dropped;
+  }
+  if (n)
+    write_all(iov, n);
+  return total + n;
+}
+
+/* 쓰는 스레드: 쓸 것이 없으면 ACCESS_FLUSH_MS 쉬고 다시 돈다.
+ * access_log_close()가 부르면 링이 빌 때까지 쓰고 끝난다 */
+static void *writer(void *arg) {
+  struct timespec ts = { 0, ACCESS_FLUSH_MS * 1000000L };
+  unsigned long reported = 0;
+
+  while (1) {
+    if (drain(&reported))
+      continue;
+    if (__atomic_load_n(&closing, __ATOMIC_ACQUIRE))
+      break;
+    nanosleep(&ts, NULL);
+  }
+  pthread_mutex_lock(&closed_lock);
+  closing = 2;
+  pthread_cond_signal(&closed);
+  pthread_mutex_unlock(&closed_lock);
+  return NULL;
+}
+
+/* 프로세스를 끝내기 전에: 이미 넣은 레코드를 모두 쓸 때까지 기다린다 */
+void access_log_close(void) {
+  if (out_fd < 0)
+    return;
+  pthread_mutex_lock(&closed_lock);
+  __atomic_store_n(&closing, 1, __ATOMIC_RELEASE);
+  while (closing != 2)
+    pthread_cond_wait(&closed, &closed_lock);
+  pthread_mutex_unlock(&closed_lock);
+}
@@ -0,0 +1,48 @@
+#ifndef __ACCESSLOG_H__
+#define __ACCESSLOG_H__
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define ACCESS_RING_SIZE 256            // 스레드 하나의 링에 쌓아둘 레코드 수 (2의 거듭제곱)
+#define ACCESS_URI_MAX   160            // 레코드에 남기는 URI 길이 (넘으면 자름)
+#define ACCESS_BATCH     64             // writev 한 번에 쓰는 줄 수
+#define ACCESS_FLUSH_MS  10             // 쓸 것이 없을 때 쓰는 스레드가 쉬는 시간
+
+/* 캐시 결과 */
+enum { ACCESS_CACHE_NONE, ACCESS_CACHE_HIT, ACCESS_CACHE_MISS };
+
+/* 요청 하나의 기록. 요청을 처리한 스레드는 복사만 하고 글자로 바꾸는 것은 쓰는 스레드가 한다 */
+typedef struct {
+  long long time_us;            // 요청을 끝낸 시각 (epoch, us)
+  long long total_us;           // 연결을 받은 뒤 끝낼 때까지
+  /* 단계별 시간 (프록시는 phase.h의 구간), 그 단계가 없으면 -1 */
+  long long header_us;          // 요청 헤더 읽기
+  long long cache_us;           // 캐시 검사 (잠금 대기 포함)
+  long long dns_us;             // 원 서버 이름 찾기
+  long long connect_us;         // 원 서버 연결
+  long long first_byte_us;      // 요청을 보낸 뒤 응답 헤더까지
+  long long relay_us;           // 응답 헤더 뒤로 중계를 끝낼 때까지
+  long long bytes;              // 클라이언트에 보낸 바이트, 모르면 -1
+  int status;                   // 응답 상태 코드, 보내지 못했으면 0
+  int cache;                    // ACCESS_CACHE_*
+  union {
+    struct sockaddr sa;
+    struct sockaddr_in in;
+    struct sockaddr_in6 in6;
+  } addr;                       // 클라이언트 주소
+  char method[16];
+  char uri[ACCESS_URI_MAX];
+  char error[24];               // 실패 원인, 성공이면 빈 문자열
+} access_rec;
+
+int access_log_open(const char *path);
+void access_log_close(void);
+int access_log_restart(void);
+int access_log_enabled(void);
+void access_log_set_addr(access_rec *r, const struct sockaddr *sa, socklen_t len);
+void access_log_put(const access_rec *r);
+unsigned long access_log_dropped(void);
+long long access_log_now_us(void);
+
+#endif /* __ACCESSLOG_H__ */
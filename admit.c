@@ -0,0 +1,255 @@
+#include "admit.h"
+
+/* 큐에서 처리를 기다리는 연결 */
+typedef struct pending {
+  int fd;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+  long long arrived_ms;            // accept한 시각
+  struct pending *next;
+} pending;
+
+/* IP별 요청 수 (처리 중 + 큐에서 대기 중) */
+typedef struct ip_entry {
+  ip_key key;
+  int count;
+  struct ip_entry *next;
+} ip_entry;
+
+static struct {
+  int max_active, max_per_ip, queue_ms;
+  admit_start_fn start;
+  pending *head, *tail;            // FIFO 큐
+  ip_entry *ips[ADMIT_IP_BUCKETS];
+  admit_stats st;
+  pthread_mutex_t lock;
+} adm = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static const char *shed_resp =
+    "HTTP/1.0 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+
+static long long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void get_ip(struct sockaddr_storage *addr, ip_key *key) {
+  memset(key, 0, sizeof(*key));
+  key->family = addr->ss_family;
+  if (addr->ss_family == AF_INET)
+    memcpy(key->addr, &((struct sockaddr_in *)addr)->sin_addr, 4);
+  else if (addr->ss_family == AF_INET6)
+    memcpy(key->addr, &((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+}
+
+static unsigned ip_hash(ip_key *key) {
+  unsigned h = 2166136261u;      // FNV-1a
+  int i;
+  for (i = 0; i < 16; i++)
+    h = (h ^ key->addr[i]) * 16777619u;
+  return h % ADMIT_IP_BUCKETS;
+}
+
+/* IP의 요청 수를 delta만큼 바꾸고 바뀐 값을 반환. 표에 넣을 메모리가
+ * 없으면 -1 (lock을 잡은 상태에서 호출) */
+static int ip_add(struct sockaddr_storage *addr, int delta) {
+  ip_key key;
+  ip_entry **pp, *e;
+  int count;
+
+  get_ip(addr, &key);
+  for (pp = &adm.ips[ip_hash(&key)]; (e = *pp); pp = &e->next)
+    if (!memcmp(&e->key, &key, sizeof(key)))
+      break;
+  if (!e) {
+    if (delta <= 0)
+      return 0;
+    if (!(e = malloc(sizeof(ip_entry))))
+      return -1;
+    e->key = key;
+    e->count = 0;
+    e->next = NULL;
+    *pp = e;
+  }
+  count = (e->count += delta);
+  if (count <= 0) {              // 요청이 없는 IP는 표에서 뺀다
+    *pp = e->next;
+    Free(e);
+  }
+  return count;
+}
+
+void admit_init(int max_active, int max_per_ip, int queue_ms, admit_start_fn start) {
+  adm.max_active = max_active;
+  adm.max_per_ip = max_per_ip;
+  adm.queue_ms = queue_ms;
+  adm.start = start;
+}
+
+/* 과부하로 거절: 요청을 읽지 않고 503만 보내고 닫는다 */
+void admit_reject(int fd) {
+  rio_writen(fd, (char *)shed_resp, strlen(shed_resp));
+  close(fd);
+}
+
+/*
+ * 큐 맨 앞에서 처리할 연결을 꺼낸다. 마감 시간을 넘긴 연결은 꺼내서
+ * *expired 목록에 모은다 (lock을 잡은 상태에서 호출).
+ */
+static pending *dequeue(long long now, pending **expired) {
+  pending *p;
+
+  while ((p = adm.head)) {
+    adm.head = p->next;
+    if (!adm.head)
+      adm.tail = NULL;
+    adm.st.waiting--;
+    if (now - p->arrived_ms <= adm.queue_ms)
+      return p;
+    ip_add(&p->addr, -1);
+    adm.st.shed_deadline++;
+    p->next = *expired;
+    *expired = p;
+  }
+  return NULL;
+}
+
+static void reject_all(pending *list) {
+  pending *next;
+  for (; list; list = next) {
+    next = list->next;
+    admit_reject(list->fd);
+    Free(list);
+  }
+}
+
+/*
+ * 처리 중인 요청 수에 여유가 있는 동안 큐에 있는 연결을 시작한다.
+ * 시작 함수가 자원 부족으로 실패하면 그 연결을 큐 맨 앞에 되돌려 놓고
+ * 다른 요청이 끝날 때까지 기다린다.
+ */
+static void run_queue(void) {
+  pending *p, *expired = NULL;
+
+  while (1) {
+    pthread_mutex_lock(&adm.lock);
+    if (adm.st.active >= adm.max_active || !(p = dequeue(now_ms(), &expired))) {
+      pthread_mutex_unlock(&adm.lock);
+      break;
+    }
+    adm.st.active++;
+    pthread_mutex_unlock(&adm.lock);
+
+    if (adm.start(p->fd, &p->addr, p->addrlen) == 0) {
+      pthread_mutex_lock(&adm.lock);
+      adm.st.admitted++;
+      pthread_mutex_unlock(&adm.lock);
+      Free(p);
+      continue;
+    }
+    pthread_mutex_lock(&adm.lock);
+    adm.st.active--;
+    p->next = adm.head;
+    adm.head = p;
+    if (!adm.tail)
+      adm.tail = p;
+    adm.st.waiting++;
+    pthread_mutex_unlock(&adm.lock);
+    break;
+  }
+  reject_all(expired);
+}
+
+/*
+ * admit_submit - 새로 accept한 연결을 처리할지, 큐에 넣을지, 503으로
+ *     거절할지 정한다. 한도를 넘은 연결은 요청을 읽기 전에 바로 거절하므로
+ *     이미 받아들인 요청의 지연 시간은 부하가 늘어도 유지된다.
+ */
+void admit_submit(int fd, struct sockaddr_storage *addr, socklen_t addrlen) {
+  pending *p;
+  int count;
+
+  pthread_mutex_lock(&adm.lock);
+  adm.st.accepted++;
+  if ((count = ip_add(addr, 1)) > adm.max_per_ip) {
+    ip_add(addr, -1);
+    adm.st.shed_per_ip++;
+    pthread_mutex_unlock(&adm.lock);
+    admit_reject(fd);
+    return;
+  }
+  if (count < 0 || adm.st.waiting >= ADMIT_MAX_QUEUE
+      || !(p = malloc(sizeof(pending)))) {   // 메모리가 모자랄 때도 큐가 가득 찬 것으로 침
+    if (count > 0)
+      ip_add(addr, -1);
+    adm.st.shed_queue_full++;
+    pthread_mutex_unlock(&adm.lock);
+    admit_reject(fd);
+    return;
+  }
+  p->fd = fd;
+  memcpy(&p->addr, addr, addrlen);
+  p->addrlen = addrlen;
+  p->arrived_ms = now_ms();
+  p->next = NULL;
+  if (adm.tail)
+    adm.tail->next = p;
+  else
+    adm.head = p;
+  adm.tail = p;
+  adm.st.waiting++;
+  if (adm.st.active >= adm.max_active)
+    adm.st.queued++;
+  pthread_mutex_unlock(&adm.lock);
+
+  run_queue();
+}
+
+/* 요청 처리가 끝났을 때 호출. 자리가 났으니 큐에서 다음 연결을 시작한다 */
+void admit_done(struct sockaddr_storage *addr) {
+  pthread_mutex_lock(&adm.lock);
+  adm.st.active--;
+  ip_add(addr, -1);
+  pthread_mutex_unlock(&adm.lock);
+  run_queue();
+}
+
+/* 설정을 다시 읽었을 때 한도를 바꾼다. 늘었으면 기다리던 연결을 바로 시작 */
+void admit_set_limits(int max_active, int max_per_ip, int queue_ms) {
+  pthread_mutex_lock(&adm.lock);
+  adm.max_active = max_active;
+  adm.max_per_ip = max_per_ip;
+  adm.queue_ms = queue_ms;
+  pthread_mutex_unlock(&adm.lock);
+  run_queue();
+}
+
+/* 큐에서 마감 시간을 넘긴 연결을 503으로 거절 (주기적으로 호출).
+ * 큐는 도착 순서이므로 맨 앞부터 마감을 넘긴 연결만 보면 된다 */
+void admit_expire(void) {
+  pending *p, *expired = NULL;
+  long long now = now_ms();
+
+  pthread_mutex_lock(&adm.lock);
+  while ((p = adm.head) && now - p->arrived_ms > adm.queue_ms) {
+    adm.head = p->next;
+    adm.st.waiting--;
+    adm.st.shed_deadline++;
+    ip_add(&p->addr, -1);
+    p->next = expired;
+    expired = p;
+  }
+  if (!adm.head)
+    adm.tail = NULL;
+  pthread_mutex_unlock(&adm.lock);
+  reject_all(expired);
+  run_queue();
+}
+
+void admit_get_stats(admit_stats *st) {
+  pthread_mutex_lock(&adm.lock);
+  *st = adm.st;
+  pthread_mutex_unlock(&adm.lock);
+}
@@ -0,0 +1,42 @@
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include "csapp.h"
+
+#define ADMIT_MAX_ACTIVE   512     // 동시에 처리하는 최대 요청 수 (-c)
+#define ADMIT_MAX_PER_IP   64      // 클라이언트 IP 하나당 최대 요청 수 (-i)
+#define ADMIT_QUEUE_MS     500     // 큐에서 기다릴 수 있는 최대 시간 (-q)
+#define ADMIT_MAX_QUEUE    4096    // 큐에 쌓아둘 최대 연결 수
+#define ADMIT_SWEEP_MS     50      // 큐 마감 시간을 검사하는 주기
+#define ADMIT_IP_BUCKETS   1024
+
+/* 클라이언트 주소에서 포트를 뺀 IP (IPv4는 앞 4바이트만 씀) */
+typedef struct {
+  int family;
+  unsigned char addr[16];
+} ip_key;
+
+/* 수락 제어 카운터 */
+typedef struct {
+  unsigned long accepted;          // 받은 연결
+  unsigned long admitted;          // 처리를 시작한 연결
+  unsigned long queued;            // 한 번이라도 큐에서 기다린 연결
+  unsigned long shed_queue_full;   // 큐가 가득 차서 거절
+  unsigned long shed_per_ip;       // IP당 한도를 넘어서 거절
+  unsigned long shed_deadline;     // 큐에서 마감 시간을 넘겨서 거절
+  int active;                      // 지금 처리 중인 요청 수
+  int waiting;                     // 지금 큐에 있는 연결 수
+} admit_stats;
+
+/* 처리를 시작하는 함수. 자원이 모자라 시작하지 못하면 -1을 반환 */
+typedef int (*admit_start_fn)(int fd, struct sockaddr_storage *addr, socklen_t addrlen);
+
+void admit_init(int max_active, int max_per_ip, int queue_ms, admit_start_fn start);
+void admit_set_limits(int max_active, int max_per_ip, int queue_ms);
+void admit_submit(int fd, struct sockaddr_storage *addr, socklen_t addrlen);
+void admit_done(struct sockaddr_storage *addr);
+void admit_expire(void);
+void admit_get_stats(admit_stats *st);
+void admit_reject(int fd);
+
+#endif /* __ADMIT_H__ */
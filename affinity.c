@@ -0,0 +1,116 @@
+/*
+ * affinity.c - 스레드를 CPU에 고정한다 (-a). 고른 CPU 목록에서 몇 번째인지
+ *     (slot)로 부르고, slot마다 NUMA 노드를 sysfs에서 읽어 둔다.
+ *     작업자 i는 slot i에, 연결 처리 스레드는 그 연결의 패킷을 받은 CPU
+ *     (SO_INCOMING_CPU)에 고정하므로 한 연결이 받기부터 압축까지 한
+ *     코어에서 처리된다.
+ *
+ *     csapp.h와 겹치는 gai_error 때문에 csapp.h 없이 _GNU_SOURCE로 컴파일한다.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include "affinity.h"
+
+static int cpus[AFFINITY_MAX_CPUS];   // slot -> CPU 번호
+static int nodes[AFFINITY_MAX_CPUS];  // slot -> NUMA 노드 (모르면 -1)
+static int ncpus;
+
+/* cpu가 속한 NUMA 노드: /sys/devices/system/cpu/cpuN/nodeM. 모르면 -1 */
+static int cpu_node(int cpu) {
+  char path[64];
+  struct dirent *d;
+  DIR *dir;
+  int node = -1;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  if (!(dir = opendir(path)))
+    return -1;
+  while ((d = readdir(dir)))
+    if (!strncmp(d->d_name, "node", 4) && sscanf(d->d_name + 4, "%d", &node) == 1)
+      break;
+  closedir(dir);
+  return node;
+}
+
+/*
+ * affinity_init - "0-3,8,10-11" 같은 CPU 목록을 읽는다. 이 프로세스가
+ *     쓸 수 없는 CPU가 있으면 거절한다.
+ *
+ *     반환값: 0, 목록이 잘못되었으면 -1
+ */
+int affinity_init(const char *cpulist) {
+  const char *p = cpulist;
+  cpu_set_t allowed;
+  int lo, hi, n, cpu;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+    return -1;
+  ncpus = 0;
+  while (*p) {
+    if (sscanf(p, "%d%n", &lo, &n) != 1 || lo < 0)
+      return -1;
+    p += n;
+    hi = lo;
+    if (*p == '-') {
+      if (sscanf(p + 1, "%d%n", &hi, &n) != 1 || hi < lo)
+        return -1;
+      p += 1 + n;
+    }
+    for (cpu = lo; cpu <= hi; cpu++) {
+      if (ncpus == AFFINITY_MAX_CPUS || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+        return -1;
+      nodes[ncpus] = cpu_node(cpu);
+      cpus[ncpus++] = cpu;
+    }
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return -1;
+  }
+  return ncpus ? 0 : -1;
+}
+
+/* -a로 CPU를 골랐는지 */
+int affinity_enabled(void) {
+  return ncpus > 0;
+}
+
+int affinity_ncpus(void) {
+  return ncpus;
+}
+
+int affinity_cpu(int slot) {
+  return cpus[slot % ncpus];
+}
+
+int affinity_node(int slot) {
+  return nodes[slot % ncpus];
+}
+
+/* 지금 스레드를 slot의 CPU에 고정한다. 반환값: 0, 실패하면 -1 */
+int affinity_pin(int slot) {
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpus[slot % ncpus], &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) ? -1 : 0;
+}
+
+/* fd의 패킷을 처리한 CPU(SO_INCOMING_CPU)의 slot. 목록에 없거나 모르면 -1 */
+int affinity_incoming(int fd) {
+  socklen_t len = sizeof(int);
+  int cpu, i;
+
+  if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+    return -1;
+  for (i = 0; i < ncpus; i++)
+    if (cpus[i] == cpu)
+      return i;
+  return -1;
+}
@@ -0,0 +1,14 @@
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#define AFFINITY_MAX_CPUS 256
+
+int affinity_init(const char *cpulist);
+int affinity_enabled(void);
+int affinity_ncpus(void);
+int affinity_cpu(int slot);
+int affinity_node(int slot);
+int affinity_pin(int slot);
+int affinity_incoming(int fd);
+
+#endif /* __AFFINITY_H__ */
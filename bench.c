@@ -0,0 +1,343 @@
+/*
+ * bench.c - tiny와 프록시를 위한 HTTP 부하 생성기. 연결마다 스레드 하나가
+ *     요청을 보내고 응답을 끝까지 읽는 것을 반복하고, 지연 시간을
+ *     HdrHistogram 방식의 히스토그램(hist.c)에 모아 백분위로 보여 준다.
+ *
+ *     -r이 없으면 closed loop: 응답을 받자마자 다음 요청을 보낸다.
+ *     -r이 있으면 open loop: 연결마다 rate/conns의 간격으로 보낼 시각을
+ *     미리 정해 두고, 늦어졌으면 밀린 만큼 바로 보낸다. 지연 시간은 보내려던
+ *     시각부터 재므로 서버가 멈춘 동안 보내지 못한 요청의 대기도 들어간다
+ *     (coordinated omission 보정).
+ *
+ *     URL 앞에 "N*"를 붙이면 가중치, URL 안의 "{n}"은 요청마다 다른 번호로
+ *     바뀐다 (캐시 미스 만들기). -x를 주면 프록시에 절대 URI로 보낸다.
+ *     -k면 서버가 닫지 않는 한 연결을 다시 쓴다.
+ *
+ *     usage: ./bench [-c conns] [-d secs] [-n requests] [-r rate] [-k]
+ *                    [-x proxy_host:port] [N*]url...
+ */
+#include "csapp.h"
+#include "http.h"
+#include "chunked.h"
+#include "hist.h"
+
+#define BENCH_MAX_URLS 64
+#define BENCH_TIMEOUT  5                // 응답을 기다리는 최대 시간 (초)
+
+typedef struct {
+  int weight;
+  char host[NI_MAXHOST];
+  char port[NI_MAXSERV];
+  char url[MAXLINE];            // 프록시에 보낼 절대 URI
+  char *path;                   // url 안의 경로 (서버에 직접 보낼 때)
+} target;
+
+/* 연결 하나 (스레드 하나) */
+typedef struct {
+  int id;
+  pthread_t tid;
+  int fd;                       // 다시 쓸 수 있는 연결, 없으면 -1
+  unsigned seed;
+  histogram hist;               // 지연 시간 (us)
+  unsigned long requests, errors, non2xx, connects;
+  unsigned long long bytes;
+  char buf[MAXBUF];
+} bconn;
+
+static target targets[BENCH_MAX_URLS];
+static int ntargets, total_weight;
+static char proxy_host[NI_MAXHOST], proxy_port[NI_MAXSERV];
+static int use_proxy, keepalive, nconns = 16;
+static double rate;             // 초당 요청 (0이면 closed loop)
+static long long max_requests;  // 0이면 시간으로만 끝냄
+static long long issued;        // 지금까지 시작한 요청 (-n)
+static long long start_ns, end_ns;
+static volatile int stop;
+static unsigned long counter;   // {n}에 넣는 번호
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* "[N*]http://host[:port]/path"를 targets에 더한다. 반환값: 0, 잘못되었으면 -1 */
+static int add_target(char *arg) {
+  target *t = &targets[ntargets];
+  char *p = arg, *host, *slash, *colon;
+  size_t n;
+
+  if (ntargets == BENCH_MAX_URLS)
+    return -1;
+  t->weight = 1;
+  if ((colon = strchr(arg, '*')) && colon < strstr(arg, "://")) {
+    t->weight = atoi(arg);
+    p = colon + 1;
+  }
+  if (t->weight <= 0 || strncasecmp(p, "http://", 7) || strlen(p) >= MAXLINE)
+    return -1;
+  strcpy(t->url, p);
+  host = t->url + 7;
+  if (!(slash = strchr(host, '/')))
+    slash = host + strlen(host);
+  n = slash - host;
+  if (n == 0 || n >= NI_MAXHOST)
+    return -1;
+  memcpy(t->host, host, n);
+  t->host[n] = '\0';
+  strcpy(t->port, "80");
+  if ((colon = strchr(t->host, ':'))) {
+    *colon = '\0';
+    snprintf(t->port, NI_MAXSERV, "%s", colon + 1);
+  }
+  t->path = *slash ? slash : "/";
+  total_weight += t->weight;
+  ntargets++;
+  return 0;
+}
+
+/* 가중치에 따라 URL 하나를 고른다 */
+static target *pick(bconn *bc) {
+  int r = rand_r(&bc->seed) % total_weight, i;
+
+  for (i = 0; r >= targets[i].weight; i++)
+    r -= targets[i].weight;
+  return &targets[i];
+}
+
+/* 요청 메시지를 buf에 만든다. 반환값: 길이 */
+static int build_request(char *buf, target *t) {
+  char uri[MAXLINE], *src = use_proxy ? t->url : t->path, *mark;
+  unsigned long n;
+
+  if ((mark = strstr(src, "{n}"))) {
+    n = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    snprintf(uri, sizeof(uri), "%.*s%lu%s", (int)(mark - src), src, n, mark + 3);
+  } else {
+    snprintf(uri, sizeof(uri), "%s", src);
+  }
+  return snprintf(buf, MAXBUF, "GET %s HTTP/1.1\r\nHost: %s:%s\r\nConnection: %s\r\n"
+                  "User-Agent: webproxy-bench\r\n\r\n",
+                  uri, t->host, t->port, keepalive ? "keep-alive" : "close");
+}
+
+static int open_conn(bconn *bc, target *t) {
+  struct timeval tv = { BENCH_TIMEOUT, 0 };
+  int fd;
+
+  if ((fd = open_clientfd(use_proxy ? proxy_host : t->host,
+                          use_proxy ? proxy_port : t->port)) < 0)
+    return -1;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  bc->connects++;
+  return fd;
+}
+
+static void close_conn(bconn *bc) {
+  if (bc->fd >= 0)
+    close(bc->fd);
+  bc->fd = -1;
+}
+
+/*
+ * read_response - 응답 헤더와 바디를 끝까지 읽는다. 바디 길이는
+ *     Content-Length, chunked, 연결 종료 순으로 판단한다.
+ *
+ *     반환값: 상태 코드, 실패하면 -1. *reuse는 연결을 다시 쓸 수 있는지
+ */
+static int read_response(bconn *bc, int *reuse) {
+  http_response resp;
+  chunk_decoder dec;
+  http_field *f;
+  char *buf = bc->buf;
+  int len = 0, hdrlen = 0, status;
+  long long remain;
+  size_t used;
+  ssize_t n;
+
+  while (!(hdrlen = http_header_end(buf, len))) {
+    if (len == MAXBUF || (n = read(bc->fd, buf + len, MAXBUF - len)) <= 0)
+      return -1;
+    len += n;
+    bc->bytes += n;
+  }
+  if (http_parse_response(&resp, buf, hdrlen) < 0)
+    return -1;
+  status = resp.status;
+  *reuse = keepalive && resp.minor_version >= 1;
+  if ((f = http_find(&resp, "Connection")) && !strncasecmp(f->value, "close", 5))
+    *reuse = 0;
+
+  len -= hdrlen;                  // 헤더와 같이 읽은 바디
+  memmove(buf, buf + hdrlen, len);
+  if (resp.chunked) {
+    chunk_decoder_init(&dec);
+    while (1) {
+      if (chunk_decode(&dec, buf, len, &used) < 0)
+        return -1;
+      if (chunk_done(&dec))
+        return status;
+      if ((n = read(bc->fd, buf, MAXBUF)) <= 0)
+        return -1;
+      len = n;
+      bc->bytes += n;
+    }
+  }
+  if (resp.content_length >= 0) {
+    for (remain = resp.content_length - len; remain > 0; remain -= n) {
+      if ((n = read(bc->fd, buf, remain < MAXBUF ? remain : MAXBUF)) <= 0)
+        return -1;
+      bc->bytes += n;
+    }
+    return status;
+  }
+  *reuse = 0;                     // 길이가 없으면 닫힐 때까지
+  while ((n = read(bc->fd, buf, MAXBUF)) > 0)
+    bc->bytes += n;
+  return n < 0 ? -1 : status;
+}
+
+/* 요청 하나를 보내고 응답을 받는다. 다시 쓴 연결이 이미 닫혀 있었으면 새로 연결해서 한 번 더 */
+static int one_request(bconn *bc, target *t) {
+  char req[MAXBUF];
+  int len = build_request(req, t), status, reuse = 0, tries;
+
+  for (tries = 0; tries < 2; tries++) {
+    if (bc->fd < 0 && (bc->fd = open_conn(bc, t)) < 0)
+      return -1;
+    if (rio_writen(bc->fd, req, len) == len && (status = read_response(bc, &reuse)) >= 0) {
+      if (!reuse)
+        close_conn(bc);
+      return status;
+    }
+    close_conn(bc);
+    if (!keepalive)
+      break;
+  }
+  return -1;
+}
+
+static void *conn_main(void *arg) {
+  bconn *bc = arg;
+  long long interval = rate > 0 ? (long long)(nconns * 1e9 / rate) : 0;
+  long long intended, t0, now;
+  struct timespec ts;
+  int status;
+
+  /* open loop: 연결마다 보낼 시각을 간격의 1/nconns씩 어긋나게 시작 */
+  intended = start_ns + (interval ? interval * bc->id / nconns : 0);
+  while (!stop) {
+    if (max_requests && __atomic_fetch_add(&issued, 1, __ATOMIC_RELAXED) >= max_requests)
+      break;
+    if (interval) {
+      if ((now = now_ns()) < intended) {
+        ts.tv_sec = (intended - now) / 1000000000;
+        ts.tv_nsec = (intended - now) % 1000000000;
+        nanosleep(&ts, NULL);
+      }
+      t0 = intended;               // 밀린 요청은 보내려던 시각부터 잰다
+      intended += interval;
+    } else {
+      t0 = now_ns();
+    }
+    if (stop)
+      break;
+    status = one_request(bc, pick(bc));
+    now = now_ns();
+    if (now > end_ns && !max_requests)
+      break;                       // 끝난 뒤에 돌아온 응답은 세지 않음
+    bc->requests++;
+    if (status < 0)
+      bc->errors++;
+    else {
+      if (status < 200 || status >= 400)
+        bc->non2xx++;
+      hist_record(&bc->hist, (now - t0) / 1000);
+    }
+  }
+  close_conn(bc);
+  return NULL;
+}
+
+static void usage(char *prog) {
+  fprintf(stderr, "usage: %s [-c conns] [-d secs] [-n requests] [-r rate] [-k] "
+          "[-x proxy_host:port] [N*]url...\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  static histogram all;
+  unsigned long requests = 0, errors = 0, non2xx = 0, connects = 0;
+  unsigned long long bytes = 0;
+  double secs = 10, elapsed;
+  static const double pcts[] = { 50, 75, 90, 99, 99.9, 99.99, 100 };
+  bconn *conns;
+  char *colon;
+  int opt, i;
+
+  while ((opt = getopt(argc, argv, "c:d:n:r:kx:")) != -1) {
+    switch (opt) {
+    case 'c': nconns = atoi(optarg); break;
+    case 'd': secs = atof(optarg); break;
+    case 'n': max_requests = atoll(optarg); break;
+    case 'r': rate = atof(optarg); break;
+    case 'k': keepalive = 1; break;
+    case 'x':
+      if (!(colon = strrchr(optarg, ':')))
+        usage(argv[0]);
+      snprintf(proxy_host, sizeof(proxy_host), "%.*s", (int)(colon - optarg), optarg);
+      snprintf(proxy_port, sizeof(proxy_port), "%s", colon + 1);
+      use_proxy = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind == argc || nconns <= 0 || secs <= 0 || rate < 0 || max_requests < 0)
+    usage(argv[0]);
+  for (i = optind; i < argc; i++)
+    if (add_target(argv[i]) < 0)
+      usage(argv[0]);
+
+  Signal(SIGPIPE, SIG_IGN);
+  conns = Calloc(nconns, sizeof(bconn));
+  start_ns = now_ns();
+  end_ns = start_ns + (long long)(secs * 1e9);
+  for (i = 0; i < nconns; i++) {
+    conns[i].id = i;
+    conns[i].fd = -1;
+    conns[i].seed = i + 1;
+    hist_init(&conns[i].hist);
+    Pthread_create(&conns[i].tid, NULL, conn_main, &conns[i]);
+  }
+  if (!max_requests) {
+    while (now_ns() < end_ns)
+      usleep(10000);
+    stop = 1;
+  }
+  hist_init(&all);
+  for (i = 0; i < nconns; i++) {
+    Pthread_join(conns[i].tid, NULL);
+    hist_merge(&all, &conns[i].hist);
+    requests += conns[i].requests;
+    errors += conns[i].errors;
+    non2xx += conns[i].non2xx;
+    connects += conns[i].connects;
+    bytes += conns[i].bytes;
+  }
+  elapsed = (now_ns() - start_ns) / 1e9;
+  if (!max_requests && elapsed > secs)
+    elapsed = secs;
+
+  printf("%d connections, %s loop%s, %.1fs%s\n", nconns, rate > 0 ? "open" : "closed",
+         keepalive ? ", keep-alive" : "", elapsed, use_proxy ? ", via proxy" : "");
+  printf("requests %lu  errors %lu  non-2xx/3xx %lu  connects %lu  read %.1f MB\n",
+         requests, errors, non2xx, connects, bytes / 1e6);
+  printf("throughput %.1f req/s  %.2f MB/s\n", requests / elapsed, bytes / 1e6 / elapsed);
+  printf("latency (us) mean %.0f  min %lld", hist_mean(&all), all.min);
+  for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+    printf("  p%g %lld", pcts[i], hist_percentile(&all, pcts[i]));
+  printf("\n");
+  return errors ? 2 : 0;
+}
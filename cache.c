@@ -0,0 +1,468 @@
+#include <sys/mman.h>
+#include "cache.h"
+
+static void unlink_node(LRU_Cache *cache, Node *node);
+static void drop_node(LRU_Cache *cache, Node *node);
+static void evict_to(LRU_Cache *cache, int limit);
+static Node *alloc_node(LRU_Cache *cache, size_t n);
+static void free_node(LRU_Cache *cache, Node *node);
+static void pin(LRU_Cache *cache, Node *node);
+static void unpin(LRU_Cache *cache, Node *node);
+static void lose_cache(LRU_Cache *cache);
+static void finish_reset(LRU_Cache *cache);
+
+static const char *policy_names[CACHE_POLICIES] = { "lru", "fifo", "clock" };
+
+static int self;      // 이 프로세스의 워커 번호 (Node.refs[], pins[]의 칸)
+
+static void init_cache(LRU_Cache *cache, int capacity, pthread_mutexattr_t *attr) {
+  memset(cache, 0, sizeof(LRU_Cache));
+  cache->capacity = capacity;
+  cache->policy = CACHE_LRU;
+  pthread_mutex_init(&cache->lock, attr);
+  pthread_mutex_init(&cache->walk_lock, attr);
+}
+
+/* 캐시 생성 */
+LRU_Cache *createCache(int capacity) {
+  LRU_Cache *cache = Malloc(sizeof(LRU_Cache));
+
+  init_cache(cache, capacity, NULL);
+  return cache;
+}
+
+/*
+ * cache_create_shared - 워커 프로세스들이 나눠 쓰는 캐시 (prefork, -p).
+ *     구조체와 노드를 공유 메모리(노드는 bytes 크기의 shm_arena)에 두므로
+ *     fork 전에 만든다. 잠금은 잡은 프로세스가 죽어도 풀리는 robust
+ *     mutex다 (cache_lock 참고).
+ *
+ *     반환값: 캐시, 공유 메모리를 만들지 못하면 NULL
+ */
+LRU_Cache *cache_create_shared(int capacity, size_t bytes) {
+  pthread_mutexattr_t attr;
+  LRU_Cache *cache;
+  shm_arena *arena;
+
+  if (!(arena = shm_create(bytes)))
+    return NULL;
+  cache = mmap(NULL, sizeof(LRU_Cache), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (cache == MAP_FAILED) {
+    shm_destroy(arena);
+    return NULL;
+  }
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  init_cache(cache, capacity, &attr);
+  pthread_mutexattr_destroy(&attr);
+  cache->arena = arena;
+  return cache;
+}
+
+/* 이 프로세스가 워커 id임을 알린다 (fork한 워커에서 호출). 기본은 0 */
+void cache_set_worker(int id) {
+  self = id;
+}
+
+/* 이름("lru", "fifo", "clock")에 해당하는 교체 정책. 없으면 -1 */
+int cache_policy(const char *name) {
+  int i;
+
+  for (i = 0; i < CACHE_POLICIES; i++)
+    if (!strcasecmp(name, policy_names[i]))
+      return i;
+  return -1;
+}
+
+const char *cache_policy_name(int policy) {
+  return policy_names[policy];
+}
+
+/* 캐시 해제 */
+void freeCache(LRU_Cache *cache) {
+  Node *node, *next;
+
+  for (node = cache->head; node; node = next) {
+    next = node->next;
+    free_node(cache, node);
+  }
+  for (node = cache->zombies; node; node = next) {
+    next = node->next;
+    free_node(cache, node);
+  }
+  pthread_mutex_destroy(&cache->lock);
+  pthread_mutex_destroy(&cache->walk_lock);
+  if (cache->arena) {
+    shm_destroy(cache->arena);
+    munmap(cache, sizeof(LRU_Cache));
+  } else {
+    Free(cache);
+  }
+}
+
+/*
+ * cache_lock - 캐시 잠금. 공유 캐시에서 잠금을 잡은 워커가 죽었으면 그
+ *     워커가 리스트나 할당기를 고치다 말았을 수 있으므로 믿지 않고 캐시를
+ *     비운다 (lose_cache). 다른 워커가 이미 꺼내 간 노드는 아직 보내는
+ *     중일 수 있으므로 공간은 그 참조가 모두 돌아온 뒤에 되돌린다.
+ */
+void cache_lock(LRU_Cache *cache) {
+  if (pthread_mutex_lock(&cache->lock) == EOWNERDEAD) {
+    pthread_mutex_consistent(&cache->lock);
+    lose_cache(cache);
+  }
+}
+
+void cache_unlock(LRU_Cache *cache) {
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/* 리스트를 버리고 세대를 올린다. 이전 세대의 노드는 찾을 수 없게 되고
+ * 참조가 모두 돌아오면 finish_reset()이 공간을 통째로 되돌린다 */
+static void lose_cache(LRU_Cache *cache) {
+  fprintf(stderr, "cache: a worker died holding the cache lock, dropping %d bytes\n",
+          cache->size);
+  cache->head = cache->tail = cache->zombies = NULL;
+  cache->size = 0;
+  cache->gen++;
+  cache->resetting = 1;
+  finish_reset(cache);
+}
+
+/* 비운 뒤 이전 세대의 참조가 모두 돌아왔으면 공간을 되돌린다 (lock을 잡은 상태에서 호출) */
+static void finish_reset(LRU_Cache *cache) {
+  int i;
+
+  for (i = 0; i < CACHE_MAX_WORKERS; i++)
+    if (cache->pins[i])
+      return;
+  shm_reset(cache->arena);
+  cache->resetting = 0;
+}
+
+/*
+ * cache_forget_worker - 죽은 워커 id가 잡고 있던 참조를 모두 푼다 (워커를
+ *     다시 띄우기 전에 master가 호출). 그 워커가 보내던 중에 빠진 노드는
+ *     여기서 해제한다. 노드를 만들다가 죽었으면 그 노드의 공간은 잃는다.
+ */
+void cache_forget_worker(LRU_Cache *cache, int id) {
+  Node *lists[2], *node, *next;
+  int i;
+
+  cache_lock(cache);
+  lists[0] = cache->head;
+  lists[1] = cache->zombies;
+  for (i = 0; i < 2; i++) {
+    for (node = lists[i]; node; node = next) {
+      next = node->next;
+      if (!node->refs[id])
+        continue;
+      node->refcnt -= node->refs[id];
+      node->refs[id] = 0;
+      if (node->evicted && node->refcnt == 0)
+        free_node(cache, node);
+    }
+  }
+  cache->pins[id] = 0;
+  if (cache->resetting)
+    finish_reset(cache);
+  cache_unlock(cache);
+}
+
+/* 캐시에 머문 시간까지 더한 현재 Age (RFC 7234 4.2.3) */
+static long current_age(Node *node) {
+  return node->age + (long)(time(NULL) - node->stored_at);
+}
+
+/* key에 해당하는 웹 객체를 찾아 맨 앞으로 옮긴다.
+ * 찾은 노드는 참조 카운트가 증가된 상태로 반환되므로
+ * 사용이 끝나면 반드시 release_cache()를 호출해야 한다.
+ * 신선도 유지 시간이 지난 객체는 제거하고 없는 것으로 취급한다. */
+Node *find_cache(LRU_Cache *cache, char *key) {
+  Node *node;
+
+  cache_lock(cache);
+  for (node = cache->head; node; node = node->next) {
+    if (!strcmp(node->key, key)) {
+      if (node->max_age >= 0 && current_age(node) > node->max_age) {
+        drop_node(cache, node);
+        node = NULL;
+        break;
+      }
+      pin(cache, node);
+      node->hits++;
+      if (cache->policy == CACHE_LRU)
+        moveToHead(cache, node);
+      else if (cache->policy == CACHE_CLOCK)
+        node->visited = 1;
+      break;
+    }
+  }
+  cache_unlock(cache);
+  return node;
+}
+
+/* find_cache()로 얻은 노드의 참조를 반납. 전송 중에 교체된 노드는 마지막 사용자가 해제 */
+void release_cache(LRU_Cache *cache, Node *node) {
+  cache_lock(cache);
+  unpin(cache, node);
+  cache_unlock(cache);
+}
+
+/* 노드의 참조를 하나 잡는다 (lock을 잡은 상태에서 호출) */
+static void pin(LRU_Cache *cache, Node *node) {
+  node->refcnt++;
+  node->refs[self]++;
+  cache->pins[self]++;
+}
+
+/* 참조를 하나 놓는다. 빠진 노드의 마지막 참조였으면 해제 (lock을 잡은 상태에서 호출) */
+static void unpin(LRU_Cache *cache, Node *node) {
+  cache->pins[self]--;
+  if (node->gen != cache->gen) {  // 비우기 전 세대: 공간은 finish_reset()이 한꺼번에
+    if (cache->resetting)
+      finish_reset(cache);
+    return;
+  }
+  node->refcnt--;
+  node->refs[self]--;
+  if (node->refcnt == 0 && node->evicted)
+    free_node(cache, node);
+}
+
+/* 캐싱된 웹 객체를 클라이언트에 전송. 헤더 끝에 Age와 X-Cache를 덧붙인다.
+ * head_only면 바디는 빼고 헤더만 (HEAD 요청)
+ * 반환값: 0, 클라이언트가 연결을 끊었으면 -1 */
+int send_cache(int fd, Node *node, int head_only) {
+  char hit_hdr[CACHE_HIT_HDR_MAX];
+  struct iovec iov[CACHE_IOV];
+
+  return rio_writev(fd, iov, cache_iov(node, iov, hit_hdr, head_only)) < 0 ? -1 : 0;
+}
+
+/* 캐시 히트 응답을 보낼 조각 (저장된 헤더 + Age/X-Cache + 바디).
+ * head_only면 바디 조각은 뺀다. hit_hdr는 CACHE_HIT_HDR_MAX 크기.
+ * 반환값: 조각 수 (CACHE_IOV, head_only면 CACHE_IOV - 1) */
+int cache_iov(Node *node, struct iovec *iov, char *hit_hdr, int head_only) {
+  iov[0].iov_base = node->value;
+  iov[0].iov_len = node->hdrlen;
+  iov[1].iov_base = hit_hdr;
+  iov[1].iov_len = snprintf(hit_hdr, CACHE_HIT_HDR_MAX, "Age: %ld\r\nX-Cache: HIT\r\n\r\n",
+                            current_age(node));
+  if (head_only)
+    return CACHE_IOV - 1;
+  iov[2].iov_base = node->value + node->hdrlen + 2;
+  iov[2].iov_len = node->size - node->hdrlen - 2;
+  return CACHE_IOV;
+}
+
+/* 사용한 노드를 리스트의 맨 앞으로 이동 (lock을 잡은 상태에서 호출) */
+void moveToHead(LRU_Cache *cache, Node *node) {
+  if (cache->head == node)
+    return;
+  unlink_node(cache, node);
+  node->prev = NULL;
+  node->next = cache->head;
+  if (cache->head)
+    cache->head->prev = node;
+  cache->head = node;
+  if (!cache->tail)
+    cache->tail = node;
+}
+
+/* 새 웹 객체를 캐시에 추가. 공간이 부족하면 evict_to()로 비운다 */
+void add_cache(LRU_Cache *cache, char *key, char *value, int size,
+               int hdrlen, long age, long max_age) {
+  size_t keylen = strlen(key);
+  Node *node, *victim;
+
+  if (size > MAX_OBJECT_SIZE || size > cache->capacity)
+    return;
+
+  /* 키와 객체는 노드 뒤에 붙여 한 번에 받는다.
+   * 메모리가 모자라면 캐시하지 않고 넘어간다 (응답은 이미 보냈음) */
+  if (!(node = alloc_node(cache, sizeof(Node) + keylen + 1 + size)))
+    return;
+  node->key = (char *)(node + 1);
+  node->value = node->key + keylen + 1;
+  memcpy(node->key, key, keylen + 1);
+  memcpy(node->value, value, size);
+  node->size = size;
+  node->hdrlen = hdrlen;
+  node->stored_at = time(NULL);
+  node->age = age;
+  node->max_age = max_age;
+
+  cache_lock(cache);
+  if (cache->arena && node->gen != cache->gen) {
+    /* 만드는 동안 캐시를 비웠다: 공간은 finish_reset()이 되돌린다 */
+    cache->pins[self]--;
+    if (cache->resetting)
+      finish_reset(cache);
+    cache_unlock(cache);
+    return;
+  }
+  if (cache->arena)
+    cache->pins[self]--;
+  /* 동시에 같은 객체를 받아온 스레드가 먼저 넣었다면 추가하지 않음 */
+  for (victim = cache->head; victim; victim = victim->next) {
+    if (!strcmp(victim->key, key)) {
+      free_node(cache, node);
+      cache_unlock(cache);
+      return;
+    }
+  }
+  evict_to(cache, cache->capacity - size);
+  moveToHead(cache, node);
+  cache->size += size;
+  cache_unlock(cache);
+}
+
+/*
+ * alloc_node - 노드 하나의 메모리 (n바이트, 앞의 Node는 0으로). 공유
+ *     캐시면 맞는 빈 자리가 날 때까지 리스트 끝부터 비우고, 채우는 동안
+ *     캐시를 비우더라도 공간이 되돌려지지 않게 참조로 센다 (add_cache가
+ *     넣거나 버릴 때 뺀다).
+ *
+ *     반환값: 노드, 모자라면 NULL
+ */
+static Node *alloc_node(LRU_Cache *cache, size_t n) {
+  Node *node = NULL;
+
+  if (!cache->arena) {
+    if ((node = malloc(n)))
+      memset(node, 0, sizeof(Node));
+    return node;
+  }
+  cache_lock(cache);
+  if (!cache->resetting)
+    while (!(node = shm_alloc(cache->arena, n)) && cache->tail)
+      evict_to(cache, cache->size - 1);
+  if (node) {
+    memset(node, 0, sizeof(Node));
+    node->gen = cache->gen;
+    cache->pins[self]++;
+  }
+  cache_unlock(cache);
+  return node;
+}
+
+/* 용량과 교체 정책을 바꾼다 (설정을 다시 읽을 때). 줄었으면 바로 비운다 */
+void cache_configure(LRU_Cache *cache, int capacity, int policy) {
+  cache_lock(cache);
+  cache->capacity = capacity;
+  cache->policy = policy;
+  evict_to(cache, capacity);
+  cache_unlock(cache);
+}
+
+/* 저장된 크기가 limit 이하가 될 때까지 리스트 끝의 객체부터 제거
+ * (CLOCK이면 히트 표시가 있는 객체는 표시를 지우고 맨 앞으로 돌려보낸다).
+ * lock을 잡은 상태에서 호출 */
+static void evict_to(LRU_Cache *cache, int limit) {
+  Node *victim;
+
+  while (cache->size > limit && cache->tail) {
+    victim = cache->tail;
+    if (victim->visited) {        // 표시는 한 번씩만 지우므로 반드시 끝난다
+      victim->visited = 0;
+      moveToHead(cache, victim);
+      continue;
+    }
+    drop_node(cache, victim);
+    cache->evictions++;
+  }
+}
+
+/*
+ * cache_walk - 캐시의 노드마다 fn을 부른다. fn이 0이 아닌 값을 돌려주면
+ *     그 노드를 캐시에서 뺀다. 요청 처리를 오래 막지 않도록 잠금은
+ *     CACHE_WALK_BATCH개마다 놓았다 다시 잡는다. 그동안 다음에 볼 노드는
+ *     참조를 잡아 해제되지 않게 하고, 이미 본 노드는 scan 번호로 건너뛴다.
+ *     놓은 사이에 다음 노드가 제거되었으면 처음부터 다시 훑는다.
+ *     놓은 사이에 이미 지나간 자리로 옮겨진 노드는 빠질 수 있다.
+ *     fn은 잠금을 잡은 채로 불리므로 짧아야 한다.
+ *
+ *     반환값: 뺀 노드 수
+ */
+int cache_walk(LRU_Cache *cache, int (*fn)(Node *node, void *arg), void *arg) {
+  Node *node, *next;
+  unsigned scan;
+  int steps, gone, removed = 0;
+
+  if (pthread_mutex_lock(&cache->walk_lock) == EOWNERDEAD)
+    pthread_mutex_consistent(&cache->walk_lock);
+  cache_lock(cache);
+  scan = ++cache->scans;
+  node = cache->head;
+  while (node) {
+    for (steps = 0; node && steps < CACHE_WALK_BATCH; steps++, node = next) {
+      next = node->next;
+      if (node->scan == scan)
+        continue;
+      node->scan = scan;
+      if (fn(node, arg)) {
+        drop_node(cache, node);
+        removed++;
+      }
+    }
+    if (!node)
+      break;
+    pin(cache, node);
+    cache_unlock(cache);
+    cache_lock(cache);
+    gone = node->evicted || node->gen != cache->gen;
+    unpin(cache, node);           // 그 사이 빠졌고 마지막 참조였으면 여기서 해제
+    if (gone)
+      node = cache->head;
+  }
+  cache_unlock(cache);
+  pthread_mutex_unlock(&cache->walk_lock);
+  return removed;
+}
+
+/* 노드를 캐시에서 뺀다. 전송 중이면 zombies에 두고 마지막 사용자가 해제
+ * (lock을 잡은 상태에서 호출) */
+static void drop_node(LRU_Cache *cache, Node *node) {
+  unlink_node(cache, node);
+  cache->size -= node->size;
+  node->evicted = 1;
+  if (node->refcnt == 0) {
+    free_node(cache, node);
+    return;
+  }
+  node->next = cache->zombies;
+  if (cache->zombies)
+    cache->zombies->prev = node;
+  cache->zombies = node;
+}
+
+/* 리스트에서 노드를 떼어냄 */
+static void unlink_node(LRU_Cache *cache, Node *node) {
+  if (node->prev)
+    node->prev->next = node->next;
+  else if (cache->head == node)
+    cache->head = node->next;
+  if (node->next)
+    node->next->prev = node->prev;
+  else if (cache->tail == node)
+    cache->tail = node->prev;
+  node->prev = node->next = NULL;
+}
+
+/* 노드를 해제한다. 빠진 노드면 zombies에서도 뗀다 (lock을 잡은 상태에서 호출) */
+static void free_node(LRU_Cache *cache, Node *node) {
+  if (node->evicted) {
+    if (node->prev)
+      node->prev->next = node->next;
+    else if (cache->zombies == node)
+      cache->zombies = node->next;
+    if (node->next)
+      node->next->prev = node->prev;
+  }
+  if (cache->arena)
+    shm_free(cache->arena, node);
+  else
+    free(node);
+}
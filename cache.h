@@ -0,0 +1,83 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <time.h>
+#include "csapp.h"
+#include "shm.h"
+
+/* Recommended max cache and object sizes */
+#define MAX_CACHE_SIZE 1049000
+#define MAX_OBJECT_SIZE 102400
+
+#define CACHE_IOV         3     // 캐시 히트 응답의 조각 수
+#define CACHE_HIT_HDR_MAX 64    // "Age: N\r\nX-Cache: HIT\r\n\r\n"
+#define CACHE_WALK_BATCH  64    // cache_walk()가 잠금을 한 번 잡고 보는 노드 수
+#define CACHE_MAX_WORKERS 32    // 공유 캐시를 쓰는 워커 프로세스 수 한도 (-p)
+
+/* 교체 정책 (-P). 리스트 하나로 구현하며 히트를 어떻게 반영하는지만 다르다 */
+enum {
+  CACHE_LRU,          // 히트하면 맨 앞으로
+  CACHE_FIFO,         // 히트해도 그대로, 들어온 순서대로 제거
+  CACHE_CLOCK,        // 히트하면 표시만, 제거할 때 표시가 있으면 한 번 살려 맨 앞으로
+  CACHE_POLICIES
+};
+
+/* 캐시에 저장되는 웹 객체 (이중 연결 리스트 노드) */
+typedef struct Node {
+  char *key;          // 캐시 키 (요청 URI)
+  char *value;        // 캐싱된 웹 객체 (응답 헤더 + 바디)
+  int size;           // 웹 객체 크기
+  int hdrlen;         // 마지막 빈 줄을 뺀 헤더 길이 (바디는 hdrlen + 2부터)
+  time_t stored_at;   // 캐시에 저장한 시각
+  long age;           // 저장할 때 이미 지난 시간 (원 서버의 Age 헤더)
+  long max_age;       // 신선도 유지 시간, 제한이 없으면 -1
+  int refcnt;         // 전송 중인 스레드 수 (0이 되어야 해제 가능)
+  int evicted;        // 리스트에서 제거되었는지 여부
+  int visited;        // CLOCK: 마지막으로 살린 뒤 히트했는지
+  unsigned long hits; // 저장한 뒤 히트한 횟수
+  unsigned scan;      // 이 노드를 마지막으로 지나간 cache_walk()의 번호
+  unsigned gen;       // 만들 때의 캐시 세대 (cache_lock 참고)
+  unsigned short refs[CACHE_MAX_WORKERS];  // 워커별 참조 (죽은 워커의 참조를 풀 때)
+  struct Node *prev;
+  struct Node *next;
+} Node;
+
+/* LRU 정책을 사용하는 캐시. 공유 캐시(-p)면 이 구조체와 노드가 모두
+ * fork 전에 만든 공유 메모리에 있고 잠금은 프로세스 사이에서 쓴다 */
+typedef struct {
+  int capacity;       // 최대 캐시 크기
+  int size;           // 현재 캐시에 저장된 바이트 수
+  int policy;         // 교체 정책 (CACHE_*)
+  unsigned long evictions;  // 공간을 만들려고 제거한 객체 수
+  unsigned scans;     // 지금까지 시작한 cache_walk() 수
+  Node *head;         // 가장 최근에 사용된 노드
+  Node *tail;         // 가장 오래전에 사용된 노드
+  Node *zombies;      // 리스트에서 빠졌지만 아직 전송 중인 노드
+  shm_arena *arena;   // 공유 캐시의 노드를 나눠 주는 곳, 아니면 NULL (malloc)
+  unsigned gen;       // 잠금을 잡은 워커가 죽어서 캐시를 비운 횟수
+  int resetting;      // 비운 뒤 이전 세대의 참조가 아직 남아 있음
+  int pins[CACHE_MAX_WORKERS];  // 워커별로 잡고 있는 참조 (만드는 중인 노드 포함)
+  pthread_mutex_t lock;
+  pthread_mutex_t walk_lock;  // cache_walk()는 한 번에 하나씩
+} LRU_Cache;
+
+LRU_Cache *createCache(int capacity);
+LRU_Cache *cache_create_shared(int capacity, size_t bytes);
+void cache_set_worker(int id);
+void cache_forget_worker(LRU_Cache *cache, int id);
+void cache_lock(LRU_Cache *cache);
+void cache_unlock(LRU_Cache *cache);
+int cache_policy(const char *name);
+const char *cache_policy_name(int policy);
+void freeCache(LRU_Cache *cache);
+Node *find_cache(LRU_Cache *cache, char *key);
+void release_cache(LRU_Cache *cache, Node *node);
+int send_cache(int fd, Node *node, int head_only);
+int cache_iov(Node *node, struct iovec *iov, char *hit_hdr, int head_only);
+void moveToHead(LRU_Cache *cache, Node *node);
+void add_cache(LRU_Cache *cache, char *key, char *value, int size,
+               int hdrlen, long age, long max_age);
+void cache_configure(LRU_Cache *cache, int capacity, int policy);
+int cache_walk(LRU_Cache *cache, int (*fn)(Node *node, void *arg), void *arg);
+
+#endif /* __CACHE_H__ */
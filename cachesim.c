@@ -0,0 +1,134 @@
+/*
+ * cachesim.c - 프록시가 남긴 캐시 접근 트레이스(proxy -t)를 실제 캐시 코드
+ *     (cache.c)에 다시 흘려 캐시 크기와 교체 정책별 히트율을 보여 준다.
+ *     캐시 키는 URI의 해시, 객체는 기록된 크기만큼의 빈 바이트다.
+ *
+ *     재생 순서는 프록시와 같다. 검사(HIT/MISS 레코드)는 find_cache,
+ *     받아온 응답(FILL 레코드)은 add_cache. 기록에서는 히트였지만 여기서는
+ *     없는 객체는 기록된 크기로 바로 채운다. 신선도는 재생하지 않는다
+ *     (모든 객체가 max_age 없음).
+ *
+ *     usage: make cachesim && ./cachesim [-s size,...] [-p lru,fifo,clock] trace
+ *            크기에는 K, M 접미사를 쓸 수 있다
+ */
+#include <limits.h>
+#include "csapp.h"
+#include "cache.h"
+#include "trace.h"
+
+#define SIM_MAX_SIZES 32
+
+static char object[MAX_OBJECT_SIZE];    // 캐시에 넣는 빈 객체
+
+/* "512K" 같은 크기. 잘못되었으면 -1 */
+static long parse_size(char *s) {
+  char *end;
+  long v = strtol(s, &end, 10);
+
+  if (*end == 'K' || *end == 'k')
+    v <<= 10, end++;
+  else if (*end == 'M' || *end == 'm')
+    v <<= 20, end++;
+  return (*end || v <= 0 || v > INT_MAX) ? -1 : v;
+}
+
+/* 트레이스를 capacity, policy인 새 캐시에 재생한다. 반환값: 히트한 요청 수 */
+static unsigned long replay(trace_rec *recs, long n, int capacity, int policy) {
+  LRU_Cache *cache = createCache(capacity);
+  unsigned long hits = 0;
+  char key[32];
+  Node *node;
+  long i;
+
+  cache->policy = policy;
+  for (i = 0; i < n; i++) {
+    sprintf(key, "%016llx", (unsigned long long)recs[i].key);
+    if (TRACE_TYPE(&recs[i]) == TRACE_FILL) {
+      add_cache(cache, key, object, TRACE_OBJ(&recs[i]), 0, 0, -1);
+      continue;
+    }
+    if ((node = find_cache(cache, key))) {
+      hits++;
+      release_cache(cache, node);
+    } else if (TRACE_TYPE(&recs[i]) == TRACE_HIT) {
+      add_cache(cache, key, object, TRACE_OBJ(&recs[i]), 0, 0, -1);
+    }
+  }
+  freeCache(cache);
+  return hits;
+}
+
+static void usage(char *prog) {
+  fprintf(stderr, "usage: %s [-s size,...] [-p lru,fifo,clock] trace\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  long sizes[SIM_MAX_SIZES], n = 0, cap = 1024, requests = 0, hits = 0, fills = 0;
+  int policies[CACHE_POLICIES], nsizes = 0, npolicies = 0, opt, i, j;
+  char *tok;
+  trace_rec *recs;
+  time_t start;
+  FILE *fp;
+
+  while ((opt = getopt(argc, argv, "s:p:")) != -1) {
+    switch (opt) {
+    case 's':
+      for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ","))
+        if (nsizes == SIM_MAX_SIZES || (sizes[nsizes++] = parse_size(tok)) < 0)
+          usage(argv[0]);
+      break;
+    case 'p':
+      for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ","))
+        if (npolicies == CACHE_POLICIES || (policies[npolicies++] = cache_policy(tok)) < 0)
+          usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+  if (!nsizes)    // 기본: MAX_CACHE_SIZE의 1/8배부터 8배까지
+    for (i = -3; i <= 3; i++)
+      sizes[nsizes++] = i < 0 ? MAX_CACHE_SIZE >> -i : (long)MAX_CACHE_SIZE << i;
+  if (!npolicies)
+    for (i = 0; i < CACHE_POLICIES; i++)
+      policies[npolicies++] = i;
+
+  if (!(fp = trace_open_read(argv[optind], &start))) {
+    fprintf(stderr, "%s: not a cache trace\n", argv[optind]);
+    exit(1);
+  }
+  recs = Malloc(cap * sizeof(trace_rec));
+  while (trace_next(fp, &recs[n])) {
+    if (TRACE_TYPE(&recs[n]) == TRACE_FILL)
+      fills++;
+    else {
+      requests++;
+      hits += TRACE_TYPE(&recs[n]) == TRACE_HIT;
+    }
+    if (++n == cap)
+      recs = Realloc(recs, (cap *= 2) * sizeof(trace_rec));
+  }
+  fclose(fp);
+  if (!requests) {
+    fprintf(stderr, "%s: no requests\n", argv[optind]);
+    exit(1);
+  }
+
+  printf("trace: %ld requests, %ld fills over %.1fs, recorded hit ratio %.1f%%\n",
+         requests, fills, n ? recs[n - 1].ms / 1000.0 : 0, 100.0 * hits / requests);
+  printf("%12s", "cache bytes");
+  for (j = 0; j < npolicies; j++)
+    printf(" %8s", cache_policy_name(policies[j]));
+  printf("   (hit %%)\n");
+  for (i = 0; i < nsizes; i++) {
+    printf("%12ld", sizes[i]);
+    for (j = 0; j < npolicies; j++)
+      printf(" %7.1f%%", 100.0 * replay(recs, n, sizes[i], policies[j]) / requests);
+    printf("\n");
+  }
+  Free(recs);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#!/usr/bin/python3
+
+# chunk-server.py - This is an HTTP/1.1 origin stand-in that we use for
+#                   the chunked test. It serves files from the current
+#                   directory with "Transfer-Encoding: chunked", using
+#                   uneven chunk sizes, chunk extensions and a trailer,
+#                   and then keeps the connection open so that a proxy
+#                   which waits for the close instead of the last chunk
+#                   times out. POST, PUT, PATCH and DELETE read the
+#                   request body (Content-Length or chunked) and answer
+#                   with its method, length and MD5, which the methods
+#                   test compares with the file that was sent. A GET
+#                   with "gzip" in Accept-Encoding, or with the query
+#                   "?gzip" (an origin that ignores what it was asked
+#                   for), gets the file gzip-compressed.
+#
+# usage: chunk-server.py <port>
+#
+import gzip
+import hashlib
+import os
+import socket
+import sys
+import threading
+
+CHUNK_SIZES = [1, 7, 100, 4096, 3, 8192, 15000]
+
+def read_body(f, headers):
+  if headers.get(b'transfer-encoding', b'').lower() == b'chunked':
+    body = b''
+    while True:
+      size = int(f.readline().split(b';')[0], 16)
+      if size == 0:
+        break
+      body += f.read(size)
+      f.readline()
+    while f.readline() not in (b'\r\n', b'\n', b''):
+      pass
+    return body
+  return f.read(int(headers.get(b'content-length', b'0')))
+
+def handle(channel):
+  f = channel.makefile('rb')
+  request = f.readline().split()
+  headers = {}
+  while True:
+    line = f.readline()
+    if line in (b'\r\n', b'\n', b''):
+      break
+    name, _, value = line.partition(b':')
+    headers[name.strip().lower()] = value.strip()
+  if len(request) < 2:
+    channel.close()
+    return
+  method, path = request[0], request[1].decode()
+  if '://' in path:
+    path = '/' + path.split('://', 1)[1].split('/', 1)[-1]
+  filename = '.' + path.split('?', 1)[0]
+  try:
+    if method in (b'POST', b'PUT', b'PATCH', b'DELETE'):
+      data = read_body(f, headers)
+      body = b'%s %d %s\n' % (method, len(data), hashlib.md5(data).hexdigest().encode())
+    else:
+      with open(filename, 'rb') as fp:
+        body = fp.read()
+  except OSError:
+    channel.sendall(b'HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n')
+    channel.close()
+    return
+
+  out = [b'HTTP/1.1 200 OK\r\n',
+         b'Server: chunk-server\r\n']
+  if method in (b'GET', b'HEAD') and (b'gzip' in headers.get(b'accept-encoding', b'')
+                                      or path.endswith('?gzip')):
+    body = gzip.compress(body)
+    out.append(b'Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n')
+  out.append(b'Transfer-Encoding: chunked\r\n\r\n')
+  if method != b'HEAD':
+    i = pos = 0
+    while pos < len(body):
+      n = CHUNK_SIZES[i % len(CHUNK_SIZES)]
+      chunk = body[pos:pos + n]
+      ext = b';ext=%d' % i if i % 3 == 0 else b''
+      out.append(b'%x%s\r\n%s\r\n' % (len(chunk), ext, chunk))
+      pos += n
+      i += 1
+    out.append(b'0\r\nX-Trailer: done\r\n\r\n')
+  data = b''.join(out)
+  # Dribble the response out so the proxy sees arbitrary read boundaries
+  for i in range(0, len(data), 997):
+    channel.sendall(data[i:i + 997])
+
+  # Keep the connection open until the client closes it
+  while channel.recv(4096):
+    pass
+  channel.close()
+
+serversocket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+serversocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+serversocket.bind(('', int(sys.argv[1])))
+serversocket.listen(5)
+
+while 1:
+  channel, details = serversocket.accept()
+  threading.Thread(target=handle, args=(channel,), daemon=True).start()
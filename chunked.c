@@ -0,0 +1,140 @@
+#include "chunked.h"
+
+void chunk_decoder_init(chunk_decoder *dec) {
+  dec->state = CHUNK_SIZE;
+  dec->ndigits = 0;
+  dec->remain = 0;
+}
+
+/* 16진수 문자 하나를 값으로 변환, 16진수가 아니면 -1 */
+static int hexval(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/*
+ * chunk_decode - buf의 len 바이트를 디코딩해서 청크 데이터만 buf 앞쪽에
+ *     제자리(in-place)로 모은다. 출력은 항상 입력보다 짧으므로 별도의
+ *     버퍼가 필요 없다. *used에는 소비한 입력 바이트 수가 들어가며,
+ *     마지막 청크를 만나면 그 뒤의 바이트는 소비하지 않는다.
+ *
+ *     반환값: 모은 데이터 바이트 수, 형식 오류면 -1
+ */
+ssize_t chunk_decode(chunk_decoder *dec, char *buf, size_t len, size_t *used) {
+  size_t in = 0, out = 0, n;
+  int v;
+  char c;
+
+  while (in < len && dec->state != CHUNK_DONE) {
+    c = buf[in];
+    switch (dec->state) {
+    case CHUNK_SIZE:
+      if ((v = hexval(c)) >= 0) {
+        if (dec->remain > ((size_t)-1 >> 4)) { // 크기 오버플로
+          dec->state = CHUNK_ERROR;
+          break;
+        }
+        dec->remain = (dec->remain << 4) | v;
+        dec->ndigits++;
+      } else if (dec->ndigits == 0) {
+        dec->state = CHUNK_ERROR;
+      } else if (c == '\r') {
+        dec->state = CHUNK_SIZE_LF;
+      } else if (c == '\n') {                  // bare LF도 허용
+        dec->state = dec->remain ? CHUNK_DATA : CHUNK_TRAILER;
+      } else if (c == ';' || c == ' ' || c == '\t') {
+        dec->state = CHUNK_EXT;
+      } else {
+        dec->state = CHUNK_ERROR;
+      }
+      in++;
+      break;
+    case CHUNK_EXT:
+      if (c == '\r')
+        dec->state = CHUNK_SIZE_LF;
+      else if (c == '\n')
+        dec->state = dec->remain ? CHUNK_DATA : CHUNK_TRAILER;
+      in++;
+      break;
+    case CHUNK_SIZE_LF:
+      if (c != '\n') {
+        dec->state = CHUNK_ERROR;
+        break;
+      }
+      dec->state = dec->remain ? CHUNK_DATA : CHUNK_TRAILER;
+      in++;
+      break;
+    case CHUNK_DATA:
+      n = len - in;
+      if (n > dec->remain)
+        n = dec->remain;
+      memmove(buf + out, buf + in, n);
+      in += n;
+      out += n;
+      dec->remain -= n;
+      if (dec->remain == 0)
+        dec->state = CHUNK_DATA_CR;
+      break;
+    case CHUNK_DATA_CR:
+      if (c == '\r') {
+        dec->state = CHUNK_DATA_LF;
+      } else if (c == '\n') {
+        dec->state = CHUNK_SIZE;
+        dec->ndigits = 0;
+      } else {
+        dec->state = CHUNK_ERROR;
+        break;
+      }
+      in++;
+      break;
+    case CHUNK_DATA_LF:
+      if (c != '\n') {
+        dec->state = CHUNK_ERROR;
+        break;
+      }
+      dec->state = CHUNK_SIZE;
+      dec->ndigits = 0;
+      in++;
+      break;
+    case CHUNK_TRAILER:                 // 트레일러는 전달하지 않고 버린다
+      if (c == '\r')
+        dec->state = CHUNK_TRAILER_LF;
+      else if (c == '\n')
+        dec->state = CHUNK_DONE;
+      else
+        dec->state = CHUNK_TRAILER_LINE;
+      in++;
+      break;
+    case CHUNK_TRAILER_LINE:
+      if (c == '\n')
+        dec->state = CHUNK_TRAILER;
+      in++;
+      break;
+    case CHUNK_TRAILER_LF:
+      if (c != '\n') {
+        dec->state = CHUNK_ERROR;
+        break;
+      }
+      dec->state = CHUNK_DONE;
+      in++;
+      break;
+    }
+    if (dec->state == CHUNK_ERROR)
+      return -1;
+  }
+  if (used)
+    *used = in;
+  return out;
+}
+
+/* 마지막 청크까지 모두 디코딩했는지 */
+int chunk_done(chunk_decoder *dec) {
+  return dec->state == CHUNK_DONE;
+}
+
+/* n 바이트짜리 청크의 크기 줄을 dst에 쓰고 그 길이를 반환 */
+int chunk_encode_head(char *dst, size_t n) {
+  return sprintf(dst, "%zx\r\n", n);
+}
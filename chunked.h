@@ -0,0 +1,37 @@
+#ifndef __CHUNKED_H__
+#define __CHUNKED_H__
+
+#include "csapp.h"
+
+/* chunked 디코더 상태 */
+enum {
+  CHUNK_SIZE,         // 청크 크기(16진수)를 읽는 중
+  CHUNK_EXT,          // 청크 확장(;name=value)을 건너뛰는 중
+  CHUNK_SIZE_LF,      // 크기 줄의 LF를 기다리는 중
+  CHUNK_DATA,         // 청크 데이터를 복사하는 중
+  CHUNK_DATA_CR,      // 데이터 뒤의 CR을 기다리는 중
+  CHUNK_DATA_LF,      // 데이터 뒤의 LF를 기다리는 중
+  CHUNK_TRAILER,      // 트레일러 줄의 시작
+  CHUNK_TRAILER_LINE, // 트레일러 헤더를 건너뛰는 중
+  CHUNK_TRAILER_LF,   // 마지막 빈 줄의 LF를 기다리는 중
+  CHUNK_DONE,         // 마지막 청크까지 모두 읽음
+  CHUNK_ERROR         // 형식 오류
+};
+
+/* 스트리밍 chunked 디코더: 입력이 어느 경계에서 잘려 들어와도 이어서 디코딩한다 */
+typedef struct {
+  int state;
+  int ndigits;        // 현재 크기 줄에서 읽은 16진수 자릿수
+  size_t remain;      // 현재 청크에서 아직 읽지 않은 데이터 바이트
+} chunk_decoder;
+
+#define CHUNK_HEAD_MAX 20               // "%zx\r\n"의 최대 길이
+#define CHUNK_LAST     "0\r\n\r\n"      // 마지막 청크 + 빈 트레일러
+#define CHUNK_CRLF     "\r\n"           // 청크 데이터 뒤의 CRLF
+
+void chunk_decoder_init(chunk_decoder *dec);
+ssize_t chunk_decode(chunk_decoder *dec, char *buf, size_t len, size_t *used);
+int chunk_done(chunk_decoder *dec);
+int chunk_encode_head(char *dst, size_t n);
+
+#endif /* __CHUNKED_H__ */
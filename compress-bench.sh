@@ -0,0 +1,85 @@
+#!/bin/bash
+#
+# compress-bench.sh - Measures bytes on the wire and proxy CPU time per
+#     request for the compressible tiny files, once with the plain proxy
+#     and once with the compression stage enabled (proxy -z). Every file
+#     is fetched once to fill the cache, then REQUESTS times as cache hits
+#     by a client that sends "Accept-Encoding: br, gzip".
+#
+#     usage: ./compress-bench.sh [REQUESTS]
+#
+
+REQUESTS=${1:-200}
+FILES="home.html csapp.c tiny.c"
+HOME_DIR=`pwd`
+CLK_TCK=`getconf CLK_TCK`
+
+#
+# cpu_ticks - user + system clock ticks consumed so far by a process
+# usage: cpu_ticks <pid>
+#
+function cpu_ticks {
+    awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+#
+# fetch - fetch a file through the proxy and print the bytes received
+#     (header + body)
+# usage: fetch <file>
+#
+function fetch {
+    curl --silent --output /dev/null --max-time 5 \
+         --header "Accept-Encoding: br, gzip" \
+         --write-out "%{size_header} %{size_download}\n" \
+         --proxy "http://localhost:${proxy_port}" \
+         "http://localhost:${tiny_port}/$1"
+}
+
+if [ ! -x ./proxy ] || [ ! -x ./tiny/tiny ]; then
+    echo "Error: build ./proxy and ./tiny/tiny first."
+    exit 1
+fi
+
+tiny_port=`./free-port.sh`
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+sleep 1
+
+printf "%-6s %-10s %12s %12s %14s\n" "mode" "file" "fill-cpu-ms" "bytes/req" "hit-cpu-us/req"
+for mode in "" "-z"
+do
+    proxy_port=`./free-port.sh`
+    ./proxy ${mode} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+    sleep 1
+
+    for file in ${FILES}
+    do
+        # Cache fill: the only request that pays for compression
+        start=`cpu_ticks ${proxy_pid}`
+        fetch ${file} > /dev/null
+        fill=`cpu_ticks ${proxy_pid}`
+
+        # Cache hits
+        bytes=0
+        for ((i = 0; i < REQUESTS; i++))
+        do
+            set -- `fetch ${file}`
+            bytes=$((bytes + $1 + $2))
+        done
+        end=`cpu_ticks ${proxy_pid}`
+
+        printf "%-6s %-10s %12d %12d %14d\n" "${mode:-off}" ${file} \
+            $(( (fill - start) * 1000 / CLK_TCK )) \
+            $(( bytes / REQUESTS )) \
+            $(( (end - fill) * 1000000 / CLK_TCK / REQUESTS ))
+    done
+
+    kill ${proxy_pid} 2> /dev/null
+    wait ${proxy_pid} 2> /dev/null
+done
+
+kill ${tiny_pid} 2> /dev/null
+wait ${tiny_pid} 2> /dev/null
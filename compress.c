@@ -0,0 +1,107 @@
+#include <zlib.h>
+#include <brotli/encode.h>
+#include "compress.h"
+
+static const char *enc_names[ENC_COUNT] = { "identity", "gzip", "br" };
+
+/* 압축해서 이득이 있는 Content-Type */
+static const char *compressible_types[] = {
+  "text/", "application/javascript", "application/json", "application/xml",
+  "image/svg+xml", NULL
+};
+
+const char *encoding_name(int enc) {
+  return enc_names[enc];
+}
+
+/*
+ * accept_encoding - Accept-Encoding 값에서 클라이언트가 받을 수 있는
+ *     인코딩의 비트마스크(1 << ENC_*)를 구한다. q=0인 인코딩은 거부한 것으로
+ *     보고, identity는 항상 받을 수 있는 것으로 본다.
+ */
+int accept_encoding(const char *value, int value_len) {
+  int mask = 1 << ENC_IDENTITY, bits, i = 0, j, k, n;
+  const char *q;
+  char token[32];
+
+  while (i < value_len) {
+    for (j = i; j < value_len && value[j] != ','; j++)
+      ;
+    for (k = i; k < j && (value[k] == ' ' || value[k] == '\t'); k++)
+      ;
+    for (n = 0; k + n < j && value[k + n] != ';' && !isspace(value[k + n]); n++)
+      ;
+    snprintf(token, sizeof(token), "%.*s", n, value + k);
+
+    bits = 0;
+    if (!strcasecmp(token, "gzip") || !strcasecmp(token, "x-gzip"))
+      bits = 1 << ENC_GZIP;
+    else if (!strcasecmp(token, "br"))
+      bits = 1 << ENC_BR;
+    else if (!strcmp(token, "*"))
+      bits = (1 << ENC_GZIP) | (1 << ENC_BR);
+
+    /* ;q=0 (또는 0.0, 0.00...) 이면 거부 */
+    for (q = value + k + n; q < value + j && *q != 'q'; q++)
+      ;
+    if (q + 2 < value + j && q[1] == '=' && atof(q + 2) <= 0.0)
+      bits = 0;
+
+    mask |= bits;
+    i = j + 1;
+  }
+  return mask;
+}
+
+/* Content-Type 값이 압축할 만한 텍스트 계열인지 */
+int compressible_type(const char *value, int value_len) {
+  int i, len;
+  for (i = 0; compressible_types[i]; i++) {
+    len = strlen(compressible_types[i]);
+    if (value_len >= len && !strncasecmp(value, compressible_types[i], len))
+      return 1;
+  }
+  return 0;
+}
+
+/* gzip 형식(deflate + gzip 헤더)으로 압축 */
+static long gzip_body(const char *in, long inlen, char *out, long outsize) {
+  z_stream zs;
+  long n;
+
+  memset(&zs, 0, sizeof(zs));
+  /* windowBits 15 + 16: zlib 헤더 대신 gzip 헤더를 씀 */
+  if (deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return -1;
+  zs.next_in = (Bytef *)in;
+  zs.avail_in = inlen;
+  zs.next_out = (Bytef *)out;
+  zs.avail_out = outsize;
+  n = (deflate(&zs, Z_FINISH) == Z_STREAM_END) ? (long)zs.total_out : -1;
+  deflateEnd(&zs);
+  return n;
+}
+
+static long brotli_body(const char *in, long inlen, char *out, long outsize) {
+  size_t n = outsize;
+
+  if (!BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                             inlen, (const uint8_t *)in, &n, (uint8_t *)out))
+    return -1;
+  return n;
+}
+
+/*
+ * compress_body - in을 enc로 압축해서 out에 쓴다.
+ *
+ *     반환값: 압축된 길이, 실패했거나 outsize 안에 들어가지 않으면 -1
+ */
+long compress_body(int enc, const char *in, long inlen, char *out, long outsize) {
+  switch (enc) {
+  case ENC_GZIP:
+    return gzip_body(in, inlen, out, outsize);
+  case ENC_BR:
+    return brotli_body(in, inlen, out, outsize);
+  }
+  return -1;
+}
@@ -0,0 +1,23 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include "csapp.h"
+
+/* 콘텐츠 인코딩 (숫자가 클수록 먼저 고른다) */
+enum {
+  ENC_IDENTITY,
+  ENC_GZIP,
+  ENC_BR,
+  ENC_COUNT
+};
+
+#define GZIP_LEVEL        6     // zlib 압축 레벨
+#define BROTLI_QUALITY    9     // 캐시에 넣을 때 한 번만 압축하므로 높게 잡음
+#define COMPRESS_MIN_SIZE 256   // 이보다 작은 바디는 압축해도 이득이 없음
+
+const char *encoding_name(int enc);
+int accept_encoding(const char *value, int value_len);
+int compressible_type(const char *value, int value_len);
+long compress_body(int enc, const char *in, long inlen, char *out, long outsize);
+
+#endif /* __COMPRESS_H__ */
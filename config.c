@@ -0,0 +1,280 @@
+/*
+ * config.c - 설정 파일 (-f)과 SIGHUP으로 다시 읽기.
+ *
+ *     파일은 한 줄에 "이름 값" 하나. 줄 처음이나 공백 뒤의 '#'부터는 주석이다.
+ *     읽을 때마다 기본값 -> 파일 -> 명령줄 옵션 순서로 새 스냅샷을 만들므로
+ *     명령줄에서 준 값은 다시 읽어도 그대로 남는다.
+ *
+ *     스냅샷은 RCU처럼 바꾼다. accept 루프가 새 스냅샷의 포인터를 한 번에
+ *     바꾸고(config_publish), 이전 스냅샷은 그것을 잡은 연결이 모두 끝난
+ *     뒤에 지운다(config_reclaim). 연결은 시작할 때 한 번 참조를 잡을 뿐
+ *     요청 처리 중에는 잠금 없이 자기 스냅샷을 읽는다.
+ */
+#include <limits.h>
+#include <stddef.h>
+#include "config.h"
+#include "conn.h"
+#include "cache.h"
+#include "admit.h"
+#include "upgrade.h"
+#include "upstream.h"
+
+/* You won't lose style points for including this long line in your code */
+#define DEFAULT_USER_AGENT \
+    "Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3"
+#define DEFAULT_VIA "webproxy"
+#define DEFAULT_CONNECT_PORTS "443"
+
+enum { T_INT, T_STR, T_POLICY, T_POOL, T_ROUTE };
+
+/* 설정 이름과 config 안의 위치. T_INT는 [min, max], T_STR은 max가 버퍼 크기.
+ * T_POOL, T_ROUTE는 줄마다 하나씩 더한다 (upstream.c) */
+static const struct {
+  const char *name;
+  int type;
+  size_t off;
+  int min, max;
+} keys[] = {
+  { "listen",                T_STR,    offsetof(config, listen),        1, NI_MAXSERV },
+  { "memory_mb",             T_INT,    offsetof(config, memory_mb),     1, INT_MAX >> 20 },
+  { "workers",               T_INT,    offsetof(config, workers),       -1, 1024 },
+  { "backlog",               T_INT,    offsetof(config, backlog),       1, 65535 },
+  { "cache_size",            T_INT,    offsetof(config, cache_size),    0, INT_MAX },
+  { "max_object",            T_INT,    offsetof(config, max_object),    0, MAX_OBJECT_SIZE },
+  { "policy",                T_POLICY, offsetof(config, policy),        0, 0 },
+  { "header_timeout_ms",     T_INT,    offsetof(config, header_ms),     0, INT_MAX },
+  { "connect_timeout_ms",    T_INT,    offsetof(config, connect_ms),    0, INT_MAX },
+  { "first_byte_timeout_ms", T_INT,    offsetof(config, first_byte_ms), 0, INT_MAX },
+  { "idle_timeout_ms",       T_INT,    offsetof(config, idle_ms),       0, INT_MAX },
+  { "max_active",            T_INT,    offsetof(config, max_active),    1, INT_MAX },
+  { "max_per_ip",            T_INT,    offsetof(config, max_per_ip),    1, INT_MAX },
+  { "queue_ms",              T_INT,    offsetof(config, queue_ms),      0, INT_MAX },
+  { "user_agent",            T_STR,    offsetof(config, user_agent),    0, CONFIG_STR_MAX },
+  { "via",                   T_STR,    offsetof(config, via),           1, CONFIG_STR_MAX },
+  { "drain_timeout_ms",      T_INT,    offsetof(config, drain_ms),      0, INT_MAX },
+  { "connect_ports",         T_STR,    offsetof(config, connect_ports), 0, CONFIG_STR_MAX },
+  { "upstream",              T_POOL,   0,                               0, 0 },
+  { "route",                 T_ROUTE,  0,                               0, 0 },
+  { "backends",              T_STR,    offsetof(config, backends),      0, CONFIG_STR_MAX },
+  { "retries",               T_INT,    offsetof(config, retries),       0, UPSTREAM_SERVERS - 1 },
+  { "health_fails",          T_INT,    offsetof(config, health_fails),  0, INT_MAX },
+  { "health_down_ms",        T_INT,    offsetof(config, health_down_ms), 0, INT_MAX },
+};
+#define NKEYS (sizeof(keys) / sizeof(keys[0]))
+
+/* 명령줄 옵션으로 준 값. 파일을 읽은 뒤 매번 다시 덮어쓴다 */
+static struct {
+  int key;
+  char value[CONFIG_STR_MAX];
+} overrides[CONFIG_OVERRIDES];
+static int noverrides;
+
+static config *current;         // 새 연결이 잡을 스냅샷
+static config *retired;         // 바뀌었지만 아직 지우지 않은 스냅샷
+static int acquiring;           // config_get()에서 포인터를 읽고 참조를 더하는 중인 스레드 수
+
+static int find_key(const char *name) {
+  size_t i;
+
+  for (i = 0; i < NKEYS; i++)
+    if (!strcmp(keys[i].name, name))
+      return i;
+  return -1;
+}
+
+/* cfg의 key 값을 value로 바꾼다. 반환값: 0, 값이 잘못되었으면 -1 */
+static int set_key(config *cfg, int key, const char *value) {
+  char *field = (char *)cfg + keys[key].off, *end;
+  long v;
+
+  switch (keys[key].type) {
+  case T_INT:
+    errno = 0;
+    v = strtol(value, &end, 10);
+    if (errno || end == value || *end || v < keys[key].min || v > keys[key].max)
+      return -1;
+    *(int *)field = v;
+    return 0;
+  case T_POLICY:
+    return (*(int *)field = cache_policy(value)) < 0 ? -1 : 0;
+  case T_POOL:
+    return upstream_parse_pool(cfg, value);
+  case T_ROUTE:
+    return upstream_parse_route(cfg, value);
+  default:                      // "-"면 빈 값 (user_agent: 클라이언트 것을 그대로)
+    if (!strcmp(value, "-"))
+      value = "";
+    if (strlen(value) < (size_t)keys[key].min || strlen(value) >= (size_t)keys[key].max)
+      return -1;
+    strcpy(field, value);
+    return 0;
+  }
+}
+
+/* 명령줄 옵션의 값을 기억해 둔다. 반환값: 0, 이름이나 값이 잘못되었으면 -1 */
+int config_override(const char *name, const char *value) {
+  config scratch;
+  int key = find_key(name), i;
+
+  memset(&scratch, 0, sizeof(scratch));
+  if (key < 0 || set_key(&scratch, key, value) < 0)
+    return -1;
+  for (i = 0; i < noverrides && overrides[i].key != key; i++)
+    ;
+  if (i == CONFIG_OVERRIDES)
+    return -1;
+  if (i == noverrides)
+    noverrides++;
+  overrides[i].key = key;
+  strcpy(overrides[i].value, value);
+  return 0;
+}
+
+static void set_defaults(config *cfg) {
+  memset(cfg, 0, sizeof(config));
+  cfg->memory_mb = MEM_BUDGET_MB;
+  cfg->workers = -1;
+  cfg->backlog = LISTENQ;
+  cfg->cache_size = MAX_CACHE_SIZE;
+  cfg->max_object = MAX_OBJECT_SIZE;
+  cfg->policy = CACHE_LRU;
+  cfg->header_ms = HEADER_TIMEOUT_MS;
+  cfg->connect_ms = CONNECT_TIMEOUT_MS;
+  cfg->first_byte_ms = FIRST_BYTE_TIMEOUT_MS;
+  cfg->idle_ms = IDLE_TIMEOUT_MS;
+  cfg->max_active = ADMIT_MAX_ACTIVE;
+  cfg->max_per_ip = ADMIT_MAX_PER_IP;
+  cfg->queue_ms = ADMIT_QUEUE_MS;
+  strcpy(cfg->user_agent, DEFAULT_USER_AGENT);
+  strcpy(cfg->via, DEFAULT_VIA);
+  cfg->drain_ms = DRAIN_TIMEOUT_MS;
+  strcpy(cfg->connect_ports, DEFAULT_CONNECT_PORTS);
+  cfg->retries = UPSTREAM_RETRIES;
+  cfg->health_fails = HEALTH_FAILS;
+  cfg->health_down_ms = HEALTH_DOWN_MS;
+}
+
+/* 파일의 설정을 cfg에 덮어쓴다. 잘못된 줄은 stderr에 알리고 -1 */
+static int read_file(config *cfg, const char *path) {
+  char line[CONFIG_STR_MAX + 64], *name, *value, *end;
+  int lineno = 0, key, err = 0;
+  FILE *fp;
+
+  if (!(fp = fopen(path, "r"))) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    lineno++;
+    for (end = line; *end; end++)
+      if (*end == '#' && (end == line || isspace((unsigned char)end[-1])))
+        break;
+    for (; end > line && isspace((unsigned char)end[-1]); end--)
+      ;
+    *end = '\0';
+    for (name = line; isspace((unsigned char)*name); name++)
+      ;
+    if (!*name)
+      continue;
+    for (value = name; *value && !isspace((unsigned char)*value); value++)
+      ;
+    if (*value)
+      *value++ = '\0';
+    while (isspace((unsigned char)*value))
+      value++;
+    if ((key = find_key(name)) < 0) {
+      fprintf(stderr, "%s:%d: unknown setting %s\n", path, lineno, name);
+      err = -1;
+    } else if (set_key(cfg, key, value) < 0) {
+      fprintf(stderr, "%s:%d: bad value for %s: %s\n", path, lineno, name, value);
+      err = -1;
+    }
+  }
+  fclose(fp);
+  return err;
+}
+
+/*
+ * config_load - 기본값에 path의 파일(NULL이면 없음)과 명령줄 옵션을 차례로
+ *     덮어쓴 새 스냅샷을 만든다. 아직 공개하지 않았으므로 고쳐도 된다.
+ *
+ *     반환값: 스냅샷, 파일을 읽지 못했거나 잘못된 값(없는 풀을 가리키는
+ *             규칙 등)이 있으면 NULL
+ */
+config *config_load(const char *path) {
+  config *cfg;
+  int i;
+
+  if (!(cfg = malloc(sizeof(config))))
+    return NULL;
+  set_defaults(cfg);
+  if (path && read_file(cfg, path) < 0) {
+    free(cfg);
+    return NULL;
+  }
+  for (i = 0; i < noverrides; i++)
+    set_key(cfg, overrides[i].key, overrides[i].value);
+  if (upstream_config(cfg) < 0) {
+    free(cfg);
+    return NULL;
+  }
+  return cfg;
+}
+
+/* 새 연결부터 cfg를 쓰게 한다. 이전 스냅샷은 다 쓰고 나면 지운다 (accept 루프에서 호출) */
+void config_publish(config *cfg) {
+  config *old = current;
+
+  __atomic_store_n(&current, cfg, __ATOMIC_SEQ_CST);
+  if (old) {
+    old->next = retired;
+    retired = old;
+  }
+  config_reclaim();
+}
+
+/* 지금 공개된 스냅샷. 참조를 잡지 않으므로 바꾸는 쪽(accept 루프)에서만 쓴다 */
+config *config_current(void) {
+  return current;
+}
+
+/*
+ * config_get - 지금 스냅샷의 참조를 잡는다. 다 쓰면 config_put().
+ *     포인터를 읽고 참조를 더하기 전에 스냅샷이 바뀌어 지워지지 않도록,
+ *     그 사이에 있는 스레드 수(acquiring)를 세어 두면 config_reclaim()이
+ *     그 수가 0일 때만 지운다.
+ */
+config *config_get(void) {
+  config *cfg;
+
+  __atomic_add_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+  cfg = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&cfg->users, 1, __ATOMIC_SEQ_CST);
+  __atomic_sub_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+  return cfg;
+}
+
+void config_put(config *cfg) {
+  __atomic_sub_fetch(&cfg->users, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * config_reclaim - 바뀐 스냅샷 중 더는 쓰는 연결이 없는 것을 지운다.
+ *     acquiring이 0인 것을 본 뒤에는 이전 포인터를 읽은 스레드가 모두
+ *     참조를 더했으므로 users가 0이면 다시 늘지 않는다 (accept 루프에서
+ *     주기적으로 호출).
+ */
+void config_reclaim(void) {
+  config **pp = &retired, *cfg;
+
+  if (!retired || __atomic_load_n(&acquiring, __ATOMIC_SEQ_CST))
+    return;
+  while ((cfg = *pp)) {
+    if (__atomic_load_n(&cfg->users, __ATOMIC_ACQUIRE) == 0) {
+      *pp = cfg->next;
+      free(cfg);
+    } else {
+      pp = &cfg->next;
+    }
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include "csapp.h"
+
+#define CONFIG_STR_MAX   256    // 문자열 값 (user_agent, via)의 최대 길이
+#define CONFIG_OVERRIDES 16     // 명령줄 옵션으로 덮어쓸 수 있는 값의 수
+
+/* 리버스 프록시 (upstream.c) */
+#define UPSTREAM_MAX      8     // 서버 풀 수
+#define UPSTREAM_SERVERS  16    // 풀 하나의 서버 수
+#define UPSTREAM_NAME_MAX 32    // 풀 이름의 최대 길이
+#define UPSTREAM_HOST_MAX 128   // 서버 이름, 규칙의 Host 최대 길이
+#define ROUTE_MAX         16    // 경로 규칙 수
+
+enum { BALANCE_LOR, BALANCE_HASH };
+
+/* 풀의 서버 하나. 처리 중인 요청 수와 상태는 upstream.c의 표에서 id로 찾는다 */
+typedef struct {
+  char host[UPSTREAM_HOST_MAX];
+  char port[NI_MAXSERV];
+  int id;
+} upstream_server;
+
+typedef struct {
+  char name[UPSTREAM_NAME_MAX];
+  int balance;                  // BALANCE_LOR (처리 중인 요청이 가장 적은 곳), BALANCE_HASH (URI)
+  int nservers;
+  upstream_server servers[UPSTREAM_SERVERS];
+} upstream_pool;
+
+/* "route [host]/prefix 풀": host가 비었으면 모든 Host */
+typedef struct {
+  char host[UPSTREAM_HOST_MAX];
+  char prefix[CONFIG_STR_MAX];
+  char pool_name[UPSTREAM_NAME_MAX];
+  int pool;                     // pools[]의 번호 (다 읽은 뒤 upstream_config가 찾음)
+} route_rule;
+
+/*
+ * 설정 한 벌 (스냅샷). 한 번 공개하면 바꾸지 않는다. 연결은 만들어질 때
+ * 그때의 스냅샷을 잡아(config_get) 끝날 때까지 그 값만 읽으므로 요청
+ * 처리 중에는 잠금이 필요 없고, SIGHUP으로 새 스냅샷이 공개되어도
+ * 처리 중인 요청의 설정은 바뀌지 않는다.
+ */
+typedef struct config {
+  /* 시작할 때만 읽는다 (바꾸면 재시작해야 적용) */
+  char listen[NI_MAXSERV];      // 받을 포트
+  int memory_mb;                // 메모리 예산 (-m)
+  int workers;                  // 압축 작업자 수 (-w), -1이면 CPU 수
+
+  /* SIGHUP으로 다시 읽으면 바로 적용 */
+  int backlog;                  // listen 큐 길이
+  int cache_size;               // 캐시 용량 (바이트)
+  int max_object;               // 캐시할 객체의 최대 크기 (MAX_OBJECT_SIZE 이하)
+  int policy;                   // 캐시 교체 정책 (-P, CACHE_*)
+  int header_ms, connect_ms, first_byte_ms, idle_ms;  // 단계별 시간 제한 (-T, 0이면 없음)
+  int max_active, max_per_ip, queue_ms;               // 수락 제어 (-c, -i, -q)
+  char user_agent[CONFIG_STR_MAX];  // 원 서버에 보낼 User-Agent, 비었으면 클라이언트 것을 그대로
+  char via[CONFIG_STR_MAX];         // Via 헤더의 프록시 이름
+  int drain_ms;                 // 업그레이드(-u)로 넘겨준 뒤 처리 중인 요청을 기다리는 시간
+  char connect_ports[CONFIG_STR_MAX];  // CONNECT를 허용하는 포트 목록, "*"면 모두, 비었으면 막음
+  char backends[CONFIG_STR_MAX];       // -R: "/"를 받는 lor 풀의 서버 목록 (쉼표로 나눔)
+  int npools, nroutes;                 // 규칙이 있으면 origin-form 요청을 리버스 프록시로 받음
+  upstream_pool pools[UPSTREAM_MAX];
+  route_rule routes[ROUTE_MAX];
+  int retries;                  // 연결하지 못하면 풀의 다른 서버로 다시 시도할 횟수
+  int health_fails;             // 잇따라 이만큼 실패한 서버는 잠시 빼 둠 (0이면 빼지 않음)
+  int health_down_ms;           // 빼 둔 서버를 다시 고를 때까지
+
+  /* 스냅샷 관리 */
+  int users;                    // 이 스냅샷을 잡은 연결 수
+  struct config *next;          // 바뀌었지만 아직 쓰는 연결이 있는 스냅샷
+} config;
+
+int config_override(const char *key, const char *value);
+config *config_load(const char *path);
+void config_publish(config *cfg);
+config *config_current(void);
+config *config_get(void);
+void config_put(config *cfg);
+void config_reclaim(void);
+
+#endif /* __CONFIG_H__ */
@@ -0,0 +1,244 @@
+#include "conn.h"
+#include "cache.h"
+#include "affinity.h"
+#include "metrics.h"
+
+static mem_pool conn_pool;      // conn_t
+static mem_pool object_pool;    // MAX_OBJECT_SIZE 버퍼
+static size_t cost;             // 연결 하나가 예산에서 차지하는 크기
+static int live;                // 지금 있는 연결 수
+
+static void conn_expire(tw_timer *t);
+
+/* extra는 처리 방식마다 연결 하나에 더 드는 메모리: 스레드 스택,
+ * 상태 기계의 연결 상태, 코루틴 스택 */
+void conn_init(size_t budget_bytes, size_t extra) {
+  cost = sizeof(conn_t) + extra;
+  budget_init(budget_bytes);
+  pool_init(&conn_pool, sizeof(conn_t), 64);
+  pool_init(&object_pool, MAX_OBJECT_SIZE, 16);
+}
+
+/*
+ * conn_new - 예산에서 연결 하나의 몫을 빌려 컨텍스트를 만든다. 예산이
+ *     모자라면 최대 wait_ms 동안 다른 연결이 끝나기를 기다린다.
+ *
+ *     반환값: 컨텍스트, 예산이나 메모리를 얻지 못하면 NULL
+ */
+conn_t *conn_new(int fd, int wait_ms) {
+  conn_t *c;
+
+  if (budget_reserve(cost, wait_ms) < 0)
+    return NULL;
+  if (!(c = pool_get(&conn_pool))) {
+    budget_release(cost);
+    return NULL;
+  }
+  c->fd = fd;
+  c->cfg = config_get();          // 끝날 때까지 이 설정으로 처리 (SIGHUP으로 바뀌어도)
+  if (!affinity_enabled() || (c->home = affinity_incoming(fd)) < 0)
+    c->home = fd;
+  c->uri[0] = c->method[0] = '\0';
+  c->path = c->uri;
+  c->addrlen = 0;                 // 스레드 처리 방식은 accept의 주소로 채운다
+  c->objbuf = NULL;
+  c->serverfd = -1;
+  c->reverse = c->tried = c->attempts = 0;
+  c->route = c->backend = -1;
+  c->phase = CONN_NONE;
+  c->timed_out = CONN_NONE;
+  c->deadline = 0;
+  c->start_us = c->phase_us = metrics_now_us();
+  memset(c->marks, 0, sizeof(c->marks));
+  c->marks[PH_START] = c->start_us;
+  c->bytes_out = 0;
+  c->status = 0;
+  c->cache_result = 0;
+  pthread_mutex_init(&c->lock, NULL);
+  timer_init(&c->timer, conn_expire, c);
+  __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+  return c;
+}
+
+/* 연결 하나가 예산에서 차지하는 크기: 컨텍스트 + 처리 방식의 몫 */
+size_t conn_cost(void) {
+  return cost;
+}
+
+void conn_free(conn_t *c) {
+  conn_clear_deadline(c);
+  conn_close_serverfd(c);
+  pthread_mutex_destroy(&c->lock);
+  if (c->objbuf)
+    object_buf_put(c->objbuf);
+  config_put(c->cfg);
+  pool_put(&conn_pool, c);
+  budget_release(cost);
+  __atomic_sub_fetch(&live, 1, __ATOMIC_RELAXED);
+}
+
+/* 처리 중인 연결 수 (업그레이드 뒤에 다 끝나기를 기다릴 때) */
+int conn_live(void) {
+  return __atomic_load_n(&live, __ATOMIC_RELAXED);
+}
+
+/* 캐시에 넣을 객체 버퍼. 예산이 모자라면 NULL (캐시하지 않고 중계만 함) */
+char *conn_objbuf(conn_t *c) {
+  if (!c->objbuf)
+    c->objbuf = object_buf_get();
+  return c->objbuf;
+}
+
+/* MAX_OBJECT_SIZE 크기의 버퍼를 예산 안에서 빌림. 기다리지 않는다 */
+char *object_buf_get(void) {
+  char *buf;
+
+  if (budget_reserve(MAX_OBJECT_SIZE, 0) < 0)
+    return NULL;
+  if (!(buf = pool_get(&object_pool)))
+    budget_release(MAX_OBJECT_SIZE);
+  return buf;
+}
+
+void object_buf_put(char *buf) {
+  pool_put(&object_pool, buf);
+  budget_release(MAX_OBJECT_SIZE);
+}
+
+/* 단계별 시간 제한 (ms). 0이면 그 단계는 제한 없음 */
+static int phase_timeout(conn_t *c, int phase) {
+  switch (phase) {
+  case CONN_HEADER:     return c->cfg->header_ms;
+  case CONN_CONNECT:    return c->cfg->connect_ms;
+  case CONN_FIRST_BYTE: return c->cfg->first_byte_ms;
+  case CONN_BODY:
+  case CONN_IDLE:       return c->cfg->idle_ms;
+  default:              return 0;
+  }
+}
+
+/*
+ * conn_deadline - 연결이 phase 단계에 들어갔음을 기록하고 그 단계의
+ *     마감 시간을 타이머 휠에 건다. 이전 단계의 마감 시간은 대체된다.
+ *     모든 처리 방식이 단계마다 부르므로 원 서버 연결 시간(연결 -> 요청
+ *     바디나 첫 바이트)과 첫 바이트 시간(첫 바이트 -> 중계)도 여기서 재서
+ *     지표에 더하고 단계 시각(PH_CONNECTED, PH_FIRST_BYTE)을 찍는다.
+ */
+void conn_deadline(conn_t *c, int phase) {
+  int ms = phase_timeout(c, phase);
+  long long now = metrics_now_us();
+
+  if (c->phase == CONN_CONNECT && (phase == CONN_BODY || phase == CONN_FIRST_BYTE)) {
+    c->marks[PH_CONNECTED] = now;
+    metrics_observe(H_CONNECT, now - c->phase_us);
+  } else if (c->phase == CONN_FIRST_BYTE && phase == CONN_IDLE) {
+    c->marks[PH_FIRST_BYTE] = now;
+    metrics_observe(H_FIRST_BYTE, now - c->phase_us);
+  }
+  c->phase_us = now;
+
+  /* 타이머 콜백이 c->lock을 잡으므로 timer_add/cancel은 lock 밖에서 부른다 */
+  pthread_mutex_lock(&c->lock);
+  c->phase = phase;
+  c->last_active = timer_now();
+  c->deadline = ms > 0 ? c->last_active + ms : 0;
+  pthread_mutex_unlock(&c->lock);
+  if (ms > 0)
+    timer_add(&c->timer, ms);
+  else
+    timer_cancel(&c->timer);
+}
+
+/* 마감 시간을 없앤다. 돌아온 뒤에는 타이머가 소켓을 건드리지 않는다 */
+void conn_clear_deadline(conn_t *c) {
+  timer_cancel(&c->timer);
+  pthread_mutex_lock(&c->lock);
+  c->phase = CONN_NONE;
+  c->deadline = 0;
+  pthread_mutex_unlock(&c->lock);
+}
+
+/* 중계 중 데이터가 오갔음을 기록. 타이머는 만료될 때 이 시각을 보고
+ * 남은 시간만큼 다시 걸리므로 읽고 쓸 때마다 휠을 건드리지 않는다 */
+void conn_touch(conn_t *c) {
+  c->last_active = timer_now();
+}
+
+/* 원 서버 소켓을 타이머에 알림. 이미 시간 초과면 -1 (호출한 쪽이 닫음) */
+int conn_set_serverfd(conn_t *c, int fd) {
+  int rc = 0;
+
+  pthread_mutex_lock(&c->lock);
+  if (c->timed_out)
+    rc = -1;
+  else
+    c->serverfd = fd;
+  pthread_mutex_unlock(&c->lock);
+  return rc;
+}
+
+/* 원 서버 소켓을 닫는다. lock 안에서 닫으므로 타이머가 같은 번호로
+ * 다시 열린 다른 소켓을 shutdown하는 일은 없다 */
+void conn_close_serverfd(conn_t *c) {
+  pthread_mutex_lock(&c->lock);
+  if (c->serverfd >= 0)
+    close(c->serverfd);
+  c->serverfd = -1;
+  pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * conn_expire - 마감 시간이 지났을 때 accept 루프의 timer_expire()에서
+ *     호출된다. 소켓을 shutdown해서 막혀 있는 read/write/connect를 깨우면
+ *     처리 스레드가 c->timed_out을 보고 408/504로 응답하거나 연결을 끊는다.
+ *     스레드가 마감 시간을 치울 때까지 한 틱마다 다시 shutdown한다.
+ */
+static void conn_expire(tw_timer *t) {
+  conn_t *c = t->arg;
+  long long now = timer_now(), deadline;
+
+  pthread_mutex_lock(&c->lock);
+  if (!c->timed_out) {
+    deadline = c->deadline;
+    if (deadline && (c->phase == CONN_IDLE || c->phase == CONN_BODY))
+      deadline = c->last_active + c->cfg->idle_ms;
+    if (!deadline) {                // 그 사이에 마감 시간이 치워짐
+      pthread_mutex_unlock(&c->lock);
+      return;
+    }
+    if (now < deadline) {           // 그 사이에 데이터가 오갔거나 단계가 바뀜
+      timer_add(t, deadline - now);
+      pthread_mutex_unlock(&c->lock);
+      return;
+    }
+    c->timed_out = c->phase;
+  }
+
+  switch (c->timed_out) {
+  case CONN_HEADER:                 // 요청 읽기만 멈추고 408은 보낼 수 있게 둔다
+    shutdown(c->fd, SHUT_RD);
+    break;
+  case CONN_BODY:                   // 요청 바디: 읽기와 원 서버만 끊고 408은 보낼 수 있게
+    shutdown(c->fd, SHUT_RD);
+    if (c->serverfd >= 0)
+      shutdown(c->serverfd, SHUT_RDWR);
+    break;
+  case CONN_CONNECT:                // 원 서버만 끊고 클라이언트에는 504
+  case CONN_FIRST_BYTE:
+    if (c->serverfd >= 0)
+      shutdown(c->serverfd, SHUT_RDWR);
+    break;
+  default:                          // 중계 중에는 양쪽 모두 끊음
+    shutdown(c->fd, SHUT_RDWR);
+    if (c->serverfd >= 0)
+      shutdown(c->serverfd, SHUT_RDWR);
+    break;
+  }
+  timer_add(t, TIMER_TICK_MS);
+  pthread_mutex_unlock(&c->lock);
+}
+
+/* 요청이 mark 지점을 지났음을 기록 (phase.h) */
+void conn_mark(conn_t *c, int mark) {
+  c->marks[mark] = metrics_now_us();
+}
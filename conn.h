@@ -0,0 +1,91 @@
+#ifndef __CONN_H__
+#define __CONN_H__
+
+#include "csapp.h"
+#include "mempool.h"
+#include "timer.h"
+#include "phase.h"
+#include "config.h"
+
+#define METHOD_MAX        16            // 요청 메서드 최대 길이
+#define VERSION_MAX       16            // HTTP 버전 최대 길이
+#define THREAD_STACK_SIZE (256 * 1024)  // 연결 처리 스레드의 스택 크기
+#define MEM_BUDGET_MB     256           // 기본 메모리 예산 (-m, memory_mb로 변경)
+
+/* 기본 시간 제한 (ms, -T나 설정 파일로 변경, 0이면 제한 없음) */
+#define HEADER_TIMEOUT_MS     10000     // 클라이언트 요청 헤더를 다 받을 때까지
+#define CONNECT_TIMEOUT_MS    5000      // 원 서버 연결
+#define FIRST_BYTE_TIMEOUT_MS 30000     // 요청을 보낸 뒤 응답 헤더를 받을 때까지
+#define IDLE_TIMEOUT_MS       60000     // 중계 중 양쪽 모두 아무것도 오가지 않는 시간
+                                        // (요청 바디를 보내는 동안에도 같은 제한)
+
+/* 연결이 지금 기다리고 있는 단계. 단계마다 시간 제한이 다르다 */
+enum { CONN_NONE, CONN_HEADER, CONN_CONNECT, CONN_BODY, CONN_FIRST_BYTE, CONN_IDLE };
+
+/*
+ * 연결 하나가 요청을 처리하는 동안 쓰는 버퍼를 모은 컨텍스트.
+ * 요청 줄(buf), uri, 요청 헤더(header), 응답 헤더(resp_hdr)와 rio 읽기
+ * 버퍼는 각각 최대 크기(8KB)로 잡혀 있어서 컨텍스트 하나가 약 41KB다
+ * (x86-64에서 42520 바이트). 연결마다 요청 하나만 처리하므로 이 버퍼들은
+ * 연결이 끝날 때까지 쓰이고, 경로는 uri 안을 가리켜 따로 두지 않는다.
+ * 컨텍스트는 풀에서 빌려 재사용하므로 요청마다 malloc하지 않는다.
+ * 예산에는 여기에 처리 방식의 몫(conn_init의 extra)을 더해 센다.
+ * 캐시에 넣을 객체 버퍼(MAX_OBJECT_SIZE)는 캐시할 응답일 때만 빌린다.
+ */
+typedef struct {
+  int fd;                       // 클라이언트 소켓
+  config *cfg;                  // 연결을 받을 때의 설정 (시간 제한, 헤더 정책 등)
+  struct sockaddr_storage addr; // 클라이언트 주소
+  socklen_t addrlen;
+  rio_t rio;                    // 클라이언트 읽기 버퍼
+  char buf[MAXLINE];            // 요청 줄, 응답 바디 중계용
+  char method[METHOD_MAX];
+  char version[VERSION_MAX];
+  char uri[MAXLINE];
+  char hostname[NI_MAXHOST];
+  char port[NI_MAXSERV];
+  char *path;                   // 요청 경로, uri 안을 가리킴 (없으면 "/")
+  char header[MAXBUF];          // 서버로 보낼 요청 헤더
+  char resp_hdr[MAXBUF];        // 서버 응답의 헤더 블록
+  int client_encs;              // 클라이언트가 받을 수 있는 인코딩 (1 << ENC_*)
+  long req_length;              // 요청 바디의 Content-Length, 없으면 -1
+  int req_chunked;              // 요청 바디가 chunked
+  int expect_continue;          // 클라이언트가 바디를 보내기 전에 100 Continue를 기다림
+  int reverse;                  // 리버스 프록시로 받은 요청 (origin-form, upstream.c)
+  int route;                    // 고른 규칙 (cfg->routes의 번호), 없으면 -1
+  int backend;                  // 지금 보내는 풀의 서버 번호, 없으면 -1
+  unsigned int tried;           // 이 요청에서 시도한 서버 (1 << 번호)
+  int attempts;                 // 시도한 서버 수
+  char *objbuf;                 // 캐시에 넣을 객체, 빌리지 않았으면 NULL
+  int serverfd;                 // 원 서버 소켓, 없으면 -1
+  int home;                     // CPU 작업을 맡길 작업자 (-a면 패킷을 받은 CPU의 slot)
+  int phase;                    // 시간 제한을 건 단계 (CONN_*)
+  int timed_out;                // 시간 초과로 끊었으면 그 단계, 아니면 CONN_NONE
+  long long deadline;           // 지금 단계의 마감 시각, 제한이 없으면 0
+  long long last_active;        // 중계 중 마지막으로 데이터가 오간 시각
+  long long start_us;           // 연결을 받은 시각 (요청 처리 시간)
+  long long phase_us;           // 지금 단계에 들어간 시각 (연결, 첫 바이트 시간)
+  long long marks[PH_COUNT];    // 단계별 시각 (phase.h), 지나지 않았으면 0
+  long long bytes_out;          // 클라이언트에 보낸 바이트 (접근 로그)
+  int status;                   // 클라이언트에 보낸 상태 코드, 아직이면 0
+  int cache_result;             // 캐시 검사 결과 (ACCESS_CACHE_*)
+  tw_timer timer;               // 단계별 마감 시간
+  pthread_mutex_t lock;         // 소켓을 닫는 것과 타이머의 shutdown이 겹치지 않게
+} conn_t;
+
+void conn_init(size_t budget_bytes, size_t extra);
+size_t conn_cost(void);
+conn_t *conn_new(int fd, int wait_ms);
+void conn_free(conn_t *c);
+int conn_live(void);
+char *conn_objbuf(conn_t *c);
+char *object_buf_get(void);
+void object_buf_put(char *buf);
+void conn_deadline(conn_t *c, int phase);
+void conn_clear_deadline(conn_t *c);
+int conn_set_serverfd(conn_t *c, int fd);
+void conn_close_serverfd(conn_t *c);
+void conn_touch(conn_t *c);
+void conn_mark(conn_t *c, int mark);
+
+#endif /* __CONN_H__ */
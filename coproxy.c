@@ -0,0 +1,496 @@
+/*
+ * coproxy.c - 입출력 엔진 위에서 연결마다 코루틴(coro.c) 하나로 요청을
+ *     처리한다. 상태 기계(evproxy.c)와 같은 엔진과 단계 함수(proxy.h)를
+ *     쓰지만 코드는 스레드의 doit()처럼 위에서 아래로 읽힌다: I/O를
+ *     엔진에 맡기고 끝날 때까지 코루틴이 멈춰 있을 뿐이다. io_req와
+ *     relay_t 같은 연결별 상태는 코루틴 스택의 지역 변수이므로 연결
+ *     하나의 메모리는 conn_t와 코루틴 스택 하나다.
+ *
+ *     마감 시간은 conn_deadline을 그대로 쓴다. 타이머가 소켓을 shutdown하면
+ *     기다리던 I/O가 실패로 끝나고 코루틴이 c->timed_out을 보고 답한다.
+ *     원 서버 연결은 상태 기계와 같은 dial.c로 주소를 엇갈려 시도한다.
+ *     원 서버 이름은 getaddrinfo로 찾으므로 그 동안은 루프가 멈춘다.
+ */
+#include "proxy.h"
+#include "coproxy.h"
+#include "coro.h"
+#include "dial.h"
+#include "admit.h"
+#include "err.h"
+#include "tunnel.h"
+#include "reqbody.h"
+#include "upstream.h"
+
+/* CONNECT 터널의 한 방향. req 하나로 from에서 받고 받은 버퍼를 to로 보낸다 */
+typedef struct {
+  io_req *req;
+  int from, to;
+  int state;                    // TUN_RECV, TUN_SEND, TUN_CLOSED
+  int busy;                     // 엔진에 맡긴 I/O가 아직 끝나지 않음
+  coro *co;
+} co_dir;
+
+enum { TUN_RECV, TUN_SEND, TUN_CLOSED };
+
+static io_engine *io;
+static io_req accept_req;
+
+static void co_accept(io_req *req, int res);
+static void co_handler(void *arg);
+static int co_doit(conn_t *c, io_req *client, io_req *upstream);
+static int co_connect_upstream(conn_t *c, size_t len);
+static int co_connect_once(conn_t *c, size_t len);
+static int co_forward_body(conn_t *c, io_req *client, io_req *upstream, int off, int len);
+static int co_relay_response(conn_t *c, io_req *client, io_req *upstream);
+static int co_tunnel(conn_t *c, io_req *client, io_req *upstream);
+
+/* engine으로 listenfd의 연결을 받기 시작한다. 반환값: 0, 엔진을 쓸 수 없으면 -1 */
+int co_proxy_init(io_engine *engine, int listenfd) {
+  io = engine;
+  if (io->init() < 0)
+    return -1;
+  dial_init(io);
+  accept_req.done = co_accept;
+  io->accept(&accept_req, listenfd);
+  return 0;
+}
+
+/* 새 연결 받기를 멈춘다 (listen 소켓을 넘겨준 뒤). 받은 연결은 끝까지 처리 */
+void co_proxy_stop_accept(void) {
+  io->cancel(&accept_req);
+}
+
+/* 최대 timeout_ms 동안 완료를 기다려 처리한다 (accept 루프에서 호출).
+ * 타이머가 깨운 코루틴이나 원 서버 연결이 있으면 먼저 잇고 기다리지 않는다 */
+int co_proxy_wait(int timeout_ms) {
+  int n = coro_run_ready() + dial_run_ready();
+
+  return n + io->wait(n ? 0 : timeout_ms);
+}
+
+/* 엔진의 완료: 결과를 남기고 기다리던 코루틴을 잇는다 */
+static void co_io_done(io_req *req, int res) {
+  req->res = res;
+  coro_wake(req->arg);
+}
+
+/* fd에서 받을 때까지 멈춘다. 반환값: 받은 바이트 (req->buf에, 다 쓰면
+ * buf_put으로 반납), 상대가 닫았으면 0, 실패하면 -errno */
+static int co_recv(io_req *req, int fd) {
+  req->done = co_io_done;
+  req->arg = coro_self();
+  io->recv(req, fd);
+  coro_wait(1);
+  return req->res;
+}
+
+/* iov를 모두 보낼 때까지 멈춘다. 반환값: 보낸 바이트, 실패하면 -errno */
+static int co_send(io_req *req, int fd, struct iovec *iov, int niov) {
+  req->done = co_io_done;
+  req->arg = coro_self();
+  io->send(req, fd, iov, niov);
+  coro_wait(1);
+  return req->res;
+}
+
+/* dial.c의 연결 시도가 끝남: 기다리던 코루틴을 잇는다 */
+static void co_dial_done(dial *d, int rc) {
+  coro_wake(d->arg);
+}
+
+/* list의 주소로 연결하고 iov를 보낼 때까지 멈춘다 (Happy Eyeballs, dial.c).
+ * 반환값: 보냈으면 1 (d->he.fd), 실패하면 -1 (d->he.error) */
+static int co_dial(dial *d, struct addrinfo *list, int timeout_ms, struct iovec *iov) {
+  if (!dial_start(d, list, timeout_ms, iov, co_dial_done, coro_self()))
+    coro_wait(1);
+  return d->rc;
+}
+
+/* 응답을 보내기 전의 실패: 원인에 맞는 상태 코드로 답한다. 반환값: err */
+static int co_reply_error(conn_t *c, io_req *client, int err) {
+  struct iovec iov;
+
+  if ((iov.iov_len = error_response(c->buf, err))) {
+    iov.iov_base = c->buf;
+    co_send(client, c->fd, &iov, 1);
+  }
+  return err;
+}
+
+static void co_accept(io_req *req, int res) {
+  conn_t *c;
+  coro *co;
+
+  if (res < 0)
+    return;                       // EMFILE 등: 다음 연결에서 다시 시도
+  if (!(c = conn_new(res, 0))) {
+    admit_reject(res);
+    return;
+  }
+  if (!(co = coro_new(co_handler, c))) {
+    conn_free(c);
+    admit_reject(res);
+    return;
+  }
+  c->addrlen = 0;
+  coro_resume(co);                // 첫 I/O를 맡기고 멈출 때까지 실행
+}
+
+/* 연결 하나를 처리하는 코루틴. 끝나면 소켓을 닫고 컨텍스트를 반납 */
+static void co_handler(void *arg) {
+  conn_t *c = arg;
+  io_req client, upstream;
+  int err;
+
+  client.buf = upstream.buf = NULL;
+  if ((err = co_doit(c, &client, &upstream)) != ERR_NONE) {
+    err_record(err);
+    printf("Request failed: %s %s\n", err_name(err), c->uri);
+  }
+  if (client.buf)                 // 보내지 않고 끝낸 요청 바디
+    io->buf_put(&client);
+  io_stat.requests++;
+  request_done(c, err);
+  conn_clear_deadline(c);         // 소켓을 닫기 전에 타이머를 치움
+  if (c->serverfd >= 0) {
+    io->forget(c->serverfd);
+    io_stat.syscalls++;
+  }
+  conn_close_serverfd(c);
+  io->forget(c->fd);
+  io_stat.syscalls++;
+  close(c->fd);
+  conn_free(c);
+}
+
+/*
+ * co_read_header - 빈 줄까지 받아서 c->resp_hdr에 모은다. 헤더와 같이
+ *     온 바디는 req->buf의 *body_off부터 *body_len 바이트로 남는다
+ *     (호출한 쪽이 buf_put으로 반납).
+ *
+ *     반환값: 헤더 길이, 그 전에 닫혔으면 0, 실패하면 -errno,
+ *     헤더가 MAXBUF를 넘으면 -EMSGSIZE
+ */
+static int co_read_header(conn_t *c, io_req *req, int fd, int *body_off, int *body_len) {
+  int len = 0, old, hdrlen, used, res;
+
+  do {
+    if ((res = co_recv(req, fd)) <= 0) {
+      if (req->buf)
+        io->buf_put(req);
+      return res;
+    }
+    old = len;
+    if (!(hdrlen = http_collect(c->resp_hdr, MAXBUF, &len, req->buf, res, &used)))
+      io->buf_put(req);
+  } while (!hdrlen);
+  if (hdrlen < 0) {
+    io->buf_put(req);
+    return -EMSGSIZE;
+  }
+  *body_off = hdrlen - old;       // 이번에 받은 것 중 헤더 뒤
+  *body_len = res - *body_off;
+  return hdrlen;
+}
+
+/* 클라이언트의 요청을 처리한다. doit()과 같은 순서로, I/O만 엔진에 맡긴다.
+ * 반환값: ERR_NONE, 실패하면 원인 (ERR_*) */
+static int co_doit(conn_t *c, io_req *client, io_req *upstream) {
+  struct iovec iov[CACHE_IOV];
+  char hit_hdr[CACHE_HIT_HDR_MAX];
+  Node *node;
+  int hdrlen, off, len, res, err;
+
+  /* 요청 헤더를 다 받을 때까지. 버티는 클라이언트는 마감 시간에 408 */
+  conn_deadline(c, CONN_HEADER);
+  if ((hdrlen = co_read_header(c, client, c->fd, &off, &len)) <= 0) {
+    if (c->timed_out)
+      return co_reply_error(c, client, ERR_HEADER_TIMEOUT);
+    if (hdrlen == -EMSGSIZE)
+      return co_reply_error(c, client, ERR_HEADER_TOO_LARGE);
+    return hdrlen < 0 ? ERR_CLIENT_READ : ERR_CLIENT_CLOSED;
+  }
+  err = parse_request(c, hdrlen);
+  if (err == ERR_NONE && tunnel_request(c))   // 터널이 열리면 원 서버에 넘길 것
+    memcpy(c->header, client->buf + off, len);
+  /* 요청 헤더는 복사했으므로 버퍼는 바로 반납. 같이 온 요청 바디는 보낼 때까지 둔다 */
+  if (err != ERR_NONE || !reqbody_expected(c) || !len)
+    io->buf_put(client);
+  if (err != ERR_NONE)
+    return co_reply_error(c, client, err);
+  if (strstr(c->uri, "favicon"))
+    return ERR_NONE;
+  conn_mark(c, PH_HEADER);
+  if (tunnel_request(c)) {  // CONNECT: 연결하면서 같이 받은 바이트를 넘기고 잇기만 함
+    conn_deadline(c, CONN_CONNECT);
+    if ((err = co_connect_upstream(c, len)) != ERR_NONE)
+      return co_reply_error(c, client, err);
+    conn_deadline(c, CONN_FIRST_BYTE);
+    return co_tunnel(c, client, upstream);
+  }
+  if (admin_request(c)) {  // 원 서버가 아니라 프록시에게 보낸 요청
+    if ((err = admin_response(c, iov, &len)) != ERR_NONE)
+      return co_reply_error(c, client, err);
+    return co_send(client, c->fd, iov, len) < 0 ? ERR_CLIENT_WRITE : ERR_NONE;
+  }
+
+  // 캐시 검사: 클라이언트가 받을 수 있는 압축 변형부터 찾음
+  if ((node = lookup_cache(c))) {
+    conn_deadline(c, CONN_IDLE);
+    res = co_send(client, c->fd, iov, cache_iov(node, iov, hit_hdr, !strcasecmp(c->method, "HEAD")));
+    release_cache(cache, node);
+    return relay_error(c, res < 0 ? ERR_CLIENT_WRITE : ERR_NONE);
+  }
+
+  conn_deadline(c, CONN_CONNECT);
+  if ((err = co_connect_upstream(c, strlen(c->header))) != ERR_NONE)
+    return co_reply_error(c, client, err);
+  if (reqbody_expected(c)) {
+    conn_deadline(c, CONN_BODY);
+    if ((err = co_forward_body(c, client, upstream, off, len)) != ERR_NONE)
+      return co_reply_error(c, client, err);
+  } else {
+    conn_deadline(c, CONN_FIRST_BYTE);
+  }
+  return co_relay_response(c, client, upstream);
+}
+
+/*
+ * co_connect_upstream - 원 서버에 연결하고 요청 헤더(c->header의 len
+ *     바이트)를 보낸다. 리버스 프록시면 풀에서 서버를 고르고, 연결하지
+ *     못하면 다른 서버로 다시 시도한다 (upstream.c).
+ *
+ *     반환값: ERR_NONE (c->serverfd에 소켓), 실패하면 원인
+ */
+static int co_connect_upstream(conn_t *c, size_t len) {
+  int err;
+
+  upstream_pick(c);
+  while ((err = co_connect_once(c, len)) != ERR_NONE && upstream_retry(c, err))
+    conn_deadline(c, CONN_CONNECT);
+  return err;
+}
+
+/* c->hostname:c->port에 연결하고 요청 헤더를 보낸다. 연결 시도는
+ * 보낼 때까지만 빌리고, 주소 사이의 시도는 co_dial이 엇갈려 한다 */
+static int co_connect_once(conn_t *c, size_t len) {
+  struct addrinfo *listp;
+  struct iovec iov;
+  dial *d;
+  int rc, fd, error, connected;
+
+  conn_mark(c, PH_DNS_BEGIN);
+  if (he_resolve(c->hostname, c->port, &listp) != 0)
+    return ERR_DNS;
+  conn_mark(c, PH_DNS_END);
+  if (!(d = dial_get())) {
+    freeaddrinfo(listp);
+    return ERR_NOMEM;
+  }
+  iov.iov_base = c->header;
+  iov.iov_len = len;
+  rc = co_dial(d, listp, c->cfg->connect_ms, &iov);
+  freeaddrinfo(listp);
+  fd = d->he.fd;
+  error = d->he.error;
+  connected = d->connected;
+  dial_put(d);
+  if (rc < 0 && error == ETIMEDOUT)
+    return ERR_CONNECT_TIMEOUT;
+  if (rc < 0)
+    return connected ? ERR_UPSTREAM_WRITE : ERR_CONNECT;
+  if (conn_set_serverfd(c, fd) < 0) {
+    io->forget(fd);
+    close(fd);
+    return ERR_CONNECT_TIMEOUT;
+  }
+  return ERR_NONE;
+}
+
+/* 클라이언트에서 받은 요청 바디 n 바이트를 변환해서 원 서버로 보낸다 */
+static int co_body_data(conn_t *c, reqbody_t *b, io_req *upstream, char *buf, int n) {
+  int err, niov;
+
+  if ((err = reqbody_data(b, buf, n, &niov)) != ERR_NONE)
+    return err;
+  if (niov && co_send(upstream, c->serverfd, b->iov, niov) < 0)
+    return reqbody_error(c, ERR_UPSTREAM_WRITE);
+  conn_touch(c);
+  return ERR_NONE;
+}
+
+/*
+ * co_forward_body - 요청 헤더를 보낸 뒤 바디를 원 서버로 보낸다.
+ *     reqbody_forward()와 같은 단계로, 헤더와 같이 받은 바이트(client->buf의
+ *     off부터 len 바이트)부터 보내고 그 뒤로는 client로 받아 upstream으로
+ *     보낸다.
+ *
+ *     반환값: ERR_NONE, 실패하면 원인 (아직 응답을 보내지 않았음)
+ */
+static int co_forward_body(conn_t *c, io_req *client, io_req *upstream, int off, int len) {
+  reqbody_t b;
+  struct iovec iov;
+  int niov, res = 0, err = ERR_NONE;
+
+  reqbody_start(c, &b);
+  if ((niov = reqbody_continue(c, &iov)) && co_send(client, c->fd, &iov, niov) < 0)
+    return ERR_CLIENT_WRITE;
+  if (len > 0) {
+    err = co_body_data(c, &b, upstream, client->buf + off, len);
+    io->buf_put(client);
+    if (err != ERR_NONE)
+      return err;
+  }
+  while (!reqbody_done(&b) && (res = co_recv(client, c->fd)) > 0) {
+    conn_touch(c);
+    err = co_body_data(c, &b, upstream, client->buf, res);
+    io->buf_put(client);
+    if (err != ERR_NONE)
+      return err;
+  }
+  if (!reqbody_done(&b))
+    return reqbody_error(c, res < 0 ? ERR_CLIENT_READ : ERR_CLIENT_CLOSED);
+  conn_deadline(c, CONN_FIRST_BYTE);
+  return ERR_NONE;
+}
+
+/* 받은 바디 n 바이트를 변환해서 클라이언트로 보낸다 */
+static int co_relay_data(conn_t *c, relay_t *r, io_req *client, char *buf, int n) {
+  int err, niov;
+
+  if ((err = relay_data(c, r, buf, n, &niov)) != ERR_NONE)
+    return err;                   // 잘못된 응답은 캐시하지 않고 연결을 끊음
+  if (niov && co_send(client, c->fd, r->iov, niov) < 0)
+    return relay_error(c, ERR_CLIENT_WRITE);
+  conn_touch(c);
+  return ERR_NONE;
+}
+
+/*
+ * co_relay_response - 원 서버의 응답을 클라이언트에 중계하고 캐시 가능하면
+ *     캐시에 넣는다. relay_response()와 같은 단계를 엔진의 버퍼로 부른다.
+ *
+ *     반환값: ERR_NONE, 실패하면 원인
+ */
+static int co_relay_response(conn_t *c, io_req *client, io_req *upstream) {
+  relay_t r;
+  int hdrlen, niov, off, len, res = 0, err = ERR_NONE;
+
+  /* 상태 줄과 헤더를 모아서 한 번만 파싱. 같이 온 바디는 버퍼에 남아 있다 */
+  if ((hdrlen = co_read_header(c, upstream, c->serverfd, &off, &len)) <= 0)
+    return co_reply_error(c, client, c->timed_out ? ERR_FIRST_BYTE_TIMEOUT : ERR_BAD_RESPONSE);
+  if (relay_start(c, &r, hdrlen, &niov) != ERR_NONE) {
+    io->buf_put(upstream);
+    return co_reply_error(c, client, ERR_BAD_RESPONSE);
+  }
+  if (co_send(client, c->fd, r.iov, niov) < 0)
+    err = relay_error(c, ERR_CLIENT_WRITE);
+  else if (r.has_body && len > 0)
+    err = co_relay_data(c, &r, client, upstream->buf + off, len);
+  io->buf_put(upstream);
+  if (err != ERR_NONE || !r.has_body)
+    return err;                   // 바디가 없는 응답은 캐시하지 않음
+
+  while (!relay_done(&r) && (res = co_recv(upstream, c->serverfd)) > 0) {
+    conn_touch(c);
+    err = co_relay_data(c, &r, client, upstream->buf, res);
+    io->buf_put(upstream);
+    if (err != ERR_NONE)
+      return err;
+  }
+  if (res < 0)
+    return relay_error(c, ERR_UPSTREAM_READ);
+  return relay_finish(c, &r);
+}
+
+/* 터널 방향의 완료: 결과를 남기고 코루틴을 깨운다 (어느 방향인지는 busy로 안다) */
+static void co_tunnel_done(io_req *req, int res) {
+  co_dir *d = req->arg;
+
+  req->res = res;
+  d->busy = 0;
+  coro_wake(d->co);
+}
+
+static void co_dir_recv(co_dir *d) {
+  d->state = TUN_RECV;
+  d->busy = 1;
+  d->req->done = co_tunnel_done;
+  d->req->arg = d;
+  io->recv(d->req, d->from);
+}
+
+/* 끝난 I/O 하나를 보고 다음 I/O를 건다. 반환값: ERR_NONE, 실패하면 원인 */
+static int co_dir_step(conn_t *c, co_dir *d, int to_client) {
+  struct iovec iov;
+  int res = d->req->res;
+
+  if (d->state == TUN_SEND) {
+    if (d->req->buf) {            // 원 서버 -> 클라이언트의 첫 send(200)는 버퍼가 없음
+      io->buf_put(d->req);
+      if (res >= 0)
+        tunnel_count(c, to_client, res);
+    }
+    if (res < 0) {
+      d->state = TUN_CLOSED;
+      return relay_error(c, to_client ? ERR_CLIENT_WRITE : ERR_UPSTREAM_WRITE);
+    }
+    co_dir_recv(d);
+    return ERR_NONE;
+  }
+  if (res <= 0) {
+    d->state = TUN_CLOSED;
+    if (res < 0 || c->timed_out)
+      return c->timed_out ? ERR_IDLE_TIMEOUT : to_client ? ERR_UPSTREAM_READ : ERR_CLIENT_READ;
+    shutdown(d->to, SHUT_WR);     // 반대쪽 방향은 계속 잇는다
+    return ERR_NONE;
+  }
+  conn_touch(c);
+  iov.iov_base = d->req->buf;
+  iov.iov_len = res;
+  d->state = TUN_SEND;
+  d->busy = 1;
+  io->send(d->req, d->to, &iov, 1);
+  return ERR_NONE;
+}
+
+/*
+ * co_tunnel - CONNECT: 200을 보내고 두 방향을 잇는다. client 요청은
+ *     클라이언트 -> 원 서버, upstream 요청은 원 서버 -> 클라이언트를 맡아
+ *     받은 버퍼를 그대로 반대쪽에 보낸다. 코루틴은 어느 쪽이든 I/O가
+ *     끝날 때마다 깨어나 그 방향의 다음 I/O를 건다. 실패하면 양쪽 소켓을
+ *     끊어서 남은 I/O를 끝내고 돌아온다 (요청은 이 스택에 있으므로).
+ *
+ *     반환값: ERR_NONE, 실패하면 원인
+ */
+static int co_tunnel(conn_t *c, io_req *client, io_req *upstream) {
+  co_dir d[2] = {
+    { client, c->fd, c->serverfd, TUN_RECV, 0, coro_self() },
+    { upstream, c->serverfd, c->fd, TUN_SEND, 0, coro_self() },
+  };
+  struct iovec iov;
+  int i, err = ERR_NONE, e;
+
+  d[1].busy = 1;
+  upstream->done = co_tunnel_done;
+  upstream->arg = &d[1];
+  io->send(upstream, c->fd, &iov, tunnel_reply(c, &iov));
+  co_dir_recv(&d[0]);
+  while (d[0].state != TUN_CLOSED || d[1].state != TUN_CLOSED) {
+    coro_wait(1);
+    for (i = 0; i < 2; i++) {
+      if (d[i].busy || d[i].state == TUN_CLOSED)
+        continue;
+      if (err != ERR_NONE) {      // 이미 실패: 남은 I/O가 끝나기만 기다림
+        if (d[i].req->buf)
+          io->buf_put(d[i].req);
+        d[i].state = TUN_CLOSED;
+      } else if ((e = co_dir_step(c, &d[i], i == 1)) != ERR_NONE) {
+        err = e;
+        shutdown(c->fd, SHUT_RDWR);
+        shutdown(c->serverfd, SHUT_RDWR);
+      }
+    }
+  }
+  return err;
+}
@@ -0,0 +1,10 @@
+#ifndef __COPROXY_H__
+#define __COPROXY_H__
+
+#include "ioengine.h"
+
+int co_proxy_init(io_engine *engine, int listenfd);
+void co_proxy_stop_accept(void);
+int co_proxy_wait(int timeout_ms);
+
+#endif /* __COPROXY_H__ */
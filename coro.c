@@ -0,0 +1,233 @@
+/*
+ * coro.c - 이벤트 루프 위에서 도는 스택 코루틴. 코루틴마다 작은 스택을
+ *     주고 문맥을 바꿔 가며 멈췄다가 이어 가므로, 처리 코드는 blocking
+ *     I/O를 쓰는 doit()처럼 위에서 아래로 쓰고 I/O를 엔진에 맡긴 뒤
+ *     coro_wait()로 루프에 돌아간다. 완료 콜백의 coro_wake()가 멈춘
+ *     자리에서 다시 이어 준다.
+ *
+ *     스택(코루틴 프레임)은 mmap으로 잡아 맨 아래에 guard 페이지를 두고
+ *     맨 위에 coro를 둔다. 다 쓴 스택은 free list에 남겨 두었다가
+ *     재사용하므로 연결마다 malloc이나 mmap을 부르지 않는다.
+ *     이벤트 루프 스레드 하나에서만 쓴다.
+ */
+#include "coro.h"
+#include "timer.h"
+#include <sys/mman.h>
+#if !defined(__x86_64__)
+#include <ucontext.h>
+#endif
+
+struct coro {
+#if defined(__x86_64__)
+  void *sp;                     // 멈춘 코루틴의 스택 포인터
+  void *caller_sp;              // 코루틴을 이어 준 쪽의 스택 포인터
+#else
+  ucontext_t ctx, caller;
+#endif
+  void (*fn)(void *arg);
+  void *arg;
+  int waiting;                  // 아직 오지 않은 깨우기 수
+  int done;                     // fn이 끝났음
+  struct coro *next;            // 빈 스택 목록, 깨울 코루틴 목록
+};
+
+static coro *current;           // 지금 실행 중인 코루틴, 루프면 NULL
+static coro *idle;              // 재사용할 스택
+static int nidle;
+static coro *ready_head, *ready_tail;  // 타이머가 깨운 코루틴
+
+#if defined(__x86_64__)
+/*
+ * coro_switch - callee-saved 레지스터를 지금 스택에 넣고 스택 포인터를
+ *     *save에 둔 뒤, to 스택에서 레지스터를 꺼내 그쪽으로 돌아간다.
+ *     ucontext의 swapcontext와 달리 시그널 마스크를 건드리지 않으므로
+ *     전환마다 시스템 콜이 없다.
+ */
+void coro_switch(void **save, void *to);
+__asm__(".text\n"
+        ".globl coro_switch\n"
+        ".type coro_switch, @function\n"
+        "coro_switch:\n"
+        "  pushq %rbp\n"
+        "  pushq %rbx\n"
+        "  pushq %r12\n"
+        "  pushq %r13\n"
+        "  pushq %r14\n"
+        "  pushq %r15\n"
+        "  movq %rsp, (%rdi)\n"
+        "  movq %rsi, %rsp\n"
+        "  popq %r15\n"
+        "  popq %r14\n"
+        "  popq %r13\n"
+        "  popq %r12\n"
+        "  popq %rbx\n"
+        "  popq %rbp\n"
+        "  ret\n"
+        ".size coro_switch, .-coro_switch\n");
+#endif
+
+/* 새 코루틴이 처음 이어질 때 여기서 시작한다 */
+static void coro_entry(void) {
+  coro *co = current;
+
+  co->fn(co->arg);
+  co->done = 1;
+#if defined(__x86_64__)
+  coro_switch(&co->sp, co->caller_sp);
+#endif
+}                               // ucontext는 uc_link(caller)로 돌아감
+
+/* 스택 하나를 얻는다: 빈 목록에서 꺼내거나 새로 mmap */
+static coro *coro_alloc(void) {
+  coro *co;
+  char *base;
+
+  if ((co = idle)) {
+    idle = co->next;
+    nidle--;
+    return co;
+  }
+  base = mmap(NULL, CORO_STACK_SIZE, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+  mprotect(base, getpagesize(), PROT_NONE);  // 넘치면 덮어쓰지 않고 SIGSEGV
+  return (coro *)(base + CORO_STACK_SIZE - ((sizeof(coro) + 15) & ~15));
+}
+
+static void coro_free(coro *co) {
+  if (nidle >= CORO_MAX_IDLE) {
+    munmap((char *)co + ((sizeof(coro) + 15) & ~15) - CORO_STACK_SIZE, CORO_STACK_SIZE);
+    return;
+  }
+  co->next = idle;
+  idle = co;
+  nidle++;
+}
+
+/*
+ * coro_new - fn(arg)을 실행할 코루틴을 만든다. coro_resume으로 이어야
+ *     시작하고, fn이 돌아오면 스택은 자동으로 반납된다.
+ *
+ *     반환값: 코루틴, 스택을 얻지 못하면 NULL
+ */
+coro *coro_new(void (*fn)(void *arg), void *arg) {
+  coro *co;
+  void **sp;
+
+  if (!(co = coro_alloc()))
+    return NULL;
+  co->fn = fn;
+  co->arg = arg;
+  co->waiting = 0;
+  co->done = 0;
+#if defined(__x86_64__)
+  /* coro_switch가 꺼낼 레지스터 6개와 돌아갈 주소. coro_entry에 들어갈 때
+   * 함수 호출 직후처럼 rsp % 16 == 8이 되도록 빈 칸 하나를 둔다 */
+  sp = (void **)co;
+  *--sp = NULL;
+  *--sp = (void *)coro_entry;
+  sp -= 6;
+  memset(sp, 0, 6 * sizeof(void *));
+  co->sp = sp;
+#else
+  sp = NULL;
+  getcontext(&co->ctx);
+  co->ctx.uc_stack.ss_sp = (char *)co + ((sizeof(coro) + 15) & ~15) - CORO_STACK_SIZE
+                           + getpagesize();
+  co->ctx.uc_stack.ss_size = (char *)co - (char *)co->ctx.uc_stack.ss_sp;
+  co->ctx.uc_link = &co->caller;
+  makecontext(&co->ctx, coro_entry, 0);
+#endif
+  return co;
+}
+
+/* co를 다음에 멈출 때까지 실행한다. fn이 끝났으면 스택을 반납 */
+void coro_resume(coro *co) {
+  coro *prev = current;
+
+  current = co;
+#if defined(__x86_64__)
+  coro_switch(&co->caller_sp, co->sp);
+#else
+  swapcontext(&co->caller, &co->ctx);
+#endif
+  current = prev;
+  if (co->done)
+    coro_free(co);
+}
+
+/* 지금 실행 중인 코루틴. 코루틴 밖이면 NULL */
+coro *coro_self(void) {
+  return current;
+}
+
+/* 루프로 돌아간다 */
+static void coro_yield(void) {
+  coro *co = current;
+
+#if defined(__x86_64__)
+  coro_switch(&co->sp, co->caller_sp);
+#else
+  swapcontext(&co->ctx, &co->caller);
+#endif
+}
+
+/*
+ * coro_wait - 지금 코루틴에 대한 coro_wake()가 n번 올 때까지 멈춘다.
+ *     완료 콜백이 먼저 불렸어도 (이미 온 깨우기는 세어 두므로) 된다.
+ */
+void coro_wait(int n) {
+  coro *co = current;
+
+  co->waiting += n;
+  while (co->waiting > 0)
+    coro_yield();
+}
+
+/* 완료 콜백에서 부른다. 기다리던 깨우기가 모두 왔으면 이어서 실행 */
+void coro_wake(coro *co) {
+  if (--co->waiting == 0 && co != current)
+    coro_resume(co);
+}
+
+/* 타이머 콜백이 끝난 뒤에도 휠이 타이머를 건드리므로 (타이머가 코루틴
+ * 스택에 있다) 바로 잇지 않고 루프가 coro_run_ready()에서 잇는다 */
+static void sleep_done(tw_timer *t) {
+  coro *co = t->arg;
+
+  co->next = NULL;
+  if (ready_tail)
+    ready_tail->next = co;
+  else
+    ready_head = co;
+  ready_tail = co;
+}
+
+/* ms 동안 멈춘다. 그 사이에 루프는 다른 연결을 처리한다 */
+void coro_sleep(int ms) {
+  tw_timer t;
+
+  timer_init(&t, sleep_done, current);
+  timer_add(&t, ms);
+  coro_wait(1);
+}
+
+/* 타이머가 깨운 코루틴을 잇는다. 반환값: 이은 수 */
+int coro_run_ready(void) {
+  coro *co;
+  int n = 0;
+
+  while ((co = ready_head)) {
+    if (!(ready_head = co->next))
+      ready_tail = NULL;
+    coro_wake(co);
+    n++;
+  }
+  return n;
+}
+
+/* 코루틴 하나가 차지하는 메모리 (스택 + coro) */
+size_t coro_frame_size(void) {
+  return CORO_STACK_SIZE;
+}
@@ -0,0 +1,20 @@
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include "csapp.h"
+
+#define CORO_STACK_SIZE (64 * 1024)  // 코루틴 하나의 스택 (guard 페이지와 coro 포함)
+#define CORO_MAX_IDLE   256          // 재사용하려고 남겨둘 최대 빈 스택 수
+
+typedef struct coro coro;
+
+coro *coro_new(void (*fn)(void *arg), void *arg);
+void coro_resume(coro *co);
+coro *coro_self(void);
+void coro_wait(int n);
+void coro_wake(coro *co);
+void coro_sleep(int ms);
+int coro_run_ready(void);
+size_t coro_frame_size(void);
+
+#endif /* __CORO_H__ */
@@ -792,6 +792,37 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_writev - Robustly write all the bytes described by an iovec array
+ *    (unbuffered). Partial writes advance through the array in place, so
+ *    the caller's iov is clobbered.
+ */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t nwritten;
+
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt)) <= 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		continue;        /* and call writev() again */
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	total += nwritten;
+	while (iovcnt > 0 && nwritten >= iov->iov_len) {
+	    nwritten -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt > 0) {
+	    iov->iov_base = (char *)iov->iov_base + nwritten;
+	    iov->iov_len -= nwritten;
+	}
+    }
+    return total;
+}
+
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -893,6 +924,16 @@ ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
 }
 /* $end rio_readlineb */
 
+/*
+ * rio_readsomeb - Read whatever is available, at most n bytes (buffered).
+ *    Unlike rio_readnb, returns as soon as one read() delivers data, so
+ *    it never blocks waiting for bytes the peer hasn't sent yet.
+ */
+ssize_t rio_readsomeb(rio_t *rp, void *usrbuf, size_t n)
+{
+    return rio_read(rp, usrbuf, n);
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -911,6 +952,12 @@ void Rio_writen(int fd, void *usrbuf, size_t n)
 	unix_error("Rio_writen error");
 }
 
+void Rio_writev(int fd, struct iovec *iov, int iovcnt) 
+{
+    if (rio_writev(fd, iov, iovcnt) < 0)
+	unix_error("Rio_writev error");
+}
+
 void Rio_readinitb(rio_t *rp, int fd)
 {
     rio_readinitb(rp, fd);
@@ -0,0 +1,254 @@
+/*
+ * dial.c - 입출력 엔진 위에서 원 서버에 연결한다. 주소를 늘어놓고
+ *     엇갈려 시작하는 것은 happy.c가 하고, 여기서는 he_pollfds() 대신
+ *     진행 중인 소켓마다 엔진에 writable을 맡기고, he_timeout()을 타이머
+ *     휠에 걸어 때가 되면 he_step()을 부른다. 그래서 상태 기계(evproxy.c)와
+ *     코루틴(coproxy.c)도 스레드의 connect_once()처럼 다음 주소를 동시에
+ *     시도하고, 한 주소가 마감 시간까지 답하지 않아도 다른 주소로 넘어간다.
+ *     이긴 소켓으로는 요청 헤더까지 보낸다.
+ *
+ *     주소가 하나면 경주할 상대가 없으므로 he_*를 거치지 않고 엔진의
+ *     connect_send에 연결과 send를 묶어 맡긴다 (io_uring은 CONNECT와 SEND를
+ *     IOSQE_IO_LINK로 묶어 SQE 두 개를 한 번에 낸다). 주소가 여럿이면
+ *     묶지 않는다: 시도마다 send를 묶어 두면 둘 다 연결될 때 원 서버가
+ *     요청을 두 번 받는다.
+ *
+ *     연결 시도 하나가 io_req를 주소 수만큼 가지므로 연결하는 동안만
+ *     풀에서 빌린다. 이벤트 루프 스레드 하나에서만 쓴다.
+ */
+#include "dial.h"
+#include "mempool.h"
+
+static io_engine *io;
+static mem_pool dial_pool;
+static dial *ready_head, *ready_tail;  // 타이머가 깨운 시도
+
+static void dial_poll_done(io_req *req, int res);
+static void dial_connect_done(io_req *req, int res);
+static void dial_send_done(io_req *req, int res);
+
+/* engine으로 연결을 시도한다 (ev_init, co_proxy_init에서 호출) */
+void dial_init(io_engine *engine) {
+  io = engine;
+  pool_init(&dial_pool, sizeof(dial), 16);
+}
+
+/* 연결 시도 하나를 빌린다. 반환값: 시도, 메모리가 없으면 NULL */
+dial *dial_get(void) {
+  return pool_get(&dial_pool);
+}
+
+/* 끝난 (done이 불린) 시도를 반납한다 */
+void dial_put(dial *d) {
+  pool_put(&dial_pool, d);
+}
+
+/* 새로 시작한 주소를 엔진에 맡기고 다음에 he_step을 부를 시각을 건다 */
+static void dial_arm(dial *d) {
+  int i, ms;
+
+  for (i = 0; i < d->he.naddrs; i++) {
+    if (d->he.fds[i] >= 0 && !(d->polling & (1u << i))) {
+      d->polling |= 1u << i;
+      d->polls[i].done = dial_poll_done;
+      d->polls[i].arg = d;
+      io_stat.syscalls += 2;      // he_*가 부른 socket, connect
+      io->writable(&d->polls[i], d->he.fds[i]);
+    }
+  }
+  if ((ms = he_timeout(&d->he)) >= 0)
+    timer_add(&d->timer, ms);
+}
+
+/*
+ * dial_finish - 끝났고 엔진에 맡긴 것이 모두 돌아왔으면 done을 부른다.
+ *     실패했으면 연결된 소켓을 닫는다. done 뒤에는 d를 건드리지 않는다
+ *     (done이 반납할 수 있음).
+ */
+static void dial_finish(dial *d) {
+  if (!d->rc || d->polling)
+    return;
+  timer_cancel(&d->timer);
+  if (d->rc < 0 && d->he.fd >= 0) {
+    io->forget(d->he.fd);
+    io_stat.syscalls++;
+    close(d->he.fd);
+    d->he.fd = -1;
+  }
+  d->done(d, d->rc);
+}
+
+/* 연결된 he.fd로 요청 헤더를 보낸다. 마감 시간은 보내는 동안에도 건다 */
+static void dial_send(dial *d) {
+  long long ms = d->he.deadline - timer_now();
+
+  d->connected = 1;
+  d->polling |= DIAL_SEND;
+  d->send.done = dial_send_done;
+  d->send.arg = d;
+  io->send(&d->send, d->he.fd, &d->iov, 1);
+  if (d->he.deadline)
+    timer_add(&d->timer, ms > 0 ? ms : 0);
+}
+
+/*
+ * dial_update - he_*의 결과 rc를 반영한다. 끝났으면 타이머와 아직 걸린
+ *     writable을 거두고 (he_*가 이미 소켓을 닫았어도 엔진이 요청을
+ *     돌려줘야 함), 연결되었으면 요청 헤더를 보낸다.
+ */
+static void dial_update(dial *d, int rc) {
+  int i;
+
+  if (!d->rc && !d->connected && rc) {
+    timer_cancel(&d->timer);
+    for (i = 0; i < HE_MAX_ADDRS; i++)
+      if (d->polling & (1u << i))
+        io->cancel(&d->polls[i]);
+    if (rc > 0)
+      dial_send(d);
+    else
+      d->rc = rc;
+  }
+  if (!d->rc && !d->connected)
+    dial_arm(d);
+  dial_finish(d);
+}
+
+static void dial_poll_done(io_req *req, int res) {
+  dial *d = req->arg;
+  struct pollfd pfd;
+
+  d->polling &= ~(1u << (req - d->polls));
+  if (d->rc || d->connected) {    // 이미 끝났거나 다른 주소로 연결됨: 거둔 요청이 돌아옴
+    dial_finish(d);
+    return;
+  }
+  if (res < 0) {                  // 엔진이 기다리지 못함 (연결 결과를 알 수 없음)
+    he_abort(&d->he);
+    d->he.error = -res;
+    dial_update(d, -1);
+    return;
+  }
+  pfd.fd = req->fd;
+  pfd.events = POLLOUT;
+  pfd.revents = res;
+  io_stat.syscalls++;             // he_step의 getsockopt
+  dial_update(d, he_step(&d->he, &pfd, 1));
+}
+
+/* 묶어 맡긴 connect가 끝남. 실패했으면 send는 -ECANCELED로 돌아온다 */
+static void dial_connect_done(io_req *req, int res) {
+  dial *d = req->arg;
+
+  d->polling &= ~1u;
+  if (res == 0) {
+    d->connected = 1;
+  } else if (!d->rc) {
+    d->rc = -1;
+    d->he.error = -res;
+  }
+  dial_finish(d);
+}
+
+static void dial_send_done(io_req *req, int res) {
+  dial *d = req->arg;
+
+  d->polling &= ~DIAL_SEND;
+  if (!d->rc && res < 0) {
+    d->rc = -1;
+    d->he.error = -res;
+  } else if (!d->rc) {
+    d->rc = 1;
+  }
+  dial_finish(d);
+}
+
+/* 맡긴 connect와 send를 거두고 ETIMEDOUT으로 끝낸다 */
+static void dial_expire(dial *d) {
+  d->rc = -1;
+  d->he.error = ETIMEDOUT;
+  if (d->polling & 1u)
+    io->cancel(&d->polls[0]);
+  if (d->polling & DIAL_SEND)
+    io->cancel(&d->send);
+  dial_finish(d);
+}
+
+/* 주소 ai 하나로 연결한다. 엔진에 connect와 send를 묶어 맡긴다 */
+static int dial_linked(dial *d, struct addrinfo *ai, int timeout_ms) {
+  d->he.naddrs = 0;
+  d->he.error = 0;
+  io_stat.syscalls++;             // socket
+  if ((d->he.fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+    d->he.error = errno;
+    return d->rc = -1;
+  }
+  d->linked = 1;
+  d->polling = 1u | DIAL_SEND;
+  d->polls[0].done = dial_connect_done;
+  d->polls[0].arg = d;
+  d->send.done = dial_send_done;
+  d->send.arg = d;
+  io->connect_send(&d->polls[0], &d->send, d->he.fd, ai->ai_addr, ai->ai_addrlen, &d->iov, 1);
+  if (timeout_ms > 0)
+    timer_add(&d->timer, timeout_ms);
+  return 0;
+}
+
+/* 타이머 콜백이 끝난 뒤에도 휠이 타이머를 건드리므로 (done이 d를 반납할
+ * 수 있다) 여기서 he_step을 부르지 않고 루프가 dial_run_ready()에서 부른다 */
+static void dial_tick(tw_timer *t) {
+  dial *d = t->arg;
+
+  d->next = NULL;
+  if (ready_tail)
+    ready_tail->next = d;
+  else
+    ready_head = d;
+  ready_tail = d;
+}
+
+/*
+ * dial_start - list의 주소로 연결을 시작하고, 연결되면 iov(요청 헤더)를
+ *     보낸다. list와 iov는 바로 해제해도 되지만 iov가 가리키는 바이트는
+ *     done까지 그대로 둔다. timeout_ms가 0이면 마감 시간 없음.
+ *
+ *     반환값: 바로 실패하면 -1 (d->he.error), 아니면 0이고 끝나면
+ *     done(d, rc)가 불린다 (rc는 d->rc와 같음)
+ */
+int dial_start(dial *d, struct addrinfo *list, int timeout_ms, struct iovec *iov,
+               dial_done_fn done, void *arg) {
+  d->polling = d->linked = d->connected = d->rc = 0;
+  d->iov = *iov;
+  d->done = done;
+  d->arg = arg;
+  timer_init(&d->timer, dial_tick, d);
+  if (list && !list->ai_next)     // 주소가 하나: 경주할 상대가 없음
+    return dial_linked(d, list, timeout_ms);
+  if ((d->rc = he_start(&d->he, list, timeout_ms)) < 0)
+    return -1;
+  if (d->rc == 0) {
+    dial_arm(d);
+  } else {
+    d->rc = 0;
+    dial_send(d);
+  }
+  return 0;
+}
+
+/* 타이머가 깨운 시도의 he_step을 부른다 (엔진의 wait 전에). 반환값: 처리한 수 */
+int dial_run_ready(void) {
+  dial *d;
+  int n = 0;
+
+  while ((d = ready_head)) {
+    if (!(ready_head = d->next))
+      ready_tail = NULL;
+    if (!d->rc && (d->linked || d->connected))
+      dial_expire(d);             // 묶은 connect나 요청 헤더의 send가 마감 시간을 넘김
+    else if (!d->rc)
+      dial_update(d, he_step(&d->he, NULL, 0));
+    n++;
+  }
+  return n;
+}
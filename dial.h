@@ -0,0 +1,42 @@
+#ifndef __DIAL_H__
+#define __DIAL_H__
+
+#include "ioengine.h"
+#include "happy.h"
+#include "timer.h"
+
+typedef struct dial dial;
+typedef void (*dial_done_fn)(dial *d, int rc);
+
+#define DIAL_SEND (1u << HE_MAX_ADDRS)  // polling에서 send의 자리
+
+/*
+ * 입출력 엔진 위의 원 서버 연결 시도 (Happy Eyeballs). he_*가 연 소켓마다
+ * 엔진의 writable을 걸고, 다음 주소를 시작할 시각과 마감 시간은 타이머
+ * 휠에 건다. 연결되면 요청 헤더(iov)까지 보내고 done(d, rc)가 한 번
+ * 불린다. 주소가 하나면 경주할 상대가 없으므로 엔진의 connect_send로
+ * 연결과 send를 묶어 맡긴다.
+ */
+struct dial {
+  he_connect he;
+  io_req polls[HE_MAX_ADDRS];   // he.fds[i]가 쓰기 가능해지기를 기다림 (묶었으면 polls[0]이 connect)
+  io_req send;                  // 연결된 소켓으로 요청 헤더를 보냄
+  struct iovec iov;             // 보낼 요청 헤더
+  unsigned polling;             // 엔진에 맡긴 요청 (polls는 1 << i, send는 DIAL_SEND)
+  int linked;                   // connect와 send를 묶어 맡김 (주소가 하나일 때)
+  int connected;                // 연결은 되었음 (rc가 -1이면 요청을 보내다 실패)
+  int rc;                       // 보냈으면 1 (he.fd), 실패하면 -1 (he.error), 진행 중이면 0
+  tw_timer timer;               // he_timeout()
+  dial_done_fn done;
+  void *arg;
+  dial *next;                   // 타이머가 깨운 시도 목록
+};
+
+void dial_init(io_engine *engine);
+dial *dial_get(void);
+void dial_put(dial *d);
+int dial_start(dial *d, struct addrinfo *list, int timeout_ms, struct iovec *iov,
+               dial_done_fn done, void *arg);
+int dial_run_ready(void);
+
+#endif /* __DIAL_H__ */
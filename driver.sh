@@ -14,6 +14,18 @@
 MAX_BASIC=40
 MAX_CONCURRENCY=15
 MAX_CACHE=15
+MAX_CHUNKED=15
+MAX_TIMEOUT=10
+MAX_ENGINE=10
+MAX_TUNNEL=10
+MAX_METHODS=15
+MAX_REVERSE=15
+MAX_ADMIN=10
+MAX_RELOAD=10
+MAX_UPGRADE=10
+MAX_PREFORK=10
+MAX_ADMISSION=10
+MAX_COMPRESS=10
 
 # Various constants
 HOME_DIR=`pwd`
@@ -37,6 +49,30 @@ CACHE_LIST="tiny.c
             home.html
             csapp.c"
 
+# List of files for the I/O engine test (the last one is fetched twice,
+# so the second copy comes from the cache)
+ENGINE_LIST="home.html
+             godzilla.jpg
+             home.html"
+
+# List of text and binary files for the CONNECT tunnel test
+TUNNEL_LIST="home.html
+             godzilla.jpg"
+
+# List of files for the reverse proxy test with -R
+REVERSE_LIST="home.html
+              csapp.c
+              godzilla.jpg
+              tiny"
+
+# List of text and binary files for the chunked test
+CHUNKED_LIST="home.html
+              csapp.c
+              godzilla.jpg"
+
+# The file we send as a request body in the methods test
+BODY_FILE="godzilla.jpg"
+
 # The file we will fetch for various tests
 FETCH_FILE="home.html"
 
@@ -55,6 +91,18 @@ function download_proxy {
     cd $HOME_DIR
 }
 
+#
+# download_proxy10 - download a file from the origin server via the proxy
+#     using HTTP/1.0
+# usage: download_proxy10 <testdir> <filename> <origin_url> <proxy_url>
+#
+function download_proxy10 {
+    cd $1
+    curl --max-time ${TIMEOUT} --silent --http1.0 --proxy $4 --output $2 $3
+    (( $? == 28 )) && echo "Error: Fetch timed out after ${TIMEOUT} seconds"
+    cd $HOME_DIR
+}
+
 #
 # download_noproxy - download a file directly from the origin server
 # usage: download_noproxy <testdir> <filename> <origin_url>
@@ -66,6 +114,35 @@ function download_noproxy {
     cd $HOME_DIR
 }
 
+#
+# backend_stat - print a reverse proxy server's counter from /metrics
+# usage: backend_stat <proxy_port> <requests_total|failures_total|up> <server_port>
+#
+function backend_stat {
+    curl --max-time ${TIMEOUT} --silent "http://localhost:$1/metrics" \
+        | grep "^proxy_backend_$2{server=\"127.0.0.1:$3\"}" | cut -d' ' -f2
+}
+
+#
+# reverse_get - fetch a path from the reverse proxy with the given Host
+#     header and print the HTTP status
+# usage: reverse_get <proxy_port> <host> <path> <output_file>
+#
+function reverse_get {
+    curl --max-time ${TIMEOUT} --silent --header "Host: $2" --output $4 \
+        --write-out "%{http_code}" "http://localhost:$1$3"
+}
+
+#
+# x_cache - fetch a URL through the proxy into a file and print the
+#     value of the X-Cache header (HIT or MISS)
+# usage: x_cache <proxy_port> <url> <output_file>
+#
+function x_cache {
+    curl --max-time ${TIMEOUT} --silent --dump-header - --output $3 \
+        --proxy "http://localhost:$1" "$2" | grep -i "^X-Cache:" | cut -d' ' -f2 | tr -d '\r'
+}
+
 #
 # clear_dirs - Clear the download directories
 #
@@ -142,7 +219,7 @@ function free_port {
 #
 
 # Kill any stray proxies or tiny servers owned by this user
-killall -q proxy tiny nop-server.py 2> /dev/null
+killall -q proxy tiny nop-server.py chunk-server.py tunnel-client.py 2> /dev/null
 
 # Make sure we have a Tiny directory
 if [ ! -d ./tiny ]
@@ -188,6 +265,20 @@ then
     exit
 fi
 
+# Make sure we have an existing executable chunk-server.py file
+if [ ! -x ./chunk-server.py ]
+then 
+    echo "Error: ./chunk-server.py not found or not an executable file."
+    exit
+fi
+
+# Make sure we have an existing executable tunnel-client.py file
+if [ ! -x ./tunnel-client.py ]
+then 
+    echo "Error: ./tunnel-client.py not found or not an executable file."
+    exit
+fi
+
 # Create the test directories if needed
 if [ ! -d ${PROXY_DIR} ]
 then
@@ -400,9 +491,1220 @@ wait $proxy_pid 2> /dev/null
 
 echo "cacheScore: $cacheScore/${MAX_CACHE}"
 
+#####
+# Chunked
+#
+echo ""
+echo "*** Chunked ***"
+
+# Run the chunking origin stand-in. It serves the tiny files with
+# Transfer-Encoding: chunked and never closes the connection itself.
+chunk_port=$(free_port)
+echo "Starting the chunked origin server on port ${chunk_port}"
+cd ./tiny
+../chunk-server.py ${chunk_port} &> /dev/null &
+chunk_pid=$!
+cd ${HOME_DIR}
+
+# Wait for the chunk server to start in earnest
+wait_for_port_use "${chunk_port}"
+
+# Run the proxy
+proxy_port=$(free_port)
+echo "Starting proxy on port ${proxy_port}"
+./proxy ${proxy_port} &> /dev/null &
+proxy_pid=$!
+
+# Wait for the proxy to start in earnest
+wait_for_port_use "${proxy_port}"
+
+# Fetch each file through the proxy with HTTP/1.1 (re-chunked) and
+# HTTP/1.0 (de-chunked), and compare both with the original
+numRun=0
+numSucceeded=0
+for file in ${CHUNKED_LIST}
+do
+    numRun=`expr $numRun + 2`
+    echo "${file}"
+    clear_dirs
+    echo "   Fetching ./tiny/${file} into ${PROXY_DIR} using HTTP/1.1"
+    download_proxy $PROXY_DIR ${file} "http://localhost:${chunk_port}/${file}" "http://localhost:${proxy_port}"
+    echo "   Fetching ./tiny/${file} into ${NOPROXY_DIR} using HTTP/1.0"
+    download_proxy10 $NOPROXY_DIR ${file} "http://localhost:${chunk_port}/${file}" "http://localhost:${proxy_port}"
+    for dir in ${PROXY_DIR} ${NOPROXY_DIR}
+    do
+        diff -q ./tiny/${file} ${dir}/${file} &> /dev/null
+        if [ $? -eq 0 ]; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: ${dir}/${file} is identical."
+        else
+            echo "   Failure: ${dir}/${file} differs."
+        fi
+    done
+done
+
+# Kill the chunk server and fetch the de-chunked copy from the cache
+echo "Killing the chunked origin server"
+kill $chunk_pid 2> /dev/null
+wait $chunk_pid 2> /dev/null
+
+numRun=`expr $numRun + 1`
+clear_dirs
+echo "Fetching a cached copy of ./tiny/${FETCH_FILE} into ${NOPROXY_DIR}"
+download_proxy $NOPROXY_DIR ${FETCH_FILE} "http://localhost:${chunk_port}/${FETCH_FILE}" "http://localhost:${proxy_port}"
+diff -q ./tiny/${FETCH_FILE} ${NOPROXY_DIR}/${FETCH_FILE}  &> /dev/null
+if [ $? -eq 0 ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "Success: Was able to fetch tiny/${FETCH_FILE} from the cache."
+else
+    echo "Failure: Was not able to fetch tiny/${FETCH_FILE} from the proxy cache."
+fi
+
+# Kill the proxy
+echo "Killing proxy"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+
+chunkedScore=`expr ${MAX_CHUNKED} \* ${numSucceeded} / ${numRun}`
+echo "chunkedScore: $chunkedScore/${MAX_CHUNKED}"
+
+#####
+# Timeout
+#
+echo ""
+echo "*** Timeout ***"
+
+# Run the blocking nop-server as an origin that never answers
+nop_port=$(free_port)
+echo "Starting the blocking NOP server on port ${nop_port}"
+./nop-server.py ${nop_port} &> /dev/null &
+nop_pid=$!
+
+# Wait for the nop server to start in earnest
+wait_for_port_use "${nop_port}"
+
+# Run the proxy with 1 second header, connect, first byte and idle timeouts
+proxy_port=$(free_port)
+echo "Starting proxy on port ${proxy_port} with 1 second timeouts"
+./proxy -T 1000,1000,1000,1000 ${proxy_port} &> /dev/null &
+proxy_pid=$!
+
+# Wait for the proxy to start in earnest
+wait_for_port_use "${proxy_port}"
+
+numRun=0
+numSucceeded=0
+
+# A stalled origin must get a 504 well before the client gives up
+numRun=`expr $numRun + 1`
+echo "Fetching from the blocking nop-server through the proxy"
+status=`curl --max-time ${TIMEOUT} --silent --output /dev/null --write-out "%{http_code}" \
+        --proxy "http://localhost:${proxy_port}" "http://localhost:${nop_port}/nop-file.txt"`
+if [ "${status}" = "504" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: The proxy answered 504 for the stalled origin."
+else
+    echo "   Failure: Expected 504 from the proxy, got '${status}'."
+fi
+
+# A client that never finishes its request header must get a 408
+numRun=`expr $numRun + 1`
+echo "Sending an unfinished request header to the proxy"
+status=`timeout ${TIMEOUT} bash -c "exec 3<>/dev/tcp/localhost/${proxy_port};
+        printf 'GET http://localhost:${nop_port}/ HTTP/1.0\r\n' >&3; head -1 <&3"`
+if echo "${status}" | grep -q " 408 "; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: The proxy answered 408 for the slow client."
+else
+    echo "   Failure: Expected 408 from the proxy, got '${status}'."
+fi
+
+# Clean up
+echo "Killing proxy and nop-server"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+kill $nop_pid 2> /dev/null
+wait $nop_pid 2> /dev/null
+
+timeoutScore=`expr ${MAX_TIMEOUT} \* ${numSucceeded} / ${numRun}`
+echo "timeoutScore: $timeoutScore/${MAX_TIMEOUT}"
+
+#####
+# Engine
+#
+echo ""
+echo "*** Engine ***"
+
+# Run the Tiny Web server
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+
+# Wait for tiny to start in earnest
+wait_for_port_use "${tiny_port}"
+
+numRun=0
+numSucceeded=0
+for mode in "-E epoll" "-E uring" "-C -E epoll" "-C -E uring"
+do
+    # Run the proxy on the event loop instead of one thread per connection,
+    # as a state machine or with one coroutine per connection (-C)
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} with ${mode}"
+    ./proxy ${mode} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    for file in ${ENGINE_LIST}
+    do
+        numRun=`expr $numRun + 1`
+        echo "${numRun}: ${file}"
+        clear_dirs
+        download_proxy $PROXY_DIR ${file} "http://localhost:${tiny_port}/${file}" "http://localhost:${proxy_port}"
+        download_noproxy $NOPROXY_DIR ${file} "http://localhost:${tiny_port}/${file}"
+        diff -q ${PROXY_DIR}/${file} ${NOPROXY_DIR}/${file} &> /dev/null
+        if [ $? -eq 0 ]; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: Files are identical."
+        else
+            echo "   Failure: Files differ."
+        fi
+    done
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+echo "Killing tiny"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+
+engineScore=`expr ${MAX_ENGINE} \* ${numSucceeded} / ${numRun}`
+echo "engineScore: $engineScore/${MAX_ENGINE}"
+
+#####
+# Tunnel
+#
+echo ""
+echo "*** Tunnel ***"
+
+# Run the Tiny Web server
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+
+# Wait for tiny to start in earnest
+wait_for_port_use "${tiny_port}"
+
+# CONNECT is only allowed to port 443 by default
+tunnel_conf=`mktemp`
+echo "connect_ports *" > ${tunnel_conf}
+
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll" "-E uring" "-C -E epoll" "-C -E uring"
+do
+    # Run the proxy with one thread per connection (splice) and on the
+    # event loop, as a state machine or with one coroutine per connection
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads}"
+    ./proxy ${mode} -f ${tunnel_conf} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    # The request goes client -> tiny and the file comes back tiny -> client
+    # after the client has closed its write half; the client only stops
+    # reading when tiny's close comes through the tunnel
+    for file in ${TUNNEL_LIST}
+    do
+        numRun=`expr $numRun + 1`
+        echo "${numRun}: ${file}"
+        clear_dirs
+        timeout ${TIMEOUT} ./tunnel-client.py ${proxy_port} ${tiny_port} ${file} > ${PROXY_DIR}/${file}
+        if [ $? -eq 0 ] && diff -q ./tiny/${file} ${PROXY_DIR}/${file} &> /dev/null; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: The tunneled file is identical and both sides closed."
+        else
+            echo "   Failure: The tunnel did not carry ${file} through to the close."
+        fi
+    done
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+echo "Killing tiny"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+rm -f ${tunnel_conf}
+
+tunnelScore=`expr ${MAX_TUNNEL} \* ${numSucceeded} / ${numRun}`
+echo "tunnelScore: $tunnelScore/${MAX_TUNNEL}"
+
+#####
+# Methods
+#
+echo ""
+echo "*** Methods ***"
+
+# Run the chunking origin stand-in, which answers POST/PUT/DELETE with the
+# method, length and MD5 of the request body it got, and tiny, whose adder
+# CGI program reads a POST body
+chunk_port=$(free_port)
+echo "Starting the chunked origin server on port ${chunk_port}"
+cd ./tiny
+../chunk-server.py ${chunk_port} &> /dev/null &
+chunk_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${chunk_port}"
+
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny_port}"
+
+body_size=`wc -c < ./tiny/${BODY_FILE} | tr -d ' '`
+body_md5=`md5sum ./tiny/${BODY_FILE} | cut -d' ' -f1`
+
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll" "-C -E epoll"
+do
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads}"
+    ./proxy ${mode} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    # Request bodies must reach the origin byte for byte, whether the
+    # client sends a Content-Length or chunks them
+    for method in POST PUT chunked
+    do
+        numRun=`expr $numRun + 1`
+        if [ "${method}" = "chunked" ]; then
+            echo "Sending ./tiny/${BODY_FILE} as a chunked POST body"
+            out=`curl --max-time ${TIMEOUT} --silent --header "Transfer-Encoding: chunked" \
+                 --data-binary @./tiny/${BODY_FILE} --proxy "http://localhost:${proxy_port}" \
+                 "http://localhost:${chunk_port}/upload"`
+            method=POST
+        else
+            echo "Sending ./tiny/${BODY_FILE} as a ${method} body with Content-Length"
+            out=`curl --max-time ${TIMEOUT} --silent --request ${method} \
+                 --data-binary @./tiny/${BODY_FILE} --proxy "http://localhost:${proxy_port}" \
+                 "http://localhost:${chunk_port}/upload"`
+        fi
+        if [ "${out}" = "${method} ${body_size} ${body_md5}" ]; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: The origin got the whole body."
+        else
+            echo "   Failure: Expected '${method} ${body_size} ${body_md5}', got '${out}'."
+        fi
+    done
+
+    # A CGI program behind tiny reads the POST body from its stdin
+    numRun=`expr $numRun + 1`
+    echo "Posting ./tiny/${BODY_FILE} to tiny's adder"
+    out=`curl --max-time ${TIMEOUT} --silent --data-binary @./tiny/${BODY_FILE} \
+         --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/cgi-bin/adder"`
+    if echo "${out}" | grep -q "Received ${body_size} bytes"; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: adder got all ${body_size} bytes."
+    else
+        echo "   Failure: adder did not get all ${body_size} bytes."
+    fi
+
+    # "Expect: 100-continue": the proxy must answer 100 before the client
+    # sends the body, or the client waits here until the timeout
+    numRun=`expr $numRun + 1`
+    echo "Posting with Expect: 100-continue"
+    out=`timeout ${TIMEOUT} bash -c "exec 3<>/dev/tcp/localhost/${proxy_port};
+         printf 'POST http://localhost:${tiny_port}/cgi-bin/adder HTTP/1.1\r\nHost: localhost:${tiny_port}\r\nContent-Length: 3\r\nExpect: 100-continue\r\nConnection: close\r\n\r\n' >&3;
+         head -1 <&3; printf '1&2' >&3; cat <&3"`
+    if echo "${out}" | head -1 | grep -q " 100 " && echo "${out}" | grep -q "1 + 2 = 3"; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: The proxy sent 100 Continue and relayed the body."
+    else
+        echo "   Failure: No 100 Continue before the body, or no answer after it."
+    fi
+
+    # A successful PUT, POST or DELETE on a cached URI drops it from the
+    # cache, so the next GET goes back to the origin
+    for method in PUT POST DELETE
+    do
+        numRun=`expr $numRun + 1`
+        echo "Checking that ${method} invalidates the cached ./tiny/${FETCH_FILE}"
+        url="http://localhost:${chunk_port}/${FETCH_FILE}"
+        curl --max-time ${TIMEOUT} --silent --output /dev/null --proxy "http://localhost:${proxy_port}" ${url}
+        before=`curl --max-time ${TIMEOUT} --silent --dump-header - --output /dev/null \
+                --proxy "http://localhost:${proxy_port}" ${url} | grep -i "^X-Cache:" | tr -d '\r'`
+        curl --max-time ${TIMEOUT} --silent --output /dev/null --request ${method} --data "x" \
+             --proxy "http://localhost:${proxy_port}" ${url}
+        after=`curl --max-time ${TIMEOUT} --silent --dump-header - --output /dev/null \
+               --proxy "http://localhost:${proxy_port}" ${url} | grep -i "^X-Cache:" | tr -d '\r'`
+        if [ "${before}" = "X-Cache: HIT" ] && [ "${after}" = "X-Cache: MISS" ]; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: HIT before the ${method}, MISS after it."
+        else
+            echo "   Failure: Expected HIT then MISS, got '${before}' then '${after}'."
+        fi
+    done
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+echo "Killing tiny and the chunked origin server"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+kill $chunk_pid 2> /dev/null
+wait $chunk_pid 2> /dev/null
+
+methodsScore=`expr ${MAX_METHODS} \* ${numSucceeded} / ${numRun}`
+echo "methodsScore: $methodsScore/${MAX_METHODS}"
+
+#####
+# Reverse
+#
+echo ""
+echo "*** Reverse ***"
+
+# Run two Tiny Web servers as the backends
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny_port}"
+
+tiny2_port=$(free_port)
+echo "Starting a second tiny on port ${tiny2_port}"
+cd ./tiny
+./tiny ${tiny2_port} &> /dev/null &
+tiny2_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny2_port}"
+
+# Nobody listens on this port until the recovery test
+dead_port=$(free_port)
+
+# Pools and routes. Nothing is cached (max_object 0), so every request
+# reaches a backend and shows up in the per-server counters of /metrics
+reverse_conf=`mktemp`
+cat > ${reverse_conf} <<EOF
+max_object     0
+retries        1
+health_fails   2
+health_down_ms 1500
+upstream       one lor 127.0.0.1:${tiny_port}
+upstream       two lor 127.0.0.1:${tiny2_port}
+upstream       both lor 127.0.0.1:${tiny_port} 127.0.0.1:${tiny2_port}
+upstream       hashed hash 127.0.0.1:${tiny_port} 127.0.0.1:${tiny2_port}
+upstream       flaky lor 127.0.0.1:${dead_port} 127.0.0.1:${tiny_port}
+route          / one
+route          /cgi-bin/ two
+route          vhost.test/ two
+route          other.test/ one
+route          lor.test/ both
+route          hash.test/ hashed
+route          retry.test/ flaky
+EOF
+
+proxy_port=$(free_port)
+echo "Starting proxy on port ${proxy_port} with the reverse proxy routes"
+./proxy -f ${reverse_conf} ${proxy_port} &> /dev/null &
+proxy_pid=$!
+
+# Wait for the proxy to start in earnest
+wait_for_port_use "${proxy_port}"
+
+numRun=0
+numSucceeded=0
+
+# route: "/" catches everything and the longer "/cgi-bin/" wins over it.
+# A rule for the Host wins over both, even with a shorter prefix
+for test in "localhost /${FETCH_FILE} ${tiny_port} catch-all" \
+            "localhost /cgi-bin/adder?1&2 ${tiny2_port} longest-prefix" \
+            "vhost.test /${FETCH_FILE} ${tiny2_port} Host" \
+            "other.test /cgi-bin/adder?1&2 ${tiny_port} Host"
+do
+    set -- ${test}
+    numRun=`expr $numRun + 1`
+    echo "Fetching $2 with Host: $1"
+    before=`backend_stat ${proxy_port} requests_total $3`
+    status=`reverse_get ${proxy_port} $1 $2 /dev/null`
+    after=`backend_stat ${proxy_port} requests_total $3`
+    if [ "${status}" = "200" ] && [ "${after}" = "`expr ${before} + 1`" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: The $4 rule sent it to port $3."
+    else
+        echo "   Failure: Expected the $4 rule to send it to port $3 (status ${status})."
+    fi
+done
+
+# lor: one request at a time, so both servers take turns
+numRun=`expr $numRun + 1`
+echo "Sending 6 requests to the lor pool"
+before1=`backend_stat ${proxy_port} requests_total ${tiny_port}`
+before2=`backend_stat ${proxy_port} requests_total ${tiny2_port}`
+for i in 1 2 3 4 5 6
+do
+    reverse_get ${proxy_port} lor.test "/cgi-bin/adder?${i}&${i}" /dev/null > /dev/null
+done
+got1=`expr $(backend_stat ${proxy_port} requests_total ${tiny_port}) - ${before1}`
+got2=`expr $(backend_stat ${proxy_port} requests_total ${tiny2_port}) - ${before2}`
+if [ "${got1}" = "3" ] && [ "${got2}" = "3" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: Each server got 3."
+else
+    echo "   Failure: Expected 3 and 3, got ${got1} and ${got2}."
+fi
+
+# hash: a URI always goes to the same server, and the URIs are spread
+numRun=`expr $numRun + 1`
+echo "Sending 16 URIs twice each to the hash pool"
+same=0
+used1=0
+used2=0
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16
+do
+    before1=`backend_stat ${proxy_port} requests_total ${tiny_port}`
+    reverse_get ${proxy_port} hash.test "/cgi-bin/adder?${i}&0" /dev/null > /dev/null
+    reverse_get ${proxy_port} hash.test "/cgi-bin/adder?${i}&0" /dev/null > /dev/null
+    got1=`expr $(backend_stat ${proxy_port} requests_total ${tiny_port}) - ${before1}`
+    case ${got1} in
+        0) same=`expr ${same} + 1`; used2=1 ;;
+        2) same=`expr ${same} + 1`; used1=1 ;;
+    esac
+done
+if [ "${same}" = "16" ] && [ "${used1}" = "1" ] && [ "${used2}" = "1" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: Every URI stayed on one server, and both servers were used."
+else
+    echo "   Failure: ${same}/16 URIs stayed on one server (used: ${used1} ${used2})."
+fi
+
+# Retry: a refused connection sent nothing, so the other server answers
+# instead. After health_fails failures in a row the dead server is left out
+numRun=`expr $numRun + 1`
+echo "Sending requests to a pool with a dead server on port ${dead_port}"
+ok=1
+for i in 1 2 3 4 5 6
+do
+    status=`reverse_get ${proxy_port} retry.test /${FETCH_FILE} /dev/null`
+    [ "${status}" = "200" ] || ok=0
+    [ "$(backend_stat ${proxy_port} failures_total ${dead_port})" -ge 2 ] && break
+done
+if [ "${ok}" = "1" ] && [ "$(backend_stat ${proxy_port} failures_total ${dead_port})" = "2" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: Every request was retried on the live server."
+else
+    echo "   Failure: A request failed, or the dead server was not tried."
+fi
+
+numRun=`expr $numRun + 1`
+echo "Checking that the dead server is left out"
+before=`backend_stat ${proxy_port} requests_total ${dead_port}`
+for i in 1 2 3 4
+do
+    reverse_get ${proxy_port} retry.test /${FETCH_FILE} /dev/null > /dev/null
+done
+after=`backend_stat ${proxy_port} requests_total ${dead_port}`
+if [ "$(backend_stat ${proxy_port} up ${dead_port})" = "0" ] && [ "${after}" = "${before}" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: The dead server is down and was not tried."
+else
+    echo "   Failure: The dead server was still tried."
+fi
+
+# Bring the dead server up: after health_down_ms it is tried again, and
+# once it answers it is back in the pool
+numRun=`expr $numRun + 1`
+echo "Starting tiny on port ${dead_port} and waiting out health_down_ms"
+cd ./tiny
+./tiny ${dead_port} &> /dev/null &
+tiny3_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${dead_port}"
+sleep 2
+before=`backend_stat ${proxy_port} requests_total ${dead_port}`
+for i in 1 2 3 4
+do
+    reverse_get ${proxy_port} retry.test /${FETCH_FILE} /dev/null > /dev/null
+done
+after=`backend_stat ${proxy_port} requests_total ${dead_port}`
+if [ "$(backend_stat ${proxy_port} up ${dead_port})" = "1" ] && [ "${after}" -gt "${before}" ] \
+   && [ "$(backend_stat ${proxy_port} failures_total ${dead_port})" = "2" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: The recovered server is back in the pool."
+else
+    echo "   Failure: The recovered server was not used again."
+fi
+
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+kill $tiny3_pid 2> /dev/null
+wait $tiny3_pid 2> /dev/null
+rm -f ${reverse_conf}
+
+# -R: the files come back whole although the first server picked is dead
+dead_port=$(free_port)
+for mode in "" "-E epoll" "-C -E epoll"
+do
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads} -R 127.0.0.1:${dead_port},127.0.0.1:${tiny2_port}"
+    ./proxy ${mode} -R 127.0.0.1:${dead_port},127.0.0.1:${tiny2_port} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    numRun=`expr $numRun + 1`
+    ok=1
+    clear_dirs
+    for file in ${REVERSE_LIST}
+    do
+        echo "   Fetching /${file} into ${PROXY_DIR}"
+        reverse_get ${proxy_port} localhost /${file} ${PROXY_DIR}/${file} > /dev/null
+        diff -q ./tiny/${file} ${PROXY_DIR}/${file} &> /dev/null || ok=0
+    done
+    if [ "${ok}" = "1" ] && [ "$(backend_stat ${proxy_port} failures_total ${dead_port})" -ge 1 ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: Every file is identical after retrying past the dead server."
+    else
+        echo "   Failure: A file differs, or the dead server was never tried."
+    fi
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+echo "Killing tiny"
+kill $tiny_pid $tiny2_pid 2> /dev/null
+wait $tiny_pid $tiny2_pid 2> /dev/null
+
+reverseScore=`expr ${MAX_REVERSE} \* ${numSucceeded} / ${numRun}`
+echo "reverseScore: $reverseScore/${MAX_REVERSE}"
+
+#####
+# Admin
+#
+echo ""
+echo "*** Admin ***"
+
+# Run the Tiny Web server
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+
+# Wait for tiny to start in earnest
+wait_for_port_use "${tiny_port}"
+
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll" "-C -E epoll"
+do
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads}"
+    ./proxy ${mode} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    # Fill the cache, hitting ${FETCH_FILE} twice more
+    for file in ${CACHE_LIST} ${FETCH_FILE} ${FETCH_FILE}
+    do
+        curl --max-time ${TIMEOUT} --silent --output /dev/null \
+             --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${file}"
+    done
+
+    # /cache lists every object by its URI
+    numRun=`expr $numRun + 1`
+    echo "Listing the cache"
+    listing=`curl --max-time ${TIMEOUT} --silent "http://localhost:${proxy_port}/cache"`
+    ok=1
+    echo "${listing}" | grep -q "^objects 3$" || ok=0
+    for file in ${CACHE_LIST}
+    do
+        echo "${listing}" | grep -q " http://localhost:${tiny_port}/${file}$" || ok=0
+    done
+    if [ "${ok}" = "1" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: All 3 objects are listed."
+    else
+        echo "   Failure: The listing does not show the 3 cached objects."
+    fi
+
+    # /cache?top=1&by=hits shows only the most hit object
+    numRun=`expr $numRun + 1`
+    echo "Listing the most hit object"
+    top=`curl --max-time ${TIMEOUT} --silent "http://localhost:${proxy_port}/cache?top=1&by=hits" \
+         | grep "http://" | tr -s ' ' | cut -d' ' -f3,6`
+    if [ "${top}" = "2 http://localhost:${tiny_port}/${FETCH_FILE}" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: ${FETCH_FILE} is on top with 2 hits."
+    else
+        echo "   Failure: Expected '2 http://localhost:${tiny_port}/${FETCH_FILE}', got '${top}'."
+    fi
+
+    # PURGE <URI> drops one object: 200 the first time, 404 once it is gone,
+    # and the next GET goes back to tiny
+    numRun=`expr $numRun + 1`
+    echo "Purging ${FETCH_FILE}"
+    url="http://localhost:${tiny_port}/${FETCH_FILE}"
+    first=`curl --max-time ${TIMEOUT} --silent --request PURGE --write-out "%{http_code}" \
+           --proxy "http://localhost:${proxy_port}" ${url} | tr '\n' ' '`
+    second=`curl --max-time ${TIMEOUT} --silent --request PURGE --write-out "%{http_code}" \
+            --proxy "http://localhost:${proxy_port}" ${url} | tr '\n' ' '`
+    cached=`curl --max-time ${TIMEOUT} --silent --dump-header - --output /dev/null \
+            --proxy "http://localhost:${proxy_port}" ${url} | grep -i "^X-Cache:" | tr -d '\r'`
+    if [ "${first}" = "purged 1 200" ] && [ "${second}" = "purged 0 404" ] \
+       && [ "${cached}" = "X-Cache: MISS" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: Purged once, then 404, then fetched from tiny again."
+    else
+        echo "   Failure: Got '${first}', '${second}', then '${cached}'."
+    fi
+
+    # PURGE <prefix>* drops everything under it
+    numRun=`expr $numRun + 1`
+    echo "Purging http://localhost:${tiny_port}/*"
+    out=`curl --max-time ${TIMEOUT} --silent --request PURGE --write-out "%{http_code}" \
+         --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/*" | tr '\n' ' '`
+    objects=`curl --max-time ${TIMEOUT} --silent "http://localhost:${proxy_port}/cache" | grep "^objects"`
+    if [ "${out}" = "purged 3 200" ] && [ "${objects}" = "objects 0" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: The prefix purge emptied the cache."
+    else
+        echo "   Failure: Got '${out}' and '${objects}'."
+    fi
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+echo "Killing tiny"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+
+adminScore=`expr ${MAX_ADMIN} \* ${numSucceeded} / ${numRun}`
+echo "adminScore: $adminScore/${MAX_ADMIN}"
+
+#####
+# Reload
+#
+echo ""
+echo "*** Reload ***"
+
+# Run the Tiny Web server
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+
+# Wait for tiny to start in earnest
+wait_for_port_use "${tiny_port}"
+
+reload_conf=`mktemp`
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll" "-C -E epoll"
+do
+    echo "via alpha" > ${reload_conf}
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads} -f ${reload_conf}"
+    ./proxy ${mode} -f ${reload_conf} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    # Each step fetches a file that is not cached yet, so the Via header
+    # comes from the config the proxy has right now
+    i=0
+    for step in "via alpha|start|alpha" \
+                "via beta|a new via|beta" \
+                "via beta,cache_size 0|cache_size 0|beta" \
+                "no_such_key 1|a broken file|beta"
+    do
+        conf=`echo "${step}" | cut -d'|' -f1`
+        what=`echo "${step}" | cut -d'|' -f2`
+        expect=`echo "${step}" | cut -d'|' -f3`
+        file=`echo ${CACHE_LIST} | cut -d' ' -f$((i % 3 + 1))`
+        i=`expr $i + 1`
+        numRun=`expr $numRun + 1`
+        if [ "${what}" != "start" ]; then
+            echo "${conf}" | tr ',' '\n' > ${reload_conf}
+            echo "Reloading with ${what}"
+            kill -HUP $proxy_pid
+            sleep 1
+        fi
+        via=`curl --max-time ${TIMEOUT} --silent --dump-header - --output /dev/null \
+             --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${file}" \
+             | grep -i "^Via:" | tr -d '\r'`
+        ok=1
+        [ "${via}" = "Via: 1.0 ${expect}" ] || ok=0
+        if [ "${what}" = "cache_size 0" ]; then
+            # Shrinking the cache evicts right away
+            curl --max-time ${TIMEOUT} --silent "http://localhost:${proxy_port}/cache" \
+                | grep -q "^objects 0$" || ok=0
+        fi
+        if [ "${ok}" = "1" ]; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: ${what}: '${via}'."
+        else
+            echo "   Failure: ${what}: expected 'Via: 1.0 ${expect}', got '${via}'."
+        fi
+    done
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+rm -f ${reload_conf}
+
+echo "Killing tiny"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+
+reloadScore=`expr ${MAX_RELOAD} \* ${numSucceeded} / ${numRun}`
+echo "reloadScore: $reloadScore/${MAX_RELOAD}"
+
+#####
+# Upgrade
+#
+echo ""
+echo "*** Upgrade ***"
+
+# Run the blocking nop-server as an origin that never answers, so a
+# request is still in flight when the old proxy hands over
+nop_port=$(free_port)
+echo "Starting the blocking NOP server on port ${nop_port}"
+./nop-server.py ${nop_port} &> /dev/null &
+nop_pid=$!
+
+# Wait for the nop server to start in earnest
+wait_for_port_use "${nop_port}"
+
+upgrade_sock=`mktemp -u`
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll" "-C -E epoll"
+do
+    # Run the Tiny Web server
+    tiny_port=$(free_port)
+    echo "Starting tiny on port ${tiny_port}"
+    cd ./tiny
+    ./tiny ${tiny_port} &> /dev/null &
+    tiny_pid=$!
+    cd ${HOME_DIR}
+    wait_for_port_use "${tiny_port}"
+
+    # The first byte timeout answers the stalled request 2 seconds in
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads} -u ${upgrade_sock}"
+    ./proxy ${mode} -T 10000,5000,2000,60000 -u ${upgrade_sock} ${proxy_port} &> /dev/null &
+    old_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    # Fill the cache of the old proxy
+    for file in ${CACHE_LIST}
+    do
+        curl --max-time ${TIMEOUT} --silent --output /dev/null \
+             --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${file}"
+    done
+
+    # One request in flight, and a client that keeps fetching while the
+    # new proxy takes over
+    clear_dirs
+    curl --max-time ${TIMEOUT} --silent --output /dev/null --write-out "%{http_code}\n" \
+         --proxy "http://localhost:${proxy_port}" "http://localhost:${nop_port}/nop-file.txt" \
+         > ${PROXY_DIR}/inflight &
+    inflight_pid=$!
+    sleep 0.5
+    for i in `seq 30`
+    do
+        curl --max-time ${TIMEOUT} --silent --output /dev/null --write-out "%{http_code}\n" \
+             --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${FETCH_FILE}"
+        sleep 0.05
+    done > ${NOPROXY_DIR}/statuses &
+    client_pid=$!
+
+    echo "Starting a new proxy with -u ${upgrade_sock}"
+    ./proxy ${mode} -T 10000,5000,2000,60000 -u ${upgrade_sock} ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+    for i in `seq 50`
+    do
+        kill -0 $old_pid 2> /dev/null || break
+        sleep 0.1
+    done
+    wait $inflight_pid $client_pid 2> /dev/null
+
+    # The old proxy answers its stalled request itself, then exits
+    numRun=`expr $numRun + 1`
+    if ! kill -0 $old_pid 2> /dev/null && [ "`cat ${PROXY_DIR}/inflight`" = "504" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: The old proxy answered its request in flight and exited."
+    else
+        echo "   Failure: The old proxy did not drain ('`cat ${PROXY_DIR}/inflight`')."
+        kill $old_pid 2> /dev/null
+    fi
+    wait $old_pid 2> /dev/null
+
+    # Not one connection is refused while the listener moves
+    numRun=`expr $numRun + 1`
+    if [ "`sort -u ${NOPROXY_DIR}/statuses`" = "200" ] && [ "`wc -l < ${NOPROXY_DIR}/statuses`" = "30" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: All 30 requests during the handoff got 200."
+    else
+        echo "   Failure: Some requests during the handoff failed."
+    fi
+
+    # The new proxy has the cache: every file comes back with tiny gone
+    echo "Killing tiny"
+    kill $tiny_pid 2> /dev/null
+    wait $tiny_pid 2> /dev/null
+    numRun=`expr $numRun + 1`
+    ok=1
+    clear_dirs
+    for file in ${CACHE_LIST}
+    do
+        download_proxy $PROXY_DIR ${file} "http://localhost:${tiny_port}/${file}" "http://localhost:${proxy_port}"
+        diff -q ./tiny/${file} ${PROXY_DIR}/${file} &> /dev/null || ok=0
+    done
+    if [ "${ok}" = "1" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: The new proxy served every file from the handed-over cache."
+    else
+        echo "   Failure: The new proxy did not get the cache."
+    fi
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+rm -f ${upgrade_sock}
+
+echo "Killing nop-server"
+kill $nop_pid 2> /dev/null
+wait $nop_pid 2> /dev/null
+
+upgradeScore=`expr ${MAX_UPGRADE} \* ${numSucceeded} / ${numRun}`
+echo "upgradeScore: $upgradeScore/${MAX_UPGRADE}"
+
+#####
+# Prefork
+#
+echo ""
+echo "*** Prefork ***"
+
+# Run the Tiny Web server
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+
+# Wait for tiny to start in earnest
+wait_for_port_use "${tiny_port}"
+
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll" "-C -E epoll"
+do
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads} -p 2"
+    ./proxy ${mode} -p 2 ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+    sleep 1
+
+    # Both workers accept on the same socket. Stopping one makes the
+    # other take every connection, so we know which worker answers
+    workers=`pgrep -P ${proxy_pid} | tr '\n' ' '`
+    worker1=`echo ${workers} | cut -d' ' -f1`
+    worker2=`echo ${workers} | cut -d' ' -f2`
+    echo "Workers: ${workers}"
+
+    # Worker 1 fills the shared cache, worker 2 hits it
+    numRun=`expr $numRun + 1`
+    ok=1
+    clear_dirs
+    kill -STOP ${worker2}
+    for file in ${CACHE_LIST}
+    do
+        status=`x_cache ${proxy_port} "http://localhost:${tiny_port}/${file}" ${NOPROXY_DIR}/${file}`
+        [ "${status}" = "MISS" ] || ok=0
+    done
+    kill -CONT ${worker2}
+    kill -STOP ${worker1}
+    for file in ${CACHE_LIST}
+    do
+        status=`x_cache ${proxy_port} "http://localhost:${tiny_port}/${file}" ${PROXY_DIR}/${file}`
+        [ "${status}" = "HIT" ] || ok=0
+        diff -q ./tiny/${file} ${PROXY_DIR}/${file} &> /dev/null || ok=0
+    done
+    if [ "${worker1}" != "${worker2}" ] && [ "${ok}" = "1" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: Worker ${worker2} hit every object worker ${worker1} filled."
+    else
+        echo "   Failure: Worker ${worker2} did not hit what worker ${worker1} filled."
+    fi
+
+    # A PURGE through worker 2 is gone for worker 1 too
+    numRun=`expr $numRun + 1`
+    purged=`curl --max-time ${TIMEOUT} --silent --request PURGE \
+            --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${FETCH_FILE}"`
+    kill -CONT ${worker1}
+    kill -STOP ${worker2}
+    status=`x_cache ${proxy_port} "http://localhost:${tiny_port}/${FETCH_FILE}" /dev/null`
+    kill -CONT ${worker2}
+    if [ "${purged}" = "purged 1" ] && [ "${status}" = "MISS" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: Worker ${worker1} missed what worker ${worker2} purged."
+    else
+        echo "   Failure: Expected 'purged 1' then MISS, got '${purged}' then '${status}'."
+    fi
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+echo "Killing tiny"
+kill $tiny_pid 2> /dev/null
+wait $tiny_pid 2> /dev/null
+
+preforkScore=`expr ${MAX_PREFORK} \* ${numSucceeded} / ${numRun}`
+echo "preforkScore: $preforkScore/${MAX_PREFORK}"
+
+#####
+# Admission
+#
+echo ""
+echo "*** Admission ***"
+
+# Run the Tiny Web server and the blocking nop-server
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny_port}"
+
+nop_port=$(free_port)
+echo "Starting the blocking NOP server on port ${nop_port}"
+./nop-server.py ${nop_port} &> /dev/null &
+nop_pid=$!
+wait_for_port_use "${nop_port}"
+
+# One request at a time, one per client IP, 300ms in the queue at most.
+# The first byte timeout frees the slot held by nop-server after 2 seconds.
+# SIGUSR1 makes the proxy print its shed counters to its output
+proxy_log=`mktemp`
+proxy_port=$(free_port)
+echo "Starting proxy on port ${proxy_port} with -c 1 -i 1 -q 300"
+./proxy -c 1 -i 1 -q 300 -T 10000,5000,2000,60000 ${proxy_port} > ${proxy_log} 2>&1 &
+proxy_pid=$!
+
+# Wait for the proxy to start in earnest
+wait_for_port_use "${proxy_port}"
+
+numRun=0
+numSucceeded=0
+
+# Hold the only slot from 127.0.0.1
+echo "Holding the only slot with a request to nop-server"
+curl --max-time ${TIMEOUT} --silent --output /dev/null --write-out "%{http_code}" \
+     --proxy "http://localhost:${proxy_port}" "http://localhost:${nop_port}/nop-file.txt" \
+     > ${PROXY_DIR}/held &
+held_pid=$!
+sleep 0.5
+
+# Each shed must be a 503 with Retry-After, and its counter must go up:
+# per_ip for a second request from 127.0.0.1 (answered at once), deadline
+# for a request from 127.0.0.2 that waits out -q in the queue
+for test in "127.0.0.1 per_ip" "127.0.0.2 deadline"
+do
+    set -- ${test}
+    numRun=`expr $numRun + 1`
+    echo "Fetching ./tiny/${FETCH_FILE} from $1 while the slot is held"
+    reply=`curl --max-time ${TIMEOUT} --silent --dump-header - --output /dev/null --interface $1 \
+           --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${FETCH_FILE}" | tr -d '\r'`
+    kill -USR1 $proxy_pid
+    sleep 0.5
+    count=`grep "shed:" ${proxy_log} | tail -1 | sed "s/.* $2 \([0-9]*\).*/\1/"`
+    if echo "${reply}" | head -1 | grep -q " 503 " && echo "${reply}" | grep -q "^Retry-After: " \
+       && [ "${count}" = "1" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: 503 with Retry-After, $2 shed count ${count}."
+    else
+        echo "   Failure: Expected a 503 with Retry-After and $2 1, got '`echo ${reply} | head -c 40`' and ${count}."
+    fi
+done
+
+# Once the held request times out, the slot is free again
+numRun=`expr $numRun + 1`
+wait $held_pid 2> /dev/null
+echo "Fetching ./tiny/${FETCH_FILE} after the held request ended"
+status=`curl --max-time ${TIMEOUT} --silent --output /dev/null --write-out "%{http_code}" --interface 127.0.0.2 \
+        --proxy "http://localhost:${proxy_port}" "http://localhost:${tiny_port}/${FETCH_FILE}"`
+if [ "`cat ${PROXY_DIR}/held`" = "504" ] && [ "${status}" = "200" ]; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: The freed slot was admitted."
+else
+    echo "   Failure: Expected 504 for the held request and 200 after it, got `cat ${PROXY_DIR}/held` and ${status}."
+fi
+
+# Clean up
+echo "Killing proxy, tiny and nop-server"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+kill $tiny_pid $nop_pid 2> /dev/null
+wait $tiny_pid $nop_pid 2> /dev/null
+rm -f ${proxy_log}
+
+admissionScore=`expr ${MAX_ADMISSION} \* ${numSucceeded} / ${numRun}`
+echo "admissionScore: $admissionScore/${MAX_ADMISSION}"
+
+#####
+# Compress
+#
+echo ""
+echo "*** Compress ***"
+
+# Run the Tiny Web server and the chunking origin. chunk-server.py
+# gzips a file when asked to, or always with "?gzip"
+tiny_port=$(free_port)
+echo "Starting tiny on port ${tiny_port}"
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${tiny_port}"
+
+chunk_port=$(free_port)
+echo "Starting the chunked origin server on port ${chunk_port}"
+cd ./tiny
+../chunk-server.py ${chunk_port} &> /dev/null &
+chunk_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use "${chunk_port}"
+
+numRun=0
+numSucceeded=0
+for mode in "" "-E epoll"
+do
+    proxy_port=$(free_port)
+    echo "Starting proxy on port ${proxy_port} ${mode:-with threads} -z"
+    ./proxy ${mode} -z ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+
+    # Wait for the proxy to start in earnest
+    wait_for_port_use "${proxy_port}"
+
+    # A plain fetch fills the cache, a --compressed one hits the variant
+    # the proxy made from it. Both decode to the bytes tiny has, and both
+    # say the reply varies with Accept-Encoding
+    clear_dirs
+    url="http://localhost:${tiny_port}/${FETCH_FILE}"
+    for fetch in "MISS|" "HIT|--compressed"
+    do
+        expect=`echo "${fetch}" | cut -d'|' -f1`
+        flags=`echo "${fetch}" | cut -d'|' -f2`
+        numRun=`expr $numRun + 1`
+        echo "Fetching ${FETCH_FILE} ${flags:-plain}"
+        headers=`curl --max-time ${TIMEOUT} --silent ${flags} --dump-header - --output ${PROXY_DIR}/${FETCH_FILE} \
+                 --proxy "http://localhost:${proxy_port}" ${url} | tr -d '\r'`
+        status=`echo "${headers}" | grep -i "^X-Cache:" | cut -d' ' -f2`
+        if [ "${status}" = "${expect}" ] && echo "${headers}" | grep -qi "^Vary: Accept-Encoding" \
+           && diff -q ./tiny/${FETCH_FILE} ${PROXY_DIR}/${FETCH_FILE} &> /dev/null; then
+            numSucceeded=`expr ${numSucceeded} + 1`
+            echo "   Success: ${expect} with Vary, and the bytes match."
+        else
+            echo "   Failure: Expected ${expect} with Vary and tiny's bytes, got '${status}'."
+        fi
+        sleep 0.5
+    done
+
+    # An origin that gzips although the proxy asked for identity must not
+    # land in the cache under the identity key
+    numRun=`expr $numRun + 1`
+    url="http://localhost:${chunk_port}/${FETCH_FILE}?gzip"
+    echo "Fetching ${FETCH_FILE}?gzip twice"
+    x_cache ${proxy_port} ${url} /dev/null > /dev/null
+    status=`x_cache ${proxy_port} ${url} /dev/null`
+    if [ "${status}" = "MISS" ]; then
+        numSucceeded=`expr ${numSucceeded} + 1`
+        echo "   Success: The gzipped reply was not cached."
+    else
+        echo "   Failure: Expected MISS, got '${status}'."
+    fi
+
+    kill $proxy_pid 2> /dev/null
+    wait $proxy_pid 2> /dev/null
+done
+
+# Without -z the client's Accept-Encoding goes to the origin as is. A
+# gzipped reply for one client must not reach the next, plain one
+proxy_port=$(free_port)
+echo "Starting proxy on port ${proxy_port} without -z"
+./proxy ${proxy_port} &> /dev/null &
+proxy_pid=$!
+wait_for_port_use "${proxy_port}"
+
+numRun=`expr $numRun + 1`
+clear_dirs
+url="http://localhost:${chunk_port}/${FETCH_FILE}"
+echo "Fetching ${FETCH_FILE} --compressed, then plain"
+curl --max-time ${TIMEOUT} --silent --compressed --output ${NOPROXY_DIR}/${FETCH_FILE} \
+     --proxy "http://localhost:${proxy_port}" ${url}
+download_proxy $PROXY_DIR ${FETCH_FILE} ${url} "http://localhost:${proxy_port}"
+if diff -q ./tiny/${FETCH_FILE} ${NOPROXY_DIR}/${FETCH_FILE} &> /dev/null \
+   && diff -q ./tiny/${FETCH_FILE} ${PROXY_DIR}/${FETCH_FILE} &> /dev/null; then
+    numSucceeded=`expr ${numSucceeded} + 1`
+    echo "   Success: The plain fetch got the plain bytes."
+else
+    echo "   Failure: The plain fetch did not get the plain bytes."
+fi
+
+# Clean up
+echo "Killing proxy, tiny and chunk-server"
+kill $proxy_pid 2> /dev/null
+wait $proxy_pid 2> /dev/null
+kill $tiny_pid $chunk_pid 2> /dev/null
+wait $tiny_pid $chunk_pid 2> /dev/null
+
+compressScore=`expr ${MAX_COMPRESS} \* ${numSucceeded} / ${numRun}`
+echo "compressScore: $compressScore/${MAX_COMPRESS}"
+
 # Emit the total score
-totalScore=`expr ${basicScore} + ${cacheScore} + ${concurrencyScore}`
-maxScore=`expr ${MAX_BASIC} + ${MAX_CACHE} + ${MAX_CONCURRENCY}`
+totalScore=`expr ${basicScore} + ${cacheScore} + ${concurrencyScore} + ${chunkedScore} + ${timeoutScore} + ${engineScore} + ${tunnelScore} + ${methodsScore} + ${reverseScore} + ${adminScore} + ${reloadScore} + ${upgradeScore} + ${preforkScore} + ${admissionScore} + ${compressScore}`
+maxScore=`expr ${MAX_BASIC} + ${MAX_CACHE} + ${MAX_CONCURRENCY} + ${MAX_CHUNKED} + ${MAX_TIMEOUT} + ${MAX_ENGINE} + ${MAX_TUNNEL} + ${MAX_METHODS} + ${MAX_REVERSE} + ${MAX_ADMIN} + ${MAX_RELOAD} + ${MAX_UPGRADE} + ${MAX_PREFORK} + ${MAX_ADMISSION} + ${MAX_COMPRESS}`
 echo ""
 echo "totalScore: ${totalScore}/${maxScore}"
 exit
@@ -0,0 +1,329 @@
+/*
+ * engine_epoll.c - readiness 기반 입출력 엔진. 요청을 받으면 먼저 바로
+ *     시도하고, EAGAIN일 때만 소켓을 epoll에 (edge-triggered로 한 번만)
+ *     등록해서 준비되면 다시 시도한다. 바로 끝난 요청도 done을 그 자리에서
+ *     부르지 않고 완료 목록에 두었다가 wait()에서 부르므로, 호출 순서는
+ *     io_uring 엔진과 같다.
+ */
+#include "ioengine.h"
+#include <sys/epoll.h>
+
+/* csapp.h와 겹치는 gai_error 때문에 _GNU_SOURCE 없이 직접 선언 */
+int accept4(int fd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
+#define EP_MAX_EVENTS  256
+#define EP_FAIR_ROUNDS 16       // 완료 목록이 계속 차 있어도 이만큼마다 epoll을 확인
+
+/* 소켓마다 기다리고 있는 요청 (읽기 쪽과 쓰기 쪽 하나씩) */
+typedef struct {
+  io_req *rd;                   // accept 또는 recv
+  io_req *wr;                   // connect, writable 또는 send
+  int added;                    // epoll에 등록했는지
+} ep_slot;
+
+typedef struct {
+  io_req *head, *tail;
+} req_list;
+
+static int epfd = -1;
+static ep_slot *slots;
+static int nslots;
+static char *bufs;
+static int free_bids[IO_NBUFS], nfree;
+static req_list ready;          // 끝났지만 아직 done을 부르지 않은 요청
+static req_list bufwait;        // 받기 버퍼가 없어 기다리는 recv
+static unsigned rounds;
+
+static void list_push(req_list *l, io_req *req) {
+  req->next = NULL;
+  if (l->tail)
+    l->tail->next = req;
+  else
+    l->head = req;
+  l->tail = req;
+}
+
+static io_req *list_pop(req_list *l) {
+  io_req *req = l->head;
+
+  if (req && !(l->head = req->next))
+    l->tail = NULL;
+  return req;
+}
+
+static ep_slot *slot(int fd) {
+  int n = nslots ? nslots : 1024;
+
+  if (fd >= nslots) {
+    while (n <= fd)
+      n *= 2;
+    slots = Realloc(slots, n * sizeof(ep_slot));
+    memset(slots + nslots, 0, (n - nslots) * sizeof(ep_slot));
+    nslots = n;
+  }
+  return &slots[fd];
+}
+
+static void complete(io_req *req, int res) {
+  req->res = res;
+  list_push(&ready, req);
+}
+
+/* fd를 epoll에 등록 (처음 한 번만). 반환값: 0, 실패하면 -errno */
+static int arm(int fd) {
+  ep_slot *s = slot(fd);
+  struct epoll_event ev;
+
+  if (s->added)
+    return 0;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.fd = fd;
+  io_stat.syscalls++;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    return -errno;
+  s->added = 1;
+  return 0;
+}
+
+static void wait_rd(io_req *req) {
+  int rc;
+
+  slot(req->fd)->rd = req;
+  if ((rc = arm(req->fd)) < 0) {
+    slot(req->fd)->rd = NULL;
+    complete(req, rc);
+  }
+}
+
+static void wait_wr(io_req *req) {
+  int rc;
+
+  slot(req->fd)->wr = req;
+  if ((rc = arm(req->fd)) < 0) {
+    slot(req->fd)->wr = NULL;
+    complete(req, rc);
+  }
+}
+
+static void try_recv(io_req *req) {
+  char *buf;
+  ssize_t n;
+
+  if (!nfree) {
+    list_push(&bufwait, req);
+    return;
+  }
+  buf = bufs + (size_t)free_bids[nfree - 1] * IO_BUF_SIZE;
+  do {
+    io_stat.syscalls++;
+    n = recv(req->fd, buf, IO_BUF_SIZE, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0 && errno == EAGAIN) {
+    wait_rd(req);
+    return;
+  }
+  req->buf = NULL;
+  if (n > 0) {
+    req->bid = free_bids[--nfree];
+    req->buf = buf;
+  }
+  complete(req, n < 0 ? -errno : n);
+}
+
+static void try_send(io_req *req) {
+  ssize_t n;
+
+  while (1) {
+    io_stat.syscalls++;
+    if ((n = sendmsg(req->fd, &req->msg, MSG_NOSIGNAL)) < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        wait_wr(req);
+      else
+        complete(req, -errno);
+      return;
+    }
+    if (io_advance(req, n)) {
+      complete(req, req->sent);
+      return;
+    }
+  }
+}
+
+/* 리슨 소켓의 대기열이 빌 때까지 받는다 (edge-triggered) */
+static void try_accept(io_req *req) {
+  int fd;
+
+  while (1) {
+    io_stat.syscalls++;
+    if ((fd = accept4(req->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN)
+        req->done(req, -errno);
+      slot(req->fd)->rd = req;
+      return;
+    }
+    req->done(req, fd);
+  }
+}
+
+/* fd를 epoll에서 빼고 상태를 지운다. writable은 한 번만 기다리므로, 연결에
+ * 진 소켓을 dial.c가 닫아도 같은 번호의 다음 소켓에 등록이 남지 않는다 */
+static void unwatch(int fd) {
+  if (slots[fd].added) {
+    io_stat.syscalls++;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  }
+  memset(&slots[fd], 0, sizeof(ep_slot));
+}
+
+/* 연결이 끝났으면 결과를 알리고 이어서 보낸다 */
+static void finish_connect(io_req *creq) {
+  socklen_t len = sizeof(int);
+  int err;
+
+  io_stat.syscalls++;
+  if (getsockopt(creq->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+    err = errno;
+  if (err) {
+    complete(creq, -err);
+    complete(creq->linked, -ECANCELED);
+  } else {
+    complete(creq, 0);
+    try_send(creq->linked);
+  }
+}
+
+static int ep_init(void) {
+  int i;
+
+  if (!(bufs = io_bufs_init()))
+    return -1;
+  for (i = 0; i < IO_NBUFS; i++)
+    free_bids[nfree++] = IO_NBUFS - 1 - i;
+  return (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 ? -1 : 0;
+}
+
+static void ep_accept(io_req *req, int listenfd) {
+  req->op = IO_ACCEPT;
+  req->fd = listenfd;
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);  // 빌 때까지 받으므로
+  wait_rd(req);                 // 등록할 때 이미 쌓인 연결이 있으면 바로 알려 준다
+}
+
+static void ep_cancel(io_req *req) {
+  if (req->fd >= nslots || (slots[req->fd].rd != req && slots[req->fd].wr != req))
+    return;                       // 이미 끝났음
+  unwatch(req->fd);
+  if (req->op == IO_WRITABLE || req->op == IO_CONNECT || req->op == IO_SEND)
+    complete(req, -ECANCELED);
+  if (req->op == IO_CONNECT)
+    complete(req->linked, -ECANCELED);
+}
+
+static void ep_recv(io_req *req, int fd) {
+  req->op = IO_RECV;
+  req->fd = fd;
+  try_recv(req);
+}
+
+static void ep_send(io_req *req, int fd, struct iovec *iov, int niov) {
+  io_send_init(req, fd, iov, niov);
+  try_send(req);
+}
+
+static void ep_connect_send(io_req *creq, io_req *sreq, int fd, SA *addr, socklen_t addrlen,
+                            struct iovec *iov, int niov) {
+  creq->op = IO_CONNECT;
+  creq->fd = fd;
+  creq->linked = sreq;
+  io_send_init(sreq, fd, iov, niov);
+  io_stat.syscalls++;
+  if (connect(fd, addr, addrlen) == 0) {
+    complete(creq, 0);
+    try_send(sreq);
+  } else if (errno == EINPROGRESS) {
+    wait_wr(creq);
+  } else {
+    complete(creq, -errno);
+    complete(sreq, -ECANCELED);
+  }
+}
+
+static void ep_writable(io_req *req, int fd) {
+  req->op = IO_WRITABLE;
+  req->fd = fd;
+  wait_wr(req);                 // 새 소켓이라 등록할 때 이미 쓸 수 있으면 바로 알려 준다
+}
+
+static void ep_buf_put(io_req *req) {
+  io_req *w;
+
+  free_bids[nfree++] = req->bid;
+  req->buf = NULL;
+  if ((w = list_pop(&bufwait)))
+    try_recv(w);
+}
+
+static void ep_forget(int fd) {
+  if (fd < nslots)
+    memset(&slots[fd], 0, sizeof(ep_slot));
+}
+
+/* 준비된 소켓의 요청을 다시 시도한다 */
+static int ep_poll(int timeout_ms) {
+  struct epoll_event evs[EP_MAX_EVENTS];
+  io_req *req;
+  ep_slot *s;
+  int i, n;
+
+  io_stat.syscalls++;
+  if ((n = epoll_wait(epfd, evs, EP_MAX_EVENTS, timeout_ms)) < 0)
+    return 0;
+  for (i = 0; i < n; i++) {
+    s = slot(evs[i].data.fd);
+    if ((evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) && (req = s->rd)) {
+      s->rd = NULL;
+      if (req->op == IO_ACCEPT)
+        try_accept(req);
+      else
+        try_recv(req);
+    }
+    s = slot(evs[i].data.fd);     // accept한 소켓 때문에 slots가 커졌을 수 있음
+    if ((evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && (req = s->wr)) {
+      s->wr = NULL;
+      if (req->op == IO_CONNECT) {
+        finish_connect(req);
+      } else if (req->op == IO_WRITABLE) {
+        unwatch(evs[i].data.fd);
+        complete(req, evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP));
+      } else
+        try_send(req);
+    }
+  }
+  return n;
+}
+
+/* 완료 목록에 있던 요청의 done을 부른다. 그 사이에 끝난 요청은 다음 차례 */
+static int ep_wait(int timeout_ms) {
+  io_req *req, *last;
+  int n = 0;
+
+  if (!ready.head || ++rounds % EP_FAIR_ROUNDS == 0)
+    ep_poll(ready.head ? 0 : timeout_ms);
+  if ((last = ready.tail)) {
+    do {
+      req = list_pop(&ready);
+      req->done(req, req->res);
+      n++;
+    } while (req != last);
+  }
+  return n;
+}
+
+io_engine epoll_engine = {
+  "epoll", ep_init, ep_accept, ep_cancel, ep_recv, ep_send, ep_connect_send,
+  ep_writable, ep_buf_put, ep_forget, ep_wait
+};
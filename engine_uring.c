@@ -0,0 +1,370 @@
+/*
+ * engine_uring.c - io_uring 입출력 엔진 (liburing 없이 시스템 콜을 직접 씀).
+ *     - accept는 multishot 하나로 새 연결마다 완료를 받는다.
+ *     - recv는 등록한 버퍼 링(provided buffer ring)에서 커널이 버퍼를
+ *       고르므로 연결마다 받기 버퍼를 미리 잡아 두지 않는다.
+ *     - 같은 버퍼 영역을 고정 버퍼로도 등록해서, 받은 버퍼를 그대로
+ *       보낼 때는 (Content-Length 응답의 바디) WRITE_FIXED로 보내서 페이지를
+ *       매번 고정하지 않는다.
+ *     - 원 서버 주소가 하나면 (dial.c) connect와 요청 send를 IOSQE_IO_LINK로
+ *       묶어 한 번에 낸다. 여러 주소를 엇갈려 시도할 때는 POLL_ADD로 쓰기
+ *       가능을 기다린다 (시도마다 send를 묶으면 둘 다 연결될 때 요청이
+ *       두 번 간다).
+ *     요청은 SQ에 쌓아 두었다가 wait()의 io_uring_enter 한 번으로 내고
+ *     완료를 함께 기다린다.
+ */
+#include "ioengine.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define UR_ENTRIES 4096         // SQ 크기 (CQ는 4배)
+#define UR_BGID    0            // 받기 버퍼 그룹
+
+static int ring_fd = -1;
+static unsigned *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries;
+static unsigned *cq_head, *cq_tail, cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned sq_local_tail;  // 아직 커널에 알리지 않은 SQ 끝
+static unsigned to_submit;
+static char *bufs;
+static struct io_uring_buf_ring *br;
+static unsigned short br_tail;
+static int fixed_send = 1;      // send가 고정 버퍼를 지원하는지 (처음 실패하면 끔)
+
+typedef struct {
+  io_req *head, *tail;
+} req_list;
+
+static req_list bufwait;        // 버퍼 링이 비어 기다리는 recv
+
+static void list_push(req_list *l, io_req *req) {
+  req->next = NULL;
+  if (l->tail)
+    l->tail->next = req;
+  else
+    l->head = req;
+  l->tail = req;
+}
+
+static io_req *list_pop(req_list *l) {
+  io_req *req = l->head;
+
+  if (req && !(l->head = req->next))
+    l->tail = NULL;
+  return req;
+}
+
+static int ur_enter(unsigned submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+  io_stat.syscalls++;
+  return syscall(__NR_io_uring_enter, ring_fd, submit, min_complete, flags, arg, argsz);
+}
+
+static int ur_register(unsigned opcode, void *arg, unsigned nargs) {
+  io_stat.syscalls++;
+  return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nargs);
+}
+
+/* 쌓아 둔 SQE를 커널에 보인다 (enter는 부르지 않음) */
+static void flush_sq(void) {
+  __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+}
+
+/* SQ에 n개가 들어갈 자리를 만든다. 모자라면 쌓인 것을 먼저 낸다 */
+static void reserve_sq(unsigned n) {
+  if (sq_local_tail + n - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) <= sq_entries)
+    return;
+  flush_sq();
+  if (ur_enter(to_submit, 0, 0, NULL, 0) > 0)
+    to_submit = 0;
+}
+
+static struct io_uring_sqe *get_sqe(io_req *req, int opcode, int fd) {
+  struct io_uring_sqe *sqe;
+  unsigned idx;
+
+  reserve_sq(1);
+  idx = sq_local_tail++ & sq_mask;
+  sq_array[idx] = idx;
+  to_submit++;
+  sqe = &sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = (unsigned long)req;
+  return sqe;
+}
+
+/* 버퍼 bid를 버퍼 링에 돌려준다 */
+static void buf_ring_add(int bid) {
+  struct io_uring_buf *b = &br->bufs[br_tail & (IO_NBUFS - 1)];
+
+  b->addr = (unsigned long)(bufs + (size_t)bid * IO_BUF_SIZE);
+  b->len = IO_BUF_SIZE;
+  b->bid = bid;
+  br_tail++;
+  __atomic_store_n(&br->tail, br_tail, __ATOMIC_RELEASE);
+}
+
+static int ur_init(void) {
+  struct io_uring_params p;
+  struct io_uring_buf_reg reg;
+  struct iovec iov;
+  size_t sq_size, cq_size;
+  char *sq, *cq;
+  int i;
+
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN
+            | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+  p.cq_entries = UR_ENTRIES * 4;
+  if ((ring_fd = syscall(__NR_io_uring_setup, UR_ENTRIES, &p)) < 0) {
+    memset(&p, 0, sizeof(p));   // 오래된 커널: 기본 설정으로
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = UR_ENTRIES * 4;
+    if ((ring_fd = syscall(__NR_io_uring_setup, UR_ENTRIES, &p)) < 0)
+      return -1;
+  }
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  sq = mmap(NULL, sq_size > cq_size ? sq_size : cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED)
+    return -1;
+  cq = sq;
+  sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return -1;
+  sq_head = (unsigned *)(sq + p.sq_off.head);
+  sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+  sq_entries = *(unsigned *)(sq + p.sq_off.ring_entries);
+  sq_array = (unsigned *)(sq + p.sq_off.array);
+  sq_local_tail = *sq_tail;
+  cq_head = (unsigned *)(cq + p.cq_off.head);
+  cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  /* 받기 버퍼: 버퍼 링으로 등록하고, 같은 영역을 send용 고정 버퍼로도 등록 */
+  if (!(bufs = io_bufs_init()))
+    return -1;
+  br = mmap(NULL, IO_NBUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (br == MAP_FAILED)
+    return -1;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (unsigned long)br;
+  reg.ring_entries = IO_NBUFS;
+  reg.bgid = UR_BGID;
+  if (ur_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    return -1;
+  for (i = 0; i < IO_NBUFS; i++)
+    buf_ring_add(i);
+  iov.iov_base = bufs;
+  iov.iov_len = (size_t)IO_NBUFS * IO_BUF_SIZE;
+  if (ur_register(IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    fixed_send = 0;               // 고정 버퍼 없이도 동작은 같음
+  return 0;
+}
+
+static void ur_accept(io_req *req, int listenfd) {
+  struct io_uring_sqe *sqe;
+
+  req->op = IO_ACCEPT;
+  req->fd = listenfd;
+  sqe = get_sqe(req, IORING_OP_ACCEPT, listenfd);
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+/* multishot accept나 writable의 POLL_ADD를 취소한다. 취소 자체의 완료는
+ * user_data가 0이라 버린다 */
+static void ur_cancel(io_req *req) {
+  struct io_uring_sqe *sqe;
+
+  sqe = get_sqe(NULL, IORING_OP_ASYNC_CANCEL, -1);
+  sqe->addr = (unsigned long)req;
+  req->fd = -1;                   // -ECANCELED로 끝나도 다시 걸지 않게
+}
+
+static void ur_recv(io_req *req, int fd) {
+  struct io_uring_sqe *sqe;
+
+  req->op = IO_RECV;
+  req->fd = fd;
+  req->buf = NULL;
+  sqe = get_sqe(req, IORING_OP_RECV, fd);
+  sqe->len = IO_BUF_SIZE;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = UR_BGID;
+}
+
+/* 남은 조각을 보낸다. 조각이 하나이고 받기 버퍼 안이면 고정 버퍼로 */
+static void submit_send(io_req *req) {
+  struct iovec *v = req->msg.msg_iov;
+  struct io_uring_sqe *sqe;
+
+  req->fixed = 0;
+  if (req->msg.msg_iovlen == 1 && fixed_send && (char *)v->iov_base >= bufs
+      && (char *)v->iov_base + v->iov_len <= bufs + (size_t)IO_NBUFS * IO_BUF_SIZE) {
+    /* 고정 버퍼 write는 소켓에도 쓸 수 있다 (SIGPIPE는 무시하고 있음) */
+    sqe = get_sqe(req, IORING_OP_WRITE_FIXED, req->fd);
+    sqe->addr = (unsigned long)v->iov_base;
+    sqe->len = v->iov_len;
+    sqe->off = -1;
+    sqe->buf_index = 0;
+    req->fixed = 1;
+    return;
+  }
+  if (req->msg.msg_iovlen == 1) {
+    sqe = get_sqe(req, IORING_OP_SEND, req->fd);
+    sqe->addr = (unsigned long)v->iov_base;
+    sqe->len = v->iov_len;
+  } else {
+    sqe = get_sqe(req, IORING_OP_SENDMSG, req->fd);
+    sqe->addr = (unsigned long)&req->msg;
+    sqe->len = 1;
+  }
+  sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+static void ur_send(io_req *req, int fd, struct iovec *iov, int niov) {
+  io_send_init(req, fd, iov, niov);
+  submit_send(req);
+}
+
+static void ur_connect_send(io_req *creq, io_req *sreq, int fd, SA *addr, socklen_t addrlen,
+                            struct iovec *iov, int niov) {
+  struct io_uring_sqe *sqe;
+
+  creq->op = IO_CONNECT;
+  creq->fd = fd;
+  creq->linked = sreq;
+  memcpy(&creq->addr, addr, addrlen);
+  creq->addrlen = addrlen;
+  io_send_init(sreq, fd, iov, niov);
+  reserve_sq(2);                  // 묶은 두 SQE가 같은 enter에 들어가야 함
+  sqe = get_sqe(creq, IORING_OP_CONNECT, fd);
+  sqe->addr = (unsigned long)&creq->addr;
+  sqe->off = addrlen;
+  sqe->flags = IOSQE_IO_LINK;
+  submit_send(sreq);
+}
+
+static void ur_writable(io_req *req, int fd) {
+  struct io_uring_sqe *sqe;
+
+  req->op = IO_WRITABLE;
+  req->fd = fd;
+  sqe = get_sqe(req, IORING_OP_POLL_ADD, fd);
+  sqe->poll32_events = POLLOUT;
+}
+
+static void ur_buf_put(io_req *req) {
+  io_req *w;
+
+  buf_ring_add(req->bid);
+  req->buf = NULL;
+  if ((w = list_pop(&bufwait)))
+    ur_recv(w, w->fd);
+}
+
+static void ur_forget(int fd) {
+}
+
+/* 완료 하나를 요청에 반영하고 끝났으면 done을 부른다 */
+static void handle_cqe(io_req *req, int res, unsigned flags) {
+  int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+  switch (req->op) {
+  case IO_ACCEPT:
+    if (!(flags & IORING_CQE_F_MORE) && req->fd >= 0)  // multishot이 끝났으면 다시 건다
+      ur_accept(req, req->fd);
+    if (res != -ECANCELED)
+      req->done(req, res);
+    return;
+  case IO_RECV:
+    if (res == -ENOBUFS) {              // 버퍼가 돌아올 때까지 기다림
+      list_push(&bufwait, req);
+      return;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+      if (res > 0) {
+        req->bid = bid;
+        req->buf = bufs + (size_t)bid * IO_BUF_SIZE;
+      } else {
+        buf_ring_add(bid);
+      }
+    }
+    break;
+  case IO_SEND:
+    if (res == -EINVAL && req->fixed) { // 소켓에 고정 버퍼 write를 쓸 수 없는 커널
+      fixed_send = 0;
+      submit_send(req);
+      return;
+    }
+    if (res >= 0 && !io_advance(req, res)) {
+      submit_send(req);                 // 일부만 보냄
+      return;
+    }
+    if (res >= 0)
+      res = req->sent;
+    break;
+  }
+  req->done(req, res);
+}
+
+static int ur_wait(int timeout_ms) {
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  struct io_uring_cqe *cqe;
+  unsigned head, tail;
+  io_req *req;
+  int n = 0, res;
+  unsigned flags;
+
+  flush_sq();
+  head = *cq_head;
+  if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+    if (to_submit && ur_enter(to_submit, 0, IORING_ENTER_GETEVENTS, NULL, 0) >= 0)
+      to_submit = 0;
+  } else {
+    /* 쌓인 요청을 내면서 완료 하나를 timeout_ms까지 기다림 (enter 한 번) */
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0) {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      arg.ts = (unsigned long)&ts;
+    }
+    if (ur_enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                 &arg, sizeof(arg)) >= 0 || errno == ETIME || errno == EINTR)
+      to_submit = 0;
+  }
+
+  tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    cqe = &cqes[head & cq_mask];
+    req = (io_req *)(unsigned long)cqe->user_data;
+    res = cqe->res;
+    flags = cqe->flags;
+    head++;
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    if (req)
+      handle_cqe(req, res, flags);
+    n++;
+  }
+  return n;
+}
+
+io_engine uring_engine = {
+  "uring", ur_init, ur_accept, ur_cancel, ur_recv, ur_send, ur_connect_send,
+  ur_writable, ur_buf_put, ur_forget, ur_wait
+};
@@ -0,0 +1,61 @@
+#include "err.h"
+
+/* 원인마다 카운터 이름과, 응답을 보내기 전이라면 클라이언트에 줄 상태 코드 */
+static const struct {
+  const char *name;
+  char *status, *reason;
+} err_info[ERR_COUNT] = {
+  [ERR_NONE]               = { "none" },
+  [ERR_CLIENT_CLOSED]      = { "client_closed" },
+  [ERR_CLIENT_READ]        = { "client_read" },
+  [ERR_CLIENT_WRITE]       = { "client_write" },
+  [ERR_HEADER_TIMEOUT]     = { "header_timeout", "408", "Request Timeout" },
+  [ERR_BODY_TIMEOUT]       = { "body_timeout", "408", "Request Timeout" },
+  [ERR_BAD_REQUEST]        = { "bad_request", "400", "Bad Request" },
+  [ERR_METHOD]             = { "method", "501", "Not Implemented" },
+  [ERR_URI_TOO_LONG]       = { "uri_too_long", "414", "URI Too Long" },
+  [ERR_HEADER_TOO_LARGE]   = { "header_too_large", "431", "Request Header Fields Too Large" },
+  [ERR_FORBIDDEN]          = { "forbidden", "403", "Forbidden" },
+  [ERR_NO_ROUTE]           = { "no_route", "404", "Not Found" },
+  [ERR_DNS]                = { "dns", "502", "Bad Gateway" },
+  [ERR_CONNECT]            = { "connect", "502", "Bad Gateway" },
+  [ERR_CONNECT_TIMEOUT]    = { "connect_timeout", "504", "Gateway Timeout" },
+  [ERR_UPSTREAM_WRITE]     = { "upstream_write", "502", "Bad Gateway" },
+  [ERR_FIRST_BYTE_TIMEOUT] = { "first_byte_timeout", "504", "Gateway Timeout" },
+  [ERR_BAD_RESPONSE]       = { "bad_response", "502", "Bad Gateway" },
+  [ERR_UPSTREAM_READ]      = { "upstream_read" },
+  [ERR_BAD_CHUNK]          = { "bad_chunk" },
+  [ERR_TRUNCATED]          = { "truncated" },
+  [ERR_IDLE_TIMEOUT]       = { "idle_timeout" },
+  [ERR_TUNNEL]             = { "tunnel" },
+  [ERR_NOMEM]              = { "nomem", "503", "Service Unavailable" },
+};
+
+/* 원인별 실패 횟수. 요청 스레드마다 더하므로 lock 없이 원자적으로 더한다 */
+static unsigned long err_counts[ERR_COUNT];
+
+const char *err_name(int err) {
+  return err >= 0 && err < ERR_COUNT ? err_info[err].name : "unknown";
+}
+
+/* 클라이언트에 보낼 상태 코드와 사유. 보낼 응답이 없는 원인이면 -1 */
+int err_status(int err, char **status, char **reason) {
+  if (err <= ERR_NONE || err >= ERR_COUNT || !err_info[err].status)
+    return -1;
+  *status = err_info[err].status;
+  *reason = err_info[err].reason;
+  return 0;
+}
+
+void err_record(int err) {
+  if (err > ERR_NONE && err < ERR_COUNT)
+    __atomic_fetch_add(&err_counts[err], 1, __ATOMIC_RELAXED);
+}
+
+/* counts[ERR_COUNT]에 지금까지의 카운터를 복사 */
+void err_snapshot(unsigned long *counts) {
+  int i;
+
+  for (i = 0; i < ERR_COUNT; i++)
+    counts[i] = __atomic_load_n(&err_counts[i], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,41 @@
+#ifndef __ERR_H__
+#define __ERR_H__
+
+/*
+ * 요청 하나가 실패한 원인. 연결별 I/O 오류는 프로세스를 끝내지 않고
+ * 이 코드로 돌려받아 그 요청만 정리하고, 원인별 카운터에 더한다.
+ */
+enum {
+  ERR_NONE,
+  ERR_CLIENT_CLOSED,        // 요청을 다 보내기 전에 클라이언트가 끊음
+  ERR_CLIENT_READ,          // 클라이언트 읽기 오류 (ECONNRESET 등)
+  ERR_CLIENT_WRITE,         // 클라이언트 쓰기 오류 (EPIPE 등)
+  ERR_HEADER_TIMEOUT,       // 요청 헤더 시간 초과 (408)
+  ERR_BODY_TIMEOUT,         // 요청 바디를 보내는 동안 유휴 시간 초과 (408)
+  ERR_BAD_REQUEST,          // 요청 줄, 바디 길이나 chunked 형식 오류 (400)
+  ERR_METHOD,               // 지원하지 않는 메서드 (501)
+  ERR_URI_TOO_LONG,         // 414
+  ERR_HEADER_TOO_LARGE,     // 431
+  ERR_FORBIDDEN,            // 루프백이 아닌 곳에서 온 관리 요청, 막은 CONNECT 포트 (403)
+  ERR_NO_ROUTE,             // 리버스 프록시: Host와 경로에 맞는 규칙이 없음 (404)
+  ERR_DNS,                  // 원 서버 이름을 찾지 못함 (502)
+  ERR_CONNECT,              // 원 서버 연결 실패 (502)
+  ERR_CONNECT_TIMEOUT,      // 원 서버 연결 시간 초과 (504)
+  ERR_UPSTREAM_WRITE,       // 원 서버에 요청을 보내지 못함 (502)
+  ERR_FIRST_BYTE_TIMEOUT,   // 응답 헤더 시간 초과 (504)
+  ERR_BAD_RESPONSE,         // 응답 헤더 형식 오류 (502)
+  ERR_UPSTREAM_READ,        // 응답 바디를 읽다가 오류
+  ERR_BAD_CHUNK,            // chunked 형식 오류
+  ERR_TRUNCATED,            // 응답 바디가 중간에 끊김
+  ERR_IDLE_TIMEOUT,         // 중계 중 유휴 시간 초과
+  ERR_TUNNEL,               // CONNECT 터널이 두 소켓을 기다리지 못함 (poll 실패)
+  ERR_NOMEM,                // 메모리나 스레드를 얻지 못함
+  ERR_COUNT
+};
+
+const char *err_name(int err);
+int err_status(int err, char **status, char **reason);
+void err_record(int err);
+void err_snapshot(unsigned long *counts);
+
+#endif /* __ERR_H__ */
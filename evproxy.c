@@ -0,0 +1,643 @@
+/*
+ * evproxy.c - 스레드 없이 입출력 엔진(epoll, io_uring) 위에서 요청을
+ *     처리하는 연결 상태 기계. I/O가 끝날 때마다 다음 단계로 넘어가고,
+ *     요청 줄과 헤더의 해석, 캐시 검사, 응답 중계와 캐시 채우기는 스레드의
+ *     doit()과 같은 함수(proxy.h)를 쓴다. 마감 시간도 같은 conn_deadline을
+ *     쓰므로 타이머가 소켓을 shutdown하면 걸려 있던 I/O가 끝나면서
+ *     408/504나 연결 종료로 이어진다.
+ *
+ *     연결마다 엔진에 맡긴 I/O는 한 번에 하나뿐이다 (CONNECT 터널은
+ *     방향마다 하나씩 두 개). 원 서버 연결은 dial.c가 주소마다 엔진에
+ *     맡겨 엇갈려 시도하고 (Happy Eyeballs) 요청 헤더까지 보낸 뒤
+ *     ev_connected로 돌아온다.
+ *     요청 바디는 클라이언트에서 받고 원 서버로 보내기를 번갈아 한다.
+ *     원 서버 이름은 getaddrinfo로 찾으므로 그 동안은 루프가 멈춘다.
+ */
+#include <stddef.h>
+#include "proxy.h"
+#include "evproxy.h"
+#include "dial.h"
+#include "admit.h"
+#include "err.h"
+#include "tunnel.h"
+#include "reqbody.h"
+#include "upstream.h"
+
+/* 연결이 기다리고 있는 것 */
+enum {
+  EV_REQUEST,                   // 클라이언트의 요청 헤더
+  EV_UPSTREAM,                  // 원 서버 연결 (dial)과 요청 전송
+  EV_BODY,                      // 요청 바디 전송 (받고 보내기를 번갈아)
+  EV_RESPONSE,                  // 원 서버의 응답 헤더
+  EV_RELAY,                     // 응답 바디 중계 (받고 보내기를 번갈아)
+  EV_HIT,                       // 캐시 객체 전송
+  EV_ERROR,                     // 오류 응답 전송
+  EV_TUNNEL,                    // CONNECT: 두 방향을 따로 잇기
+  EV_CLOSING                    // 남은 완료를 기다렸다가 해제
+};
+
+typedef struct {
+  conn_t *c;
+  int state;
+  int err;                      // EV_ERROR: 보내고 나서 기록할 원인, EV_TUNNEL: 먼저 실패한 원인
+  int inflight;                 // 엔진에 맡긴 I/O 수
+  int len;                      // c->resp_hdr에 모은 바이트 (요청 헤더, 다음에는 응답 헤더)
+  int body_off, body_len;       // 응답 헤더와 같이 받은 바디 (upstream.buf 안),
+                                // 요청 헤더와 같이 받은 요청 바디 (client.buf 안),
+                                // CONNECT면 요청 헤더와 같이 받은 바이트 (c->header로 옮김)
+  int open;                     // EV_TUNNEL: 아직 닫히지 않은 방향 수
+  Node *node;                   // 보내고 있는 캐시 객체
+  char hit_hdr[CACHE_HIT_HDR_MAX];
+  io_req client;                // 클라이언트 recv/send
+  io_req upstream;              // 원 서버 send/recv
+  reqbody_t b;
+  relay_t r;
+} ev_conn;
+
+static io_engine *io;
+static io_req accept_req;
+static mem_pool ev_pool;
+
+static void ev_accept(io_req *req, int res);
+static void client_recv_done(io_req *req, int res);
+static void client_send_done(io_req *req, int res);
+static void dial_done(dial *d, int rc);
+static void upstream_recv_done(io_req *req, int res);
+static void ev_connected(ev_conn *ev, dial *d, int rc);
+static void ev_retry(ev_conn *ev, int err);
+static void ev_tunnel(ev_conn *ev);
+static void ev_body(ev_conn *ev);
+static void ev_body_next(ev_conn *ev);
+static void ev_response(ev_conn *ev);
+static void body_recv_done(io_req *req, int res);
+static void body_send_done(io_req *req, int res);
+static void tunnel_recv_done(io_req *req, int res);
+static void tunnel_send_done(io_req *req, int res);
+
+/* engine으로 listenfd의 연결을 받기 시작한다. 반환값: 0, 엔진을 쓸 수 없으면 -1 */
+int ev_init(io_engine *engine, int listenfd) {
+  io = engine;
+  if (io->init() < 0)
+    return -1;
+  pool_init(&ev_pool, sizeof(ev_conn), 64);
+  dial_init(io);
+  accept_req.done = ev_accept;
+  io->accept(&accept_req, listenfd);
+  return 0;
+}
+
+/* 새 연결 받기를 멈춘다 (listen 소켓을 넘겨준 뒤). 받은 연결은 끝까지 처리 */
+void ev_stop_accept(void) {
+  io->cancel(&accept_req);
+}
+
+/* 최대 timeout_ms 동안 완료를 기다려 처리한다 (accept 루프에서 호출).
+ * 타이머가 깨운 원 서버 연결이 있으면 먼저 잇고 기다리지 않는다 */
+int ev_wait(int timeout_ms) {
+  int n = dial_run_ready();
+
+  return n + io->wait(n ? 0 : timeout_ms);
+}
+
+/* conn_t 밖에서 연결 하나가 쓰는 메모리 */
+size_t ev_conn_size(void) {
+  return sizeof(ev_conn);
+}
+
+static void ev_recv(ev_conn *ev, io_req *req, int fd, io_done_fn done) {
+  req->done = done;
+  ev->inflight++;
+  io->recv(req, fd);
+}
+
+static void ev_send(ev_conn *ev, io_req *req, int fd, struct iovec *iov, int niov,
+                    io_done_fn done) {
+  req->done = done;
+  ev->inflight++;
+  io->send(req, fd, iov, niov);
+}
+
+static void ev_free(ev_conn *ev) {
+  conn_free(ev->c);
+  pool_put(&ev_pool, ev);
+}
+
+/* 요청을 끝내고 소켓을 닫는다. 걸려 있는 I/O가 있으면 끝난 뒤에 해제 */
+static void ev_finish(ev_conn *ev, int err) {
+  conn_t *c = ev->c;
+
+  if (err != ERR_NONE) {
+    err_record(err);
+    printf("Request failed: %s %s\n", err_name(err), c->uri);
+  }
+  io_stat.requests++;
+  request_done(c, err);
+  if (ev->node)
+    release_cache(cache, ev->node);
+  ev->node = NULL;
+  if (ev->upstream.buf)
+    io->buf_put(&ev->upstream);
+  if (ev->client.buf)             // 아직 보내지 않은 요청 바디
+    io->buf_put(&ev->client);
+  conn_clear_deadline(c);
+  if (ev->inflight) {             // 남은 I/O를 깨워서 끝나게 한다
+    shutdown(c->fd, SHUT_RDWR);
+    if (c->serverfd >= 0)
+      shutdown(c->serverfd, SHUT_RDWR);
+  }
+  if (c->serverfd >= 0) {
+    io->forget(c->serverfd);
+    io_stat.syscalls++;
+  }
+  conn_close_serverfd(c);
+  io->forget(c->fd);
+  io_stat.syscalls++;
+  close(c->fd);
+  ev->state = EV_CLOSING;
+  if (!ev->inflight)
+    ev_free(ev);
+}
+
+/* 응답을 보내기 전의 실패: 원인에 맞는 상태 코드를 보낸 뒤에 끝낸다 */
+static void ev_fail(ev_conn *ev, int err) {
+  struct iovec iov;
+  conn_t *c = ev->c;
+
+  if (!(iov.iov_len = error_response(c->buf, err))) {
+    ev_finish(ev, err);
+    return;
+  }
+  iov.iov_base = c->buf;
+  ev->state = EV_ERROR;
+  ev->err = err;
+  ev_send(ev, &ev->client, c->fd, &iov, 1, client_send_done);
+}
+
+/* 완료를 받을 연결. 이미 끝낸 연결이면 NULL (마지막 완료였으면 해제) */
+static ev_conn *ev_done(io_req *req) {
+  ev_conn *ev = req->arg;
+
+  ev->inflight--;
+  if (ev->state != EV_CLOSING)
+    return ev;
+  if (req->buf)
+    io->buf_put(req);
+  if (!ev->inflight)
+    ev_free(ev);
+  return NULL;
+}
+
+static void ev_accept(io_req *req, int res) {
+  ev_conn *ev;
+  conn_t *c;
+
+  if (res < 0)
+    return;                       // EMFILE 등: 다음 연결에서 다시 시도
+  if (!(c = conn_new(res, 0))) {
+    admit_reject(res);
+    return;
+  }
+  if (!(ev = pool_get(&ev_pool))) {
+    conn_free(c);
+    admit_reject(res);
+    return;
+  }
+  memset(ev, 0, offsetof(ev_conn, r));
+  ev->c = c;
+  ev->state = EV_REQUEST;
+  ev->client.arg = ev->upstream.arg = ev;
+  c->addrlen = 0;
+  conn_deadline(c, CONN_HEADER);
+  ev_recv(ev, &ev->client, c->fd, client_recv_done);
+}
+
+/* 원 서버 주소를 찾고 연결을 시작한다. 연결 시도는 끝날 때까지 빌린다 */
+static void ev_resolve(ev_conn *ev) {
+  struct addrinfo *listp;
+  conn_t *c = ev->c;
+  struct iovec iov;
+  dial *d;
+  int rc;
+
+  conn_mark(c, PH_DNS_BEGIN);
+  if (he_resolve(c->hostname, c->port, &listp) != 0) {
+    ev_retry(ev, ERR_DNS);
+    return;
+  }
+  conn_mark(c, PH_DNS_END);
+  if (!(d = dial_get())) {
+    freeaddrinfo(listp);
+    ev_fail(ev, ERR_NOMEM);
+    return;
+  }
+  conn_deadline(c, CONN_CONNECT);
+  ev->state = EV_UPSTREAM;
+  iov.iov_base = c->header;       // CONNECT면 요청과 같이 받은 바이트 (없으면 0)
+  iov.iov_len = tunnel_request(c) ? ev->body_len : strlen(c->header);
+  rc = dial_start(d, listp, c->cfg->connect_ms, &iov, dial_done, ev);
+  freeaddrinfo(listp);
+  if (rc < 0)
+    ev_connected(ev, d, rc);
+}
+
+static void dial_done(dial *d, int rc) {
+  ev_connected(d->arg, d, rc);
+}
+
+/* 원 서버에 연결하고 요청 헤더를 보냈다 (rc는 d->rc). 시도를 반납하고
+ * 터널, 요청 바디나 응답으로 넘어간다 */
+static void ev_connected(ev_conn *ev, dial *d, int rc) {
+  conn_t *c = ev->c;
+  int fd = d->he.fd, error = d->he.error, connected = d->connected;
+
+  dial_put(d);
+  if (rc < 0 && connected && error != ETIMEDOUT) {
+    ev_fail(ev, reqbody_error(c, ERR_UPSTREAM_WRITE));
+    return;
+  }
+  if (rc < 0) {
+    ev_retry(ev, error == ETIMEDOUT ? ERR_CONNECT_TIMEOUT : ERR_CONNECT);
+    return;
+  }
+  if (conn_set_serverfd(c, fd) < 0) {
+    io->forget(fd);
+    close(fd);
+    ev_fail(ev, ERR_CONNECT_TIMEOUT);
+    return;
+  }
+  conn_deadline(c, reqbody_expected(c) ? CONN_BODY : CONN_FIRST_BYTE);
+  if (tunnel_request(c))
+    ev_tunnel(ev);
+  else if (reqbody_expected(c))
+    ev_body(ev);
+  else
+    ev_response(ev);
+}
+
+/* 원 서버에 연결하지 못했다. 리버스 프록시면 풀의 다른 서버로 다시 시도한다 */
+static void ev_retry(ev_conn *ev, int err) {
+  if (!upstream_retry(ev->c, err)) {
+    ev_fail(ev, err);
+    return;
+  }
+  ev_resolve(ev);
+}
+
+/* 요청 헤더(c->resp_hdr의 hdrlen 바이트)를 doit()과 같은 함수로 처리.
+ * 헤더 뒤에 같이 온 바이트는 client.buf의 body_off부터 body_len 바이트 */
+static void ev_request(ev_conn *ev, int hdrlen) {
+  conn_t *c = ev->c;
+  struct iovec iov[CACHE_IOV];
+  int err, n;
+
+  err = parse_request(c, hdrlen);
+  if (err == ERR_NONE && tunnel_request(c))   // 터널이 열리면 원 서버에 넘길 것
+    memcpy(c->header, ev->client.buf + ev->body_off, ev->body_len);
+  /* 요청 헤더는 복사했으므로 버퍼는 바로 반납. 같이 온 요청 바디는 보낼 때까지 둔다 */
+  if (err != ERR_NONE || !reqbody_expected(c) || !ev->body_len)
+    io->buf_put(&ev->client);
+  if (err != ERR_NONE) {
+    ev_fail(ev, err);
+    return;
+  }
+  if (strstr(c->uri, "favicon")) {
+    ev_finish(ev, ERR_NONE);
+    return;
+  }
+  conn_mark(c, PH_HEADER);
+  if (tunnel_request(c)) {
+    ev_resolve(ev);
+    return;
+  }
+  if (admin_request(c)) {  // 프록시에게 보낸 요청: 캐시 히트처럼 한 번 보내고 끝냄
+    if ((err = admin_response(c, iov, &n)) != ERR_NONE) {
+      ev_fail(ev, err);
+      return;
+    }
+    ev->state = EV_HIT;
+    ev_send(ev, &ev->client, c->fd, iov, n, client_send_done);
+    return;
+  }
+
+  if ((ev->node = lookup_cache(c))) {
+    conn_deadline(c, CONN_IDLE);
+    ev->state = EV_HIT;
+    n = cache_iov(ev->node, iov, ev->hit_hdr, !strcasecmp(c->method, "HEAD"));
+    ev_send(ev, &ev->client, c->fd, iov, n, client_send_done);
+    return;
+  }
+  upstream_pick(c);
+  ev_resolve(ev);
+}
+
+/* 받은 n 바이트를 c->resp_hdr에 이어 붙인다 (http_collect) */
+static int ev_collect(ev_conn *ev, char *buf, int n, int *used) {
+  return http_collect(ev->c->resp_hdr, MAXBUF, &ev->len, buf, n, used);
+}
+
+static void client_recv_done(io_req *req, int res) {
+  ev_conn *ev;
+  conn_t *c;
+  int hdrlen, used, old;
+
+  if (!(ev = ev_done(req)))
+    return;
+  c = ev->c;
+  if (res <= 0 || c->timed_out) {
+    if (req->buf)
+      io->buf_put(req);
+    if (c->timed_out)
+      ev_fail(ev, ERR_HEADER_TIMEOUT);
+    else
+      ev_finish(ev, res < 0 ? ERR_CLIENT_READ : ERR_CLIENT_CLOSED);
+    return;
+  }
+  old = ev->len;
+  if ((hdrlen = ev_collect(ev, req->buf, res, &used)) <= 0)
+    io->buf_put(req);             // 요청 헤더는 복사했으므로 버퍼는 바로 반납
+  if (hdrlen < 0)
+    ev_fail(ev, ERR_HEADER_TOO_LARGE);
+  else if (hdrlen == 0)
+    ev_recv(ev, &ev->client, c->fd, client_recv_done);
+  else {
+    ev->body_off = hdrlen - old;  // 이번에 받은 것 중 헤더 뒤
+    ev->body_len = res - ev->body_off;
+    ev_request(ev, hdrlen);
+  }
+}
+
+/* 요청을 다 보냈으니 응답 헤더를 기다린다 */
+static void ev_response(ev_conn *ev) {
+  ev->state = EV_RESPONSE;
+  ev->len = 0;
+  ev_recv(ev, &ev->upstream, ev->c->serverfd, upstream_recv_done);
+}
+
+/*
+ * ev_body - 요청 헤더를 보냈으니 바디를 보낸다. 클라이언트가 100을
+ *     기다리면 먼저 보내고, 헤더와 같이 받은 바이트(client.buf)부터 보낸
+ *     뒤로는 client 요청으로 받고 upstream 요청으로 보내기를 번갈아 한다.
+ */
+static void ev_body(ev_conn *ev) {
+  conn_t *c = ev->c;
+  struct iovec iov;
+  int niov;
+
+  ev->state = EV_BODY;
+  reqbody_start(c, &ev->b);
+  if ((niov = reqbody_continue(c, &iov)))
+    ev_send(ev, &ev->client, c->fd, &iov, niov, client_send_done);
+  else
+    ev_body_next(ev);
+}
+
+/* 받은 바디 n 바이트를 변환해서 원 서버로 보낸다 (버퍼는 보낸 뒤에 반납) */
+static void ev_body_data(ev_conn *ev, char *buf, int n) {
+  conn_t *c = ev->c;
+  int err, niov;
+
+  if ((err = reqbody_data(&ev->b, buf, n, &niov)) != ERR_NONE)
+    ev_fail(ev, err);
+  else if (niov)
+    ev_send(ev, &ev->upstream, c->serverfd, ev->b.iov, niov, body_send_done);
+  else
+    ev_body_next(ev);
+}
+
+/* 보낸 버퍼를 반납하고 다음 바디를 받는다. 다 보냈으면 응답을 기다린다 */
+static void ev_body_next(ev_conn *ev) {
+  conn_t *c = ev->c;
+  int n;
+
+  if (ev->body_len > 0) {         // 요청 헤더와 같이 받은 바디
+    n = ev->body_len;
+    ev->body_len = 0;
+    ev_body_data(ev, ev->client.buf + ev->body_off, n);
+    return;
+  }
+  if (ev->client.buf)
+    io->buf_put(&ev->client);
+  if (!reqbody_done(&ev->b)) {
+    ev_recv(ev, &ev->client, c->fd, body_recv_done);
+    return;
+  }
+  conn_deadline(c, CONN_FIRST_BYTE);
+  ev_response(ev);
+}
+
+static void body_recv_done(io_req *req, int res) {
+  ev_conn *ev;
+  conn_t *c;
+
+  if (!(ev = ev_done(req)))
+    return;
+  c = ev->c;
+  if (res <= 0) {
+    ev_fail(ev, reqbody_error(c, res < 0 ? ERR_CLIENT_READ : ERR_CLIENT_CLOSED));
+    return;
+  }
+  conn_touch(c);
+  ev_body_data(ev, req->buf, res);
+}
+
+static void body_send_done(io_req *req, int res) {
+  ev_conn *ev;
+
+  if (!(ev = ev_done(req)))
+    return;
+  if (res < 0) {
+    ev_fail(ev, reqbody_error(ev->c, ERR_UPSTREAM_WRITE));
+    return;
+  }
+  conn_touch(ev->c);
+  ev_body_next(ev);
+}
+
+/* 원 서버 버퍼를 다 보냈으니 반납하고, 바디가 남았으면 다음을 받는다 */
+static void ev_relay_next(ev_conn *ev) {
+  conn_t *c = ev->c;
+
+  if (ev->upstream.buf)
+    io->buf_put(&ev->upstream);
+  if (relay_done(&ev->r))
+    ev_finish(ev, relay_finish(c, &ev->r));
+  else
+    ev_recv(ev, &ev->upstream, c->serverfd, upstream_recv_done);
+}
+
+/* 받은 바디 n 바이트를 변환해서 클라이언트로 보낸다 (버퍼는 보낸 뒤에 반납) */
+static void ev_relay_data(ev_conn *ev, char *buf, int n) {
+  conn_t *c = ev->c;
+  int err, niov;
+
+  if ((err = relay_data(c, &ev->r, buf, n, &niov)) != ERR_NONE) {
+    ev_finish(ev, err);
+    return;
+  }
+  if (niov)
+    ev_send(ev, &ev->client, c->fd, ev->r.iov, niov, client_send_done);
+  else
+    ev_relay_next(ev);
+}
+
+static void upstream_recv_done(io_req *req, int res) {
+  ev_conn *ev;
+  conn_t *c;
+  int hdrlen, used, niov, old;
+
+  if (!(ev = ev_done(req)))
+    return;
+  c = ev->c;
+  if (ev->state == EV_RELAY) {
+    if (res < 0)
+      ev_finish(ev, relay_error(c, ERR_UPSTREAM_READ));
+    else if (res == 0)
+      ev_finish(ev, relay_finish(c, &ev->r));
+    else {
+      conn_touch(c);
+      ev_relay_data(ev, req->buf, res);
+    }
+    return;
+  }
+
+  /* 응답 헤더: 빈 줄까지 모아서 파싱. 같이 온 바디는 버퍼에 남겨 둔다 */
+  if (res <= 0) {
+    ev_fail(ev, c->timed_out ? ERR_FIRST_BYTE_TIMEOUT : ERR_BAD_RESPONSE);
+    return;
+  }
+  old = ev->len;
+  hdrlen = ev_collect(ev, req->buf, res, &used);
+  if (hdrlen == 0) {
+    io->buf_put(req);
+    ev_recv(ev, &ev->upstream, c->serverfd, upstream_recv_done);
+    return;
+  }
+  if (hdrlen < 0 || relay_start(c, &ev->r, hdrlen, &niov) != ERR_NONE) {
+    io->buf_put(req);
+    ev_fail(ev, ERR_BAD_RESPONSE);
+    return;
+  }
+  ev->body_off = hdrlen - old;    // 이번에 받은 것 중 헤더 뒤
+  ev->body_len = res - ev->body_off;
+  ev->state = EV_RELAY;
+  ev_send(ev, &ev->client, c->fd, ev->r.iov, niov, client_send_done);
+}
+
+static void client_send_done(io_req *req, int res) {
+  ev_conn *ev;
+  conn_t *c;
+  int n;
+
+  if (!(ev = ev_done(req)))
+    return;
+  c = ev->c;
+  switch (ev->state) {
+  case EV_ERROR:
+    ev_finish(ev, ev->err);
+    return;
+  case EV_HIT:
+    ev_finish(ev, res < 0 ? relay_error(c, ERR_CLIENT_WRITE) : ERR_NONE);
+    return;
+  case EV_BODY:                   // 100 Continue
+    if (res < 0)
+      ev_finish(ev, ERR_CLIENT_WRITE);
+    else
+      ev_body_next(ev);
+    return;
+  }
+
+  /* EV_RELAY: 응답 헤더나 바디 조각을 보냈음 */
+  if (res < 0) {
+    ev_finish(ev, relay_error(c, ERR_CLIENT_WRITE));
+    return;
+  }
+  conn_touch(c);
+  if (ev->body_len > 0 && ev->r.has_body) {   // 헤더와 같이 받은 바디
+    n = ev->body_len;
+    ev->body_len = 0;
+    ev_relay_data(ev, ev->upstream.buf + ev->body_off, n);
+    return;
+  }
+  if (!ev->r.has_body)
+    ev_finish(ev, ERR_NONE);
+  else
+    ev_relay_next(ev);
+}
+
+/*
+ * ev_tunnel - CONNECT: 원 서버에 연결했으니 200을 보내고 두 방향을 따로
+ *     잇는다. client 요청은 클라이언트 -> 원 서버, upstream 요청은 원
+ *     서버 -> 클라이언트를 맡아 받은 버퍼를 그대로 반대쪽에 보내고, 다
+ *     보내면 반납하고 다시 받는다. 한쪽이 닫으면 반대쪽의 쓰기만 닫는다.
+ */
+static void ev_tunnel(ev_conn *ev) {
+  conn_t *c = ev->c;
+  struct iovec iov;
+
+  ev->state = EV_TUNNEL;
+  ev->open = 2;
+  ev_send(ev, &ev->upstream, c->fd, &iov, tunnel_reply(c, &iov), tunnel_send_done);
+  ev_recv(ev, &ev->client, c->fd, tunnel_recv_done);
+}
+
+/* 한 방향이 끝났다 (err면 실패). 실패하면 소켓을 끊어 다른 방향의 I/O도
+ * 끝나게 하고, 요청은 마지막 방향이 끝낸다 (걸린 I/O가 있으면 닫을 수 없음) */
+static void tunnel_close(ev_conn *ev, int err) {
+  conn_t *c = ev->c;
+
+  if (err != ERR_NONE && ev->err == ERR_NONE) {
+    ev->err = err;
+    shutdown(c->fd, SHUT_RDWR);
+    shutdown(c->serverfd, SHUT_RDWR);
+  }
+  if (--ev->open == 0)
+    ev_finish(ev, ev->err);
+}
+
+static void tunnel_recv_done(io_req *req, int res) {
+  struct iovec iov;
+  ev_conn *ev;
+  conn_t *c;
+  int up;
+
+  if (!(ev = ev_done(req)))
+    return;
+  c = ev->c;
+  up = req == &ev->client;
+  if (res > 0 && ev->err != ERR_NONE) {
+    io->buf_put(req);
+    tunnel_close(ev, ERR_NONE);
+  } else if (res > 0) {
+    conn_touch(c);
+    iov.iov_base = req->buf;
+    iov.iov_len = res;
+    ev_send(ev, req, up ? c->serverfd : c->fd, &iov, 1, tunnel_send_done);
+  } else if (res < 0 || c->timed_out) {
+    tunnel_close(ev, c->timed_out ? ERR_IDLE_TIMEOUT : up ? ERR_CLIENT_READ : ERR_UPSTREAM_READ);
+  } else {
+    shutdown(up ? c->serverfd : c->fd, SHUT_WR);   // 반대쪽 방향은 계속 잇는다
+    tunnel_close(ev, ERR_NONE);
+  }
+}
+
+static void tunnel_send_done(io_req *req, int res) {
+  ev_conn *ev;
+  conn_t *c;
+  int up;
+
+  if (!(ev = ev_done(req)))
+    return;
+  c = ev->c;
+  up = req == &ev->client;
+  if (req->buf) {                 // 원 서버 -> 클라이언트의 첫 send(200)는 버퍼가 없음
+    io->buf_put(req);
+    if (res >= 0)
+      tunnel_count(c, !up, res);
+  }
+  if (res < 0)
+    tunnel_close(ev, relay_error(c, up ? ERR_UPSTREAM_WRITE : ERR_CLIENT_WRITE));
+  else if (ev->err != ERR_NONE)
+    tunnel_close(ev, ERR_NONE);
+  else
+    ev_recv(ev, req, up ? c->fd : c->serverfd, tunnel_recv_done);
+}
@@ -0,0 +1,11 @@
+#ifndef __EVPROXY_H__
+#define __EVPROXY_H__
+
+#include "ioengine.h"
+
+int ev_init(io_engine *engine, int listenfd);
+void ev_stop_accept(void);
+int ev_wait(int timeout_ms);
+size_t ev_conn_size(void);
+
+#endif /* __EVPROXY_H__ */
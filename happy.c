@@ -0,0 +1,218 @@
+#include "happy.h"
+#include "timer.h"
+
+/* 주소를 첫 주소의 가족부터 IPv6/IPv4가 번갈아 오도록 늘어놓는다 */
+static void order_addrs(he_connect *hc, struct addrinfo *list) {
+  struct addrinfo *p, *q[2][HE_MAX_ADDRS];
+  int n[2] = {0, 0}, i[2] = {0, 0}, f;
+
+  for (p = list; p; p = p->ai_next) {
+    f = p->ai_family != list->ai_family;
+    if (n[f] < HE_MAX_ADDRS && p->ai_addrlen <= sizeof(struct sockaddr_storage))
+      q[f][n[f]++] = p;
+  }
+  for (f = 0; hc->naddrs < HE_MAX_ADDRS && (i[0] < n[0] || i[1] < n[1]); f ^= 1) {
+    if (i[f] < n[f]) {
+      p = q[f][i[f]++];
+      memcpy(&hc->addrs[hc->naddrs], p->ai_addr, p->ai_addrlen);
+      hc->addrlens[hc->naddrs++] = p->ai_addrlen;
+    }
+  }
+}
+
+/* fd가 연결되었으니 나머지 시도는 모두 닫는다 */
+static void he_win(he_connect *hc, int fd) {
+  int i;
+
+  for (i = 0; i < hc->naddrs; i++) {
+    if (hc->fds[i] >= 0 && hc->fds[i] != fd)
+      close(hc->fds[i]);
+    hc->fds[i] = -1;
+  }
+  hc->fd = fd;
+}
+
+static int he_inflight(he_connect *hc) {
+  int i, n = 0;
+
+  for (i = 0; i < hc->naddrs; i++)
+    n += hc->fds[i] >= 0;
+  return n;
+}
+
+/*
+ * start_next - 아직 시도하지 않은 다음 주소로 non-blocking connect를 건다.
+ *     바로 실패하는 주소(ENETUNREACH 등)는 건너뛴다.
+ *
+ *     반환값: 바로 연결되면 1, 연결 중이면 0, 남은 주소가 없으면 -1
+ */
+static int start_next(he_connect *hc, long long now) {
+  struct sockaddr *sa;
+  int fd, i;
+
+  while (hc->next < hc->naddrs) {
+    i = hc->next++;
+    sa = (SA *)&hc->addrs[i];
+    if ((fd = socket(sa->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+      hc->error = errno;
+      continue;
+    }
+    if (connect(fd, sa, hc->addrlens[i]) == 0) {
+      he_win(hc, fd);
+      return 1;
+    }
+    if (errno == EINPROGRESS) {
+      hc->fds[i] = fd;
+      hc->next_start = now + HE_STAGGER_MS;
+      return 0;
+    }
+    hc->error = errno;
+    close(fd);
+  }
+  return -1;
+}
+
+/* 진행 중인 시도가 없고 더 시도할 주소도 없으면 실패 */
+static int he_fail(he_connect *hc, int error) {
+  he_abort(hc);
+  hc->error = error ? error : ECONNREFUSED;
+  errno = hc->error;
+  return -1;
+}
+
+/*
+ * he_start - list의 주소로 연결을 시작한다. list는 바로 해제해도 된다.
+ *     timeout_ms가 0이면 마감 시간 없음.
+ *
+ *     반환값: 연결되었으면 1 (hc->fd), 연결 중이면 0, 실패하면 -1 (errno)
+ */
+int he_start(he_connect *hc, struct addrinfo *list, int timeout_ms) {
+  long long now = timer_now();
+  int i;
+
+  hc->naddrs = hc->next = 0;
+  hc->fd = -1;
+  hc->error = 0;
+  for (i = 0; i < HE_MAX_ADDRS; i++)
+    hc->fds[i] = -1;
+  hc->deadline = timeout_ms > 0 ? now + timeout_ms : 0;
+  if (list)
+    order_addrs(hc, list);
+  if (start_next(hc, now) == 1)
+    return 1;
+  return he_inflight(hc) ? 0 : he_fail(hc, hc->error);
+}
+
+/* 진행 중인 시도를 pfds에 채운다 (쓰기 가능해지면 연결이 끝난 것). 반환값: 채운 수 */
+int he_pollfds(he_connect *hc, struct pollfd *pfds, int max) {
+  int i, n = 0;
+
+  for (i = 0; i < hc->naddrs && n < max; i++) {
+    if (hc->fds[i] >= 0) {
+      pfds[n].fd = hc->fds[i];
+      pfds[n].events = POLLOUT;
+      pfds[n++].revents = 0;
+    }
+  }
+  return n;
+}
+
+/* 다음 주소를 시작하거나 마감 시간이 될 때까지 남은 시간 (ms), 없으면 -1 */
+int he_timeout(he_connect *hc) {
+  long long now = timer_now(), wait = -1;
+
+  if (hc->next < hc->naddrs)
+    wait = hc->next_start - now;
+  if (hc->deadline && (wait < 0 || hc->deadline - now < wait))
+    wait = hc->deadline - now;
+  return wait < 0 && (hc->deadline || hc->next < hc->naddrs) ? 0 : wait;
+}
+
+/*
+ * he_step - poll 결과(pfds)를 반영한다. 끝난 시도의 결과를 보고, 실패한
+ *     시도가 있거나 간격이 지났으면 다음 주소를 시작한다. 이벤트가 없어도
+ *     he_timeout()이 지나면 불러야 한다.
+ *
+ *     반환값: 연결되었으면 1 (hc->fd), 연결 중이면 0, 실패하면 -1 (errno)
+ */
+int he_step(he_connect *hc, struct pollfd *pfds, int npfds) {
+  long long now = timer_now();
+  socklen_t len;
+  int i, j, err;
+
+  for (i = 0; i < npfds; i++) {
+    if (!pfds[i].revents)
+      continue;
+    for (j = 0; j < hc->naddrs && hc->fds[j] != pfds[i].fd; j++)
+      ;
+    if (j == hc->naddrs)
+      continue;
+    len = sizeof(err);
+    if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+      err = errno;
+    if (err == 0) {
+      he_win(hc, pfds[i].fd);
+      return 1;
+    }
+    hc->error = err;
+    close(hc->fds[j]);
+    hc->fds[j] = -1;
+    hc->next_start = now;         // 실패했으면 기다리지 않고 다음 주소
+  }
+
+  if (hc->deadline && now >= hc->deadline)
+    return he_fail(hc, ETIMEDOUT);
+  if (hc->next < hc->naddrs && now >= hc->next_start && start_next(hc, now) == 1)
+    return 1;
+  return he_inflight(hc) ? 0 : he_fail(hc, hc->error);
+}
+
+/* 진행 중인 시도를 모두 닫는다 (이미 연결된 hc->fd는 닫지 않음) */
+void he_abort(he_connect *hc) {
+  int i;
+
+  for (i = 0; i < hc->naddrs; i++) {
+    if (hc->fds[i] >= 0)
+      close(hc->fds[i]);
+    hc->fds[i] = -1;
+  }
+  hc->next = hc->naddrs;
+}
+
+/* 원 서버 주소 목록 (getaddrinfo). 실패는 여기서 찍지 않고 호출한 쪽이
+ * ERR_DNS로 센다 (잘못된 이름을 되풀이하는 클라이언트가 로그를 채우지 않게).
+ * 반환값: 0, 찾지 못했으면 getaddrinfo의 오류 코드 (EAI_*) */
+int he_resolve(char *hostname, char *port, struct addrinfo **listp) {
+  struct addrinfo hints;
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  return getaddrinfo(hostname, port, &hints, listp);
+}
+
+/*
+ * he_open - he_resolve로 찾은 주소로 he_*를 poll로 돌려 blocking으로
+ *     연결한다. timeout_ms 안에 연결하지 못하면 errno = ETIMEDOUT으로
+ *     실패한다. 돌려주는 소켓은 blocking 모드.
+ *
+ *     반환값: 소켓, 실패하면 -1 (errno)
+ */
+int he_open(struct addrinfo *list, int timeout_ms) {
+  struct pollfd pfds[HE_MAX_ADDRS];
+  he_connect hc;
+  int rc = he_start(&hc, list, timeout_ms), n;
+
+  while (rc == 0) {
+    n = he_pollfds(&hc, pfds, HE_MAX_ADDRS);
+    if (poll(pfds, n, he_timeout(&hc)) < 0 && errno != EINTR) {
+      he_abort(&hc);
+      return -1;
+    }
+    rc = he_step(&hc, pfds, n);
+  }
+  if (rc < 0)
+    return -1;
+  fcntl(hc.fd, F_SETFL, fcntl(hc.fd, F_GETFL) & ~O_NONBLOCK);
+  return hc.fd;
+}
@@ -0,0 +1,35 @@
+#ifndef __HAPPY_H__
+#define __HAPPY_H__
+
+#include "csapp.h"
+
+#define HE_MAX_ADDRS   8        // 시도할 최대 주소 수
+#define HE_STAGGER_MS  250      // 앞 시도가 끝나지 않았을 때 다음 주소를 시작하는 간격 (RFC 8305)
+
+/*
+ * 원 서버 연결 시도 (Happy Eyeballs). 주소를 IPv6/IPv4가 번갈아 오도록
+ * 늘어놓고, 앞 시도가 HE_STAGGER_MS 안에 끝나지 않거나 실패하면 다음
+ * 주소를 동시에 시작해서 먼저 연결된 쪽을 쓴다. 모든 소켓은 non-blocking
+ * 이라 he_pollfds/he_timeout/he_step으로 어떤 이벤트 루프에도 붙일 수 있다.
+ */
+typedef struct {
+  struct sockaddr_storage addrs[HE_MAX_ADDRS];  // 시도 순서대로
+  socklen_t addrlens[HE_MAX_ADDRS];
+  int naddrs;
+  int next;                     // 다음에 시작할 주소
+  int fds[HE_MAX_ADDRS];        // 진행 중인 시도 (-1이면 빈 자리)
+  long long next_start;         // 다음 주소를 시작할 시각 (ms)
+  long long deadline;           // 전체 연결 마감 시각, 제한이 없으면 0
+  int fd;                       // 연결된 소켓, 아직 없으면 -1
+  int error;                    // 마지막 실패 원인 (errno)
+} he_connect;
+
+int he_start(he_connect *hc, struct addrinfo *list, int timeout_ms);
+int he_pollfds(he_connect *hc, struct pollfd *pfds, int max);
+int he_timeout(he_connect *hc);
+int he_step(he_connect *hc, struct pollfd *pfds, int npfds);
+void he_abort(he_connect *hc);
+int he_resolve(char *hostname, char *port, struct addrinfo **listp);
+int he_open(struct addrinfo *list, int timeout_ms);
+
+#endif /* __HAPPY_H__ */
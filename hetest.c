@@ -0,0 +1,131 @@
+/*
+ * hetest.c - happy.c의 he_start/he_step을 실제 소켓으로 확인한다.
+ *     backlog 0인 리스너의 accept 큐를 채우면 그 뒤의 SYN은 버려지므로
+ *     connect가 끝나지 않는 주소(blackhole)가 된다. 이 주소 뒤에 살아 있는
+ *     주소를 두면 HE_STAGGER_MS 뒤에 두 번째 주소로 연결되어야 하고,
+ *     주소가 모두 blackhole이면 마감 시간에 ETIMEDOUT으로 끝나야 한다.
+ *
+ *     usage: ./hetest
+ */
+#include "csapp.h"
+#include "happy.h"
+#include "timer.h"
+
+#define SLACK_MS    100         // 기대한 시각보다 늦어도 되는 정도
+#define DEADLINE_MS 1000        // 모두 blackhole일 때의 마감 시간
+
+static int failed;
+
+/* 127.0.0.1의 빈 포트에 리스너를 연다. addr에 주소를 채운다 */
+static int listener(struct sockaddr_in *addr, int backlog) {
+  socklen_t len = sizeof(*addr);
+  int fd = Socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (SA *)addr, len) < 0 || listen(fd, backlog) < 0
+      || getsockname(fd, (SA *)addr, &len) < 0)
+    unix_error("listener");
+  return fd;
+}
+
+/* accept하지 않는 backlog 0 리스너의 큐를 채워 blackhole을 만든다.
+ * 큐에 들어간 연결은 열어 둬야 자리를 계속 차지한다 */
+static int blackhole(struct sockaddr_in *addr) {
+  struct pollfd pfd;
+  int fd = listener(addr, 0), i;
+
+  for (i = 0; i < 16; i++) {
+    pfd.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    pfd.events = POLLOUT;
+    if (connect(pfd.fd, (SA *)addr, sizeof(*addr)) < 0 && errno != EINPROGRESS)
+      unix_error("blackhole connect");
+    if (poll(&pfd, 1, 200) == 0) {
+      close(pfd.fd);              // 이 SYN은 버려졌다: 큐가 찼다
+      return fd;
+    }
+  }
+  app_error("blackhole: the accept queue never filled");
+  return -1;
+}
+
+/* addrs[0..n)을 이어 붙인 addrinfo 목록 (he_start는 복사만 한다) */
+static struct addrinfo *addr_list(struct addrinfo *ai, struct sockaddr_in *addrs, int n) {
+  int i;
+
+  memset(ai, 0, n * sizeof(*ai));
+  for (i = 0; i < n; i++) {
+    ai[i].ai_family = AF_INET;
+    ai[i].ai_socktype = SOCK_STREAM;
+    ai[i].ai_addr = (SA *)&addrs[i];
+    ai[i].ai_addrlen = sizeof(addrs[i]);
+    ai[i].ai_next = i + 1 < n ? &ai[i + 1] : NULL;
+  }
+  return ai;
+}
+
+/* he_start/he_step을 poll로 돌린다 (he_open과 같은 고리, 소켓은 non-blocking 그대로) */
+static int run(he_connect *hc, struct addrinfo *list, int timeout_ms, long long *ms) {
+  struct pollfd pfds[HE_MAX_ADDRS];
+  long long t0 = timer_now();
+  int rc = he_start(hc, list, timeout_ms), n;
+
+  while (rc == 0) {
+    n = he_pollfds(hc, pfds, HE_MAX_ADDRS);
+    if (poll(pfds, n, he_timeout(hc)) < 0 && errno != EINTR)
+      unix_error("poll");
+    rc = he_step(hc, pfds, n);
+  }
+  *ms = timer_now() - t0;
+  return rc;
+}
+
+static void check(char *what, int ok, long long ms, char *got) {
+  printf("%-5s %-40s %5lld ms  %s\n", ok ? "ok" : "FAIL", what, ms, got);
+  failed += !ok;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_in addrs[2], peer;
+  struct addrinfo ai[2];
+  socklen_t len = sizeof(peer);
+  he_connect hc;
+  long long ms;
+  int rc, ok;
+
+  Signal(SIGPIPE, SIG_IGN);
+
+  /* blackhole 다음의 살아 있는 주소: HE_STAGGER_MS 뒤에 연결 */
+  blackhole(&addrs[0]);
+  listener(&addrs[1], LISTENQ);
+  rc = run(&hc, addr_list(ai, addrs, 2), 5000, &ms);
+  ok = rc == 1 && getpeername(hc.fd, (SA *)&peer, &len) == 0
+       && peer.sin_port == addrs[1].sin_port
+       && ms >= HE_STAGGER_MS && ms < HE_STAGGER_MS + SLACK_MS;
+  check("blackhole, live: second address wins", ok, ms,
+        rc == 1 ? "connected" : strerror(hc.error));
+  if (rc == 1)
+    close(hc.fd);
+
+  /* 거절하는 주소는 간격을 기다리지 않고 다음 주소로 */
+  close(listener(&addrs[0], LISTENQ));  // 닫은 리스너의 포트는 RST로 거절
+  rc = run(&hc, addr_list(ai, addrs, 2), 5000, &ms);
+  ok = rc == 1 && ms < SLACK_MS;
+  check("refused, live: no stagger wait", ok, ms,
+        rc == 1 ? "connected" : strerror(hc.error));
+  if (rc == 1)
+    close(hc.fd);
+
+  /* 모두 blackhole: 마감 시간에 ETIMEDOUT */
+  blackhole(&addrs[0]);
+  blackhole(&addrs[1]);
+  rc = run(&hc, addr_list(ai, addrs, 2), DEADLINE_MS, &ms);
+  ok = rc == -1 && hc.error == ETIMEDOUT && errno == ETIMEDOUT
+       && ms >= DEADLINE_MS && ms < DEADLINE_MS + SLACK_MS;
+  check("blackhole, blackhole: ETIMEDOUT", ok, ms,
+        rc == 1 ? "connected" : strerror(hc.error));
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  exit(failed ? 1 : 0);
+}
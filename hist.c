@@ -0,0 +1,83 @@
+#include <string.h>
+#include "hist.h"
+
+#define SUB_COUNT (1 << HIST_SUB_BITS)
+#define HALF      (1 << (HIST_SUB_BITS - 1))
+
+/* v가 들어갈 칸. 2^B 이상이면 위쪽 B비트만 남기고 자른 자릿수(shift)로 구간을 고른다 */
+static int hist_index(long long v) {
+  int shift;
+
+  if (v < SUB_COUNT)
+    return v < 0 ? 0 : v;
+  shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+  if (shift > HIST_MAX_SHIFT)
+    return HIST_SIZE - 1;
+  return (shift << (HIST_SUB_BITS - 1)) + (int)(v >> shift);
+}
+
+/* 칸 idx에 들어가는 가장 큰 값 */
+static long long hist_value(int idx) {
+  int shift;
+
+  if (idx < SUB_COUNT)
+    return idx;
+  shift = (idx >> (HIST_SUB_BITS - 1)) - 1;
+  return ((long long)(idx - (shift << (HIST_SUB_BITS - 1))) << shift) + (1LL << shift) - 1;
+}
+
+void hist_init(histogram *h) {
+  memset(h, 0, sizeof(histogram));
+}
+
+void hist_record(histogram *h, long long v) {
+  h->counts[hist_index(v)]++;
+  if (!h->total || v < h->min)
+    h->min = v;
+  if (v > h->max)
+    h->max = v;
+  h->total++;
+  h->sum += v;
+}
+
+/* src를 dst에 더한다 */
+void hist_merge(histogram *dst, const histogram *src) {
+  int i;
+
+  if (!src->total)
+    return;
+  for (i = 0; i < HIST_SIZE; i++)
+    dst->counts[i] += src->counts[i];
+  if (!dst->total || src->min < dst->min)
+    dst->min = src->min;
+  if (src->max > dst->max)
+    dst->max = src->max;
+  dst->total += src->total;
+  dst->sum += src->sum;
+}
+
+/* 기록의 p%가 이 값 이하. 비어 있으면 0, 100이면 최댓값 */
+long long hist_percentile(const histogram *h, double p) {
+  unsigned long want, seen = 0;
+  long long v;
+  int i;
+
+  if (!h->total)
+    return 0;
+  if (p >= 100)
+    return h->max;
+  want = (unsigned long)(p / 100 * h->total + 0.999999);
+  if (want < 1)
+    want = 1;
+  for (i = 0; i < HIST_SIZE; i++) {
+    if ((seen += h->counts[i]) >= want) {
+      v = hist_value(i);
+      return v < h->max ? v : h->max;
+    }
+  }
+  return h->max;
+}
+
+double hist_mean(const histogram *h) {
+  return h->total ? h->sum / h->total : 0;
+}
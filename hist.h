@@ -0,0 +1,27 @@
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#define HIST_SUB_BITS  11       // 2의 거듭제곱 구간마다 1024칸: 상대 오차 0.1% 이하
+#define HIST_MAX_SHIFT 30       // 2^41 (us면 약 25일)까지, 넘으면 맨 끝 칸
+#define HIST_SIZE      ((HIST_MAX_SHIFT + 2) << (HIST_SUB_BITS - 1))
+
+/*
+ * HdrHistogram 방식의 log-linear 히스토그램. 값이 2^HIST_SUB_BITS보다
+ * 작으면 칸 하나에 값 하나, 그 위로는 2의 거듭제곱 구간마다 같은 수의
+ * 칸으로 나누므로 어느 크기에서나 유효 숫자 세 자리를 유지한다.
+ * 기록은 배열 한 칸을 더하는 것뿐이라 스레드마다 하나씩 두고 나중에 합친다.
+ */
+typedef struct {
+  unsigned long counts[HIST_SIZE];
+  unsigned long total;
+  long long min, max;
+  double sum;
+} histogram;
+
+void hist_init(histogram *h);
+void hist_record(histogram *h, long long v);
+void hist_merge(histogram *dst, const histogram *src);
+long long hist_percentile(const histogram *h, double p);
+double hist_mean(const histogram *h);
+
+#endif /* __HIST_H__ */
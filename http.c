@@ -0,0 +1,245 @@
+#include "http.h"
+
+/* 프록시가 다음 홉으로 넘기면 안 되는 헤더 (RFC 7230 6.1) */
+static const char *hop_by_hop[] = {
+  "Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authenticate",
+  "Proxy-Authorization", "TE", "Trailer", "Transfer-Encoding", "Upgrade", NULL
+};
+
+static int name_is(http_field *f, const char *name) {
+  return f->name_len == (int)strlen(name) && !strncasecmp(f->name, name, f->name_len);
+}
+
+/* 값 안에서 대소문자 구분 없이 token이 있는지 확인 */
+static int value_has(http_field *f, const char *token) {
+  int len = strlen(token), i;
+  for (i = 0; i + len <= f->value_len; i++)
+    if (!strncasecmp(f->value + i, token, len))
+      return 1;
+  return 0;
+}
+
+/* Cache-Control 값에서 "name=숫자"를 찾아 반환, 없으면 -1 */
+static long directive_value(http_field *f, const char *name) {
+  int len = strlen(name), i;
+  for (i = 0; i + len < f->value_len; i++) {
+    if (!strncasecmp(f->value + i, name, len) && f->value[i + len] == '='
+        && (i == 0 || f->value[i - 1] == ' ' || f->value[i - 1] == ','))
+      return atol(f->value + i + len + 1);
+  }
+  return -1;
+}
+
+/*
+ * http_read_header - 상태 줄부터 빈 줄까지의 헤더 블록을 buf에 읽는다.
+ *     바디는 rio 버퍼에 남겨둔다.
+ *
+ *     반환값: 헤더 블록 길이, 연결이 끊겼거나 buf가 모자라면 -1
+ */
+int http_read_header(rio_t *rio, char *buf, int size) {
+  int len = 0;
+  ssize_t n;
+
+  while ((n = rio_readlineb(rio, buf + len, size - len)) > 0) {
+    if (buf[len + n - 1] != '\n')
+      return -1;                    // 줄이 너무 길거나 중간에 끊김
+    len += n;
+    if (len > n && (!strcmp(buf + len - n, "\r\n") || !strcmp(buf + len - n, "\n")))
+      return len;                   // 빈 줄 (상태 줄 다음부터만 검사)
+    if (size - len <= 1)
+      return -1;
+  }
+  return -1;
+}
+
+/*
+ * http_header_end - buf에 받아 둔 len 바이트에서 헤더 블록(첫 줄부터 빈
+ *     줄까지)의 끝을 찾는다. 이벤트 루프처럼 읽은 만큼씩 모으는 쪽에서 쓴다.
+ *
+ *     반환값: 헤더 블록 길이, 아직 빈 줄이 오지 않았으면 0
+ */
+int http_header_end(char *buf, int len) {
+  char *p = buf, *end = buf + len;
+
+  while ((p = memchr(p, '\n', end - p))) {
+    p++;
+    if (p < end && *p == '\n')
+      return p + 1 - buf;
+    if (p + 1 < end && p[0] == '\r' && p[1] == '\n')
+      return p + 2 - buf;
+  }
+  return 0;
+}
+
+/*
+ * http_collect - 받은 n 바이트를 hdr(size 바이트)의 *len 뒤에 이어 붙이고
+ *     헤더 블록이 끝났는지 본다. 끝났으면 hdr을 '\0'으로 끝낸다.
+ *     *used는 복사한 바이트 (나머지는 헤더 뒤에 같이 온 바디).
+ *
+ *     반환값: 헤더 블록 길이, 아직이면 0, hdr이 가득 찼으면 -1
+ */
+int http_collect(char *hdr, int size, int *len, char *buf, int n, int *used) {
+  int hdrlen;
+
+  *used = n < size - 1 - *len ? n : size - 1 - *len;
+  memcpy(hdr + *len, buf, *used);
+  *len += *used;
+  if ((hdrlen = http_header_end(hdr, *len)) > 0) {
+    hdr[hdrlen] = '\0';
+    return hdrlen;
+  }
+  return *len >= size - 1 ? -1 : 0;
+}
+
+/*
+ * http_parse_response - buf의 헤더 블록을 한 번만 훑으면서 필드를 나누고
+ *     캐시 판단에 필요한 값을 뽑는다. 필드는 buf 안을 가리키므로 buf는
+ *     resp를 쓰는 동안 유지되어야 한다.
+ *
+ *     반환값: 0, 형식 오류면 -1
+ */
+int http_parse_response(http_response *resp, char *buf, int len) {
+  char *p = buf, *end = buf + len, *eol, *colon, *v, *ve;
+  http_field *f;
+
+  resp->buf = buf;
+  resp->len = len;
+  resp->nfields = 0;
+  resp->content_length = -1;
+  resp->chunked = 0;
+  resp->no_store = 0;
+  resp->max_age = -1;
+  resp->age = 0;
+
+  /* 상태 줄: HTTP/1.x SP status SP reason */
+  if (len < 12 || strncmp(buf, "HTTP/1.", 7) || !isdigit(buf[7]) || buf[8] != ' ')
+    return -1;
+  resp->minor_version = buf[7] - '0';
+  resp->status = atoi(buf + 9);
+  if (resp->status < 100 || resp->status > 999)
+    return -1;
+  if (!(eol = memchr(p, '\n', end - p)))
+    return -1;
+  resp->status_len = eol + 1 - buf;
+  p = eol + 1;
+
+  while (p < end && *p != '\r' && *p != '\n') {
+    if (!(eol = memchr(p, '\n', end - p)))
+      return -1;
+    if (!(colon = memchr(p, ':', eol - p)) || colon == p)
+      return -1;
+    if (resp->nfields == HTTP_MAX_FIELDS)
+      return -1;
+    f = &resp->fields[resp->nfields++];
+    f->line = p;
+    f->line_len = eol + 1 - p;
+    f->name = p;
+    f->name_len = colon - p;
+    for (v = colon + 1; v < eol && (*v == ' ' || *v == '\t'); v++)
+      ;
+    for (ve = eol; ve > v && isspace(ve[-1]); ve--)
+      ;
+    f->value = v;
+    f->value_len = ve - v;
+    f->removed = 0;
+
+    if (name_is(f, "Content-Length")) {
+      resp->content_length = atol(f->value);
+    } else if (name_is(f, "Transfer-Encoding")) {
+      resp->chunked = value_has(f, "chunked");
+    } else if (name_is(f, "Age")) {
+      resp->age = atol(f->value);
+    } else if (name_is(f, "Cache-Control")) {
+      if (value_has(f, "no-store") || value_has(f, "no-cache") || value_has(f, "private"))
+        resp->no_store = 1;
+      if ((resp->max_age = directive_value(f, "s-maxage")) < 0)
+        resp->max_age = directive_value(f, "max-age");
+    }
+    p = eol + 1;
+  }
+  if (resp->chunked)
+    resp->content_length = -1;    // Transfer-Encoding이 Content-Length보다 우선
+  return 0;
+}
+
+/* name 헤더의 첫 번째 필드, 없으면 NULL */
+http_field *http_find(http_response *resp, const char *name) {
+  int i;
+  for (i = 0; i < resp->nfields; i++)
+    if (!resp->fields[i].removed && name_is(&resp->fields[i], name))
+      return &resp->fields[i];
+  return NULL;
+}
+
+/* name 헤더를 모두 전달 대상에서 뺀다 */
+void http_remove(http_response *resp, const char *name) {
+  int i;
+  for (i = 0; i < resp->nfields; i++)
+    if (name_is(&resp->fields[i], name))
+      resp->fields[i].removed = 1;
+}
+
+/* hop-by-hop 헤더와 Connection 헤더에 나열된 헤더를 뺀다 */
+void http_remove_hop_by_hop(http_response *resp) {
+  http_field *conn;
+  char name[MAXLINE];
+  int i, j, k;
+
+  while ((conn = http_find(resp, "Connection"))) {
+    for (i = 0; i < conn->value_len; i = j + 1) {
+      for (j = i; j < conn->value_len && conn->value[j] != ','; j++)
+        ;
+      for (k = i; k < j && conn->value[k] == ' '; k++)
+        ;
+      snprintf(name, sizeof(name), "%.*s", j - k, conn->value + k);
+      for (k = strlen(name); k > 0 && name[k - 1] == ' '; k--)
+        name[k - 1] = '\0';
+      if (name[0] && strcasecmp(name, "close"))
+        http_remove(resp, name);
+    }
+    conn->removed = 1;
+  }
+  for (i = 0; hop_by_hop[i]; i++)
+    http_remove(resp, hop_by_hop[i]);
+}
+
+/* 응답을 공유 캐시에 저장해도 되는지 */
+int http_cacheable(http_response *resp) {
+  switch (resp->status) {
+  case 200: case 203: case 300: case 301: case 410:
+    break;
+  default:
+    return 0;
+  }
+  return !resp->no_store && resp->max_age != 0;
+}
+
+/*
+ * http_header_iov - 상태 줄과 빼지 않은 헤더 줄을 iov에 채운다. 연속된
+ *     줄은 하나로 합치므로 고치지 않은 헤더 블록은 iov 하나가 된다.
+ *     마지막 빈 줄은 넣지 않으므로 호출한 쪽에서 헤더를 덧붙인 뒤 끝낸다.
+ *
+ *     반환값: 채운 iov 개수
+ */
+int http_header_iov(http_response *resp, struct iovec *iov, int max) {
+  int cnt = 0, i;
+  char *start = resp->buf, *next = resp->buf + resp->status_len;
+
+  for (i = 0; i < resp->nfields; i++) {
+    http_field *f = &resp->fields[i];
+    if (f->removed) {
+      if (next > start && cnt < max) {
+        iov[cnt].iov_base = start;
+        iov[cnt++].iov_len = next - start;
+      }
+      start = next = f->line + f->line_len;
+    } else {
+      next = f->line + f->line_len;
+    }
+  }
+  if (next > start && cnt < max) {
+    iov[cnt].iov_base = start;
+    iov[cnt++].iov_len = next - start;
+  }
+  return cnt;
+}
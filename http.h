@@ -0,0 +1,42 @@
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include "csapp.h"
+
+#define HTTP_MAX_FIELDS 100
+#define HTTP_MAX_IOV    (HTTP_MAX_FIELDS + 2)
+
+/* 헤더 필드 하나. 모든 포인터는 헤더 블록 안을 가리킨다 (복사하지 않음) */
+typedef struct {
+  char *name;  int name_len;
+  char *value; int value_len;   // 앞뒤 공백을 제외한 값
+  char *line;  int line_len;    // CRLF를 포함한 줄 전체
+  int removed;                  // 전달할 때 뺄 헤더
+} http_field;
+
+/* 한 번 파싱한 응답 헤더와 캐시 판단에 필요한 값 */
+typedef struct {
+  char *buf; int len;           // 헤더 블록 (상태 줄부터 빈 줄까지)
+  int status;                   // 상태 코드
+  int minor_version;            // HTTP/1.x의 x
+  int status_len;               // CRLF를 포함한 상태 줄 길이
+  int nfields;
+  http_field fields[HTTP_MAX_FIELDS];
+  long content_length;          // Content-Length, 없으면 -1
+  int chunked;                  // Transfer-Encoding: chunked
+  int no_store;                 // Cache-Control: no-store / no-cache / private
+  long max_age;                 // Cache-Control: s-maxage 또는 max-age, 없으면 -1
+  long age;                     // Age, 없으면 0
+} http_response;
+
+int http_read_header(rio_t *rio, char *buf, int size);
+int http_header_end(char *buf, int len);
+int http_collect(char *hdr, int size, int *len, char *buf, int n, int *used);
+int http_parse_response(http_response *resp, char *buf, int len);
+http_field *http_find(http_response *resp, const char *name);
+void http_remove(http_response *resp, const char *name);
+void http_remove_hop_by_hop(http_response *resp);
+int http_cacheable(http_response *resp);
+int http_header_iov(http_response *resp, struct iovec *iov, int max);
+
+#endif /* __HTTP_H__ */
@@ -0,0 +1,112 @@
+#!/bin/bash
+#
+# io-bench.sh - Compares the epoll and io_uring engines (proxy -E) by
+#     system calls per request, counted by the proxy itself on the I/O
+#     path (engine calls plus socket/close; name resolution is the same
+#     for both and is not counted), and proxy CPU time per request.
+#     Cache hits fetch home.html after one fill; misses fetch a distinct
+#     adder URI each time. Every phase runs once with one client at a
+#     time and once with CONCURRENCY clients in parallel, where io_uring
+#     can submit and reap many connections' I/O in one io_uring_enter.
+#
+#     usage: ./io-bench.sh [REQUESTS] [CONCURRENCY]
+#
+
+REQUESTS=${1:-500}
+CONCURRENCY=${2:-32}
+HOME_DIR=`pwd`
+CLK_TCK=`getconf CLK_TCK`
+
+#
+# cpu_ticks - user + system clock ticks consumed so far by a process
+# usage: cpu_ticks <pid>
+#
+function cpu_ticks {
+    awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+#
+# io_count - ask the proxy for its counters and print "syscalls requests"
+# usage: io_count <pid> <log>
+#
+function io_count {
+    local lines=`grep -c "^io:" $2`
+    kill -USR1 $1
+    while [ `grep -c "^io:" $2` -eq ${lines} ]
+    do
+        sleep 0.05
+    done
+    grep "^io:" $2 | tail -1 | awk '{ print $4, $6 }'
+}
+
+#
+# fetch_all - fetch REQUESTS URIs through the proxy, <clients> at a time.
+#     "{}" in the URI is replaced by the request number.
+# usage: fetch_all <clients> <uri>
+#
+function fetch_all {
+    seq ${REQUESTS} | xargs -P $1 -I{} \
+        curl --silent --output /dev/null --max-time 5 \
+             --proxy "http://localhost:${proxy_port}" "$2"
+}
+
+#
+# per_request - print <delta> / <requests> with one decimal
+# usage: per_request <delta> <requests>
+#
+function per_request {
+    awk -v d=$1 -v n=$2 'BEGIN { printf "%.1f", n ? d / n : 0 }'
+}
+
+if [ ! -x ./proxy ] || [ ! -x ./tiny/tiny ]; then
+    echo "Error: build ./proxy and ./tiny/tiny first."
+    exit 1
+fi
+
+tiny_port=`./free-port.sh`
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+sleep 1
+
+log=`mktemp`
+printf "%-7s %8s %14s %14s %14s %14s\n" "engine" "clients" \
+    "hit-sys/req" "miss-sys/req" "hit-cpu-us/req" "miss-cpu-us/req"
+for engine in epoll uring
+do
+    for clients in 1 ${CONCURRENCY}
+    do
+        proxy_port=`./free-port.sh`
+        ./proxy -E ${engine} ${proxy_port} > ${log} 2>&1 &
+        proxy_pid=$!
+        sleep 1
+
+        # Cache fill, then hits
+        curl --silent --output /dev/null --proxy http://localhost:${proxy_port} \
+             http://localhost:${tiny_port}/home.html
+        set -- `io_count ${proxy_pid} ${log}`; s0=$1; r0=$2
+        t0=`cpu_ticks ${proxy_pid}`
+        fetch_all ${clients} "http://localhost:${tiny_port}/home.html"
+        set -- `io_count ${proxy_pid} ${log}`; s1=$1; r1=$2
+        t1=`cpu_ticks ${proxy_pid}`
+
+        # Misses: the adder CGI with a new query string every time
+        fetch_all ${clients} "http://localhost:${tiny_port}/cgi-bin/adder?{}&${clients}"
+        set -- `io_count ${proxy_pid} ${log}`; s2=$1; r2=$2
+        t2=`cpu_ticks ${proxy_pid}`
+
+        printf "%-7s %8d %14.1f %14.1f %14d %14d\n" ${engine} ${clients} \
+            `per_request $((s1 - s0)) $((r1 - r0))` \
+            `per_request $((s2 - s1)) $((r2 - r1))` \
+            $(( (t1 - t0) * 1000000 / CLK_TCK / (r1 - r0) )) \
+            $(( (t2 - t1) * 1000000 / CLK_TCK / (r2 - r1) ))
+
+        kill ${proxy_pid} 2> /dev/null
+        wait ${proxy_pid} 2> /dev/null
+    done
+done
+rm -f ${log}
+
+kill ${tiny_pid} 2> /dev/null
+wait ${tiny_pid} 2> /dev/null
@@ -0,0 +1,51 @@
+#include "ioengine.h"
+#include <sys/mman.h>
+
+io_stats io_stat;
+
+/* -E 옵션의 이름으로 엔진을 찾는다. 없으면 NULL */
+io_engine *io_find(const char *name) {
+  if (!strcmp(name, epoll_engine.name))
+    return &epoll_engine;
+  if (!strcmp(name, uring_engine.name))
+    return &uring_engine;
+  return NULL;
+}
+
+/* 받기 버퍼 IO_NBUFS개를 한 덩어리로 잡는다. io_uring에 등록할 수 있게
+ * 페이지 단위로 정렬한다. 반환값: 버퍼 영역, 실패하면 NULL */
+char *io_bufs_init(void) {
+  void *p = mmap(NULL, (size_t)IO_NBUFS * IO_BUF_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/* send할 조각을 req에 복사하고 보낼 위치를 처음으로 맞춘다 */
+void io_send_init(io_req *req, int fd, struct iovec *iov, int niov) {
+  req->op = IO_SEND;
+  req->fd = fd;
+  req->niov = niov < IO_MAX_IOV ? niov : IO_MAX_IOV;
+  memcpy(req->iov, iov, req->niov * sizeof(struct iovec));
+  req->sent = 0;
+  memset(&req->msg, 0, sizeof(req->msg));
+  req->msg.msg_iov = req->iov;
+  req->msg.msg_iovlen = req->niov;
+}
+
+/* n 바이트를 보냈으니 다음 위치로. 반환값: 모두 보냈으면 1 */
+int io_advance(io_req *req, size_t n) {
+  struct msghdr *msg = &req->msg;
+
+  req->sent += n;
+  while (msg->msg_iovlen && n >= msg->msg_iov->iov_len) {
+    n -= msg->msg_iov->iov_len;
+    msg->msg_iov++;
+    msg->msg_iovlen--;
+  }
+  if (msg->msg_iovlen) {
+    msg->msg_iov->iov_base = (char *)msg->msg_iov->iov_base + n;
+    msg->msg_iov->iov_len -= n;
+  }
+  return msg->msg_iovlen == 0;
+}
@@ -0,0 +1,90 @@
+#ifndef __IOENGINE_H__
+#define __IOENGINE_H__
+
+#include "csapp.h"
+
+#define IO_BUF_SIZE  MAXLINE    // 받기 버퍼 하나의 크기
+#define IO_NBUFS     1024       // 엔진이 가진 받기 버퍼 수 (2의 거듭제곱)
+#define IO_MAX_IOV   104        // 한 번에 보내는 최대 조각 수 (응답 헤더 전체)
+
+enum { IO_ACCEPT, IO_RECV, IO_SEND, IO_CONNECT, IO_WRITABLE };
+
+typedef struct io_req io_req;
+typedef void (*io_done_fn)(io_req *req, int res);
+
+/*
+ * 엔진에 맡긴 입출력 하나. 끝나면 이벤트 루프 안에서 done(req, res)가
+ * 불린다. res는 accept면 새 소켓, recv면 받은 바이트 수 (0이면 상대가
+ * 닫음), send면 보낸 바이트 수 (모두 보낸 뒤에만 완료), connect면 0,
+ * writable이면 poll의 revents, 실패하면 -errno. 완료될 때까지 req는
+ * 엔진이 가지고 있으므로 건드리지 않는다.
+ */
+struct io_req {
+  int op;                       // IO_*
+  int fd;
+  io_done_fn done;
+  void *arg;
+  int res;                      // 완료를 미뤄 둔 동안의 결과
+  char *buf;                    // recv: 엔진이 고른 버퍼 (res > 0일 때만, buf_put으로 반납)
+  int bid;                      // buf의 번호
+  struct iovec iov[IO_MAX_IOV]; // send: 아직 보내지 않은 조각
+  int niov;
+  size_t sent;                  // send: 지금까지 보낸 바이트
+  struct msghdr msg;            // send: 남은 조각 (msg_iov가 iov 안을 가리킴)
+  int fixed;                    // send: 등록된 버퍼로 보냈는지 (io_uring)
+  struct sockaddr_storage addr; // connect: 원 서버 주소
+  socklen_t addrlen;
+  io_req *linked;               // connect: 연결되면 이어서 보낼 send
+  io_req *next;                 // 엔진 안의 대기 목록
+};
+
+/*
+ * 입출력 엔진. 소켓 readiness를 기다리는 epoll과 완료를 받는 io_uring을
+ * 같은 완료 방식 인터페이스로 감싸서 연결 상태 기계(evproxy.c)는 어느
+ * 쪽인지 모른다. 이벤트 루프 스레드 하나에서만 부른다.
+ *
+ * 원 서버 이름 찾기(he_resolve의 getaddrinfo)는 엔진 밖의 blocking
+ * 호출이라 답이 올 때까지 루프 전체가 멈춘다. 숫자 주소와 /etc/hosts에
+ * 있는 이름은 바로 끝나지만, DNS를 묻는 이름이 느리면 그 동안 다른
+ * 연결의 I/O와 타이머도 밀린다.
+ */
+typedef struct {
+  const char *name;
+  int (*init)(void);
+  /* 새 연결마다 done이 불린다 (한 번 걸면 계속) */
+  void (*accept)(io_req *req, int listenfd);
+  /* 걸어 둔 accept, writable이나 connect_send의 요청을 멈춘다. accept는 done
+   * 없이 멈추고 (listen 소켓을 넘겨줄 때, 이미 받은 연결은 그대로 done에 온다)
+   * 나머지는 -ECANCELED로 끝난다 (이미 끝났으면 그 결과로). connect를 멈추면
+   * 이어서 보낼 send도 -ECANCELED로 끝난다. fd를 먼저 닫았어도 된다 */
+  void (*cancel)(io_req *req);
+  void (*recv)(io_req *req, int fd);
+  void (*send)(io_req *req, int fd, struct iovec *iov, int niov);
+  /* non-blocking 소켓 fd로 연결하고 이어서 iov를 보낸다 (dial.c, 주소가
+   * 하나일 때). 연결이 실패하면 sreq는 -ECANCELED로 끝난다 */
+  void (*connect_send)(io_req *creq, io_req *sreq, int fd, SA *addr, socklen_t addrlen,
+                       struct iovec *iov, int niov);
+  /* fd가 쓰기 가능해지면 (non-blocking connect가 끝나면) done이 불린다 (dial.c) */
+  void (*writable)(io_req *req, int fd);
+  void (*buf_put)(io_req *req);
+  /* fd를 닫기 전에 엔진이 기억하는 상태를 지운다 (걸려 있는 요청이 없어야 함) */
+  void (*forget)(int fd);
+  /* 최대 timeout_ms (-1이면 무한) 동안 완료를 기다려 done을 부른다 */
+  int (*wait)(int timeout_ms);
+} io_engine;
+
+/* 입출력 경로가 부른 시스템 콜 수 (엔진 + 소켓 열고 닫기) */
+typedef struct {
+  unsigned long syscalls;
+  unsigned long requests;       // 끝낸 요청
+} io_stats;
+
+extern io_engine epoll_engine, uring_engine;
+extern io_stats io_stat;
+
+io_engine *io_find(const char *name);
+char *io_bufs_init(void);
+void io_send_init(io_req *req, int fd, struct iovec *iov, int niov);
+int io_advance(io_req *req, size_t n);
+
+#endif /* __IOENGINE_H__ */
@@ -0,0 +1,62 @@
+#!/bin/bash
+#
+# load-bench.sh - Drives ./bench against tiny directly and through the
+#     proxy, reporting throughput and latency percentiles for each. The
+#     hit-heavy mix fetches static files the proxy caches after the first
+#     request; the miss-heavy mix mostly fetches the adder CGI with a new
+#     query string every time, so each request goes to tiny. Each mix runs
+#     closed loop (as fast as responses return) and, if RATE is given,
+#     open loop at RATE requests per second.
+#
+#     usage: ./load-bench.sh [SECONDS] [CONNS] [RATE] [PROXY_OPTIONS]
+#
+
+SECONDS_=${1:-5}
+CONNS=${2:-16}
+RATE=${3:-0}
+PROXY_OPTS=${4:-}
+HOME_DIR=`pwd`
+
+#
+# run - print a title, then run bench with the given arguments
+# usage: run <title> <bench args>...
+#
+function run {
+    echo "== $1"
+    shift
+    ./bench -c ${CONNS} -d ${SECONDS_} "$@"
+    if [ ${RATE} != 0 ]; then
+        ./bench -c ${CONNS} -d ${SECONDS_} -r ${RATE} "$@"
+    fi
+    echo
+}
+
+if [ ! -x ./proxy ] || [ ! -x ./bench ] || [ ! -x ./tiny/tiny ]; then
+    echo "Error: build ./proxy, ./bench and ./tiny/tiny first (make proxy bench)."
+    exit 1
+fi
+if [ `ulimit -n` -lt $((CONNS * 4 + 64)) ]; then
+    ulimit -n $((CONNS * 4 + 64)) || exit 1
+fi
+
+tiny_port=`./free-port.sh`
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+proxy_port=`./free-port.sh`
+./proxy ${PROXY_OPTS} ${proxy_port} &> /dev/null &
+proxy_pid=$!
+sleep 1
+
+origin=http://localhost:${tiny_port}
+HIT_MIX="8*${origin}/home.html 1*${origin}/godzilla.jpg 1*${origin}/csapp.c"
+MISS_MIX="9*${origin}/cgi-bin/adder?{n}&1 1*${origin}/home.html"
+
+run "tiny, static"                               ${HIT_MIX}
+run "proxy ${PROXY_OPTS}, hit-heavy"  -x localhost:${proxy_port} ${HIT_MIX}
+run "tiny, adder"                                ${MISS_MIX}
+run "proxy ${PROXY_OPTS}, miss-heavy" -x localhost:${proxy_port} ${MISS_MIX}
+
+kill ${proxy_pid} ${tiny_pid} 2> /dev/null
+wait ${proxy_pid} ${tiny_pid} 2> /dev/null
@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# mem-bench.sh - Compares the memory one in-flight connection costs under
+#     each way of running requests: one thread per connection (default),
+#     the state machine on an I/O engine (-E), and one coroutine per
+#     connection on the same engine (-C -E). CONNS clients each send half
+#     a request line and stall, so every handler is parked mid-request
+#     (thread blocked in read, coroutine suspended in recv). Reports the
+#     growth of the proxy's resident (VmRSS) and virtual (VmSize) memory
+#     per connection, and the per-connection cost the proxy charges to
+#     its memory budget.
+#
+#     usage: ./mem-bench.sh [CONNS] [ENGINE]
+#
+
+CONNS=${1:-200}
+ENGINE=${2:-uring}
+
+#
+# vm_kb - print a /proc/<pid>/status field in kB
+# usage: vm_kb <pid> <field>
+#
+function vm_kb {
+    awk -v f="$2:" '$1 == f { print $2 }' /proc/$1/status
+}
+
+#
+# per_conn - print (<after> - <before>) kB / CONNS in bytes
+# usage: per_conn <before> <after>
+#
+function per_conn {
+    echo $(( ($2 - $1) * 1024 / CONNS ))
+}
+
+if [ ! -x ./proxy ]; then
+    echo "Error: build ./proxy first."
+    exit 1
+fi
+if [ `ulimit -n` -lt $((CONNS * 2 + 64)) ]; then
+    ulimit -n $((CONNS * 2 + 64)) || exit 1
+fi
+
+log=`mktemp`
+printf "%-16s %14s %14s %14s\n" "model" "rss-bytes/conn" "vm-bytes/conn" "budget/conn"
+for model in "thread" "-E ${ENGINE}" "-C -E ${ENGINE}"
+do
+    opts=${model}
+    [ "${model}" = "thread" ] && opts=""
+    proxy_port=`./free-port.sh`
+    ./proxy ${opts} -c ${CONNS} -i ${CONNS} -T 60000,5000,30000,60000 ${proxy_port} > ${log} 2>&1 &
+    proxy_pid=$!
+    sleep 1
+
+    rss0=`vm_kb ${proxy_pid} VmRSS`
+    vm0=`vm_kb ${proxy_pid} VmSize`
+    fds=()
+    for i in `seq ${CONNS}`
+    do
+        exec {fd}<>/dev/tcp/localhost/${proxy_port}
+        printf "GET http://localhost/ HT" >&${fd}
+        fds+=(${fd})
+    done
+    sleep 1
+    rss1=`vm_kb ${proxy_pid} VmRSS`
+    vm1=`vm_kb ${proxy_pid} VmSize`
+    for fd in ${fds[@]}
+    do
+        exec {fd}>&-
+    done
+
+    printf "%-16s %14d %14d %14d\n" "${model}" `per_conn ${rss0} ${rss1}` \
+        `per_conn ${vm0} ${vm1}` \
+        `awk '/bytes per connection/ { print $5 }' ${log}`
+
+    kill ${proxy_pid} 2> /dev/null
+    wait ${proxy_pid} 2> /dev/null
+done
+rm -f ${log}
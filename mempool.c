@@ -0,0 +1,105 @@
+#include "mempool.h"
+
+/* 메모리 예산: 연결과 버퍼가 빌려간 바이트의 합이 limit을 넘지 않게 한다 */
+static struct {
+  size_t limit;
+  size_t used;
+  pthread_mutex_t lock;
+  pthread_cond_t freed;     // 예산이 반납되면 깨움
+} budget = { 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+void pool_init(mem_pool *pool, size_t size, int max_idle) {
+  pool->size = size < sizeof(pool_block) ? sizeof(pool_block) : size;
+  pool->max_idle = max_idle;
+  pool->nidle = 0;
+  pool->idle = NULL;
+  pthread_mutex_init(&pool->lock, NULL);
+}
+
+/* 풀에서 블록 하나를 꺼냄. 빈 블록이 없으면 새로 할당, 할당하지 못하면 NULL */
+void *pool_get(mem_pool *pool) {
+  pool_block *b;
+
+  pthread_mutex_lock(&pool->lock);
+  if ((b = pool->idle)) {
+    pool->idle = b->next;
+    pool->nidle--;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return b ? (void *)b : malloc(pool->size);
+}
+
+/* 다 쓴 블록을 풀에 돌려놓음. 풀이 가득 차 있으면 해제 */
+void pool_put(mem_pool *pool, void *p) {
+  pool_block *b = p;
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->nidle < pool->max_idle) {
+    b->next = pool->idle;
+    pool->idle = b;
+    pool->nidle++;
+    b = NULL;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if (b)
+    Free(b);
+}
+
+void budget_init(size_t limit) {
+  budget.limit = limit;
+}
+
+/*
+ * budget_reserve - 예산에서 n 바이트를 빌린다. 예산이 모자라면 다른
+ *     연결이 반납할 때까지 최대 wait_ms 동안 기다린다 (0이면 바로 실패,
+ *     음수면 무한정 대기).
+ *
+ *     반환값: 0, 예산을 얻지 못하면 -1
+ */
+int budget_reserve(size_t n, int wait_ms) {
+  struct timespec deadline;
+  int rc = 0;
+
+  if (wait_ms > 0) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_ms / 1000;
+    deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  pthread_mutex_lock(&budget.lock);
+  while (budget.used + n > budget.limit && rc == 0) {
+    if (wait_ms == 0)
+      rc = -1;
+    else if (wait_ms < 0)
+      pthread_cond_wait(&budget.freed, &budget.lock);
+    else if (pthread_cond_timedwait(&budget.freed, &budget.lock, &deadline) == ETIMEDOUT)
+      rc = (budget.used + n > budget.limit) ? -1 : 0;
+  }
+  if (rc == 0)
+    budget.used += n;
+  pthread_mutex_unlock(&budget.lock);
+  return rc;
+}
+
+void budget_release(size_t n) {
+  pthread_mutex_lock(&budget.lock);
+  budget.used -= n;
+  pthread_cond_broadcast(&budget.freed);
+  pthread_mutex_unlock(&budget.lock);
+}
+
+size_t budget_used(void) {
+  size_t used;
+  pthread_mutex_lock(&budget.lock);
+  used = budget.used;
+  pthread_mutex_unlock(&budget.lock);
+  return used;
+}
+
+size_t budget_limit(void) {
+  return budget.limit;
+}
@@ -0,0 +1,31 @@
+#ifndef __MEMPOOL_H__
+#define __MEMPOOL_H__
+
+#include "csapp.h"
+
+/* 재사용을 위해 풀에 남겨둔 빈 블록 */
+typedef struct pool_block {
+  struct pool_block *next;
+} pool_block;
+
+/* 크기가 고정된 블록의 free list. 한 번 쓴 블록은 malloc/free 없이 재사용 */
+typedef struct {
+  size_t size;        // 블록 크기
+  int max_idle;       // 풀에 남겨둘 최대 빈 블록 수 (넘으면 free)
+  int nidle;          // 현재 풀에 있는 빈 블록 수
+  pool_block *idle;
+  pthread_mutex_t lock;
+} mem_pool;
+
+void pool_init(mem_pool *pool, size_t size, int max_idle);
+void *pool_get(mem_pool *pool);
+void pool_put(mem_pool *pool, void *p);
+
+/* 프로세스 전체의 메모리 예산 */
+void budget_init(size_t limit);
+int budget_reserve(size_t n, int wait_ms);
+void budget_release(size_t n);
+size_t budget_used(void);
+size_t budget_limit(void);
+
+#endif /* __MEMPOOL_H__ */
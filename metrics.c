@@ -0,0 +1,163 @@
+/*
+ * metrics.c - 스레드마다 따로 세는 카운터와 지연 시간 히스토그램.
+ *     기록하는 쪽은 자기 스레드의 칸(shard)에 더하기만 하고 잠금도 원자적
+ *     read-modify-write도 쓰지 않는다 (칸마다 쓰는 스레드가 하나뿐이므로
+ *     relaxed store로 충분). 합치는 것은 /metrics를 읽을 때만 한다.
+ *
+ *     연결마다 스레드를 만들고 없애므로 스레드가 끝나면 칸을 빈 목록에
+ *     돌려주고 다음 스레드가 값을 이어서 쓴다. 칸은 해제하지 않으므로
+ *     칸의 수는 동시에 살아 있던 스레드 수의 최댓값을 넘지 않는다.
+ */
+#include "metrics.h"
+
+typedef struct shard {
+  unsigned long counters[M_COUNTERS];
+  unsigned long buckets[M_HISTS][METRICS_BUCKETS + 1];  // 마지막 칸은 +Inf
+  unsigned long sum_us[M_HISTS];
+  struct shard *next;           // 모든 칸의 목록
+  struct shard *next_free;      // 쓰는 스레드가 없는 칸의 목록
+} shard;
+
+/* 히스토그램 칸의 상한 (us) */
+static const long long bounds[METRICS_BUCKETS] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+  50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static const char *counter_names[M_COUNTERS][2] = {
+  { "proxy_requests_total", "Requests handled." },
+  { "proxy_cache_hits_total", "Cache lookups that found an object." },
+  { "proxy_cache_misses_total", "Cache lookups that went to the origin." },
+  { "proxy_upstream_bytes_total", "Bytes received from origin servers." },
+  { "proxy_client_bytes_total", "Bytes sent to clients." },
+};
+
+static const char *hist_names[M_HISTS][2] = {
+  { "proxy_request_duration_seconds", "Time from accept to the end of the request." },
+  { "proxy_upstream_connect_seconds", "Time to connect to the origin." },
+  { "proxy_first_byte_seconds", "Time from sending the request to the response header." },
+};
+
+static shard *shards, *free_shards;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static __thread shard *mine;
+
+/* 스레드가 끝나면 칸을 빈 목록에 돌려준다 */
+static void shard_release(void *p) {
+  shard *s = p;
+
+  pthread_mutex_lock(&lock);
+  s->next_free = free_shards;
+  free_shards = s;
+  pthread_mutex_unlock(&lock);
+}
+
+static void make_key(void) {
+  pthread_key_create(&key, shard_release);
+}
+
+/* 지금 스레드의 칸. 처음 부르면 빈 칸을 받거나 새로 만든다. 메모리가 없으면 NULL */
+static shard *shard_get(void) {
+  shard *s;
+
+  if (mine)
+    return mine;
+  pthread_once(&once, make_key);
+  pthread_mutex_lock(&lock);
+  if ((s = free_shards))
+    free_shards = s->next_free;
+  else if ((s = calloc(1, sizeof(shard)))) {
+    s->next = shards;
+    shards = s;
+  }
+  pthread_mutex_unlock(&lock);
+  if (s) {
+    pthread_setspecific(key, s);
+    mine = s;
+  }
+  return s;
+}
+
+/* 쓰는 스레드는 하나뿐: 읽는 쪽이 찢어진 값을 보지 않게 relaxed store만 쓴다 */
+static inline void bump(unsigned long *v, unsigned long n) {
+  __atomic_store_n(v, *v + n, __ATOMIC_RELAXED);
+}
+
+void metrics_add(int counter, unsigned long n) {
+  shard *s = shard_get();
+
+  if (s)
+    bump(&s->counters[counter], n);
+}
+
+void metrics_observe(int hist, long long us) {
+  shard *s = shard_get();
+  int i;
+
+  if (!s)
+    return;
+  if (us < 0)
+    us = 0;
+  for (i = 0; i < METRICS_BUCKETS && us > bounds[i]; i++)
+    ;
+  bump(&s->buckets[hist][i], 1);
+  bump(&s->sum_us[hist], us);
+}
+
+long long metrics_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned long load(unsigned long *v) {
+  return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+/*
+ * metrics_render - 모든 칸을 합쳐 Prometheus 텍스트 형식으로 buf에 쓴다.
+ *
+ *     반환값: 쓴 길이 (size를 넘으면 잘림)
+ */
+int metrics_render(char *buf, int size) {
+  unsigned long counters[M_COUNTERS] = { 0 };
+  unsigned long buckets[M_HISTS][METRICS_BUCKETS + 1] = { { 0 } };
+  unsigned long sum_us[M_HISTS] = { 0 }, cum;
+  int i, j, n = 0;
+  shard *s;
+
+  pthread_mutex_lock(&lock);
+  for (s = shards; s; s = s->next) {
+    for (i = 0; i < M_COUNTERS; i++)
+      counters[i] += load(&s->counters[i]);
+    for (i = 0; i < M_HISTS; i++) {
+      for (j = 0; j <= METRICS_BUCKETS; j++)
+        buckets[i][j] += load(&s->buckets[i][j]);
+      sum_us[i] += load(&s->sum_us[i]);
+    }
+  }
+  pthread_mutex_unlock(&lock);
+
+#define OUT(...) (n += snprintf(buf + n, n < size ? size - n : 0, __VA_ARGS__))
+  for (i = 0; i < M_COUNTERS; i++) {
+    OUT("# HELP %s %s\n# TYPE %s counter\n", counter_names[i][0], counter_names[i][1],
+        counter_names[i][0]);
+    OUT("%s %lu\n", counter_names[i][0], counters[i]);
+  }
+  for (i = 0; i < M_HISTS; i++) {
+    OUT("# HELP %s %s\n# TYPE %s histogram\n", hist_names[i][0], hist_names[i][1],
+        hist_names[i][0]);
+    for (cum = 0, j = 0; j < METRICS_BUCKETS; j++) {
+      cum += buckets[i][j];
+      OUT("%s_bucket{le=\"%g\"} %lu\n", hist_names[i][0], bounds[j] / 1e6, cum);
+    }
+    cum += buckets[i][METRICS_BUCKETS];
+    OUT("%s_bucket{le=\"+Inf\"} %lu\n", hist_names[i][0], cum);
+    OUT("%s_sum %.6f\n%s_count %lu\n", hist_names[i][0], sum_us[i] / 1e6, hist_names[i][0], cum);
+  }
+#undef OUT
+  return n < size ? n : size - 1;
+}
@@ -0,0 +1,32 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "csapp.h"
+
+#define METRICS_PATH    "/metrics"      // 프록시에 직접 보내는 이 경로로 읽는다
+#define METRICS_BUCKETS 16              // 지연 시간 히스토그램의 칸 수 (+Inf 제외)
+
+/* 카운터 */
+enum {
+  M_REQUESTS,         // 끝난 요청
+  M_HITS,             // 캐시 히트
+  M_MISSES,           // 캐시 미스
+  M_BYTES_IN,         // 원 서버에서 받은 바이트 (헤더 + 바디)
+  M_BYTES_OUT,        // 클라이언트에 보낸 바이트 (캐시 히트 포함)
+  M_COUNTERS
+};
+
+/* 지연 시간 히스토그램 (us로 기록, 초로 내보냄) */
+enum {
+  H_REQUEST,          // 연결을 받은 뒤 요청을 끝낼 때까지
+  H_CONNECT,          // 원 서버 연결
+  H_FIRST_BYTE,       // 요청을 보낸 뒤 응답 헤더를 받을 때까지
+  M_HISTS
+};
+
+void metrics_add(int counter, unsigned long n);
+void metrics_observe(int hist, long long us);
+long long metrics_now_us(void);
+int metrics_render(char *buf, int size);
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,89 @@
+/*
+ * phase.c - 요청 단계별 시각. 각 처리 방식이 conn_mark()로 conn_t의
+ *     marks[]에 시각을 찍고, 요청을 끝낼 때 구간 길이를 접근 로그에
+ *     남긴다. -j로 파일을 주면 표본으로 고른 요청의 구간을 Chrome
+ *     trace-event JSON (chrome://tracing, Perfetto)으로도 쓴다. 요청 하나가
+ *     한 줄(tid)이고 구간마다 "X"(complete) 이벤트 하나다.
+ *
+ *     trace-event 형식은 닫는 ']'가 없어도 읽으므로 이어 쓰기만 한다.
+ *     요청 하나에 드는 시간은 phasebench로 잰다.
+ */
+#include "phase.h"
+
+const phase_span phase_spans[SPAN_COUNT] = {
+  [SPAN_HEADER]     = { "header",     PH_START,       PH_HEADER },
+  [SPAN_CACHE]      = { "cache",      PH_CACHE_BEGIN, PH_CACHE_END },
+  [SPAN_DNS]        = { "dns",        PH_DNS_BEGIN,   PH_DNS_END },
+  [SPAN_CONNECT]    = { "connect",    PH_DNS_END,     PH_CONNECTED },
+  [SPAN_FIRST_BYTE] = { "first_byte", PH_CONNECTED,   PH_FIRST_BYTE },
+  [SPAN_RELAY]      = { "relay",      PH_FIRST_BYTE,  PH_DONE },
+};
+
+static FILE *out;               // NULL이면 Chrome trace를 쓰지 않음
+static int sample_every;
+static unsigned long seq;       // 끝난 요청 수 (표본 고르기)
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 구간의 길이 (us). 두 지점 중 하나라도 지나지 않았으면 -1 */
+long long phase_span_us(const long long *marks, int span) {
+  const phase_span *s = &phase_spans[span];
+
+  if (!marks[s->from] || !marks[s->to])
+    return -1;
+  return marks[s->to] - marks[s->from];
+}
+
+/* path에 Chrome trace를 새로 쓴다. 요청 sample개 중 하나. 반환값: 0, 실패하면 -1 */
+int phase_trace_open(const char *path, int sample) {
+  if (sample <= 0 || !(out = fopen(path, "w")))
+    return -1;
+  sample_every = sample;
+  fputs("[\n", out);
+  return 0;
+}
+
+/* 이번 요청을 trace에 남길지 */
+int phase_trace_sample(void) {
+  return out && __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED) % sample_every == 0;
+}
+
+/* JSON 문자열 안에 넣을 수 있게 따옴표, 역슬래시, 제어 문자를 뺀 사본 */
+static void json_safe(char *dst, const char *src, size_t size) {
+  size_t n = 0;
+
+  for (; *src && n + 1 < size; src++)
+    if (*src != '"' && *src != '\\' && (unsigned char)*src >= 0x20)
+      dst[n++] = *src;
+  dst[n] = '\0';
+}
+
+/* 요청 하나의 구간을 trace에 쓴다. 같은 요청의 이벤트는 같은 tid로 묶는다 */
+void phase_trace_write(const long long *marks, const char *method, const char *uri, int status) {
+  static unsigned long next_id;
+  char safe[256], meth[16];
+  unsigned long id;
+  long long dur;
+  int i;
+
+  json_safe(meth, method, sizeof(meth));
+  json_safe(safe, uri, sizeof(safe));
+  pthread_mutex_lock(&lock);
+  id = ++next_id;
+  fprintf(out, "{\"name\":\"%s %s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%lld,\"dur\":%lld,"
+          "\"args\":{\"status\":%d}},\n", meth, safe, id, marks[PH_START],
+          marks[PH_DONE] - marks[PH_START], status);
+  for (i = 0; i < SPAN_COUNT; i++)
+    if ((dur = phase_span_us(marks, i)) >= 0)
+      fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%lld,\"dur\":%lld},\n",
+              phase_spans[i].name, id, marks[phase_spans[i].from], dur);
+  pthread_mutex_unlock(&lock);
+}
+
+/* 버퍼에 남은 이벤트를 파일에 쓴다. accept 루프가 주기적으로 부른다 */
+void phase_trace_flush(void) {
+  if (!out)
+    return;
+  pthread_mutex_lock(&lock);
+  fflush(out);
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,38 @@
+#ifndef __PHASE_H__
+#define __PHASE_H__
+
+#include "csapp.h"
+
+#define PHASE_SAMPLE 100        // 기본: 요청 100개 중 하나를 Chrome trace에 남김
+
+/* 요청 처리 중 시각을 찍는 지점 (CLOCK_MONOTONIC us, 지나지 않았으면 0) */
+enum {
+  PH_START,           // 연결을 받음
+  PH_HEADER,          // 요청 헤더를 다 읽고 원 서버용 헤더를 만듦
+  PH_CACHE_BEGIN,     // 캐시 검사 시작 (잠금 대기 포함)
+  PH_CACHE_END,
+  PH_DNS_BEGIN,       // 원 서버 이름 찾기
+  PH_DNS_END,
+  PH_CONNECTED,       // 원 서버에 연결하고 요청을 보내기 시작
+  PH_FIRST_BYTE,      // 응답 헤더를 받음
+  PH_DONE,            // 요청을 끝냄
+  PH_COUNT
+};
+
+/* 두 지점 사이의 구간. 접근 로그와 Chrome trace가 같은 구간을 쓴다 */
+typedef struct {
+  const char *name;
+  int from, to;
+} phase_span;
+
+enum { SPAN_HEADER, SPAN_CACHE, SPAN_DNS, SPAN_CONNECT, SPAN_FIRST_BYTE, SPAN_RELAY, SPAN_COUNT };
+
+extern const phase_span phase_spans[SPAN_COUNT];
+
+long long phase_span_us(const long long *marks, int span);
+int phase_trace_open(const char *path, int sample);
+int phase_trace_sample(void);
+void phase_trace_write(const long long *marks, const char *method, const char *uri, int status);
+void phase_trace_flush(void);
+
+#endif /* __PHASE_H__ */
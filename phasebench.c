@@ -0,0 +1,67 @@
+/*
+ * phasebench.c - 요청 하나가 단계 시각(phase.c)에 쓰는 시간을 잰다.
+ *     요청마다 하는 일을 그대로 되풀이한다: PH_COUNT개 지점에 conn_mark()와
+ *     같은 시각 찍기, request_done()의 표본 고르기와 접근 로그 구간 계산,
+ *     표본으로 고른 요청(-s)의 Chrome trace 쓰기. 지점은 모두 새로 찍는
+ *     것으로 세므로 (실제로는 PH_START, PH_CONNECTED, PH_FIRST_BYTE,
+ *     PH_DONE은 원래 있던 시각을 같이 씀) 실제 비용보다 크게 나온다.
+ *
+ *     usage: ./phasebench [N] [sample]
+ */
+#include "csapp.h"
+#include "phase.h"
+#include "metrics.h"
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(char *what, int n, long long ns) {
+  printf("%-22s %8d requests %8.1f ns/request\n", what, n, (double)ns / n);
+}
+
+int main(int argc, char **argv) {
+  int i, j, n = argc > 1 ? atoi(argv[1]) : 1000000;
+  int sample = argc > 2 ? atoi(argv[2]) : PHASE_SAMPLE;
+  long long marks[PH_COUNT], t0, sum = 0;
+
+  if (n <= 0 || sample <= 0) {
+    fprintf(stderr, "usage: %s [N] [sample]\n", argv[0]);
+    exit(1);
+  }
+
+  /* conn_mark(): 지점마다 clock_gettime 한 번 */
+  t0 = now_ns();
+  for (i = 0; i < n; i++) {
+    memset(marks, 0, sizeof(marks));
+    for (j = 0; j < PH_COUNT; j++)
+      marks[j] = metrics_now_us();
+    sum += marks[PH_DONE];
+  }
+  report("marks", n, now_ns() - t0);
+
+  /* request_done(): 표본 고르기와 접근 로그(-l)의 구간 계산 (trace는 끔) */
+  t0 = now_ns();
+  for (i = 0; i < n; i++) {
+    sum += phase_trace_sample();
+    for (j = 0; j < SPAN_COUNT; j++)
+      sum += phase_span_us(marks, j);
+  }
+  report("spans", n, now_ns() - t0);
+
+  /* -j: sample개 중 하나를 trace에 쓴다 (쓰기는 /dev/null로) */
+  if (phase_trace_open("/dev/null", sample) < 0)
+    unix_error("phase_trace_open");
+  t0 = now_ns();
+  for (i = 0; i < n; i++)
+    if (phase_trace_sample())
+      phase_trace_write(marks, "GET", "http://localhost:8080/home.html", 200);
+  phase_trace_flush();
+  report("trace (-j, -s)", n, now_ns() - t0);
+
+  if (sum == 42)                  // 컴파일러가 반복을 지우지 않게
+    printf("\n");
+  exit(0);
+}
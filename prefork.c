@@ -0,0 +1,116 @@
+/*
+ * prefork.c - 워커 프로세스 여러 개로 처리하기 (-p N).
+ *
+ *     master는 listen 소켓과 공유 캐시(cache_create_shared)를 만든 뒤 워커
+ *     N개를 fork하고, 그 뒤로는 워커를 돌보기만 한다. 워커는 각자 고른
+ *     처리 방식(스레드, epoll, io_uring)으로 같은 listen 소켓에서 연결을
+ *     받는다. 워커가 죽으면 (unix_error의 exit, 시그널 등) master가 그
+ *     워커가 잡고 있던 캐시 참조를 풀고 같은 번호로 다시 띄우므로 다른
+ *     워커는 그대로 처리하고 캐시도 남는다.
+ *
+ *     SIGHUP과 SIGUSR1은 워커들에게 전달하고, SIGTERM/SIGINT를 받으면
+ *     워커를 모두 끝낸 뒤 끝난다. master가 죽으면 워커도 SIGTERM을 받는다.
+ */
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "prefork.h"
+#include "timer.h"
+
+static const int sigs[] = { SIGHUP, SIGUSR1, SIGTERM, SIGINT };
+#define NSIGS (sizeof(sigs) / sizeof(sigs[0]))
+
+static pid_t pids[PREFORK_MAX];             // 워커 번호별 pid, 없으면 0
+static long long started[PREFORK_MAX];      // 마지막으로 띄운 시각 (ms)
+static int nworkers;
+static struct sigaction saved[NSIGS];       // fork 전의 처리기 (워커에서 되돌림)
+static volatile sig_atomic_t quitting = 0;
+
+/* master: 받은 시그널을 살아 있는 워커 모두에게 */
+static void forward(int sig) {
+  int i, olderrno = errno;
+
+  for (i = 0; i < nworkers; i++)
+    if (pids[i] > 0)
+      kill(pids[i], sig);
+  errno = olderrno;
+}
+
+static void quit(int sig) {
+  quitting = 1;
+  forward(SIGTERM);
+}
+
+/* 워커 id를 띄운다. 반환값: 워커 프로세스면 0, master면 1 */
+static int spawn(int id) {
+  pid_t pid;
+  size_t i;
+
+  if ((pid = fork()) < 0) {
+    fprintf(stderr, "fork worker %d: %s\n", id, strerror(errno));
+    pids[id] = 0;
+    return 1;
+  }
+  if (pid == 0) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    for (i = 0; i < NSIGS; i++)
+      sigaction(sigs[i], &saved[i], NULL);
+    cache_set_worker(id);
+    return 0;
+  }
+  pids[id] = pid;
+  started[id] = timer_now();
+  return 1;
+}
+
+/*
+ * prefork_start - 워커 n개를 fork한다. 워커 프로세스에서는 자기 번호
+ *     (0..n-1)를 돌려주고 호출한 쪽이 accept 루프를 돌린다. master는
+ *     돌아오지 않고 죽은 워커를 다시 띄운다 (다시 띄운 워커도 여기서
+ *     돌아간다). 스레드를 만들기 전에, stdio 버퍼를 비운 뒤 불러야 한다.
+ */
+int prefork_start(int n, LRU_Cache *cache) {
+  struct sigaction sa;
+  int id, status;
+  pid_t pid;
+  size_t i;
+
+  nworkers = n;
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  for (i = 0; i < NSIGS; i++) {
+    sa.sa_handler = sigs[i] == SIGTERM || sigs[i] == SIGINT ? quit : forward;
+    sigaction(sigs[i], &sa, &saved[i]);
+  }
+  for (id = 0; id < n; id++)
+    if (!spawn(id))
+      return id;
+  printf("Started %d worker processes\n", n);
+  fflush(stdout);
+
+  while (1) {
+    if ((pid = waitpid(-1, &status, 0)) < 0) {
+      if (errno == EINTR)
+        continue;
+      exit(quitting ? 0 : 1);     // ECHILD: 남은 워커가 없음
+    }
+    for (id = 0; id < n && pids[id] != pid; id++)
+      ;
+    if (id == n)
+      continue;
+    pids[id] = 0;
+    cache_forget_worker(cache, id);
+    if (quitting)
+      continue;
+    if (WIFSIGNALED(status))
+      printf("Worker %d (pid %d) killed by signal %d, restarting\n", id, pid, WTERMSIG(status));
+    else
+      printf("Worker %d (pid %d) exited with status %d, restarting\n", id, pid,
+             WEXITSTATUS(status));
+    fflush(stdout);
+    if (timer_now() - started[id] < PREFORK_RESPAWN_MS)
+      usleep(PREFORK_RESPAWN_MS * 1000);      // 시작하자마자 죽는 워커를 계속 띄우지 않게
+    if (!spawn(id))
+      return id;
+  }
+}
@@ -0,0 +1,11 @@
+#ifndef __PREFORK_H__
+#define __PREFORK_H__
+
+#include "cache.h"
+
+#define PREFORK_MAX        CACHE_MAX_WORKERS  // 워커 프로세스 수 한도 (-p)
+#define PREFORK_RESPAWN_MS 1000               // 이보다 빨리 죽은 워커는 이만큼 쉬었다 다시 띄움
+
+int prefork_start(int nworkers, LRU_Cache *cache);
+
+#endif /* __PREFORK_H__ */
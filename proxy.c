@@ -1,16 +1,40 @@
 #include <stdio.h>
 #include "csapp.h"
 #include "cache.h"
+#include "chunked.h"
+#include "http.h"
+#include "compress.h"
+#include "conn.h"
+#include "admit.h"
+#include "happy.h"
+#include "err.h"
+#include "proxy.h"
+#include "evproxy.h"
+#include "coproxy.h"
+#include "coro.h"
+#include "sched.h"
+#include "affinity.h"
+#include "trace.h"
+#include "metrics.h"
+#include "accesslog.h"
+#include "config.h"
+#include "upgrade.h"
+#include "prefork.h"
+#include "tunnel.h"
+#include "reqbody.h"
+#include "upstream.h"
 
 
 #define DEFAULT_PORT "80"
 #define DEFAULT_PATH "/"
-#define NEW_VERSION "HTTP/1.0"
+#define NEW_VERSION "HTTP/1.1"
+#define CACHE_CL_RESERVE 32   // 캐시 객체에 덧붙일 "Content-Length: N\r\n\r\n" 자리
+#define ADMIN_CACHE_PATH "/cache"   // 캐시 목록: /cache?top=N&by=size|hits
+#define ADMIN_TOP        20         // 목록에 보일 객체 수 기본값
+#define ADMIN_TOP_MAX    200
+#define ADMIN_KEY_MAX    160        // 목록에 보일 키 길이
+#define SHARED_CACHE_FACTOR 2       // -p: 공유 캐시 영역은 cache_size의 이만큼 (조각, 전송 중인 객체 몫)
 
-/* You won't lose style points for including this long line in your code */
-static const char *user_agent_hdr =
-    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
-    "Firefox/10.0.3\r\n";
 static const char *endof_hdr = "\r\n";
 static const char *host_hdr_format = "Host: %s\r\n";
 static const char *conn_hdr = "Connection: close\r\n";
@@ -20,193 +44,1560 @@ static const char *host_key = "Host";
 static const char *connection_key = "Connection";
 static const char *proxy_connection_key = "Proxy-Connection";
 static const char *user_agent_key = "User-Agent";
+static const char *accept_encoding_key = "Accept-Encoding";
+static const char *content_type_key = "Content-Type";
+static const char *content_length_key = "Content-Length";
+static const char *content_encoding_key = "Content-Encoding";
+static const char *transfer_encoding_key = "Transfer-Encoding";
+static const char *expect_key = "Expect";
+
+/* 원 서버로 넘기는 메서드. 안전하지 않은 메서드가 성공하면 그 URI의 캐시를 지운다 */
+static const struct {
+  const char *name;
+  int unsafe;
+} methods[] = {
+  { "GET", 0 }, { "HEAD", 0 }, { "OPTIONS", 0 },
+  { "POST", 1 }, { "PUT", 1 }, { "DELETE", 1 }, { "PATCH", 1 },
+};
+#define NMETHODS (sizeof(methods) / sizeof(methods[0]))
+
+/* /cache 목록을 만들며 모으는 것. top[]은 by 기준으로 큰 것부터 */
+typedef struct {
+  int objects, expired;
+  long bytes;
+  int by_hits, max, n;
+  struct {
+    char key[ADMIN_KEY_MAX];
+    int size;
+    unsigned long hits;
+    long age, max_age;
+  } top[ADMIN_TOP_MAX];
+} admin_list;
+
+/* PURGE할 키: 정확히 같은 URI(와 그 압축 변형)거나 '*'로 끝나면 접두사 */
+typedef struct {
+  const char *key;
+  size_t len;
+  int prefix;
+} admin_purge;
+
+/* 압축 변형 만들기. tasks[ENC_IDENTITY]는 나누기 전의 작업, 나머지는 인코딩별 */
+typedef struct fill_job fill_job;
+
+typedef struct {
+  task t;
+  fill_job *job;
+  int enc;
+} fill_task;
+
+struct fill_job {
+  fill_task tasks[ENC_COUNT];
+  char *buf;                    // 원본 변형의 캐시 객체 (헤더 + 바디)
+  int hdrlen;                   // Content-Length를 뺀 헤더 길이
+  long body_off, bodylen;
+  long age, max_age;
+  int refs;                     // 아직 끝나지 않은 인코딩
+  char uri[];
+};
 
 /* For cache */
 LRU_Cache *cache;
 
-void doit(int fd);
-int parse_uri(char *uri, char *hostname, char *port, char *path);
+/* 압축 가능한 응답을 gzip/br 변형으로도 캐시할지 (-z) */
+int compress_enabled = 0;
+
+/* 연결 처리 스레드의 속성 (스택 크기) */
+pthread_attr_t thread_attr;
+
+/* SIGUSR1을 받으면 수락 제어 카운터를 출력 */
+volatile sig_atomic_t stats_requested = 0;
+volatile sig_atomic_t reload_requested = 0;
+
+/* -E로 고른 입출력 엔진. NULL이면 연결마다 스레드 */
+io_engine *engine = NULL;
+
+/* -C: 엔진 위에서 연결마다 상태 기계 대신 코루틴으로 처리 */
+int coroutines = 0;
+
+/* 큐에서 마감 시간을 넘긴 연결을 주기적으로 거절하는 타이머 */
+tw_timer sweep_timer;
+
+/* -u: 다음 프로세스를 기다리는 unix 소켓과 넘겨준 뒤 끝낼 마감 (0이면 아직 받는 중) */
+int upgrade_fd = -1;
+long long drain_deadline = 0;
+tw_timer upgrade_timer;
+
+int doit(conn_t *c);
+int parse_uri(char *uri, char *hostname, char *port, char **path);
 // void parse_uri(char *uri, char *hostname, char *path, int *port);
-void build_http_header(char *http_header, char *hostname, char *path,
-                        char* port, char *method, rio_t *rio);
+int build_http_header(conn_t *c);
+int relay_response(conn_t *c, int serverfd);
+int reply_error(conn_t *c, int err);
+int connect_upstream(conn_t *c, int *serverfd);
+int connect_once(conn_t *c, int *serverfd);
+int home_worker(conn_t *c);
+void add_compressed_variants(conn_t *c, int hdrlen, long body_off, long bodylen,
+                             long age, long max_age);
+void fill_variants(task *t);
+void fill_variant(task *t);
+char *worker_scratch(void);
+void worker_start(int idx);
+void print_affinity(void);
+void variant_key(char *key, char *uri, int enc);
 void *thread (void *vargp);
+int start_conn(int fd, struct sockaddr_storage *addr, socklen_t addrlen);
+void print_stats(void);
+void sigusr1_handler(int sig);
+void sighup_handler(int sig);
+void reload_config(char *path, int listenfd);
+void sweep_queue(tw_timer *t);
+void upgrade_poll(tw_timer *t);
+void drain_exit(void);
+int metrics_response(conn_t *c, struct iovec *iov);
+int cache_response(conn_t *c, struct iovec *iov);
+int purge_response(conn_t *c, struct iovec *iov);
+void invalidate_cache(conn_t *c);
+int method_index(conn_t *c);
+int admin_header(conn_t *c, int status, char *type, int len);
+int is_loopback(conn_t *c);
+void peer_addr(conn_t *c);
 
 int main(int argc, char **argv) {
-  int listenfd, *connfdp;
-  char hostname[MAXLINE], port[MAXLINE];
+  int listenfd, connfd, opt, bad = 0, upfd = -1, procs = 0, worker = 0;
+  size_t extra;
+  int workers, sample = PHASE_SAMPLE;
+  char *chrome_trace = NULL, *config_path = NULL, *upgrade_path = NULL, t[4][16];
+  config *cfg;
   socklen_t clientlen;
   struct sockaddr_storage clientaddr;
-  pthread_t tid;
+  struct pollfd pfd;
 
-  if (argc != 2) {
-    /* 명령행 인수가 2개가 아닌 경우 사용법 출력 후 종료 */
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+  /* 설정 파일(-f)에도 있는 값은 config_override()로 넘겨서 파일보다 앞서게 한다 */
+  while ((opt = getopt(argc, argv, "zf:m:c:i:q:T:E:Cw:a:t:P:l:j:s:u:p:R:")) != -1) {
+    switch (opt) {
+    case 'z':   // 압축 변형 캐시
+      compress_enabled = 1;
+      break;
+    case 'f':   // 설정 파일 (SIGHUP으로 다시 읽음)
+      config_path = optarg;
+      break;
+    case 'm':   // 메모리 예산 (MB)
+      bad |= config_override("memory_mb", optarg);
+      break;
+    case 'c':   // 동시에 처리하는 최대 요청 수
+      bad |= config_override("max_active", optarg);
+      break;
+    case 'i':   // 클라이언트 IP당 최대 요청 수
+      bad |= config_override("max_per_ip", optarg);
+      break;
+    case 'q':   // 큐에서 기다릴 수 있는 최대 시간 (ms)
+      bad |= config_override("queue_ms", optarg);
+      break;
+    case 'T':   // 시간 제한 (ms): 요청 헤더,연결,첫 응답,유휴
+      if (sscanf(optarg, "%15[^,],%15[^,],%15[^,],%15s", t[0], t[1], t[2], t[3]) != 4)
+        bad = 1;
+      else
+        bad |= config_override("header_timeout_ms", t[0]) |
+               config_override("connect_timeout_ms", t[1]) |
+               config_override("first_byte_timeout_ms", t[2]) |
+               config_override("idle_timeout_ms", t[3]);
+      break;
+    case 'E':   // 입출력 엔진: thread (기본), epoll, uring
+      if (strcmp(optarg, "thread") && !(engine = io_find(optarg)))
+        bad = 1;
+      break;
+    case 'C':   // 코루틴 처리 (-E epoll|uring과 함께)
+      coroutines = 1;
+      break;
+    case 'w':   // 압축 작업자 수 (0이면 연결을 처리하는 쪽에서 바로)
+      if (atoi(optarg) < 0)
+        bad = 1;
+      bad |= config_override("workers", optarg);
+      break;
+    case 'a':   // 고정할 CPU 목록 (예: 0-3,8)
+      if (affinity_init(optarg) < 0)
+        bad = 1;
+      break;
+    case 't':   // 캐시 접근 트레이스 파일 (cachesim으로 재생)
+      if (trace_open(optarg) < 0) {
+        fprintf(stderr, "cannot open trace %s: %s\n", optarg, strerror(errno));
+        exit(1);
+      }
+      break;
+    case 'l':   // 접근 로그 파일 ("-"면 표준 출력)
+      if (access_log_open(optarg) < 0) {
+        fprintf(stderr, "cannot open access log %s: %s\n", optarg, strerror(errno));
+        exit(1);
+      }
+      break;
+    case 'j':   // 표본 요청의 단계 구간을 쓸 Chrome trace 파일
+      chrome_trace = optarg;
+      break;
+    case 's':   // -j의 표본 비율: 요청 N개 중 하나
+      if ((sample = atoi(optarg)) <= 0)
+        bad = 1;
+      break;
+    case 'P':   // 캐시 교체 정책: lru (기본), fifo, clock
+      bad |= config_override("policy", optarg);
+      break;
+    case 'u':   // 업그레이드 소켓: 실행 중인 프록시의 listen 소켓과 캐시를 넘겨받음
+      upgrade_path = optarg;
+      break;
+    case 'p':   // 워커 프로세스 수 (공유 메모리 캐시를 나눠 씀)
+      if ((procs = atoi(optarg)) < 1 || procs > PREFORK_MAX)
+        bad = 1;
+      break;
+    case 'R':   // 리버스 프록시: origin-form 요청을 이 서버들(host:port,...)에 나눠 보냄
+      bad |= config_override("backends", optarg);
+      break;
+    default:
+      bad = 1;
+      break;
+    }
+  }
+  if (argc - optind == 1)
+    bad |= config_override("listen", argv[optind]);
+  if (!bad && !(cfg = config_load(config_path)))
+    exit(1);                      // 설정 파일의 잘못된 줄은 config_load가 알림
+  if (bad || argc - optind > 1 || !cfg->listen[0] || (coroutines && !engine)
+      || (procs && upgrade_path)) {
+    /* 포트가 없거나 옵션이 잘못된 경우 사용법 출력 후 종료 */
+    fprintf(stderr, "usage: %s [-f config] [-z] [-m budget_mb] [-c max_active] [-i max_per_ip] "
+            "[-q queue_ms] [-T header,connect,first_byte,idle_ms] [-E thread|epoll|uring] [-C] [-w workers] [-a cpulist] [-t trace] [-P lru|fifo|clock] [-l access_log] [-j chrome_trace] [-s sample] [-u upgrade_sock | -p processes] [-R host:port,...] [port]\n", argv[0]);
+    exit(1);
+  }
+  config_publish(cfg);
+
+  if (chrome_trace && phase_trace_open(chrome_trace, sample) < 0) {
+    fprintf(stderr, "cannot open trace %s: %s\n", chrome_trace, strerror(errno));
     exit(1);
   }
 
   /* 특정 클라이언트가 종료되었을 때 프로그램이 비정상적으로 종료되는 것을 무시 */
   Signal(SIGPIPE, SIG_IGN);
+  Signal(SIGUSR1, sigusr1_handler);
+  Signal(SIGHUP, sighup_handler);
 
-  cache = createCache(MAX_CACHE_SIZE);
+  /* -p면 캐시는 워커 프로세스들이 나눠 쓰도록 fork 전에 공유 메모리에 */
+  if (!procs)
+    cache = createCache(cfg->cache_size);
+  else if (!(cache = cache_create_shared(cfg->cache_size,
+                                         (size_t)cfg->cache_size * SHARED_CACHE_FACTOR))) {
+    fprintf(stderr, "cannot map a %d byte shared cache: %s\n", cfg->cache_size, strerror(errno));
+    exit(1);
+  }
+  cache->policy = cfg->policy;
 
-  /* 클라이언트의 연결을 수신 대기하는 소켓 생성 */
-  listenfd = Open_listenfd(argv[1]);
+  /* 클라이언트의 연결을 수신 대기하는 소켓 생성. -u로 실행 중인 프록시가
+   * 있으면 그 소켓을 넘겨받아 닫히는 순간 없이 이어 받는다 */
+  if (!upgrade_path || (upfd = upgrade_takeover(upgrade_path, &listenfd, cache)) < 0)
+    listenfd = Open_listenfd(cfg->listen);
+  if (cfg->backlog != LISTENQ)
+    listen(listenfd, cfg->backlog);
 
-  /* 클라이언트로부터의 연결을 수락하고 처리 */
-  while (1) {
-    clientlen = sizeof(clientaddr);
+  /* -p: 여기서 워커를 fork한다. 아래의 스레드, 엔진, 연결 예산은 워커마다
+   * 따로 만들고 (메모리 예산은 나눔), master는 돌아오지 않고 워커를 돌본다 */
+  if (procs) {
+    fflush(NULL);
+    worker = prefork_start(procs, cache);
+    if (access_log_restart() < 0) {
+      fprintf(stderr, "worker %d: cannot start the access log writer\n", worker);
+      exit(1);
+    }
+  }
+
+  /* 연결 하나의 몫: 스레드 스택, 상태 기계의 ev_conn, 또는 코루틴 스택 */
+  if (!engine)
+    extra = THREAD_STACK_SIZE;
+  else
+    extra = coroutines ? coro_frame_size() : ev_conn_size();
+  conn_init(((size_t)cfg->memory_mb << 20) / (procs ? procs : 1), extra);
+  printf("Memory budget %d MB, %zu bytes per connection (up to %zu connections)\n",
+         cfg->memory_mb, conn_cost(), budget_limit() / conn_cost());
+  admit_init(cfg->max_active, cfg->max_per_ip, cfg->queue_ms, start_conn);
+
+  /* -a: accept 루프(이벤트 루프)는 첫 CPU에 (-p면 워커마다 다음 CPU에).
+   * 여기서 만드는 스레드는 이 고정을 물려받고, 작업자와 연결 스레드는
+   * 각자 다시 고정한다 */
+  if (affinity_enabled()) {
+    affinity_pin(worker % affinity_ncpus());
+    print_affinity();
+  }
+
+  /* 압축 변형은 work-stealing 작업자에게 맡긴다 (-z일 때만 일이 있음).
+   * 기본 작업자 수는 -a로 고른 CPU 수, 없으면 온라인 CPU 수 */
+  if ((workers = cfg->workers) < 0)
+    workers = affinity_enabled() ? affinity_ncpus() : sysconf(_SC_NPROCESSORS_ONLN);
+  if (compress_enabled && sched_init(workers, 1, affinity_enabled() ? worker_start : NULL) < 0) {
+    fprintf(stderr, "cannot start %d workers\n", workers);
+    exit(1);
+  }
+  if (compress_enabled && affinity_enabled() && workers < affinity_ncpus())
+    fprintf(stderr, "%d workers for %d CPUs: some compression runs off the connection's CPU\n",
+            workers, affinity_ncpus());
+
+  /* 연결별 마감 시간과 큐 검사는 모두 accept 루프가 돌리는 타이머 휠에 건다 */
+  timer_wheel_init();
+  timer_init(&sweep_timer, sweep_queue, NULL);
+  timer_add(&sweep_timer, ADMIT_SWEEP_MS);
 
-    connfdp = Malloc(sizeof(int));
-    *connfdp = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-    /* 클라이언트의 주소 정보를 호스트네임과 포트로 변환 */
-    Getnameinfo((SA *)&clientaddr, clientlen, hostname, 
-                MAXLINE, port, MAXLINE, 0);
-    printf("Accepted connection from (%s, %s)\n", hostname, port);
+  /* 요청 처리에 필요한 버퍼는 conn_t에 있으므로 스레드 스택은 작게 잡는다 */
+  pthread_attr_init(&thread_attr);
+  pthread_attr_setstacksize(&thread_attr, THREAD_STACK_SIZE);
 
-    // doit(*connfdp);
-    // close(*connfdp);
+  pfd.events = POLLIN;
+  if (engine && (coroutines ? co_proxy_init(engine, listenfd) : ev_init(engine, listenfd)) < 0) {
+    fprintf(stderr, "%s engine unavailable: %s\n", engine->name, strerror(errno));
+    exit(1);
+  }
+  if (upgrade_path) {
+    if ((upgrade_fd = upgrade_listen(upgrade_path)) < 0) {
+      fprintf(stderr, "cannot listen on %s: %s\n", upgrade_path, strerror(errno));
+      exit(1);
+    }
+    timer_init(&upgrade_timer, upgrade_poll, &listenfd);
+    timer_add(&upgrade_timer, UPGRADE_POLL_MS);
+  }
+  if (upfd >= 0)
+    upgrade_ready(upfd);          // 받을 준비가 끝났으니 이전 프로세스는 물러남
 
-    /* 스레드 생성하여 클라이언트 요청 처리 */
-    Pthread_create(&tid, NULL, thread, connfdp);  
+  /* 클라이언트로부터의 연결을 수락하고 수락 제어에 넘김.
+   * 과부하 상태에서도 listen 큐에 쌓이지 않도록 바로 받아서
+   * 처리, 대기, 503 거절 중 하나로 정한다.
+   * poll은 다음 타이머가 만료될 때까지만 기다린다.
+   * 엔진을 쓰면 연결을 받고 처리하는 것 모두 엔진의 완료로 진행한다 */
+  while (1) {
+    pfd.fd = listenfd;            // 넘겨준 뒤에는 -1 (poll이 무시함)
+    if (engine && coroutines)
+      co_proxy_wait(timer_timeout());
+    else if (engine)
+      ev_wait(timer_timeout());
+    else if (poll(&pfd, 1, timer_timeout()) > 0) {
+      clientlen = sizeof(clientaddr);
+      if ((connfd = accept(listenfd, (SA *)&clientaddr, &clientlen)) >= 0)
+        admit_submit(connfd, &clientaddr, clientlen);
+      else if (errno == EMFILE || errno == ENFILE)
+        usleep(ADMIT_SWEEP_MS * 1000);  // fd가 모자라면 잠시 쉬었다가 다시 받음
+    }
+    timer_expire(timer_now());    // 만료된 마감 시간을 한 번에 처리
+    if (stats_requested) {
+      stats_requested = 0;
+      print_stats();
+    }
+    if (reload_requested) {
+      reload_requested = 0;
+      reload_config(config_path, listenfd);
+    }
   }
   freeCache(cache);
   return 0;
 }
 
+/* 수락 제어를 통과한 연결의 처리를 시작. 메모리 예산이 모자라면 -1 */
+int start_conn(int fd, struct sockaddr_storage *addr, socklen_t addrlen) {
+  pthread_t tid;
+  conn_t *c;
+
+  if (!(c = conn_new(fd, 0)))
+    return -1;                    // 다른 연결이 끝날 때까지 큐에서 기다림
+  memcpy(&c->addr, addr, addrlen);
+  c->addrlen = addrlen;
+
+  /* 스레드 생성하여 클라이언트 요청 처리. 스레드를 만들 수 없으면
+   * 큐에서 다른 연결이 끝나기를 기다린다 */
+  if (pthread_create(&tid, &thread_attr, thread, c) != 0) {
+    err_record(ERR_NOMEM);
+    conn_free(c);
+    return -1;
+  }
+  return 0;
+}
+
 void *thread (void *vargp) {
-  int connfd = *((int *)vargp);
-  Pthread_detach(pthread_self()); // 스레드 분리
-  Free(vargp);                    // 동적 할당된 메모리 해제
-  doit(connfd);                   // 클라이언트 요청 처리 함수 호출
-  Close(connfd);                  // 클라이언트 소켓 닫기
+  conn_t *c = vargp;
+  char hostname[NI_MAXHOST] = "?", port[NI_MAXSERV] = "?";
+  struct sockaddr_storage addr = c->addr;
+  int err;
+
+  pthread_detach(pthread_self()); // 스레드 분리
+  /* -a: 패킷을 받은 CPU(없으면 소켓 번호로 고른 CPU)에서 처리해서 이 연결의
+   * 소켓 버퍼와 압축 작업(같은 slot의 작업자)이 한 코어에 머물게 한다 */
+  if (affinity_enabled())
+    affinity_pin(c->home);
+
+  /* 클라이언트 요청 처리. 실패해도 이 요청만 정리하고 원인을 센다.
+   * 요청마다 찍던 줄은 stdout 잠금을 두고 다투므로 지표(/metrics)로 대신하고
+   * 실패한 요청만 남긴다 */
+  if ((err = doit(c)) != ERR_NONE) {
+    err_record(err);
+    getnameinfo((SA *)&c->addr, c->addrlen, hostname, NI_MAXHOST,
+                port, NI_MAXSERV, NI_NUMERICHOST | NI_NUMERICSERV);
+    printf("Request from (%s, %s) failed: %s %s\n", hostname, port, err_name(err), c->uri);
+  }
+  request_done(c, err);
+  conn_clear_deadline(c);         // 소켓을 닫기 전에 타이머를 치움
+  close(c->fd);                   // 클라이언트 소켓 닫기
+  conn_free(c);                   // 연결 컨텍스트를 풀과 예산에 반납
+  admit_done(&addr);              // 자리가 났으니 큐에서 다음 연결을 시작
   return NULL;
 }
 
-/* 클라이언트의 요청을 처리하는 함수 */
-void doit(int fd) {
-  int serverfd;
-  char buf[MAXLINE],
-      method[MAXLINE], uri[MAXLINE], version[MAXLINE], new_header[MAXLINE],
-      server_hostname[MAXLINE], server_path[MAXLINE], server_port[MAXLINE];
-  rio_t rio;
+/*
+ * request_done - 요청 하나를 끝낼 때 모든 처리 방식이 부른다. 지표에
+ *     더하고 (리버스 프록시면 서버의 상태에도), 접근 로그(-l)를 켰으면 레코드를 이 스레드의 링에 넣는다
+ *     (글자로 바꾸고 쓰는 것은 accesslog.c의 쓰는 스레드). 표본으로 고른
+ *     요청은 단계 구간을 Chrome trace(-j)에도 쓴다.
+ */
+void request_done(conn_t *c, int err) {
+  long long now = metrics_now_us();
+  char *status, *reason;
+  access_rec r;
 
-  /* 클라이언트로부터 요청 라인 및 헤더를 읽음 */
-  Rio_readinitb(&rio, fd);  // 클라이언트와의 연결을 읽기 위해 rio 구조체 초기화
-  Rio_readlineb(&rio, buf, MAXLINE);  // 클라이언트로부터 요청 라인 읽기
-  printf("Request header:\n");
-  printf("%s", buf);
-  sscanf(buf, "%s %s %s", method, uri, version);  // 요청 라인 파싱
+  c->marks[PH_DONE] = now;
+  upstream_done(c, err);
+  metrics_add(M_REQUESTS, 1);
+  metrics_observe(H_REQUEST, now - c->start_us);
+  if (!c->status && err != ERR_NONE && err_status(err, &status, &reason) == 0)
+    c->status = atoi(status);     // 응답 대신 보낸 오류
+  if (phase_trace_sample())
+    phase_trace_write(c->marks, c->method[0] ? c->method : "-", c->uri, c->status);
+  if (!access_log_enabled())
+    return;
+  r.time_us = access_log_now_us();
+  r.total_us = now - c->start_us;
+  r.header_us = phase_span_us(c->marks, SPAN_HEADER);
+  r.cache_us = phase_span_us(c->marks, SPAN_CACHE);
+  r.dns_us = phase_span_us(c->marks, SPAN_DNS);
+  r.connect_us = phase_span_us(c->marks, SPAN_CONNECT);
+  r.first_byte_us = phase_span_us(c->marks, SPAN_FIRST_BYTE);
+  r.relay_us = phase_span_us(c->marks, SPAN_RELAY);
+  r.bytes = c->bytes_out;
+  r.status = c->status;
+  r.cache = c->cache_result;
+  peer_addr(c);
+  memset(&r.addr, 0, sizeof(r.addr));
+  access_log_set_addr(&r, (SA *)&c->addr, c->addrlen);
+  snprintf(r.method, sizeof(r.method), "%s", c->method);
+  snprintf(r.uri, sizeof(r.uri), "%.*s", (int)sizeof(r.uri) - 1, c->uri);
+  snprintf(r.error, sizeof(r.error), "%s", err != ERR_NONE ? err_name(err) : "");
+  access_log_put(&r);
+}
 
-  /* 지원하지 않는 method인 경우 예외 처리 */
-  if (strcasecmp(method, "GET") && strcasecmp(method, "HEAD")) {
-    printf("Proxy does not implement the method");
+/* 클라이언트 주소를 c->addr에 채운다. 엔진의 accept는 주소를 받지 않으므로 처음 쓸 때 묻는다 */
+void peer_addr(conn_t *c) {
+  if (c->addrlen)
     return;
+  c->addrlen = sizeof(c->addr);
+  if (getpeername(c->fd, (SA *)&c->addr, &c->addrlen) < 0)
+    c->addrlen = 0;
+}
+
+/* 큐에서 너무 오래 기다린 연결은 503으로 거절하고 다음 검사를 건다.
+ * 다 쓴 이전 설정을 지우고, 캐시 트레이스(-t)와 Chrome trace(-j)에
+ * 모아 둔 것도 이때 파일에 쓴다 */
+void sweep_queue(tw_timer *t) {
+  admit_expire();
+  config_reclaim();
+  trace_flush();
+  phase_trace_flush();
+  timer_add(t, ADMIT_SWEEP_MS);
+}
+
+/*
+ * upgrade_poll - -u: 새 프로세스가 왔으면 listen 소켓과 캐시를 넘기고
+ *     받기를 멈춘다. 그 뒤로는 처리 중인 연결(큐에 있는 것 포함)이 모두
+ *     끝나거나 drain_timeout_ms가 지나면 프로세스를 끝낸다.
+ */
+void upgrade_poll(tw_timer *t) {
+  int *listenfd = t->arg;
+  admit_stats st;
+
+  if (drain_deadline) {
+    admit_get_stats(&st);
+    if ((conn_live() == 0 && st.waiting == 0) || timer_now() >= drain_deadline)
+      drain_exit();
+  } else if (upgrade_handoff(upgrade_fd, *listenfd, cache) == 0) {
+    if (engine)
+      coroutines ? co_proxy_stop_accept() : ev_stop_accept();
+    close(*listenfd);
+    *listenfd = -1;
+    close(upgrade_fd);
+    upgrade_fd = -1;
+    drain_deadline = timer_now() + config_current()->drain_ms;
+    printf("Handed the listener to the new proxy, draining %d connections\n", conn_live());
+    fflush(stdout);
   }
+  timer_add(t, UPGRADE_POLL_MS);
+}
 
-  if(strstr(uri, "favicon")) return; 
-  
-  parse_uri(uri, server_hostname, server_port, server_path);
-  build_http_header(new_header, server_hostname, server_path, server_port, method, &rio);
-  
-  // 캐시 검사
-  Node *cache_node = find_cache(cache, uri);
-  if (cache_node) {             // 캐시 된 웹 객체가 있으면
-    send_cache(fd, cache_node); // 캐싱된 웹 객체를 Client에 바로 전송
-    moveToHead(cache, cache_node); // 사용한 웹 객체의 순서를 맨 앞으로 갱신 후 return
+/* 넘겨준 뒤 끝낼 때: 남은 연결 수를 알리고 트레이스와 접근 로그를 다 쓴다 */
+void drain_exit(void) {
+  int left = conn_live();
+
+  if (left)
+    printf("Drain timeout, closing %d connections\n", left);
+  else
+    printf("Drained, exiting\n");
+  fflush(stdout);
+  trace_flush();
+  phase_trace_flush();
+  access_log_close();
+  exit(0);
+}
+
+void sigusr1_handler(int sig) {
+  stats_requested = 1;
+}
+
+void sighup_handler(int sig) {
+  reload_requested = 1;
+}
+
+/*
+ * reload_config - SIGHUP: 설정 파일을 다시 읽어 새 스냅샷으로 바꾼다.
+ *     새 연결부터 새 설정을 쓰고 처리 중인 연결은 자기 스냅샷을 끝까지
+ *     쓴다. 캐시 용량과 정책, 수락 제어 한도, listen 큐 길이는 여기서 바로
+ *     바꾼다. 파일이 잘못되었으면 지금 설정을 그대로 둔다.
+ */
+void reload_config(char *path, int listenfd) {
+  config *old = config_current(), *cfg;
+
+  if (!path) {
+    fprintf(stderr, "SIGHUP: no config file (-f), nothing to reload\n");
+    return;
+  }
+  if (!(cfg = config_load(path))) {
+    fprintf(stderr, "%s: keeping the current config\n", path);
     return;
   }
+  if (strcmp(cfg->listen, old->listen) || cfg->memory_mb != old->memory_mb
+      || cfg->workers != old->workers)
+    fprintf(stderr, "%s: listen, memory_mb and workers take effect after a restart\n", path);
+  if (cfg->backlog != old->backlog && listenfd >= 0)
+    listen(listenfd, cfg->backlog);
+  cache_configure(cache, cfg->cache_size, cfg->policy);
+  admit_set_limits(cfg->max_active, cfg->max_per_ip, cfg->queue_ms);
+  config_publish(cfg);
+  printf("Reloaded %s\n", path);
+  fflush(stdout);
+}
+
+/* 작업자 idx를 slot idx의 CPU에 고정 (작업자 스레드에서 호출) */
+void worker_start(int idx) {
+  affinity_pin(idx);
+}
+
+/* -a로 고른 CPU와 NUMA 노드 출력 */
+void print_affinity(void) {
+  int i;
+
+  printf("CPU affinity:");
+  for (i = 0; i < affinity_ncpus(); i++)
+    printf(" %d(node %d)", affinity_cpu(i), affinity_node(i));
+  printf("\n");
+}
+
+/* 수락 제어, 메모리 예산, 실패 원인별 카운터 출력 */
+void print_stats(void) {
+  admit_stats st;
+  unsigned long errs[ERR_COUNT];
+  sched_stats ws[SCHED_MAX_WORKERS];
+  int i, n;
+
+  admit_get_stats(&st);
+  err_snapshot(errs);
+  printf("active %d waiting %d | accepted %lu admitted %lu queued %lu | "
+         "shed: queue_full %lu per_ip %lu deadline %lu | memory %zu/%zu | timers %d\n",
+         st.active, st.waiting, st.accepted, st.admitted, st.queued,
+         st.shed_queue_full, st.shed_per_ip, st.shed_deadline,
+         budget_used(), budget_limit(), timer_pending());
+  printf("errors:");
+  for (i = ERR_NONE + 1; i < ERR_COUNT; i++)
+    if (errs[i])
+      printf(" %s %lu", err_name(i), errs[i]);
+  printf("\n");
+  if (engine)
+    printf("io: %s syscalls %lu requests %lu\n",
+           engine->name, io_stat.syscalls, io_stat.requests);
+  if ((n = sched_workers())) {
+    sched_get_stats(ws);
+    printf("sched:");
+    for (i = 0; i < n; i++)
+      printf(" w%d %lu/%lu", i, ws[i].executed, ws[i].stolen);
+    printf(" (executed/stolen)\n");
+  }
+  fflush(stdout);
+}
+
+/* 클라이언트의 요청을 처리하는 함수.
+ * 반환값: ERR_NONE, 실패하면 원인 (ERR_*) */
+int doit(conn_t *c) {
+  int serverfd, err, niov;
+  ssize_t n;
+  Node *cache_node;
+  struct iovec iov[2];
+
+  /* 클라이언트로부터 요청 라인 및 헤더를 읽음. 헤더를 다 보내지 않고
+   * 버티는 클라이언트(slowloris)는 마감 시간이 지나면 408로 끊는다 */
+  conn_deadline(c, CONN_HEADER);
+  Rio_readinitb(&c->rio, c->fd);  // 클라이언트와의 연결을 읽기 위해 rio 구조체 초기화
+  if ((n = rio_readlineb(&c->rio, c->buf, MAXLINE)) <= 0 || c->timed_out) {
+    if (c->timed_out)
+      return reply_error(c, ERR_HEADER_TIMEOUT);
+    return n < 0 ? ERR_CLIENT_READ : ERR_CLIENT_CLOSED;
+  }
+  if ((err = parse_request_line(c)) != ERR_NONE)
+    return reply_error(c, err);
+
+  if(strstr(c->uri, "favicon")) return ERR_NONE;
+  
+  if ((err = build_http_header(c)) != ERR_NONE)
+    return reply_error(c, err);
+  if (c->timed_out)
+    return reply_error(c, ERR_HEADER_TIMEOUT);
+  conn_mark(c, PH_HEADER);
+
+  if (tunnel_request(c)) {  // CONNECT: 연결한 뒤로는 양쪽 바이트를 그대로 잇기만 함
+    conn_deadline(c, CONN_CONNECT);
+    if ((err = connect_upstream(c, &serverfd)) != ERR_NONE)
+      return reply_error(c, err);
+    conn_deadline(c, CONN_FIRST_BYTE);
+    err = tunnel_splice(c, serverfd);
+    conn_close_serverfd(c);
+    return c->status ? err : reply_error(c, err);
+  }
+
+  if (admin_request(c)) {  // 원 서버가 아니라 프록시에게 보낸 요청
+    if ((err = admin_response(c, iov, &niov)) != ERR_NONE)
+      return reply_error(c, err);
+    return rio_writev(c->fd, iov, niov) < 0 ? ERR_CLIENT_WRITE : ERR_NONE;
+  }
+
+  // 캐시 검사: 클라이언트가 받을 수 있는 압축 변형부터 찾음
+  if ((cache_node = lookup_cache(c))) {  // 캐시 된 웹 객체가 있으면
+    conn_deadline(c, CONN_IDLE);
+    err = send_cache(c->fd, cache_node, !strcasecmp(c->method, "HEAD")) < 0 ? ERR_CLIENT_WRITE : ERR_NONE; // 캐싱된 웹 객체를 Client에 바로 전송
+    release_cache(cache, cache_node);
+    return relay_error(c, err);
+  }
 
   /* 클라이언트로부터 받은 요청을 서버로 전송 */
-  serverfd = Open_clientfd(server_hostname, server_port);
-  if (serverfd < 0) {
-    printf("connection failed\n");
-    return;
+  conn_deadline(c, CONN_CONNECT);
+  if ((err = connect_upstream(c, &serverfd)) != ERR_NONE)
+    return reply_error(c, err);
+
+  // write the http header (and the request body, if any) to endserver
+  conn_deadline(c, reqbody_expected(c) ? CONN_BODY : CONN_FIRST_BYTE);
+  if (rio_writen(serverfd, c->header, strlen(c->header)) < 0)
+    err = reply_error(c, reqbody_error(c, ERR_UPSTREAM_WRITE));
+  else if ((err = reqbody_forward(c, serverfd)) != ERR_NONE)
+    err = reply_error(c, err);
+  else  // recieve message from end server and send to the client
+    err = relay_response(c, serverfd);
+
+  conn_close_serverfd(c);
+  return err;
+}
+
+/* 요청 줄(c->buf)을 나눠서 method, uri, 원 서버 주소를 채운다.
+ * 반환값: ERR_NONE, 실패하면 원인 */
+int parse_request_line(conn_t *c) {
+  /* 요청 라인 파싱: 각 필드의 버퍼 크기(METHOD_MAX, MAXLINE, VERSION_MAX)를 넘지 않게 읽음 */
+  if (sscanf(c->buf, "%15s %8191s %15s", c->method, c->uri, c->version) != 3)
+    return ERR_BAD_REQUEST;
+
+  /* 지원하지 않는 method인 경우 예외 처리 (PURGE는 프록시의 캐시에 보내는 것) */
+  if (method_index(c) < 0 && strcasecmp(c->method, "PURGE") && !tunnel_request(c))
+    return ERR_METHOD;
+
+  /* 리버스 프록시 규칙이 있으면 origin-form("/path")은 Host와 경로로 원 서버를
+   * 고른다 (header_end -> upstream_route). 그 전까지 hostname에는 Host 값 */
+  c->reverse = c->uri[0] == '/' && c->cfg->nroutes > 0;
+  if (strlen(c->uri) >= MAXLINE - 1)
+    return ERR_URI_TOO_LONG;
+  if (c->reverse) {
+    c->path = c->uri;
+    c->hostname[0] = '\0';
+    strcpy(c->port, DEFAULT_PORT);
+  } else if (parse_uri(c->uri, c->hostname, c->port, &c->path) < 0)
+    return ERR_URI_TOO_LONG;
+
+  /* CONNECT는 "host:port"만 받고 허용한 포트로만 잇는다 */
+  if (tunnel_request(c) && (strchr(c->uri, '/') || !strchr(c->uri, ':')))
+    return ERR_BAD_REQUEST;
+  if (tunnel_request(c) && !tunnel_allowed(c))
+    return ERR_FORBIDDEN;
+  return ERR_NONE;
+}
+
+/* c->method의 methods[] 번호, 원 서버로 넘기지 않는 메서드면 -1 */
+int method_index(conn_t *c) {
+  size_t i;
+
+  for (i = 0; i < NMETHODS; i++)
+    if (!strcasecmp(c->method, methods[i].name))
+      return i;
+  return -1;
+}
+
+/*
+ * parse_request - 한꺼번에 받은 요청 헤더 블록(c->resp_hdr의 hdrlen 바이트)을
+ *     한 줄씩 doit()과 같은 함수로 처리해서 c->header를 만든다. 이벤트
+ *     루프와 코루틴처럼 rio 없이 읽는 쪽에서 쓴다. favicon 요청이면
+ *     요청 줄만 보고 돌아온다 (호출한 쪽이 c->uri를 보고 닫음).
+ *
+ *     반환값: ERR_NONE, 실패하면 원인
+ */
+int parse_request(conn_t *c, int hdrlen) {
+  char *p = c->resp_hdr, *end = p + hdrlen, *eol;
+  size_t n, len = 0;
+  int err, first = 1;
+
+  for (; p < end; p = eol + 1) {
+    eol = memchr(p, '\n', end - p);
+    if ((n = eol + 1 - p) >= MAXLINE)
+      return first ? ERR_URI_TOO_LONG : ERR_HEADER_TOO_LARGE;
+    memcpy(c->buf, p, n);
+    c->buf[n] = '\0';
+    if (first) {
+      if ((err = parse_request_line(c)) != ERR_NONE)
+        return err;
+      if (strstr(c->uri, "favicon"))
+        return ERR_NONE;
+      len = header_begin(c);
+      first = 0;
+    } else if (!strcmp(c->buf, "\r\n") || !strcmp(c->buf, "\n")) {
+      break;
+    } else if ((err = header_line(c, c->buf, n, &len)) != ERR_NONE) {
+      return err;
+    }
   }
+  return header_end(c, &len);
+}
 
-  // write the http header to endserver
-  Rio_writen(serverfd, new_header, strlen(new_header));
+/* 클라이언트가 받을 수 있는 변형 중 캐시에 있는 것. 없으면 NULL.
+ * 모든 처리 방식이 여기서 캐시를 보므로 트레이스(-t)도 여기서 남긴다 */
+Node *lookup_cache(conn_t *c) {
+  char key[MAXLINE + 16];
+  Node *node = NULL;
+  int enc, size;
 
-  // recieve message from end server and send to the client
-  char cachebuf[MAX_OBJECT_SIZE];
-  int sizebuf = 0;
-  size_t n;
-  while ((n=Rio_readn(serverfd, buf, MAXLINE)) != 0) {
-    /* 서버에서 보낸 응답을 저장 후 클라이언트로 전송*/
-    if (sizebuf < MAX_OBJECT_SIZE)
-      memcpy(cachebuf + sizebuf, buf,n);
-    sizebuf += n;
-    Rio_writen(fd, buf, n);
+  if (strcasecmp(c->method, "GET") && strcasecmp(c->method, "HEAD"))
+    return NULL;                  // 캐시는 GET 응답만 담는다 (HEAD 히트는 헤더만 보냄)
+  conn_mark(c, PH_CACHE_BEGIN);     // 캐시 잠금을 기다린 시간도 들어감
+  for (enc = ENC_COUNT - 1; enc >= ENC_IDENTITY && !node; enc--) {
+    if (c->client_encs & (1 << enc)) {
+      variant_key(key, c->uri, enc);
+      node = find_cache(cache, key);
+    }
+  }
+  conn_mark(c, PH_CACHE_END);
+  trace_record(c->uri, node ? TRACE_HIT : TRACE_MISS, node ? node->size : 0);
+  metrics_add(node ? M_HITS : M_MISSES, 1);
+  c->cache_result = node ? ACCESS_CACHE_HIT : ACCESS_CACHE_MISS;
+  if (node) {
+    size = strcasecmp(c->method, "HEAD") ? node->size : node->hdrlen;  // HEAD면 바디는 안 나감
+    metrics_add(M_BYTES_OUT, size);
+    c->bytes_out += size;
+    c->status = atoi(node->value + strlen("HTTP/1.x "));
+  }
+  return node;
+}
+
+/* 원 서버가 아니라 프록시에게 보낸 요청인지: /metrics, /cache, PURGE */
+int admin_request(conn_t *c) {
+  size_t n = strlen(ADMIN_CACHE_PATH);
+
+  return !strcmp(c->uri, METRICS_PATH) || !strcasecmp(c->method, "PURGE") ||
+         (!strncmp(c->uri, ADMIN_CACHE_PATH, n) && (!c->uri[n] || c->uri[n] == '?'));
+}
+
+/*
+ * admin_response - 프록시에게 보낸 요청의 응답을 iov에 만든다. /metrics는
+ *     어디서나 읽을 수 있지만 캐시를 보고 지우는 /cache와 PURGE는 루프백
+ *     주소에서 온 요청만 받는다. 캐시는 cache_walk()로 조금씩 훑으므로
+ *     그동안에도 다른 요청은 캐시를 쓴다.
+ *
+ *     반환값: ERR_NONE (*niov에 조각 수), 실패하면 원인
+ */
+int admin_response(conn_t *c, struct iovec *iov, int *niov) {
+  if (!strcmp(c->uri, METRICS_PATH))
+    *niov = metrics_response(c, iov);
+  else if (!is_loopback(c))
+    return ERR_FORBIDDEN;
+  else if (!strcasecmp(c->method, "PURGE"))
+    *niov = purge_response(c, iov);
+  else
+    *niov = cache_response(c, iov);
+  return *niov ? ERR_NONE : ERR_NOMEM;
+}
+
+/* 클라이언트가 이 호스트(127.0.0.0/8, ::1, IPv4-mapped 127.x)에서 왔는지 */
+int is_loopback(conn_t *c) {
+  struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&c->addr;
+
+  peer_addr(c);
+  if (!c->addrlen)
+    return 0;
+  if (c->addr.ss_family == AF_INET)
+    return ntohl(((struct sockaddr_in *)&c->addr)->sin_addr.s_addr) >> 24 == 127;
+  if (c->addr.ss_family == AF_INET6)
+    return IN6_IS_ADDR_LOOPBACK(&sin6->sin6_addr) ||
+           (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr) && sin6->sin6_addr.s6_addr[12] == 127);
+  return 0;
+}
+
+/* 관리 응답의 헤더를 c->buf에 쓴다. 반환값: 헤더 길이 */
+int admin_header(conn_t *c, int status, char *type, int len) {
+  c->status = status;
+  return snprintf(c->buf, MAXLINE, "HTTP/1.0 %d %s\r\nContent-Type: %s\r\n"
+                  "Content-Length: %d\r\n%s%s", status, status == 200 ? "OK" : "Not Found",
+                  type, len, conn_hdr, endof_hdr);
+}
+
+/*
+ * metrics_response - /metrics 응답을 iov에 만든다. 헤더는 c->buf, 본문은
+ *     객체 버퍼에 쓴다. 본문은 스레드별 지표(metrics.c)를 합친 것에 캐시,
+ *     리버스 프록시 서버별 상태(upstream.c)와 오류 원인별 카운터를 더한
+ *     Prometheus 텍스트 형식이다.
+ *
+ *     반환값: 조각 수 (2), 객체 버퍼를 빌리지 못했으면 0
+ */
+int metrics_response(conn_t *c, struct iovec *iov) {
+  unsigned long errs[ERR_COUNT], evictions;
+  char *buf;
+  int n, size, capacity, i;
+
+  if (!(buf = conn_objbuf(c)))
+    return 0;
+  cache_lock(cache);
+  size = cache->size;
+  capacity = cache->capacity;
+  evictions = cache->evictions;
+  cache_unlock(cache);
+  err_snapshot(errs);
+
+  n = metrics_render(buf, MAX_OBJECT_SIZE);
+  n += snprintf(buf + n, MAX_OBJECT_SIZE - n,
+                "# HELP proxy_cache_bytes Bytes of objects in the cache.\n"
+                "# TYPE proxy_cache_bytes gauge\nproxy_cache_bytes %d\n"
+                "# TYPE proxy_cache_capacity_bytes gauge\nproxy_cache_capacity_bytes %d\n"
+                "# HELP proxy_cache_evictions_total Objects evicted to make room.\n"
+                "# TYPE proxy_cache_evictions_total counter\nproxy_cache_evictions_total %lu\n"
+                "# HELP proxy_access_log_dropped_total Access log records dropped on a full ring.\n"
+                "# TYPE proxy_access_log_dropped_total counter\nproxy_access_log_dropped_total %lu\n",
+                size, capacity, evictions, access_log_dropped());
+  n += upstream_metrics(buf + n, MAX_OBJECT_SIZE - n);
+  n += snprintf(buf + n, MAX_OBJECT_SIZE - n, "# HELP proxy_errors_total Failed requests by cause.\n"
+                "# TYPE proxy_errors_total counter\n");
+  for (i = ERR_NONE + 1; i < ERR_COUNT && n < MAX_OBJECT_SIZE; i++)
+    n += snprintf(buf + n, MAX_OBJECT_SIZE - n, "proxy_errors_total{cause=\"%s\"} %lu\n",
+                  err_name(i), errs[i]);
+  if (n >= MAX_OBJECT_SIZE)
+    n = MAX_OBJECT_SIZE - 1;
+
+  iov[0].iov_base = c->buf;
+  iov[0].iov_len = admin_header(c, 200, "text/plain; version=0.0.4", n);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = n;
+  c->bytes_out = iov[0].iov_len + n;
+  return 2;
+}
+
+/* cache_walk 콜백: 객체 수와 크기를 세고 by 기준 상위 max개를 top[]에 끼워 넣는다 */
+static int list_node(Node *node, void *arg) {
+  admin_list *l = arg;
+  unsigned long v = l->by_hits ? node->hits : (unsigned long)node->size;
+  long age = node->age + (long)(time(NULL) - node->stored_at);
+  int i;
+
+  l->objects++;
+  l->bytes += node->size;
+  if (node->max_age >= 0 && age > node->max_age)
+    l->expired++;
+  for (i = l->n; i > 0 && (l->by_hits ? l->top[i - 1].hits
+                                      : (unsigned long)l->top[i - 1].size) < v; i--)
+    ;
+  if (i >= l->max)
+    return 0;
+  if (l->n < l->max)
+    l->n++;
+  memmove(&l->top[i + 1], &l->top[i], (l->n - 1 - i) * sizeof(l->top[0]));
+  snprintf(l->top[i].key, ADMIN_KEY_MAX, "%s", node->key);
+  l->top[i].size = node->size;
+  l->top[i].hits = node->hits;
+  l->top[i].age = age;
+  l->top[i].max_age = node->max_age;
+  return 0;
+}
+
+/*
+ * cache_response - /cache?top=N&by=size|hits 응답. 캐시 통계와 크기나
+ *     히트 수로 상위 N개 객체 (키가 "URI 인코딩"이면 압축 변형)를 보인다.
+ *
+ *     반환값: 조각 수 (2), 메모리가 없으면 0
+ */
+int cache_response(conn_t *c, struct iovec *iov) {
+  admin_list *l;
+  unsigned long evictions;
+  char *buf, *q;
+  int n, i;
+
+  if (!(buf = conn_objbuf(c)) || !(l = calloc(1, sizeof(admin_list))))
+    return 0;
+  l->max = ADMIN_TOP;
+  if ((q = strstr(c->uri, "top=")))
+    l->max = atoi(q + 4);
+  if (l->max < 0 || l->max > ADMIN_TOP_MAX)
+    l->max = ADMIN_TOP_MAX;
+  l->by_hits = strstr(c->uri, "by=hits") != NULL;
+  cache_walk(cache, list_node, l);
+  cache_lock(cache);
+  evictions = cache->evictions;
+  cache_unlock(cache);
+
+  n = snprintf(buf, MAX_OBJECT_SIZE, "policy %s\nobjects %d\nexpired %d\nbytes %ld\n"
+               "capacity %d\nevictions %lu\n\ntop %d by %s\n%8s %8s %8s %8s  %s\n",
+               cache_policy_name(cache->policy), l->objects, l->expired, l->bytes,
+               cache->capacity, evictions, l->n, l->by_hits ? "hits" : "size",
+               "bytes", "hits", "age", "max_age", "key");
+  for (i = 0; i < l->n && n < MAX_OBJECT_SIZE; i++)
+    n += snprintf(buf + n, MAX_OBJECT_SIZE - n, "%8d %8lu %8ld %8ld  %s\n", l->top[i].size,
+                  l->top[i].hits, l->top[i].age, l->top[i].max_age, l->top[i].key);
+  if (n >= MAX_OBJECT_SIZE)
+    n = MAX_OBJECT_SIZE - 1;
+  free(l);
+
+  iov[0].iov_base = c->buf;
+  iov[0].iov_len = admin_header(c, 200, "text/plain", n);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = n;
+  c->bytes_out = iov[0].iov_len + n;
+  return 2;
+}
+
+/* cache_walk 콜백: PURGE할 키면 1. 압축 변형의 키는 "URI 인코딩"이다 (variant_key) */
+static int purge_node(Node *node, void *arg) {
+  admin_purge *p = arg;
+
+  if (strncmp(node->key, p->key, p->len))
+    return 0;
+  return p->prefix || node->key[p->len] == '\0' || node->key[p->len] == ' ';
+}
+
+/*
+ * purge_response - "PURGE <URI>"는 그 URI의 객체를 모든 압축 변형과 함께,
+ *     "PURGE <URI>*"는 URI가 그 접두사로 시작하는 객체를 모두 캐시에서
+ *     뺀다. 전송 중인 객체는 마지막 전송이 끝날 때 해제된다.
+ *     지운 것이 있으면 200, 없으면 404 (본문은 지운 수).
+ *
+ *     반환값: 조각 수 (2)
+ */
+int purge_response(conn_t *c, struct iovec *iov) {
+  admin_purge p = { c->uri, strlen(c->uri), 0 };
+  int n, purged;
+
+  if (p.len > 0 && c->uri[p.len - 1] == '*') {
+    p.len--;
+    p.prefix = 1;
+  }
+  purged = cache_walk(cache, purge_node, &p);
+  n = snprintf(c->resp_hdr, MAXLINE, "purged %d\n", purged);
+
+  iov[0].iov_base = c->buf;
+  iov[0].iov_len = admin_header(c, purged ? 200 : 404, "text/plain", n);
+  iov[1].iov_base = c->resp_hdr;
+  iov[1].iov_len = n;
+  c->bytes_out = iov[0].iov_len + n;
+  return 2;
+}
+
+/* 안전하지 않은 메서드(POST, PUT, DELETE, PATCH)가 성공했으니 그 URI의
+ * 캐시 객체를 압축 변형과 함께 지운다 (PURGE <URI>와 같음) */
+void invalidate_cache(conn_t *c) {
+  admin_purge p = { c->uri, strlen(c->uri), 0 };
+
+  cache_walk(cache, purge_node, &p);
+}
+
+/* 응답을 보내기 전에 실패했으면 원인에 맞는 상태 코드로 답한다. 반환값: err */
+int reply_error(conn_t *c, int err) {
+  char buf[MAXLINE];
+  int n;
+
+  if ((n = error_response(buf, err)) > 0)
+    rio_writen(c->fd, buf, n);
+  return err;
+}
+
+/* 중계 중의 실패 원인. 유휴 시간 초과로 소켓을 끊었으면 그쪽이 원인 */
+int relay_error(conn_t *c, int err) {
+  return err != ERR_NONE && c->timed_out == CONN_IDLE ? ERR_IDLE_TIMEOUT : err;
+}
+
+/*
+ * connect_upstream - 원 서버에 연결. 리버스 프록시면 풀에서 서버를 고르고,
+ *     연결하지 못하면 다른 서버로 다시 시도한다 (upstream.c).
+ *
+ *     반환값: ERR_NONE (*serverfd에 소켓), 실패하면 원인
+ */
+int connect_upstream(conn_t *c, int *serverfd) {
+  int err;
+
+  upstream_pick(c);
+  while ((err = connect_once(c, serverfd)) != ERR_NONE && upstream_retry(c, err))
+    conn_deadline(c, CONN_CONNECT);
+  return err;
+}
+
+/* c->hostname:c->port에 연결. 주소가 여러 개면 엇갈려 동시에 시도하고
+ * (Happy Eyeballs) 연결 제한 시간은 그 안에서 poll로 지킨다 */
+int connect_once(conn_t *c, int *serverfd) {
+  struct addrinfo *listp;
+  int fd;
+
+  /* 이름 찾기와 연결 사이에 단계 시각을 찍는다 */
+  conn_mark(c, PH_DNS_BEGIN);
+  if (he_resolve(c->hostname, c->port, &listp) != 0)
+    return ERR_DNS;
+  conn_mark(c, PH_DNS_END);
+  fd = he_open(listp, c->cfg->connect_ms);
+  freeaddrinfo(listp);
+  if (fd < 0)
+    return errno == ETIMEDOUT ? ERR_CONNECT_TIMEOUT : ERR_CONNECT;
+  if (conn_set_serverfd(c, fd) < 0) {
+    close(fd);
+    return ERR_CONNECT_TIMEOUT;
+  }
+  *serverfd = fd;
+  return ERR_NONE;
+}
+
+/* err에 맞는 오류 응답을 buf(MAXLINE)에 만든다. 보낼 응답이 없으면 0 */
+int error_response(char *buf, int err) {
+  char *status, *reason;
+
+  if (err_status(err, &status, &reason) < 0)
+    return 0;
+  return snprintf(buf, MAXLINE, "HTTP/1.0 %s %s\r\n"
+                  "Content-Length: 0\r\n%s%s", status, reason, conn_hdr, endof_hdr);
+}
+
+/*
+ * 서버의 응답을 클라이언트에 전달하고 캐시 가능하면 캐시에 추가.
+ * 헤더를 읽은 뒤로는 relay_start/relay_data/relay_finish가 판단과 변환을
+ * 맡고, 여기서는 읽고 쓰기만 한다.
+ *
+ * 반환값: ERR_NONE, 실패하면 원인. 응답 헤더를 보낸 뒤의 실패는 연결을
+ * 끊는 것으로만 알린다.
+ */
+int relay_response(conn_t *c, int serverfd) {
+  relay_t r;
+  rio_t rio;
+  int hdrlen, niov, err;
+  ssize_t n = 0;
+
+  /* 상태 줄과 헤더를 읽어서 한 번만 파싱 */
+  Rio_readinitb(&rio, serverfd);
+  if ((hdrlen = http_read_header(&rio, c->resp_hdr, MAXBUF)) < 0
+      || relay_start(c, &r, hdrlen, &niov) != ERR_NONE)
+    return reply_error(c, c->timed_out ? ERR_FIRST_BYTE_TIMEOUT : ERR_BAD_RESPONSE);
+  if (rio_writev(c->fd, r.iov, niov) < 0)
+    return relay_error(c, ERR_CLIENT_WRITE);
+  if (!r.has_body)
+    return ERR_NONE;              // 바디가 없는 응답은 캐시하지 않음
+
+  while (!relay_done(&r) && (n = rio_readsomeb(&rio, c->buf, relay_want(&r))) > 0) {
+    conn_touch(c);
+    if ((err = relay_data(c, &r, c->buf, n, &niov)) != ERR_NONE)
+      return err;                 // 잘못된 응답은 캐시하지 않고 연결을 끊음
+    if (niov && rio_writev(c->fd, r.iov, niov) < 0)
+      return relay_error(c, ERR_CLIENT_WRITE);  // 클라이언트가 끊었거나 시간 초과
+  }
+  if (n < 0)
+    return relay_error(c, ERR_UPSTREAM_READ);
+  return relay_finish(c, &r);
+}
+
+/* iov 조각들의 총 길이 */
+static size_t iov_bytes(struct iovec *iov, int n) {
+  size_t len = 0;
+
+  while (n-- > 0)
+    len += iov[n].iov_len;
+  return len;
+}
+
+/*
+ * relay_start - c->resp_hdr의 응답 헤더(hdrlen 바이트)를 한 번만 파싱해서
+ *     상태 코드, Content-Length, Cache-Control로 캐시 여부를 정하고,
+ *     hop-by-hop 헤더를 뺀 뒤 Via와 X-Cache를 덧붙인 클라이언트용 헤더를
+ *     r->iov에 (*niov개) 만든다. 서버와는 HTTP/1.1로 통신하므로 바디의
+ *     끝은 Content-Length 또는 chunked 인코딩의 마지막 청크로 판단하고,
+ *     둘 다 없을 때만 연결 종료를 기다린다.
+ *
+ *     반환값: ERR_NONE, 헤더 형식 오류면 ERR_BAD_RESPONSE
+ */
+int relay_start(conn_t *c, relay_t *r, int hdrlen, int *niov) {
+  http_response *resp = &r->resp;
+  struct iovec iov[HTTP_MAX_IOV];
+  http_field *ctype, *cenc;
+  int i, n;
+
+  if (http_parse_response(resp, c->resp_hdr, hdrlen) < 0)
+    return ERR_BAD_RESPONSE;
+  conn_deadline(c, CONN_IDLE);    // 이제부터는 데이터가 오가는 동안 계속 연장
+  r->client_v11 = !strcasecmp(c->version, "HTTP/1.1");
+  r->content_length = resp->content_length;
+  r->bodylen = 0;
+  r->cachebuf = r->body = NULL;
+  r->cachelen = 0;
+  r->body_room = 0;
+  chunk_decoder_init(&r->dec);
+  r->has_body = strcasecmp(c->method, "HEAD") && resp->status >= 200
+                && resp->status != 204 && resp->status != 304;
+  /* 원 서버가 인코딩한 바디(gzip 등)는 identity 키로 넣으면 그 인코딩을
+   * 받지 못하는 클라이언트에게도 나가므로 캐시하지 않는다. -z가 없으면
+   * 클라이언트의 Accept-Encoding이 그대로 가고, 있어도 identity 요청을
+   * 무시하는 원 서버가 있다 */
+  cenc = http_find(resp, content_encoding_key);
+  r->cacheable = r->has_body && !strcasecmp(c->method, "GET") && http_cacheable(resp)
+                 && r->content_length < c->cfg->max_object
+                 && (!cenc || (cenc->value_len == 8 && !strncasecmp(cenc->value, "identity", 8)));
+  i = method_index(c);
+  if (i >= 0 && methods[i].unsafe && resp->status >= 200 && resp->status < 400)
+    invalidate_cache(c);
+  ctype = http_find(resp, content_type_key);
+  r->compressible = compress_enabled && r->cacheable && ctype
+                    && compressible_type(ctype->value, ctype->value_len)
+                    && !cenc;
+
+  /* 바디 길이는 프록시가 다시 정하므로 hop-by-hop 헤더와 함께 뺀다 */
+  http_remove_hop_by_hop(resp);
+  http_remove(resp, content_length_key);
+  sprintf(r->via, "Via: 1.%d %s\r\n%s%s", resp->minor_version, c->cfg->via, conn_hdr,
+          r->compressible ? "Vary: Accept-Encoding\r\n" : "");
+
+  /* 클라이언트로 보낼 헤더: 원 서버 헤더 + 바디 길이 + Via + X-Cache */
+  *niov = http_header_iov(resp, r->iov, HTTP_MAX_IOV);
+  n = 0;
+  if (resp->chunked && r->client_v11)
+    n += sprintf(r->added + n, "Transfer-Encoding: chunked\r\n");
+  else if (r->content_length >= 0)
+    n += sprintf(r->added + n, "%s: %ld\r\n", content_length_key, r->content_length);
+  n += sprintf(r->added + n, "%sX-Cache: MISS\r\n%s", r->via, endof_hdr);
+  r->iov[*niov].iov_base = r->added;
+  r->iov[(*niov)++].iov_len = n;
+  c->status = resp->status;
+  c->bytes_out += iov_bytes(r->iov, *niov);
+  metrics_add(M_BYTES_IN, hdrlen);
+  metrics_add(M_BYTES_OUT, iov_bytes(r->iov, *niov));
+
+  /* 캐시에 넣을 헤더: Age는 꺼낼 때 다시 계산하므로 빼고 복사.
+   * 헤더와 바디 사이에 Content-Length 줄이 들어갈 자리를 남겨둔다.
+   * 클라이언트용 iov는 r->iov에 두고 여기서는 따로 만든다 */
+  if (r->cacheable && !(r->cachebuf = conn_objbuf(c)))
+    r->cacheable = 0;             // 메모리 예산이 모자라면 중계만 함
+  if (r->cacheable) {
+    http_remove(resp, "Age");
+    n = http_header_iov(resp, iov, HTTP_MAX_IOV);
+    for (i = 0; i < n && r->cacheable; i++) {
+      if (r->cachelen + iov[i].iov_len + strlen(r->via) + CACHE_CL_RESERVE >= MAX_OBJECT_SIZE)
+        r->cacheable = 0;
+      else {
+        memcpy(r->cachebuf + r->cachelen, iov[i].iov_base, iov[i].iov_len);
+        r->cachelen += iov[i].iov_len;
+      }
+    }
+    if (r->cacheable) {
+      strcpy(r->cachebuf + r->cachelen, r->via);
+      r->cachelen += strlen(r->via);
+      r->body = r->cachebuf + r->cachelen + CACHE_CL_RESERVE;
+      r->body_room = MAX_OBJECT_SIZE - r->cachelen - CACHE_CL_RESERVE;
+    }
+  }
+  return ERR_NONE;
+}
+
+/* 다음에 원 서버에서 읽을 최대 바이트 (Content-Length를 넘겨 읽지 않음) */
+size_t relay_want(relay_t *r) {
+  if (!r->resp.chunked && r->content_length >= 0 && r->content_length - r->bodylen < MAXLINE)
+    return r->content_length - r->bodylen;
+  return MAXLINE;
+}
+
+/* 바디를 끝까지 받았는지. 연결 종료로 끝나는 응답은 끝을 알 수 없으므로 0 */
+int relay_done(relay_t *r) {
+  if (r->resp.chunked)
+    return chunk_done(&r->dec);
+  return r->content_length >= 0 && r->bodylen >= r->content_length;
+}
+
+/*
+ * relay_data - 원 서버에서 받은 바디 n 바이트를 buf 안에서 변환해서
+ *     클라이언트로 보낼 조각을 r->iov에 (*niov개) 채우고 캐시 버퍼에도
+ *     복사한다. chunked 응답은 디코딩해서 캐시에 저장하고, 클라이언트가
+ *     HTTP/1.1이면 다시 chunked로 인코딩해서 (청크 머리 + 데이터 + CRLF를
+ *     한 번에), HTTP/1.0이면 디코딩된 바디 그대로 보낸다. r->iov는 buf를
+ *     가리키므로 다 보낼 때까지 buf를 유지해야 한다.
+ *
+ *     반환값: ERR_NONE, chunked 형식 오류면 ERR_BAD_CHUNK
+ */
+int relay_data(conn_t *c, relay_t *r, char *buf, size_t n, int *niov) {
+  size_t used;
+  ssize_t m = n;
+
+  *niov = 0;
+  if (r->resp.chunked) {
+    if ((m = chunk_decode(&r->dec, buf, n, &used)) < 0)
+      return ERR_BAD_CHUNK;
+    if (m > 0 && r->client_v11) {
+      r->iov[0].iov_base = r->chunk_head;
+      r->iov[0].iov_len = chunk_encode_head(r->chunk_head, m);
+      r->iov[1].iov_base = buf;
+      r->iov[1].iov_len = m;
+      r->iov[2].iov_base = CHUNK_CRLF;
+      r->iov[2].iov_len = strlen(CHUNK_CRLF);
+      *niov = 3;
+    }
+    if (chunk_done(&r->dec) && r->client_v11) {
+      r->iov[*niov].iov_base = CHUNK_LAST;
+      r->iov[(*niov)++].iov_len = strlen(CHUNK_LAST);
+    }
+  } else if (r->content_length >= 0 && m > r->content_length - r->bodylen) {
+    m = r->content_length - r->bodylen;   // Content-Length 뒤에 붙어 온 바이트는 버림
+  }
+  if (m > 0 && *niov == 0 && !(r->resp.chunked && r->client_v11)) {
+    r->iov[0].iov_base = buf;
+    r->iov[0].iov_len = m;
+    *niov = 1;
+  }
+  if (r->cacheable && r->bodylen + m <= r->body_room)
+    memcpy(r->body + r->bodylen, buf, m);
+  r->bodylen += m;
+  c->bytes_out += iov_bytes(r->iov, *niov);
+  metrics_add(M_BYTES_IN, n);
+  metrics_add(M_BYTES_OUT, iov_bytes(r->iov, *niov));
+  return ERR_NONE;
+}
+
+/*
+ * relay_finish - 원 서버가 바디를 끝냈거나 연결을 닫은 뒤 부른다. 바디가
+ *     온전하고 캐시 가능한 크기면 헤더 + Content-Length + 디코딩된 바디를
+ *     캐시한다.
+ *
+ *     반환값: ERR_NONE, 바디가 중간에 끊겼으면 원인
+ */
+int relay_finish(conn_t *c, relay_t *r) {
+  int hdrlen, n;
+
+  if (!relay_done(r)) {
+    if (c->timed_out)             // 연결 종료로 끝나는 응답도 시간 초과로 끊겼으면 캐시하지 않음
+      return relay_error(c, ERR_UPSTREAM_READ);
+    if (r->resp.chunked || r->content_length >= 0)
+      return ERR_TRUNCATED;       // 마지막 청크나 Content-Length 전에 끊김
   }
-  if (sizebuf < MAX_OBJECT_SIZE) // 캐시 가능한 크기면 캐시 추가
-    add_cache(cache, uri, cachebuf, sizebuf);
 
-  Close(serverfd);
+  if (r->cacheable && r->bodylen <= r->body_room && r->bodylen < c->cfg->max_object) {
+    hdrlen = r->cachelen + sprintf(r->cachebuf + r->cachelen, "%s: %ld\r\n",
+                                   content_length_key, r->bodylen);
+    n = hdrlen + sprintf(r->cachebuf + hdrlen, "%s", endof_hdr);
+    memmove(r->cachebuf + n, r->body, r->bodylen);
+    add_cache(cache, c->uri, r->cachebuf, n + r->bodylen, hdrlen, r->resp.age, r->resp.max_age);
+    trace_record(c->uri, TRACE_FILL, n + r->bodylen);
+    if (r->compressible && r->bodylen >= COMPRESS_MIN_SIZE)
+      add_compressed_variants(c, r->cachelen, n, r->bodylen, r->resp.age, r->resp.max_age);
+  }
+  return ERR_NONE;
+}
+
+/*
+ * 압축할 수 있는 응답이면 인코딩별 변형을 캐시를 채울 때 한 번만 만들어 둔다.
+ * 이후 캐시 히트는 이미 압축된 바이트를 그대로 보내므로 요청마다 CPU를 쓰지 않는다.
+ *
+ * 압축은 CPU만 쓰므로 연결을 처리하는 스레드나 이벤트 루프에서 하지 않고
+ * 작업 스케줄러(sched.c)에 맡긴다. 작업은 연결과 같은 CPU의 작업자에게
+ * 가고 (home_worker), 인코딩마다 하위 작업으로 나뉘어 놀고 있는 작업자가 훔쳐 간다.
+ * 캐시 객체 버퍼(c->objbuf)는 작업이 넘겨받아 마지막 하위 작업이 반납한다.
+ * 변형이 캐시에 들어가기 전의 요청은 원본 변형으로 응답받는다.
+ */
+void add_compressed_variants(conn_t *c, int hdrlen, long body_off, long bodylen,
+                             long age, long max_age) {
+  size_t urilen = strlen(c->uri) + 1;
+  fill_job *job;
+  int enc;
+
+  if (!(job = malloc(sizeof(fill_job) + urilen)))
+    return;                       // 메모리가 모자라면 identity만 캐시
+  memcpy(job->uri, c->uri, urilen);
+  job->buf = c->objbuf;
+  c->objbuf = NULL;
+  job->hdrlen = hdrlen;
+  job->body_off = body_off;
+  job->bodylen = bodylen;
+  job->age = age;
+  job->max_age = max_age;
+  job->refs = ENC_COUNT - 1;
+  for (enc = ENC_IDENTITY; enc < ENC_COUNT; enc++) {
+    job->tasks[enc].job = job;
+    job->tasks[enc].enc = enc;
+    job->tasks[enc].t.fn = enc == ENC_IDENTITY ? fill_variants : fill_variant;
+  }
+  sched_submit(&job->tasks[ENC_IDENTITY].t, home_worker(c));
+}
+
+/* 연결의 압축 작업을 맡을 작업자. -a면 작업자 i는 slot i에 (worker_start),
+ * 연결 스레드는 slot c->home에 고정되므로 (affinity_pin은 둘 다 ncpus로
+ * 나눈 나머지) 작업자가 CPU마다 있으면 c->home % ncpus가 같은 CPU의 작업자다.
+ * 작업자가 CPU보다 적으면 시작할 때 알리고 c->home으로 고른다 */
+int home_worker(conn_t *c) {
+  if (!affinity_enabled() || sched_workers() < affinity_ncpus())
+    return c->home;
+  return c->home % affinity_ncpus();
 }
 
-/* URI에서 hostname, port, path를 추출 */
-int parse_uri(char *uri, char *hostname, char *port, char *path) {
+/* 작업자에서: 첫 인코딩 말고는 하위 작업으로 나누고 첫 인코딩은 바로 만든다 */
+void fill_variants(task *t) {
+  fill_job *job = ((fill_task *)t)->job;
+  int enc;
+
+  for (enc = ENC_COUNT - 1; enc > ENC_IDENTITY + 1; enc--)
+    sched_spawn(&job->tasks[enc].t);
+  fill_variant(&job->tasks[ENC_IDENTITY + 1].t);
+}
+
+/* 인코딩 하나의 변형을 만들어 캐시에 넣는다. 마지막이면 작업을 해제 */
+void fill_variant(task *t) {
+  fill_task *ft = (fill_task *)t;
+  fill_job *job = ft->job;
+  char *varbuf, *out, *body = job->buf + job->body_off, key[MAXLINE + 16];
+  int hdrlen = job->hdrlen, n;
+  long clen;
+
+  varbuf = sched_self() >= 0 ? worker_scratch() : object_buf_get();
+  if (varbuf) {                   // 메모리 예산이 모자라면 이 변형은 건너뜀
+    out = varbuf + hdrlen + 2 * CACHE_CL_RESERVE;
+    clen = compress_body(ft->enc, body, job->bodylen, out, MAX_OBJECT_SIZE - (out - varbuf));
+    if (clen >= 0 && clen < job->bodylen) {  // 줄어들지 않으면 identity만 씀
+      memcpy(varbuf, job->buf, hdrlen);
+      n = hdrlen + sprintf(varbuf + hdrlen, "Content-Encoding: %s\r\n%s: %ld\r\n",
+                           encoding_name(ft->enc), content_length_key, clen);
+      strcpy(varbuf + n, endof_hdr);
+      memmove(varbuf + n + strlen(endof_hdr), out, clen);
+      variant_key(key, job->uri, ft->enc);
+      add_cache(cache, key, varbuf, n + strlen(endof_hdr) + clen, n, job->age, job->max_age);
+    }
+    if (sched_self() < 0)
+      object_buf_put(varbuf);
+  }
+  if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    object_buf_put(job->buf);
+    free(job);
+  }
+}
+
+/*
+ * worker_scratch - 작업자마다 하나씩 두고 계속 쓰는 압축 버퍼. 풀에서
+ *     빌리지 않고 작업자 스레드가 직접 할당해 처음 써 두므로 (first touch)
+ *     -a로 고정한 CPU의 NUMA 노드 메모리에 놓인다. 예산에서 한 번만 뺀다.
+ *
+ *     반환값: 버퍼, 예산이나 메모리가 모자라면 NULL
+ */
+char *worker_scratch(void) {
+  static __thread char *scratch;
+
+  if (!scratch && budget_reserve(MAX_OBJECT_SIZE, 0) == 0) {
+    if ((scratch = malloc(MAX_OBJECT_SIZE)))
+      memset(scratch, 0, MAX_OBJECT_SIZE);
+    else
+      budget_release(MAX_OBJECT_SIZE);
+  }
+  return scratch;
+}
+
+void variant_key(char *key, char *uri, int enc) {
+  if (enc == ENC_IDENTITY)
+    strcpy(key, uri);
+  else
+    sprintf(key, "%s %s", uri, encoding_name(enc));
+}
+
+/* URI에서 hostname, port, path를 추출 (path는 uri 안을 가리킴). 각 필드가 버퍼보다 길면 -1 */
+int parse_uri(char *uri, char *hostname, char *port, char **path) {
+  char *host, *colon;
+  size_t hostlen;
+
   /* URI에서 시작 위치 설정 */
   char *ptr = strstr(uri, "://");
   ptr = ptr ? ptr + 3 : uri;
   if (ptr[0] == '/') ptr += 1;
+  host = ptr;
 
-  /* Hostname 추출 */
-  strcpy(hostname, ptr);
-
-  /* Path 추출 */
-  if((ptr = strchr(hostname, '/'))){ 
-    *ptr = '\0';                // host = www.google.com:80
-    ptr += 1;
-    strcpy(path, DEFAULT_PATH); // uri_ptos = /
-    strcat(path, ptr);          // uri_ptos = /index.html
+  /* Path 추출: 복사하지 않고 uri 안을 가리킨다 */
+  if ((ptr = strchr(host, '/'))) {
+    hostlen = ptr - host;       // host = www.google.com:80
+    *path = ptr;                // path = /index.html
   } else {
-    strcpy(path, DEFAULT_PATH);
+    hostlen = strlen(host);
+    *path = DEFAULT_PATH;       // path = /
   }
+
   /* Port Number 추출 */
-  if ((ptr = strchr(hostname, ':'))){ // host = www.google.com:80
-    *ptr = '\0';                      // host = www.google.com
-    ptr += 1;     
-    strcpy(port, ptr);                // port = 80
+  colon = memchr(host, ':', hostlen);
+  if (colon) {                  // host = www.google.com:80
+    if (hostlen - (colon + 1 - host) >= NI_MAXSERV)
+      return -1;
+    snprintf(port, NI_MAXSERV, "%.*s", (int)(hostlen - (colon + 1 - host)), colon + 1);
+    hostlen = colon - host;     // host = www.google.com
   } else {
-    strcpy(port, DEFAULT_PORT);       // port가 없을 경우 "80"을 넣어줌
+    strcpy(port, DEFAULT_PORT); // port가 없을 경우 "80"을 넣어줌
   }
+  if (hostlen >= NI_MAXHOST)
+    return -1;
+  snprintf(hostname, NI_MAXHOST, "%.*s", (int)hostlen, host);
 
   return 0; // 성공
 }
-/* 새로운 헤더 만드는 함수 */
-void build_http_header(char *http_header, char *hostname, char *path, char *port, char *method, rio_t *client_rio) {
-  char buf[MAXLINE], request_hdr[MAXLINE], other_hdr[MAXLINE], host_hdr[MAXLINE];
-  
-  // request line
-  sprintf(request_hdr, "%s %s %s\r\n", method, path, NEW_VERSION);
+
+/* 새로운 헤더 만드는 함수.
+ * 헤더를 따로 모아두지 않고 c->header에 바로 이어 붙인다.
+ * 반환값: ERR_NONE, 헤더가 MAXBUF를 넘으면 ERR_HEADER_TOO_LARGE,
+ *         읽기 오류면 ERR_CLIENT_READ */
+int build_http_header(conn_t *c) {
+  size_t len = header_begin(c);
+  ssize_t n;
+  int err;
 
   // get other request header for client rio and change it
-  while (Rio_readlineb(client_rio, buf, MAXLINE) > 0) {
-    if (strcmp(buf, endof_hdr) == 0)
+  while ((n = rio_readlineb(&c->rio, c->buf, MAXLINE)) > 0) {
+    if (strcmp(c->buf, endof_hdr) == 0)
       break;  // EOF
-    
-    if (!strncasecmp(buf, host_key, strlen(host_key))) {
-      sprintf(host_hdr, "Host: %s\r\n", hostname);
-      continue;
-    }
+    if ((err = header_line(c, c->buf, n, &len)) != ERR_NONE)
+      return err;
+  }
+  if (n < 0)
+    return ERR_CLIENT_READ;
+  return header_end(c, &len);
+}
 
-    if (strncasecmp(buf, connection_key, strlen(connection_key))
-      && strncasecmp(buf, proxy_connection_key, strlen(proxy_connection_key))
-      && strncasecmp(buf, user_agent_key, strlen(user_agent_key))) {
-      strcat(other_hdr, buf);
-    }
+/* c->header를 request line, Host, User-Agent로 시작한다. 설정에서 User-Agent를
+ * 비웠으면 클라이언트의 것을 그대로 보낸다. 반환값: 길이 */
+size_t header_begin(conn_t *c) {
+  char *hdr = c->header;
+  size_t len;
 
+  c->client_encs = 1 << ENC_IDENTITY;
+  c->req_length = -1;
+  c->req_chunked = c->expect_continue = 0;
+
+  // request line, Host는 항상 URI의 hostname으로 바꿔 씀 (리버스 프록시는 클라이언트의 것)
+  len = snprintf(hdr, MAXBUF, "%s %s %s\r\n", c->method, c->path, NEW_VERSION);
+  if (!c->reverse)
+    len += snprintf(hdr + len, MAXBUF - len, host_hdr_format, c->hostname);
+  if (c->cfg->user_agent[0])
+    len += snprintf(hdr + len, MAXBUF - len, "%s: %s\r\n", user_agent_key, c->cfg->user_agent);
+  return len;
+}
+
+/* Content-Length 값(value, 앞뒤 공백 허용)을 c->req_length에 넣는다.
+ * 숫자가 아니거나 앞서 온 값과 다르면 -1 */
+static int request_length(conn_t *c, char *value) {
+  char *end;
+  long n;
+
+  value += strspn(value, " \t");
+  if (!isdigit((unsigned char)*value))
+    return -1;
+  errno = 0;
+  n = strtol(value, &end, 10);
+  if (errno || end[strspn(end, " \t\r\n")] || (c->req_length >= 0 && c->req_length != n))
+    return -1;
+  c->req_length = n;
+  return 0;
+}
+
+/* 리버스 프록시: Host 값(앞뒤 공백 허용)을 규칙을 고를 때까지 c->hostname에 둔다.
+ * 비었거나 두 번 오면 -1 */
+static int request_host(conn_t *c, char *value) {
+  size_t n;
+
+  value += strspn(value, " \t");
+  n = strcspn(value, " \t\r\n");
+  if (!n || n >= NI_MAXHOST || c->hostname[0])
+    return -1;
+  memcpy(c->hostname, value, n);
+  c->hostname[n] = '\0';
+  return 0;
+}
+
+/* 헤더 값(value, 줄 끝까지)의 마지막 항목이 token인지 (대소문자 무시) */
+static int value_is(char *value, const char *token) {
+  char *last = strrchr(value, ',');
+  size_t n = strlen(token);
+
+  last = last ? last + 1 : value;
+  last += strspn(last, " \t");
+  return !strncasecmp(last, token, n) && !last[n + strspn(last + n, " \t\r\n")];
+}
+
+/* 클라이언트의 헤더 한 줄(line, n 바이트, NUL로 끝남)을 바꿔서 c->header에
+ * 이어 붙인다. *len은 지금까지의 길이.
+ * 반환값: ERR_NONE, 헤더가 MAXBUF를 넘으면 ERR_HEADER_TOO_LARGE,
+ *         바디 길이(Content-Length, Transfer-Encoding)나 리버스 프록시로 받은
+ *         요청의 Host가 잘못됐으면 ERR_BAD_REQUEST */
+int header_line(conn_t *c, char *line, size_t n, size_t *len) {
+  if (*len >= MAXBUF)
+    return ERR_HEADER_TOO_LARGE;
+  if (!strncasecmp(line, host_key, strlen(host_key))) {
+    if (!c->reverse || line[strlen(host_key)] != ':')
+      return ERR_NONE;
+    if (request_host(c, line + strlen(host_key) + 1) < 0)
+      return ERR_BAD_REQUEST;
   }
-  if (strlen(host_hdr) == 0) {
-    sprintf(host_hdr, host_hdr_format, hostname);
+
+  /* 요청 바디의 길이는 그대로 넘기고 보낼 때 끝을 찾는 데 쓴다 */
+  if (!strncasecmp(line, content_length_key, strlen(content_length_key))
+      && line[strlen(content_length_key)] == ':') {
+    if (request_length(c, line + strlen(content_length_key) + 1) < 0)
+      return ERR_BAD_REQUEST;
+  } else if (!strncasecmp(line, transfer_encoding_key, strlen(transfer_encoding_key))
+             && line[strlen(transfer_encoding_key)] == ':') {
+    c->req_chunked = 1;           // chunked가 아닌 인코딩은 프록시가 끝을 알 수 없음
+    if (!value_is(line + strlen(transfer_encoding_key) + 1, "chunked"))
+      return ERR_BAD_REQUEST;
+  } else if (!strncasecmp(line, expect_key, strlen(expect_key))
+             && line[strlen(expect_key)] == ':') {
+    c->expect_continue = value_is(line + strlen(expect_key) + 1, "100-continue");
+    return ERR_NONE;              // 100은 프록시가 보낸다 (reqbody.c)
   }
-  sprintf(http_header, "%s%s%s%s%s%s%s",
-          request_hdr,
-          host_hdr,
-          user_agent_hdr,
-          other_hdr,
-          conn_hdr,
-          prox_hdr,
-          endof_hdr);
-  return;
-}
\ No newline at end of file
+
+  /* 압축을 켜면 프록시가 직접 압축하므로 원 서버에는 identity만 요청 */
+  if (compress_enabled && !strncasecmp(line, accept_encoding_key, strlen(accept_encoding_key))) {
+    c->client_encs = accept_encoding(line + strlen(accept_encoding_key) + 1,
+                                     n - strlen(accept_encoding_key) - 1);
+    return ERR_NONE;
+  }
+
+  if (strncasecmp(line, connection_key, strlen(connection_key))
+    && strncasecmp(line, proxy_connection_key, strlen(proxy_connection_key))
+    && (!c->cfg->user_agent[0] || strncasecmp(line, user_agent_key, strlen(user_agent_key)))) {
+    if (*len + n >= MAXBUF)
+      return ERR_HEADER_TOO_LARGE;
+    memcpy(c->header + *len, line, n + 1);
+    *len += n;
+  }
+  return ERR_NONE;
+}
+
+/* Connection, Proxy-Connection과 빈 줄로 헤더를 마친다. 바디 길이를 두
+ * 가지로 알린 요청은 원 서버와 프록시가 끝을 다르게 볼 수 있으므로 400.
+ * 리버스 프록시로 받은 요청은 여기서 규칙을 고른다 (관리 요청은 빼고) */
+int header_end(conn_t *c, size_t *len) {
+  if (c->req_chunked && c->req_length >= 0)
+    return ERR_BAD_REQUEST;
+  if (*len < MAXBUF)
+    *len += snprintf(c->header + *len, MAXBUF - *len, "%s%s%s", conn_hdr, prox_hdr, endof_hdr);
+  if (*len >= MAXBUF)
+    return ERR_HEADER_TOO_LARGE;
+  return c->reverse && !admin_request(c) ? upstream_route(c) : ERR_NONE;
+}
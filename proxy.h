@@ -0,0 +1,53 @@
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include "csapp.h"
+#include "cache.h"
+#include "chunked.h"
+#include "http.h"
+#include "conn.h"
+
+/*
+ * 요청 헤더를 만들고 응답을 중계하는 단계들. 스레드의 doit()은 blocking
+ * I/O로 이 단계를 차례로 부르고, 이벤트 루프(evproxy.c)는 I/O가 끝날
+ * 때마다 같은 단계를 부르므로 두 처리 방식의 동작이 같다.
+ */
+
+/* 응답 하나를 중계하는 동안의 상태. 스레드는 스택에, 이벤트 루프는 연결마다 둔다 */
+typedef struct {
+  http_response resp;
+  int has_body, cacheable, compressible, client_v11;
+  long content_length;          // 원 서버의 Content-Length, 없으면 -1
+  long bodylen;                 // 지금까지 중계한 (디코딩된) 바디 길이
+  chunk_decoder dec;
+  char *cachebuf;               // 캐시에 넣을 객체 (헤더 + 바디 자리)
+  int cachelen;                 // cachebuf에 복사한 헤더 길이
+  char *body;                   // cachebuf 안의 바디 시작
+  long body_room;
+  char via[CONFIG_STR_MAX + 64];  // Via와 Connection 헤더
+  char added[CONFIG_STR_MAX + 192];  // 프록시가 덧붙이는 헤더 (via 포함)
+  char chunk_head[CHUNK_HEAD_MAX];
+  struct iovec iov[HTTP_MAX_IOV + 1];  // 다음에 클라이언트로 보낼 조각
+} relay_t;
+
+extern LRU_Cache *cache;
+extern int compress_enabled;
+
+int parse_request_line(conn_t *c);
+size_t header_begin(conn_t *c);
+int header_line(conn_t *c, char *line, size_t n, size_t *len);
+int header_end(conn_t *c, size_t *len);
+int parse_request(conn_t *c, int hdrlen);
+Node *lookup_cache(conn_t *c);
+int admin_request(conn_t *c);
+int admin_response(conn_t *c, struct iovec *iov, int *niov);
+void request_done(conn_t *c, int err);
+int relay_start(conn_t *c, relay_t *r, int hdrlen, int *niov);
+size_t relay_want(relay_t *r);
+int relay_data(conn_t *c, relay_t *r, char *buf, size_t n, int *niov);
+int relay_done(relay_t *r);
+int relay_finish(conn_t *c, relay_t *r);
+int relay_error(conn_t *c, int err);
+int error_response(char *buf, int err);
+
+#endif /* __PROXY_H__ */
@@ -0,0 +1,128 @@
+/*
+ * reqbody.c - POST, PUT 같은 요청의 바디를 원 서버로 흘려보내기.
+ *
+ *     바디는 모아 두지 않고 받는 대로 보낸다. Content-Length 바디는 그
+ *     길이만큼 그대로, chunked 바디는 응답과 같은 디코더(chunked.c)로
+ *     끝을 찾으면서 다시 chunked로 인코딩해서 보낸다 (트레일러는 버림).
+ *     바디 뒤에 붙어 온 바이트는 버린다 (원 서버와의 연결은 요청마다
+ *     닫으므로). "Expect: 100-continue"는 원 서버에 넘기지 않고 연결한
+ *     뒤에 프록시가 직접 100을 보낸다.
+ *
+ *     보내는 동안의 마감 시간은 CONN_BODY로, 중계와 같이 데이터가 오갈
+ *     때마다 연장된다. 바디를 다 보내면 응답 헤더를 기다린다
+ *     (CONN_FIRST_BYTE). 스레드는 reqbody_forward()로, 이벤트 루프와
+ *     코루틴은 reqbody_data()로 바꾼 조각을 엔진으로 보낸다.
+ */
+#include "reqbody.h"
+#include "err.h"
+
+/* 요청에 바디가 있는지 (Content-Length > 0이거나 chunked) */
+int reqbody_expected(conn_t *c) {
+  return c->req_chunked || c->req_length > 0;
+}
+
+void reqbody_start(conn_t *c, reqbody_t *b) {
+  b->chunked = c->req_chunked;
+  b->remaining = b->chunked ? 0 : c->req_length;
+  chunk_decoder_init(&b->dec);
+}
+
+/* 클라이언트가 100 Continue를 기다리면 iov에 채운다. 반환값: 조각 수 (0, 1) */
+int reqbody_continue(conn_t *c, struct iovec *iov) {
+  if (!c->expect_continue)
+    return 0;
+  iov->iov_base = CONTINUE_REPLY;
+  iov->iov_len = strlen(CONTINUE_REPLY);
+  return 1;
+}
+
+/* 다음에 클라이언트에서 읽을 최대 바이트 (Content-Length를 넘겨 읽지 않음) */
+size_t reqbody_want(reqbody_t *b) {
+  if (!b->chunked && b->remaining < MAXLINE)
+    return b->remaining;
+  return MAXLINE;
+}
+
+int reqbody_done(reqbody_t *b) {
+  return b->chunked ? chunk_done(&b->dec) : b->remaining == 0;
+}
+
+/*
+ * reqbody_data - 클라이언트에서 받은 바디 n 바이트를 buf 안에서 변환해서
+ *     원 서버로 보낼 조각을 b->iov에 (*niov개) 채운다. b->iov는 buf를
+ *     가리키므로 다 보낼 때까지 buf를 유지해야 한다.
+ *
+ *     반환값: ERR_NONE, chunked 형식 오류면 ERR_BAD_REQUEST
+ */
+int reqbody_data(reqbody_t *b, char *buf, size_t n, int *niov) {
+  size_t used;
+  ssize_t m;
+
+  *niov = 0;
+  if (!b->chunked) {
+    m = (long)n > b->remaining ? b->remaining : (long)n;
+    b->remaining -= m;
+    if (m > 0) {
+      b->iov[0].iov_base = buf;
+      b->iov[0].iov_len = m;
+      *niov = 1;
+    }
+    return ERR_NONE;
+  }
+
+  if ((m = chunk_decode(&b->dec, buf, n, &used)) < 0)
+    return ERR_BAD_REQUEST;
+  if (m > 0) {
+    b->iov[0].iov_base = b->chunk_head;
+    b->iov[0].iov_len = chunk_encode_head(b->chunk_head, m);
+    b->iov[1].iov_base = buf;
+    b->iov[1].iov_len = m;
+    b->iov[2].iov_base = CHUNK_CRLF;
+    b->iov[2].iov_len = strlen(CHUNK_CRLF);
+    *niov = 3;
+  }
+  if (chunk_done(&b->dec)) {
+    b->iov[*niov].iov_base = CHUNK_LAST;
+    b->iov[(*niov)++].iov_len = strlen(CHUNK_LAST);
+  }
+  return ERR_NONE;
+}
+
+/* 요청을 보내는 중의 실패 원인. 타이머가 소켓을 끊었으면 그쪽이 원인 */
+int reqbody_error(conn_t *c, int err) {
+  if (c->timed_out == CONN_BODY)
+    return ERR_BODY_TIMEOUT;
+  if (c->timed_out == CONN_FIRST_BYTE)
+    return ERR_FIRST_BYTE_TIMEOUT;
+  return err;
+}
+
+/*
+ * reqbody_forward - 스레드: 요청 헤더를 보낸 뒤 바디가 있으면 클라이언트에서
+ *     읽는 대로 원 서버에 보낸다. 헤더와 같이 읽힌 바디는 c->rio에 있다.
+ *
+ *     반환값: ERR_NONE, 실패하면 원인 (아직 응답을 보내지 않았음)
+ */
+int reqbody_forward(conn_t *c, int serverfd) {
+  reqbody_t b;
+  struct iovec iov;
+  ssize_t n = 0;
+  int niov, err;
+
+  if (!reqbody_expected(c))
+    return ERR_NONE;
+  reqbody_start(c, &b);
+  if ((niov = reqbody_continue(c, &iov)) && rio_writev(c->fd, &iov, niov) < 0)
+    return ERR_CLIENT_WRITE;
+  while (!reqbody_done(&b) && (n = rio_readsomeb(&c->rio, c->buf, reqbody_want(&b))) > 0) {
+    conn_touch(c);
+    if ((err = reqbody_data(&b, c->buf, n, &niov)) != ERR_NONE)
+      return err;
+    if (niov && rio_writev(serverfd, b.iov, niov) < 0)
+      return reqbody_error(c, ERR_UPSTREAM_WRITE);
+  }
+  if (!reqbody_done(&b))
+    return reqbody_error(c, n < 0 ? ERR_CLIENT_READ : ERR_CLIENT_CLOSED);
+  conn_deadline(c, CONN_FIRST_BYTE);
+  return ERR_NONE;
+}
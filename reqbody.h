@@ -0,0 +1,28 @@
+#ifndef __REQBODY_H__
+#define __REQBODY_H__
+
+#include "conn.h"
+#include "chunked.h"
+
+#define CONTINUE_REPLY "HTTP/1.1 100 Continue\r\n\r\n"
+
+/* 요청 바디 하나를 원 서버로 흘려보내는 동안의 상태. 스레드와 코루틴은
+ * 스택에, 이벤트 루프는 연결마다 둔다 */
+typedef struct {
+  long remaining;               // Content-Length 바디의 남은 바이트 (chunked면 쓰지 않음)
+  int chunked;
+  chunk_decoder dec;
+  char chunk_head[CHUNK_HEAD_MAX];
+  struct iovec iov[4];          // 다음에 원 서버로 보낼 조각 (청크 머리, 데이터, CRLF, 마지막 청크)
+} reqbody_t;
+
+int reqbody_expected(conn_t *c);
+void reqbody_start(conn_t *c, reqbody_t *b);
+int reqbody_continue(conn_t *c, struct iovec *iov);
+size_t reqbody_want(reqbody_t *b);
+int reqbody_data(reqbody_t *b, char *buf, size_t n, int *niov);
+int reqbody_done(reqbody_t *b);
+int reqbody_error(conn_t *c, int err);
+int reqbody_forward(conn_t *c, int serverfd);
+
+#endif /* __REQBODY_H__ */
@@ -0,0 +1,231 @@
+/*
+ * sched.c - CPU 작업을 위한 work-stealing 스케줄러. 작업자 스레드마다
+ *     deque를 하나씩 두고, 작업은 맡긴 쪽이 고른 작업자(연결의 home)의
+ *     deque에 들어간다. 주인은 자기 deque의 아래쪽에서 꺼내고 (최근에
+ *     넣은 것부터, 캐시가 따뜻할 때), 할 일이 없는 작업자는 임의로 고른
+ *     다른 작업자의 deque 위쪽에서 훔친다 (가장 오래된 것부터).
+ *
+ *     연결의 I/O는 그 연결을 맡은 스레드나 이벤트 루프에 그대로 두고,
+ *     압축처럼 CPU만 쓰는 일만 여기로 넘긴다. 한 작업자로 몰린 작업도
+ *     놀고 있는 작업자가 나눠 가지므로 루프나 연결이 그동안 막히지 않는다.
+ *     deque마다 lock이 있고, 작업 수는 원자적으로 센다. 전역 lock은
+ *     작업자가 잠들 때와, 잠든 작업자가 있을 때 깨우는 쪽만 잡는다
+ *     (하나만 깨움). 넣고 꺼내는 길에서는 deque의 lock만 잡는다.
+ */
+#include "sched.h"
+
+#define SCHED_MASK (SCHED_DEQUE_SIZE - 1)
+
+typedef struct {
+  pthread_mutex_t lock;
+  task *q[SCHED_DEQUE_SIZE];
+  unsigned top, bottom;             // 훔치는 쪽은 top에서, 주인은 bottom에서
+  unsigned seed;                    // 훔칠 작업자를 고르는 난수
+  sched_stats st;
+  pthread_t tid;
+} worker;
+
+static worker workers[SCHED_MAX_WORKERS];
+static int nworkers;
+static int stealing;
+static void (*on_start)(int idx);   // 작업자 스레드가 처음 부르는 함수 (CPU 고정 등)
+static __thread worker *self;       // 작업자 스레드 안에서는 자기 자신
+
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drain_cond = PTHREAD_COND_INITIALIZER;
+static long pending;                // deque에 들어 있는 작업 (원자적)
+static long outstanding;            // 맡겼지만 아직 끝나지 않은 작업 (원자적)
+static int sleepers;                // work_cond에서 잠들었거나 잠들려는 작업자
+
+static void *worker_main(void *arg);
+
+/*
+ * sched_init - 작업자 nworkers개를 띄운다. steal이 0이면 훔치지 않고
+ *     각자 자기 deque만 처리한다 (비교용). nworkers가 0이면 작업을
+ *     맡긴 자리에서 바로 실행한다. start가 있으면 작업자 i가 일을 받기
+ *     전에 자기 스레드에서 start(i)를 부른다.
+ *
+ *     반환값: 0, 스레드를 만들지 못하면 -1
+ */
+int sched_init(int n, int steal, void (*start)(int idx)) {
+  int i;
+
+  if (n > SCHED_MAX_WORKERS)
+    n = SCHED_MAX_WORKERS;
+  stealing = steal;
+  on_start = start;
+  for (i = 0; i < n; i++) {
+    pthread_mutex_init(&workers[i].lock, NULL);
+    workers[i].seed = i + 1;
+  }
+  nworkers = n;                     // 먼저 뜬 작업자도 모두를 훔칠 대상으로 본다
+  for (i = 0; i < n; i++)
+    if (pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]) != 0)
+      return -1;
+  return 0;
+}
+
+int sched_workers(void) {
+  return nworkers;
+}
+
+/* 지금 스레드가 작업자면 그 번호, 아니면 -1 */
+int sched_self(void) {
+  return self ? self - workers : -1;
+}
+
+static unsigned deque_size(worker *w) {
+  unsigned n;
+
+  pthread_mutex_lock(&w->lock);
+  n = w->bottom - w->top;
+  pthread_mutex_unlock(&w->lock);
+  return n;
+}
+
+/* 주인 쪽(아래)에서 꺼낸다 */
+static task *deque_pop(worker *w) {
+  task *t = NULL;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->bottom != w->top)
+    t = w->q[--w->bottom & SCHED_MASK];
+  pthread_mutex_unlock(&w->lock);
+  return t;
+}
+
+/* 훔치는 쪽(위)에서 꺼낸다 */
+static task *deque_steal(worker *w) {
+  task *t = NULL;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->bottom != w->top)
+    t = w->q[w->top++ & SCHED_MASK];
+  pthread_mutex_unlock(&w->lock);
+  return t;
+}
+
+/* 맡긴 작업이 모두 끝났다. sched_drain()은 lock을 잡고 outstanding을 보므로 lock 안에서 알린다 */
+static void drained(void) {
+  pthread_mutex_lock(&sleep_lock);
+  pthread_cond_broadcast(&drain_cond);
+  pthread_mutex_unlock(&sleep_lock);
+}
+
+/*
+ * enqueue - w의 deque 아래에 넣고, 잠든 작업자가 있으면 하나를 깨운다.
+ *     가득 찼으면 그 자리에서 실행한다. pending을 늘린 뒤 sleepers를 읽고,
+ *     잠드는 쪽은 sleepers를 늘린 뒤 pending을 읽으므로 (둘 다 SEQ_CST)
+ *     적어도 한쪽은 다른 쪽을 본다. 훔치지 않으면 그 주인만 꺼낼 수 있으므로
+ *     모두 깨운다.
+ */
+static void enqueue(worker *w, task *t) {
+  int full;
+
+  /* 넣기 전에 센다. 넣자마자 다른 작업자가 꺼내 끝내도 0 아래로 내려가지 않게 */
+  __atomic_add_fetch(&outstanding, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&w->lock);
+  if (!(full = w->bottom - w->top == SCHED_DEQUE_SIZE))
+    w->q[w->bottom++ & SCHED_MASK] = t;
+  pthread_mutex_unlock(&w->lock);
+  if (full) {
+    __atomic_sub_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+    t->fn(t);
+    if (__atomic_sub_fetch(&outstanding, 1, __ATOMIC_SEQ_CST) == 0)
+      drained();
+    return;
+  }
+  if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&sleep_lock);
+    if (stealing)
+      pthread_cond_signal(&work_cond);
+    else
+      pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&sleep_lock);
+  }
+}
+
+/* 할 일이 없으니 잠든다. 잠들기 직전에 다시 보므로 그사이 넣은 작업을 놓치지 않는다 */
+static void idle(worker *w) {
+  pthread_mutex_lock(&sleep_lock);
+  __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+  while (!(stealing ? __atomic_load_n(&pending, __ATOMIC_SEQ_CST) : deque_size(w)))
+    pthread_cond_wait(&work_cond, &sleep_lock);
+  __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&sleep_lock);
+}
+
+/* 임의의 작업자부터 차례로 훔쳐 본다 */
+static task *steal(worker *w) {
+  int i, v = rand_r(&w->seed) % nworkers;
+  task *t;
+
+  for (i = 0; i < nworkers; i++, v = (v + 1) % nworkers) {
+    if (&workers[v] != w && (t = deque_steal(&workers[v]))) {
+      w->st.stolen++;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+static void *worker_main(void *arg) {
+  worker *w = arg;
+  task *t;
+
+  self = w;
+  if (on_start)
+    on_start(w - workers);
+  while (1) {
+    if (!(t = deque_pop(w)) && stealing)
+      t = steal(w);
+    if (!t) {
+      idle(w);
+      continue;
+    }
+    __atomic_sub_fetch(&pending, 1, __ATOMIC_SEQ_CST);
+
+    t->fn(t);
+    w->st.executed++;
+
+    if (__atomic_sub_fetch(&outstanding, 1, __ATOMIC_SEQ_CST) == 0)
+      drained();
+  }
+  return NULL;
+}
+
+/* t를 home 작업자에게 맡긴다 (어느 스레드에서나). 작업자가 없으면 바로 실행 */
+void sched_submit(task *t, unsigned home) {
+  if (!nworkers) {
+    t->fn(t);
+    return;
+  }
+  enqueue(&workers[home % nworkers], t);
+}
+
+/* 작업 안에서 나눈 하위 작업을 자기 deque에 넣는다. 놀고 있는 작업자가 훔쳐 간다 */
+void sched_spawn(task *t) {
+  if (!self) {
+    sched_submit(t, 0);
+    return;
+  }
+  enqueue(self, t);
+}
+
+/* 맡긴 작업이 모두 끝날 때까지 기다린다 (작업자 밖에서 호출) */
+void sched_drain(void) {
+  pthread_mutex_lock(&sleep_lock);
+  while (__atomic_load_n(&outstanding, __ATOMIC_SEQ_CST))
+    pthread_cond_wait(&drain_cond, &sleep_lock);
+  pthread_mutex_unlock(&sleep_lock);
+}
+
+/* 작업자별 카운터를 st[0..nworkers-1]에 복사 */
+void sched_get_stats(sched_stats *st) {
+  int i;
+
+  for (i = 0; i < nworkers; i++)
+    st[i] = workers[i].st;
+}
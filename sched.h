@@ -0,0 +1,28 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "csapp.h"
+
+#define SCHED_MAX_WORKERS 64
+#define SCHED_DEQUE_SIZE  1024      // 작업자 하나의 deque에 쌓아둘 최대 작업 수 (2의 거듭제곱)
+
+/* 스케줄러에 맡기는 CPU 작업. 호출한 쪽의 구조체 안에 넣어서 쓴다 (할당 없음) */
+typedef struct task {
+  void (*fn)(struct task *t);
+} task;
+
+/* 작업자 하나의 카운터 */
+typedef struct {
+  unsigned long executed;           // 실행한 작업
+  unsigned long stolen;             // 그중 다른 작업자의 deque에서 훔친 것
+} sched_stats;
+
+int sched_init(int nworkers, int steal, void (*start)(int idx));
+int sched_workers(void);
+int sched_self(void);
+void sched_submit(task *t, unsigned home);
+void sched_spawn(task *t);
+void sched_drain(void);
+void sched_get_stats(sched_stats *st);
+
+#endif /* __SCHED_H__ */
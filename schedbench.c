@@ -0,0 +1,95 @@
+/*
+ * schedbench.c - 한쪽으로 몰린 작업에서 work stealing이 부하를 얼마나
+ *     고르게 나누는지 잰다. 작업 하나는 프록시가 캐시를 채울 때 하는 것과
+ *     같은 gzip 압축(64KB 텍스트)이고, 작업의 SKEW%는 작업자 0에, 나머지는
+ *     고르게 맡긴다 (인기 있는 연결이 한 작업자에 몰린 경우). 훔치지 않을
+ *     때와 훔칠 때를 각각 새 프로세스에서 돌려서 전체 시간과 작업자별
+ *     실행 수를 비교한다. 전체 시간의 차이는 코어가 여러 개일 때만 보인다.
+ *     deque가 가득 차서 맡긴 쪽이 직접 실행한 작업은 inline으로 센다.
+ *
+ *     usage: ./schedbench [tasks] [workers] [skew%]
+ */
+#include "csapp.h"
+#include "sched.h"
+#include "compress.h"
+#include <sys/wait.h>
+
+#define INPUT_SIZE (64 * 1024)
+
+typedef struct {
+  task t;
+  char out[INPUT_SIZE + 1024];
+} bench_task;
+
+static char input[INPUT_SIZE];
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void compress_task(task *t) {
+  bench_task *bt = (bench_task *)t;
+
+  compress_body(ENC_GZIP, input, INPUT_SIZE, bt->out, sizeof(bt->out));
+}
+
+/* 한 가지 방식으로 돌리고 결과 한 줄을 출력 */
+static void run(int ntasks, int nworkers, int skew, int steal) {
+  bench_task *tasks = Malloc(ntasks * sizeof(bench_task));
+  sched_stats st[SCHED_MAX_WORKERS];
+  unsigned long max = 0, inline_run = ntasks;
+  long long t0, ns;
+  int i;
+
+  if (sched_init(nworkers, steal, NULL) < 0) {
+    fprintf(stderr, "cannot start %d workers\n", nworkers);
+    exit(1);
+  }
+  srand(1);
+  t0 = now_ns();
+  for (i = 0; i < ntasks; i++) {
+    tasks[i].t.fn = compress_task;
+    sched_submit(&tasks[i].t, rand() % 100 < skew ? 0 : rand() % nworkers);
+  }
+  sched_drain();
+  ns = now_ns() - t0;
+
+  sched_get_stats(st);
+  printf("%-8s %10.1f ms %10.1f tasks/s  executed/stolen:",
+         steal ? "steal" : "no-steal", ns / 1e6, ntasks * 1e9 / ns);
+  for (i = 0; i < nworkers; i++) {
+    printf(" %lu/%lu", st[i].executed, st[i].stolen);
+    inline_run -= st[i].executed;
+    if (st[i].executed > max)
+      max = st[i].executed;
+  }
+  printf("  inline %lu  max/mean %.2f\n", inline_run,
+         (double)max * nworkers / (ntasks - inline_run));
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  int i, steal, ntasks = argc > 1 ? atoi(argv[1]) : 2000;
+  int nworkers = argc > 2 ? atoi(argv[2]) : 4;
+  int skew = argc > 3 ? atoi(argv[3]) : 90;
+
+  if (ntasks <= 0 || nworkers <= 0 || nworkers > SCHED_MAX_WORKERS || skew < 0 || skew > 100) {
+    fprintf(stderr, "usage: %s [tasks] [workers] [skew%%]\n", argv[0]);
+    exit(1);
+  }
+  for (i = 0; i < INPUT_SIZE; i++)      // 압축이 적당히 되는 텍스트
+    input[i] = "GET /index.html HTTP/1.1\r\nHost: "[i % 32] + (i / 32 % 7 == 0);
+  printf("%d tasks, %d workers, %d%% to worker 0, %ld cpus\n",
+         ntasks, nworkers, skew, sysconf(_SC_NPROCESSORS_ONLN));
+  fflush(stdout);
+  for (steal = 0; steal <= 1; steal++) {
+    if (fork() == 0) {                  // 작업자 스레드를 새로 띄우려고 프로세스를 나눔
+      run(ntasks, nworkers, skew, steal);
+      exit(0);
+    }
+    wait(NULL);
+  }
+  return 0;
+}
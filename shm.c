@@ -0,0 +1,117 @@
+/*
+ * shm.c - 프로세스 사이에서 나눠 쓰는 메모리의 할당기 (prefork 캐시용).
+ *
+ *     영역 앞에 shm_arena를 두고 나머지를 블록으로 나눈다. 블록 헤더에
+ *     자기 크기와 바로 앞 블록의 크기를 두어 해제할 때 양옆의 빈 블록과
+ *     바로 합친다 (boundary tag). 빈 블록은 한 목록에서 처음 맞는 것을
+ *     쪼개 쓴다. 캐시 객체는 수십 KB 단위이고 개수가 많지 않으므로 목록을
+ *     훑는 비용은 객체를 복사하는 비용보다 작다.
+ */
+#include <string.h>
+#include <sys/mman.h>
+#include "shm.h"
+
+#define HDR        offsetof(shm_block, next)        // 쓰는 블록의 헤더 크기
+#define MIN_BLOCK  sizeof(shm_block)
+#define USED       ((size_t)1)
+
+#define BSIZE(b)   ((b)->size & ~USED)
+#define NEXT(b)    ((shm_block *)((char *)(b) + BSIZE(b)))
+
+static void list_push(shm_arena *a, shm_block *b) {
+  b->prev = NULL;
+  b->next = a->free;
+  if (a->free)
+    a->free->prev = b;
+  a->free = b;
+}
+
+static void list_remove(shm_arena *a, shm_block *b) {
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    a->free = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+}
+
+/* bytes 크기의 공유 영역을 만든다. fork 전에 불러야 자식이 같은 영역을 본다.
+ * 반환값: 할당기, 실패하면 NULL */
+shm_arena *shm_create(size_t bytes) {
+  size_t len = (sizeof(shm_arena) + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+  shm_arena *a;
+
+  bytes = (bytes + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+  a = mmap(NULL, len + bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (a == MAP_FAILED)
+    return NULL;
+  a->base = (char *)a + len;
+  a->end = a->base + bytes;
+  shm_reset(a);
+  return a;
+}
+
+void shm_destroy(shm_arena *a) {
+  munmap(a, a->end - (char *)a);
+}
+
+/* 모든 블록을 버리고 영역 전체를 빈 블록 하나로 되돌린다 */
+void shm_reset(shm_arena *a) {
+  shm_block *b = (shm_block *)a->base;
+
+  b->size = a->end - a->base;
+  b->prev_size = 0;
+  a->free = NULL;
+  a->used = 0;
+  list_push(a, b);
+}
+
+/* n바이트 (SHM_ALIGN 정렬). 맞는 빈 블록이 없으면 NULL */
+void *shm_alloc(shm_arena *a, size_t n) {
+  size_t need = (n + HDR + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+  shm_block *b, *rest;
+
+  if (need < MIN_BLOCK)
+    need = MIN_BLOCK;
+  for (b = a->free; b && b->size < need; b = b->next)
+    ;
+  if (!b)
+    return NULL;
+  list_remove(a, b);
+  if (b->size - need >= MIN_BLOCK) {      // 남는 부분은 새 빈 블록으로
+    rest = (shm_block *)((char *)b + need);
+    rest->size = b->size - need;
+    rest->prev_size = need;
+    if ((char *)NEXT(rest) < a->end)
+      NEXT(rest)->prev_size = rest->size;
+    list_push(a, rest);
+    b->size = need;
+  }
+  a->used += b->size;
+  b->size |= USED;
+  return (char *)b + HDR;
+}
+
+/* shm_alloc()으로 받은 p를 돌려주고 양옆의 빈 블록과 합친다 */
+void shm_free(shm_arena *a, void *p) {
+  shm_block *b = (shm_block *)((char *)p - HDR), *n, *prev;
+
+  b->size &= ~USED;
+  a->used -= b->size;
+  n = NEXT(b);
+  if ((char *)n < a->end && !(n->size & USED)) {
+    list_remove(a, n);
+    b->size += n->size;
+  }
+  if (b->prev_size) {
+    prev = (shm_block *)((char *)b - b->prev_size);
+    if (!(prev->size & USED)) {
+      list_remove(a, prev);
+      prev->size += b->size;
+      b = prev;
+    }
+  }
+  if ((char *)NEXT(b) < a->end)
+    NEXT(b)->prev_size = b->size;
+  list_push(a, b);
+}
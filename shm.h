@@ -0,0 +1,32 @@
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include <stddef.h>
+
+#define SHM_ALIGN 16            // 돌려주는 메모리의 정렬
+
+/* 공유 메모리 안의 블록 하나. 빈 블록이면 next/prev로 빈 목록에 걸린다 */
+typedef struct shm_block {
+  size_t size;                  // 헤더를 포함한 크기, 가장 아래 비트는 쓰는 중 표시
+  size_t prev_size;             // 바로 앞 블록의 크기 (합칠 때), 첫 블록은 0
+  struct shm_block *next, *prev;
+} shm_block;
+
+/*
+ * fork 전에 만든 MAP_SHARED 영역의 할당기. 영역은 모든 자식 프로세스에서
+ * 같은 주소에 있으므로 블록 사이는 포인터로 잇는다. 잠금은 쓰는 쪽이
+ * 잡는다 (캐시의 잠금).
+ */
+typedef struct {
+  char *base, *end;             // 블록 영역
+  shm_block *free;              // 빈 블록 목록 (first-fit)
+  size_t used;                  // 쓰는 중인 바이트 (헤더 포함)
+} shm_arena;
+
+shm_arena *shm_create(size_t bytes);
+void shm_destroy(shm_arena *a);
+void shm_reset(shm_arena *a);
+void *shm_alloc(shm_arena *a, size_t n);
+void shm_free(shm_arena *a, void *p);
+
+#endif /* __SHM_H__ */
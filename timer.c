@@ -0,0 +1,216 @@
+#include "timer.h"
+
+#define TIMER_MASK    (TIMER_SLOTS - 1)
+#define LEVEL_SPAN(l) (1LL << (TIMER_BITS * (l)))   // l단계 한 칸이 덮는 틱 수
+
+/*
+ * 계층 타이밍 휠: 만료 시각을 TIMER_TICK_MS 단위의 틱으로 바꾸고, 남은
+ * 틱 수에 따라 64칸짜리 휠 네 단계 중 하나에 건다. 0단계는 한 칸이 한 틱,
+ * 1단계는 64틱, 2단계는 64^2틱 ... 을 덮는다. 0단계가 한 바퀴 돌 때마다
+ * 윗단계의 칸 하나를 풀어서 아랫단계로 다시 나눠 건다(cascade).
+ * 추가와 취소는 리스트 연결/해제뿐이라 타이머 수와 관계없이 O(1)이고,
+ * 만료는 0단계 칸의 리스트를 통째로 떼어 붙인 뒤 한 번에 처리한다.
+ *
+ * 휠은 accept 루프가 timer_expire()로 돌린다. 만료 콜백도 그 스레드에서
+ * 실행되므로 콜백은 짧아야 한다 (소켓 shutdown 정도).
+ */
+static struct {
+  tw_timer slots[TIMER_LEVELS][TIMER_SLOTS];  // 각 칸의 리스트 머리
+  tw_timer batch;               // 만료되어 콜백을 기다리는 타이머
+  long long start;              // 휠을 시작한 시각
+  long long cur;                // 다음에 처리할 틱
+  int npending;                 // 걸려 있는 타이머 수 (batch 포함)
+  tw_timer *running;            // 지금 콜백을 실행 중인 타이머
+  pthread_t owner;              // timer_expire()를 부르는 스레드
+  pthread_mutex_t lock;
+  pthread_cond_t done;          // 콜백 실행이 끝나면 깨움
+} wheel = { .lock = PTHREAD_MUTEX_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+long long timer_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void list_init(tw_timer *head) {
+  head->prev = head->next = head;
+}
+
+static void unlink_timer(tw_timer *t) {
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->prev = t->next = NULL;
+}
+
+/* list의 타이머를 모두 head 뒤에 붙이고 list를 비운다 */
+static void splice_list(tw_timer *list, tw_timer *head) {
+  if (list->next == list)
+    return;
+  list->next->prev = head->prev;
+  head->prev->next = list->next;
+  list->prev->next = head;
+  head->prev = list->prev;
+  list_init(list);
+}
+
+/* t->tick까지 남은 틱 수로 단계를 골라 칸에 건다 (lock을 잡은 상태에서 호출) */
+static void link_timer(tw_timer *t) {
+  long long delta = t->tick - wheel.cur;
+  tw_timer *head;
+  int level;
+
+  if (delta < 0) {              // 이미 지났으면 다음 틱에 처리
+    t->tick = wheel.cur;
+    delta = 0;
+  } else if (delta >= LEVEL_SPAN(TIMER_LEVELS)) {
+    delta = LEVEL_SPAN(TIMER_LEVELS) - 1;   // 휠보다 긴 타이머는 끝에 건다
+    t->tick = wheel.cur + delta;
+  }
+  for (level = 0; level < TIMER_LEVELS - 1 && delta >= LEVEL_SPAN(level + 1); level++)
+    ;
+  head = &wheel.slots[level][(t->tick >> (TIMER_BITS * level)) & TIMER_MASK];
+  t->next = head->next;
+  t->prev = head;
+  head->next->prev = t;
+  head->next = t;
+}
+
+/* level단계에서 지금 차례인 칸의 타이머를 아랫단계로 다시 건다.
+ * 반환값: 그 칸의 번호 (0이면 윗단계도 풀어야 함) */
+static int cascade(int level) {
+  int idx = (wheel.cur >> (TIMER_BITS * level)) & TIMER_MASK;
+  tw_timer list, *t, *next;
+
+  list_init(&list);
+  splice_list(&wheel.slots[level][idx], &list);
+  for (t = list.next; t != &list; t = next) {
+    next = t->next;
+    link_timer(t);
+  }
+  return idx;
+}
+
+/* 휠 초기화. 이 함수를 부른 스레드가 timer_expire()를 부른다 */
+void timer_wheel_init(void) {
+  int i, j;
+
+  for (i = 0; i < TIMER_LEVELS; i++)
+    for (j = 0; j < TIMER_SLOTS; j++)
+      list_init(&wheel.slots[i][j]);
+  list_init(&wheel.batch);
+  wheel.start = timer_now();
+  wheel.cur = 0;
+  wheel.npending = 0;
+  wheel.owner = pthread_self();
+}
+
+/*
+ * timer_timeout - 다음에 timer_expire()를 불러야 할 때까지 남은 시간 (ms).
+ *     poll()의 timeout으로 그대로 쓴다. 걸린 타이머가 없으면 -1.
+ *     0단계에서 비어 있는 칸은 건너뛰므로 할 일이 없는 틱마다 깨지 않는다.
+ */
+int timer_timeout(void) {
+  long long tick, wait;
+  tw_timer *head;
+
+  pthread_mutex_lock(&wheel.lock);
+  if (wheel.npending == 0) {
+    pthread_mutex_unlock(&wheel.lock);
+    return -1;
+  }
+  /* 0단계에서 처음으로 타이머가 있는 칸. cascade가 있는 틱(칸 0)에서는 멈춤 */
+  for (tick = wheel.cur; tick & TIMER_MASK; tick++) {
+    head = &wheel.slots[0][tick & TIMER_MASK];
+    if (head->next != head)
+      break;
+  }
+  wait = wheel.start + tick * TIMER_TICK_MS - timer_now();
+  pthread_mutex_unlock(&wheel.lock);
+  return wait > 0 ? wait : 0;
+}
+
+/*
+ * timer_expire - now까지 지난 틱을 모두 처리하고 만료된 타이머의 콜백을
+ *     부른다. 밀린 틱의 0단계 칸을 먼저 batch 목록에 붙인 뒤 한 번에
+ *     실행한다. 콜백은 휠 lock 없이 실행되므로 콜백 안에서 timer_add로
+ *     다시 걸거나 아직 실행되지 않은 다른 타이머를 취소할 수 있다.
+ *
+ *     반환값: 콜백을 부른 타이머 수
+ */
+int timer_expire(long long now) {
+  tw_timer *t;
+  long long target = (now - wheel.start) / TIMER_TICK_MS;
+  int level, fired = 0;
+
+  pthread_mutex_lock(&wheel.lock);
+  while (wheel.cur <= target) {
+    for (level = 1; level < TIMER_LEVELS; level++)
+      if ((wheel.cur & (LEVEL_SPAN(level) - 1)) || cascade(level))
+        break;
+    splice_list(&wheel.slots[0][wheel.cur & TIMER_MASK], &wheel.batch);
+    wheel.cur++;
+  }
+
+  while ((t = wheel.batch.next) != &wheel.batch) {
+    unlink_timer(t);
+    wheel.npending--;
+    t->state = TIMER_RUNNING;
+    wheel.running = t;
+    pthread_mutex_unlock(&wheel.lock);
+    t->fn(t);
+    fired++;
+    pthread_mutex_lock(&wheel.lock);
+    if (t->state == TIMER_RUNNING)
+      t->state = TIMER_IDLE;
+    wheel.running = NULL;
+    pthread_cond_broadcast(&wheel.done);
+  }
+  pthread_mutex_unlock(&wheel.lock);
+  return fired;
+}
+
+/* 걸려 있는 타이머 수 */
+int timer_pending(void) {
+  int n;
+
+  pthread_mutex_lock(&wheel.lock);
+  n = wheel.npending;
+  pthread_mutex_unlock(&wheel.lock);
+  return n;
+}
+
+void timer_init(tw_timer *t, void (*fn)(tw_timer *t), void *arg) {
+  t->state = TIMER_IDLE;
+  t->fn = fn;
+  t->arg = arg;
+  t->prev = t->next = NULL;
+}
+
+/* timeout_ms 뒤에 t->fn(t)이 호출되도록 건다. 이미 걸려 있으면 다시 건다 */
+void timer_add(tw_timer *t, long timeout_ms) {
+  pthread_mutex_lock(&wheel.lock);
+  if (t->state == TIMER_PENDING)
+    unlink_timer(t);
+  else
+    wheel.npending++;
+  /* 만료 시각이 들어 있는 틱의 다음 틱에 처리되도록 건다 */
+  t->expires = timer_now() + timeout_ms;
+  t->tick = (t->expires - wheel.start) / TIMER_TICK_MS + 1;
+  link_timer(t);
+  t->state = TIMER_PENDING;
+  pthread_mutex_unlock(&wheel.lock);
+}
+
+/* 타이머를 취소한다. 콜백이 실행 중이면 끝날 때까지 기다리므로
+ * 돌아온 뒤에는 t를 해제해도 안전하다 */
+void timer_cancel(tw_timer *t) {
+  pthread_mutex_lock(&wheel.lock);
+  while (wheel.running == t && !pthread_equal(pthread_self(), wheel.owner))
+    pthread_cond_wait(&wheel.done, &wheel.lock);
+  if (t->state == TIMER_PENDING) {
+    unlink_timer(t);
+    wheel.npending--;
+  }
+  t->state = TIMER_IDLE;
+  pthread_mutex_unlock(&wheel.lock);
+}
@@ -0,0 +1,33 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "csapp.h"
+
+#define TIMER_TICK_MS   10      // 휠이 한 칸 도는 시간
+#define TIMER_BITS      6
+#define TIMER_SLOTS     (1 << TIMER_BITS)  // 단계마다 칸 수
+#define TIMER_LEVELS    4       // 64^4 틱 = 약 46시간까지 걸 수 있음
+
+/* 타이머 상태 */
+enum { TIMER_IDLE, TIMER_PENDING, TIMER_RUNNING };
+
+/* 휠에 걸어두는 타이머. 호출한 쪽의 구조체 안에 넣어서 쓴다 (할당 없음) */
+typedef struct tw_timer {
+  long long expires;            // 만료 시각 (ms, CLOCK_MONOTONIC)
+  long long tick;               // 만료되는 틱
+  int state;
+  void (*fn)(struct tw_timer *t);
+  void *arg;
+  struct tw_timer *prev, *next; // 같은 칸의 타이머 목록
+} tw_timer;
+
+long long timer_now(void);
+void timer_wheel_init(void);
+int timer_timeout(void);
+int timer_expire(long long now);
+int timer_pending(void);
+void timer_init(tw_timer *t, void (*fn)(tw_timer *t), void *arg);
+void timer_add(tw_timer *t, long timeout_ms);
+void timer_cancel(tw_timer *t);
+
+#endif /* __TIMER_H__ */
@@ -0,0 +1,83 @@
+/*
+ * timerbench.c - 타이머 휠의 추가, 다시 걸기, 취소, 만료 처리량을 잰다.
+ *     N개(기본 100000)의 타이머를 최대 한 시간 안의 임의 시각에 걸어
+ *     네 단계가 모두 쓰이게 하고, 만료는 시계를 TIMER_TICK_MS씩 흉내 내어
+ *     넘기면서 각 타이머가 만료 시각보다 일찍 불리지 않는지도 확인한다.
+ *
+ *     usage: ./timerbench [N]
+ */
+#include "csapp.h"
+#include "timer.h"
+
+#define SPAN_MS (3600 * 1000)   // 타이머를 거는 범위
+
+static long long sim_now;       // timer_expire()에 넘기는 흉내 낸 시각
+static long long sim_start;     // 흉내 내기 시작한 시각 (그 전에 만료된 타이머는 지연에서 뺌)
+static long fired, early, max_late;
+
+static long long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void on_expire(tw_timer *t) {
+  long late = sim_now - t->expires;
+
+  fired++;
+  if (late < 0)
+    early++;
+  else if (late > max_late && t->expires >= sim_start)
+    max_late = late;
+}
+
+static void report(char *what, int n, long long ns) {
+  printf("%-8s %8d timers %10.1f ns/op %12.0f ops/s\n",
+         what, n, (double)ns / n, n * 1e9 / ns);
+}
+
+int main(int argc, char **argv) {
+  int i, n = argc > 1 ? atoi(argv[1]) : 100000;
+  tw_timer *timers;
+  long long t0, end;
+
+  if (n <= 0) {
+    fprintf(stderr, "usage: %s [N]\n", argv[0]);
+    exit(1);
+  }
+  timers = Malloc(n * sizeof(tw_timer));
+  srand(1);
+  timer_wheel_init();
+  for (i = 0; i < n; i++)
+    timer_init(&timers[i], on_expire, NULL);
+
+  t0 = now_ns();
+  for (i = 0; i < n; i++)
+    timer_add(&timers[i], 1 + rand() % SPAN_MS);
+  report("insert", n, now_ns() - t0);
+
+  /* 이미 걸린 타이머를 다른 시각으로 (연결이 다음 단계로 넘어갈 때) */
+  t0 = now_ns();
+  for (i = 0; i < n; i++)
+    timer_add(&timers[i], 1 + rand() % SPAN_MS);
+  report("re-arm", n, now_ns() - t0);
+
+  t0 = now_ns();
+  for (i = 0; i < n; i++)
+    timer_cancel(&timers[i]);
+  report("cancel", n, now_ns() - t0);
+
+  for (i = 0; i < n; i++)
+    timer_add(&timers[i], 1 + rand() % SPAN_MS);
+  sim_start = sim_now = timer_now();
+  end = sim_now + SPAN_MS + 2 * TIMER_TICK_MS;
+  t0 = now_ns();
+  for (; sim_now <= end; sim_now += TIMER_TICK_MS)
+    timer_expire(sim_now);
+  report("expire", n, now_ns() - t0);
+
+  printf("fired %ld/%d, early %ld, max late %ld ms, pending %d\n",
+         fired, n, early, max_late, timer_pending());
+  Free(timers);
+  return fired == n && early == 0 ? 0 : 1;
+}
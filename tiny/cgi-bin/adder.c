@@ -1,17 +1,40 @@
 /*
  * adder.c - a minimal CGI program that adds two numbers together
+ *
+ * GET은 QUERY_STRING("1&2")으로, POST는 바디(CONTENT_LENGTH 바이트)의
+ * 앞부분으로 인수를 받는다. POST 바디는 끝까지 읽고 받은 바이트 수도
+ * 알려 주므로 큰 요청 바디를 흘려보내는 시험에도 쓸 수 있다.
  */
 /* $begin adder */
 #include "csapp.h"
 
 int main(void) {
-  char *buf, *p;
-  char arg1[MAXLINE], arg2[MAXLINE], content[MAXLINE];
-  int n1 = 0, n2 = 0;
+  char *buf, *p, *method = getenv("REQUEST_METHOD");
+  char arg1[MAXLINE], arg2[MAXLINE], content[MAXLINE], body[MAXLINE], data[MAXBUF];
+  int n1 = 0, n2 = 0, post = method && strcasecmp(method, "POST") == 0;
+  long length = 0, received = 0, keep;
+  ssize_t n;
+
+  /* POST: 바디를 다 읽고 앞의 MAXLINE 바이트만 인수로 쓴다 */
+  if (post) {
+    if ((buf = getenv("CONTENT_LENGTH")) != NULL)
+      length = atol(buf);
+    body[0] = '\0';
+    while (received < length && (n = read(STDIN_FILENO, data, sizeof(data))) > 0) {
+      if (received < MAXLINE - 1) {
+        keep = n < MAXLINE - 1 - received ? n : MAXLINE - 1 - received;
+        memcpy(body + received, data, keep);
+        body[received + keep] = '\0';
+      }
+      received += n;
+    }
+    buf = body;
+  } else {
+    buf = getenv("QUERY_STRING");
+  }
 
   /* Extract the two arguments */
-  if ((buf = getenv("QUERY_STRING")) != NULL) {
-    p = strchr(buf, '&');
+  if (buf != NULL && (p = strchr(buf, '&')) != NULL) {
     *p = '\0';
     strcpy(arg1, buf);
     strcpy(arg2, p+1);
@@ -20,10 +43,11 @@ int main(void) {
   }
 
   /* Make the response body */
-  sprintf(content, "QUERY_STRING=%s", buf);
   sprintf(content, "Welcome to add.com: ");
   sprintf(content, "%sTHE Internet addition portal.\r\n<p>", content);
   sprintf(content, "%sThe answer is: %d + %d = %d\r\n<p>", content, n1, n2, n1 + n2);
+  if (post)
+    sprintf(content, "%sReceived %ld bytes\r\n<p>", content, received);
   sprintf(content, "%sThanks for visiting!\r\n", content);
 
   /* Generate the HTTP response */
@@ -31,7 +55,7 @@ int main(void) {
   printf("Content-length: %d\r\n", (int)strlen(content));
   printf("Content-tpye: text/html\r\n\r\n");
 
-  if (strcasecmp(getenv("REQUEST_METHOD"), "GET") == 0) {
+  if (strcasecmp(method, "HEAD") != 0) {
     printf("%s", content);
   }
 
@@ -5,30 +5,47 @@
  *
  * Updated 11/2019 droh
  *   - Fixed sprintf() aliasing issue in serve_static(), and clienterror().
+ *
+ * 요청마다 찍던 printf 대신 프록시와 같은 비동기 접근 로그(../accesslog.c)에
+ * 한 줄씩 남긴다. usage: tiny <port> [access_log] (기본: 표준 출력, "-")
+ *
+ * POST는 CGI 프로그램에만 받는다. Content-Length 바이트의 바디를 파이프로
+ * CGI 프로그램의 표준 입력에 흘려 넣으므로 (CONTENT_LENGTH) 프록시의 요청
+ * 바디 중계를 시험하는 원 서버로 쓸 수 있다.
  */
 #include "csapp.h"
+#include "accesslog.h"
 
 void doit(int fd);
-void read_requesthdrs(rio_t *rp);
+long read_requesthdrs(rio_t *rp);
 int parse_uri(char *uri, char *filename, char *cgiargs);
 void serve_static(int fd, char *filename, int filesize, char *method);
 void get_filetype(char *filename, char *filetype);
-void serve_dynamic(int fd, char *filename, char *cgiargs, char *method);
+void serve_dynamic(int fd, char *filename, char *cgiargs, char *method, rio_t *rp, long length);
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
 
+/* 지금 처리 중인 요청의 접근 로그 레코드 (한 번에 요청 하나만 처리하므로 하나) */
+static access_rec req;
+
 int main(int argc, char **argv) {
   int listenfd, connfd;                   // 소켓 디스크립터를 저장할 변수 선언
-  char hostname[MAXLINE], port[MAXLINE];  // 호스트네임과 포트 정보를 저장할 변수 선언
+  long long start;                        // 연결을 받은 시각 (us)
   socklen_t clientlen;                    // 클라이언트의 주소 길이를 저장할 변수 선언
   struct sockaddr_storage clientaddr;     // 클라이언트의 소켓 주소 정보를 저장할 변수 선언
 
   /* Check command line args */
-  if (argc != 2) {
-    /* 명령행 인수가 2개가 아닌 경우 사용법 출력 후 종료 */
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+  if (argc != 2 && argc != 3) {
+    /* 명령행 인수가 맞지 않는 경우 사용법 출력 후 종료 */
+    fprintf(stderr, "usage: %s <port> [access_log]\n", argv[0]);
+    exit(1);
+  }
+  if (access_log_open(argc == 3 ? argv[2] : "-") < 0) {
+    fprintf(stderr, "cannot open access log\n");
     exit(1);
   }
 
+  Signal(SIGPIPE, SIG_IGN);  // CGI 프로그램이 POST 바디를 다 읽지 않고 끝나도 서버는 계속
+
   /* 클라이언트의 연결을 수신 대기하는 소켓 생성 */
   listenfd = Open_listenfd(argv[1]); // 주어진 포트로 소켓을 열고 듣기 상태로 설정
 
@@ -36,10 +53,16 @@ int main(int argc, char **argv) {
     /* 클라이언트로부터의 연결을 수락하고 처리 */
     clientlen = sizeof(clientaddr); // 클라이언트의 주소 길이를 구함
     connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen); // 클라이언트의 연결을 수락하고 연결된 소켓 디스크립터를 반환
-    Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0); // 클라이언트의 주소 정보를 호스트네임과 포트로 변환
-    printf("Accepted connection from (%s, %s)\n", hostname, port); // 클라이언트의 연결을 콘솔에 출력
+    start = access_log_now_us();
+    memset(&req, 0, sizeof(req));
+    req.header_us = req.relay_us = -1;
+    req.cache_us = req.dns_us = req.connect_us = req.first_byte_us = -1;  // 캐시도 원 서버도 없음
+    access_log_set_addr(&req, (SA *)&clientaddr, clientlen);
     doit(connfd);   // 클라이언트와의 연결을 처리하는 함수 호출
     Close(connfd);  // 클라이언트와의 연결을 끊음
+    req.time_us = access_log_now_us();
+    req.total_us = req.time_us - start;
+    access_log_put(&req); // 글자로 바꾸고 쓰는 것은 접근 로그의 쓰는 스레드
   }
 }
 
@@ -49,28 +72,40 @@ void doit(int fd) {
   struct stat sbuf;
   char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
   char filename[MAXLINE], cgiargs[MAXLINE];
+  long length;
   rio_t rio;
 
   /* Read request line and headers */
   Rio_readinitb(&rio, fd);            // 클라이언트와의 연결을 읽기 위해 rio 구조체 초기화
   Rio_readlineb(&rio, buf, MAXLINE);  // 클라이언트로부터 요청 라인 읽기
-  printf("Request header:\n");
-  printf("%s", buf);
   sscanf(buf, "%s %s %s", method, uri, version);  // 요청 라인 파싱
+  snprintf(req.method, sizeof(req.method), "%.15s", method);
+  snprintf(req.uri, sizeof(req.uri), "%.*s", (int)sizeof(req.uri) - 1, uri);
 
-  /* GET / HEAD Method가 아닐 때 */
-  if (!(strcasecmp(method, "GET") == 0 || strcasecmp(method, "HEAD") == 0)) {
+  /* GET / HEAD / POST Method가 아닐 때 */
+  if (!(strcasecmp(method, "GET") == 0 || strcasecmp(method, "HEAD") == 0 ||
+        strcasecmp(method, "POST") == 0)) {
     /* 요청 메서드가 GET이 아닌 경우 "501 Not implemented" 오류 반환 */
     clienterror(fd, method, "501", "Not implemented", "Tiny does not implement this method");
     return;
   }
 
   /* 요청 헤더 처리 */
-  read_requesthdrs(&rio);
+  length = read_requesthdrs(&rio);
 
   /* URI 파싱 */
   is_static = parse_uri(uri, filename, cgiargs);  // URI를 파싱하여 정적인지 동적인지 확인
 
+  /* POST는 CGI 프로그램에만, 바디 길이를 알 때만 받는다 (chunked는 지원하지 않음) */
+  if (strcasecmp(method, "POST") == 0 && is_static) {
+    clienterror(fd, method, "405", "Method Not Allowed", "Tiny only posts to CGI programs");
+    return;
+  }
+  if (strcasecmp(method, "POST") == 0 && length < 0) {
+    clienterror(fd, method, "411", "Length Required", "Tiny needs a Content-Length");
+    return;
+  }
+
   /* 요청된 파일이 존재하는지 확인 */
   if (stat(filename, &sbuf) < 0) {
     /* 요청된 파일이 존재하지 않는 경우 "404 Not found" 오류 반환 */
@@ -97,7 +132,7 @@ void doit(int fd) {
       return;
     }
     /* CGI 프로그램을 실행하여 동적 콘텐츠 생성 및 전송 */
-    serve_dynamic(fd, filename, cgiargs, method);
+    serve_dynamic(fd, filename, cgiargs, method, &rio, length);
   }
   
 }
@@ -121,18 +156,22 @@ void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longms
   sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
   Rio_writen(fd, buf, strlen(buf));
   Rio_writen(fd, body, strlen(body));
+  req.status = atoi(errnum);
+  req.bytes = -1;                     // 헤더를 여러 번 나눠 보내므로 세지 않음
 }
 
-/* 요청 헤더를 읽어오는 함수 */
-void read_requesthdrs(rio_t *rp) {
+/* 요청 헤더를 읽어오는 함수. 반환값: Content-Length, 없으면 -1 */
+long read_requesthdrs(rio_t *rp) {
   char buf[MAXLINE];
+  long length = -1;
 
   Rio_readlineb(rp, buf, MAXLINE);
   while (strcmp(buf, "\r\n")) {
+    if (strncasecmp(buf, "Content-Length:", 15) == 0)
+      length = atol(buf + 15);
     Rio_readlineb(rp, buf, MAXLINE);
-    printf("%s", buf);
   }
-  return;
+  return length;
 }
 
 int parse_uri(char *uri, char *filename, char *cgiargs) {
@@ -171,14 +210,13 @@ void serve_static(int fd, char *filename, int filesize, char *method) {
   sprintf(buf, "%sContent-length: %d\r\n", buf, filesize); // 콘텐츠 길이 설정
   sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype); // MIME 타입 설정
   Rio_writen(fd, buf, strlen(buf)); // 클라이언트에게 헤더 전송
+  req.status = 200;
+  req.bytes = strlen(buf);
 
   if (strcasecmp(method, "HEAD") == 0) { // HEAD 메소드를 요청 받았을 때
     return; // 응답 바디를 전송하지 않음
   }
 
-  printf("Response header:\n");
-  printf("%s", buf);
-
   /* Send response body to client */
   srcfd = Open(filename, O_RDONLY, 0); // 파일 열기
   srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0); // 파일 메모리 매핑
@@ -186,6 +224,7 @@ void serve_static(int fd, char *filename, int filesize, char *method) {
   // Rio_readn(srcfd ,srcp, filesize);
   Close(srcfd); // 파일 닫기
   Rio_writen(fd, srcp, filesize); // 클라이언트에게 파일 내용 전송
+  req.bytes += filesize;
   Munmap(srcp, filesize); // 메모리 매핑 해제
   // free(srcp);
 }
@@ -208,21 +247,45 @@ void get_filetype(char *filename, char *filetype) {
     strcpy(filetype, "text/plain");
 }
 
-void serve_dynamic(int fd, char *filename, char *cgiargs, char *method) {
+void serve_dynamic(int fd, char *filename, char *cgiargs, char *method, rio_t *rp, long length) {
   char buf[MAXLINE], *emptylist[] = { NULL };
+  int post = strcasecmp(method, "POST") == 0, fds[2];
+  ssize_t n;
 
   /* Return first part of HTTP response */
   sprintf(buf, "HTTP/1.0 200 OK\r\n"); // HTTP 응답 헤더 생성
   Rio_writen(fd, buf, strlen(buf)); // 클라이언트에게 헤더 전송
   sprintf(buf, "Server: Tiny Web Server\r\n"); // 서버 정보 추가
   Rio_writen(fd, buf, strlen(buf)); // 클라이언트에게 헤더 전송
+  req.status = 200;
+  req.bytes = -1;                     // 나머지는 CGI 프로그램이 직접 보냄
+  if (post && pipe(fds) < 0)
+    unix_error("pipe error");
 
   if (Fork() == 0) { /* Child */ // 자식 프로세스 생성
     /* Real server would set all CGI vars here */
     setenv("QUERY_STRING", cgiargs, 1); // QUERY_STRING 환경 변수를 URI에서 추출한 CGI 인수로 설정
     setenv("REQUEST_METHOD", method, 1); // REQUEST_METHOD 환경 변수를 URI에서 추출한 CGI 인수로 설정
+    if (post) {                        // 바디는 파이프로 표준 입력에
+      sprintf(buf, "%ld", length);
+      setenv("CONTENT_LENGTH", buf, 1);
+      Dup2(fds[0], STDIN_FILENO);
+      Close(fds[0]);
+      Close(fds[1]);
+    }
     Dup2(fd, STDOUT_FILENO); // 표준 출력을 클라이언트에 연결
     Execve(filename, emptylist, environ); // CGI 프로그램 실행
   }
+  if (post) {
+    /* 헤더와 같이 읽힌 바이트(rio 버퍼)부터 length 바이트를 넘긴다. 클라이언트나
+     * CGI 프로그램이 먼저 끊어도 서버는 계속 돌아야 하므로 오류는 무시하고 멈춤 */
+    Close(fds[0]);
+    while (length > 0 && (n = rio_readnb(rp, buf, length < MAXLINE ? length : MAXLINE)) > 0) {
+      if (rio_writen(fds[1], buf, n) < 0)
+        break;
+      length -= n;
+    }
+    Close(fds[1]);
+  }
   Wait(NULL); // 부모 프로세스가 자식 프로세스의 종료를 대기
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "trace.h"
+
+static FILE *out;                       // NULL이면 트레이스를 남기지 않음
+static long long start_ms;
+static trace_rec buf[TRACE_BUF_RECS];
+static int nbuf;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* 모아 둔 레코드를 파일에 쓴다 (lock을 잡은 상태에서 호출) */
+static void flush_locked(void) {
+  if (nbuf && fwrite(buf, sizeof(trace_rec), nbuf, out) == nbuf)
+    fflush(out);
+  nbuf = 0;
+}
+
+/* 캐시 접근 트레이스를 path에 새로 쓴다 (-t). 반환값: 0, 실패하면 -1 */
+int trace_open(const char *path) {
+  int64_t start = time(NULL);
+
+  if (!(out = fopen(path, "wb")))
+    return -1;
+  if (fwrite(TRACE_MAGIC, 8, 1, out) != 1 || fwrite(&start, 8, 1, out) != 1) {
+    fclose(out);
+    out = NULL;
+    return -1;
+  }
+  start_ms = now_ms();
+  return 0;
+}
+
+int trace_enabled(void) {
+  return out != NULL;
+}
+
+/* 캐시 접근 하나를 남긴다. 여러 스레드에서 부르며 버퍼가 차면 파일에 쓴다 */
+void trace_record(const char *key, int type, int size) {
+  trace_rec r;
+
+  if (!out)
+    return;
+  r.key = trace_hash(key);
+  r.ms = now_ms() - start_ms;
+  r.size = ((uint32_t)type << 30) | ((uint32_t)size & TRACE_SIZE_MASK);
+  pthread_mutex_lock(&lock);
+  buf[nbuf++] = r;
+  if (nbuf == TRACE_BUF_RECS)
+    flush_locked();
+  pthread_mutex_unlock(&lock);
+}
+
+/* 버퍼에 남은 레코드를 쓴다. accept 루프가 주기적으로 부른다 */
+void trace_flush(void) {
+  if (!out)
+    return;
+  pthread_mutex_lock(&lock);
+  flush_locked();
+  pthread_mutex_unlock(&lock);
+}
+
+/* 64비트 FNV-1a */
+uint64_t trace_hash(const char *key) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  while (*key)
+    h = (h ^ (unsigned char)*key++) * 0x100000001b3ULL;
+  return h;
+}
+
+/* 트레이스 파일을 읽으려고 연다. 머리를 확인하고 시작 시각을 돌려준다.
+ * 반환값: 파일, 트레이스가 아니면 NULL */
+FILE *trace_open_read(const char *path, time_t *start) {
+  char magic[8];
+  int64_t t;
+  FILE *fp;
+
+  if (!(fp = fopen(path, "rb")))
+    return NULL;
+  if (fread(magic, 8, 1, fp) != 1 || memcmp(magic, TRACE_MAGIC, 8)
+      || fread(&t, 8, 1, fp) != 1) {
+    fclose(fp);
+    return NULL;
+  }
+  *start = t;
+  return fp;
+}
+
+/* 다음 레코드. 반환값: 1, 끝이면 0 */
+int trace_next(FILE *fp, trace_rec *r) {
+  return fread(r, sizeof(trace_rec), 1, fp) == 1;
+}
@@ -0,0 +1,36 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include "csapp.h"
+
+#define TRACE_MAGIC      "WPTRACE1"     // 파일 맨 앞 8바이트, 뒤에 시작 시각(초) 8바이트
+#define TRACE_BUF_RECS   4096           // 모았다가 한 번에 쓰는 레코드 수
+#define TRACE_SIZE_MASK  0x3fffffff
+
+/* 레코드 종류 (size의 상위 2비트) */
+enum {
+  TRACE_MISS,         // 캐시 검사에서 없음
+  TRACE_HIT,          // 캐시 검사에서 찾음 (size: 찾은 객체)
+  TRACE_FILL          // 받아온 응답을 캐시에 넣음 (size: 객체)
+};
+
+/* 캐시 접근 하나. 16바이트, 이 기계의 바이트 순서 그대로 쓴다 */
+typedef struct {
+  uint64_t key;       // 캐시 키(요청 URI)의 FNV-1a 해시
+  uint32_t ms;        // 트레이스를 시작한 뒤 지난 시간
+  uint32_t size;      // 하위 30비트: 객체 크기, 상위 2비트: TRACE_*
+} trace_rec;
+
+int trace_open(const char *path);
+int trace_enabled(void);
+void trace_record(const char *key, int type, int size);
+void trace_flush(void);
+uint64_t trace_hash(const char *key);
+FILE *trace_open_read(const char *path, time_t *start);
+int trace_next(FILE *fp, trace_rec *r);
+
+#define TRACE_TYPE(r) ((r)->size >> 30)
+#define TRACE_OBJ(r)  ((int)((r)->size & TRACE_SIZE_MASK))
+
+#endif /* __TRACE_H__ */
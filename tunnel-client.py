@@ -0,0 +1,50 @@
+#!/usr/bin/python3
+
+# tunnel-client.py - This is a client that we use for the tunnel test.
+#                    It asks the proxy for a CONNECT tunnel to the origin,
+#                    sends a plain HTTP/1.0 GET through the tunnel, closes
+#                    its write half right away and then reads until the
+#                    origin's close comes back through the proxy. The
+#                    response body is written to stdout. It exits with 1
+#                    if the proxy refuses the tunnel or a read times out.
+#
+# usage: tunnel-client.py <proxy_port> <origin_port> <file>
+#
+import socket
+import sys
+
+proxy_port, origin_port, filename = int(sys.argv[1]), sys.argv[2], sys.argv[3]
+
+sock = socket.create_connection(('localhost', proxy_port), timeout=5)
+sock.sendall(('CONNECT localhost:%s HTTP/1.1\r\nHost: localhost:%s\r\n\r\n'
+              % (origin_port, origin_port)).encode())
+
+# Read the proxy's answer up to the blank line; nothing else may follow
+# until we send something ourselves
+reply = b''
+while b'\r\n\r\n' not in reply:
+  data = sock.recv(1)
+  if not data:
+    sys.exit(1)
+  reply += data
+if reply.split()[1] != b'200':
+  sys.exit(1)
+
+# Client -> origin, then half-close: the origin must still get to answer
+sock.sendall(('GET /%s HTTP/1.0\r\n\r\n' % filename).encode())
+sock.shutdown(socket.SHUT_WR)
+
+# Origin -> client until the origin's close reaches us as EOF
+response = b''
+try:
+  while True:
+    data = sock.recv(65536)
+    if not data:
+      break
+    response += data
+except socket.timeout:
+  sys.exit(1)
+sock.close()
+
+header, _, body = response.partition(b'\r\n\r\n')
+sys.stdout.buffer.write(body)
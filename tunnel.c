@@ -0,0 +1,193 @@
+/*
+ * tunnel.c - CONNECT 터널 (HTTPS 등).
+ *
+ *     "CONNECT host:port"를 받으면 원 서버에 연결하고 200을 보낸 뒤로는
+ *     양쪽 바이트를 해석하지 않고 그대로 잇는다. 한쪽이 닫으면 반대쪽의
+ *     쓰기만 닫고 (half-close) 다른 방향은 계속 잇다가 양쪽 모두 닫히면
+ *     끝난다. 마감 시간은 응답 중계와 같은 유휴 시간 제한(idle_timeout_ms)
+ *     이므로 양쪽 모두 조용하면 타이머가 소켓을 끊는다.
+ *
+ *     스레드는 연결 하나에 스레드 하나로 두 방향을 poll로 함께 기다리고,
+ *     소켓 -> 파이프 -> 소켓으로 splice해서 바이트가 사용자 공간을 거치지
+ *     않는다. 이벤트 루프와 코루틴은 방향마다 엔진 요청 하나가 받은
+ *     버퍼를 그대로 반대쪽에 보낸다 (evproxy.c, coproxy.c). 허용하는
+ *     포트는 connect_ports 설정으로 정한다 (기본 443).
+ */
+#include "tunnel.h"
+#include "metrics.h"
+#include "err.h"
+
+/* csapp.h와 겹치는 gai_error 때문에 _GNU_SOURCE 없이 직접 선언 */
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len,
+               unsigned int flags);
+int pipe2(int fds[2], int flags);
+
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE     1
+#define SPLICE_F_NONBLOCK 2
+#endif
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ      1031
+#define F_GETPIPE_SZ      1032
+#endif
+
+/* 터널 한 방향: from에서 파이프로, 파이프에서 to로 */
+typedef struct {
+  int from, to;
+  int pipe[2];
+  size_t queued;                // 파이프에 있는 바이트
+  size_t room;                  // 파이프 크기
+  int eof;                      // from이 닫힘
+  int done;                     // 파이프를 비우고 to의 쓰기 쪽을 닫음
+  int read_err, write_err;      // 실패했을 때의 원인
+} splice_dir;
+
+int tunnel_request(conn_t *c) {
+  return !strcasecmp(c->method, "CONNECT");
+}
+
+/* c->port가 connect_ports(쉼표나 공백으로 나눈 목록, "*"면 모두)에 있는지 */
+int tunnel_allowed(conn_t *c) {
+  const char *p = c->cfg->connect_ports;
+  size_t n = strlen(c->port), len;
+
+  if (!strcmp(p, "*"))
+    return 1;
+  for (p += strspn(p, ", "); *p; p += strspn(p, ", ")) {
+    len = strcspn(p, ", ");
+    if (len == n && !strncmp(p, c->port, n))
+      return 1;
+    p += len;
+  }
+  return 0;
+}
+
+/* 원 서버에 연결했으니 클라이언트에 보낼 200을 iov에 채우고 중계 단계로
+ * 넘어간다. 반환값: 조각 수 (1) */
+int tunnel_reply(conn_t *c, struct iovec *iov) {
+  iov->iov_base = TUNNEL_REPLY;
+  iov->iov_len = strlen(TUNNEL_REPLY);
+  c->status = 200;
+  c->bytes_out += iov->iov_len;
+  metrics_add(M_BYTES_OUT, iov->iov_len);
+  conn_deadline(c, CONN_IDLE);
+  return 1;
+}
+
+/* 한쪽으로 n 바이트를 넘겼다. 원 서버 -> 클라이언트 방향만 지표와 접근 로그에 센다 */
+void tunnel_count(conn_t *c, int to_client, size_t n) {
+  conn_touch(c);
+  if (!to_client)
+    return;
+  c->bytes_out += n;
+  metrics_add(M_BYTES_IN, n);
+  metrics_add(M_BYTES_OUT, n);
+}
+
+static int pipe_open(splice_dir *d) {
+  int size;
+
+  if (pipe2(d->pipe, O_CLOEXEC | O_NONBLOCK) < 0)
+    return -1;
+  /* 기본 64KB로는 큰 전송에서 splice를 너무 자주 부른다. 사용자의 파이프
+   * 한도를 넘으면 실패하므로 그때는 기본 크기로 */
+  fcntl(d->pipe[1], F_SETPIPE_SZ, TUNNEL_PIPE_SIZE);
+  size = fcntl(d->pipe[1], F_GETPIPE_SZ);
+  d->room = size > 0 ? size : 65536;
+  return 0;
+}
+
+/* poll이 알린 만큼 한 방향을 진행한다. 반환값: ERR_NONE, 실패하면 원인 */
+static int splice_step(conn_t *c, splice_dir *d, short from_ev, short to_ev, int to_client) {
+  ssize_t n;
+
+  if (from_ev && !d->eof && d->queued < d->room) {
+    n = splice(d->from, NULL, d->pipe[1], NULL, d->room - d->queued,
+               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+      d->queued += n;
+      conn_touch(c);
+    } else if (n == 0) {
+      d->eof = 1;
+    } else if (errno != EAGAIN && errno != EINTR) {
+      return d->read_err;
+    }
+  }
+  if (d->queued && (to_ev || from_ev)) {  // 방금 받은 것은 쓸 수 있는지 묻기 전에 바로 보냄
+    n = splice(d->pipe[0], NULL, d->to, NULL, d->queued, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+      d->queued -= n;
+      tunnel_count(c, to_client, n);
+    } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      return d->write_err;
+    }
+  }
+  if (d->eof && !d->queued && !d->done) {
+    shutdown(d->to, SHUT_WR);
+    d->done = 1;
+  }
+  return ERR_NONE;
+}
+
+/*
+ * tunnel_splice - 스레드의 CONNECT: 200을 보내고, 요청 헤더와 같이 받아
+ *     둔 바이트(c->rio)를 원 서버에 넘긴 뒤 두 방향을 splice로 잇는다.
+ *     소켓은 non-blocking으로 바꾸고 poll 하나로 두 방향을 기다리므로
+ *     한쪽이 막혀도 다른 방향은 계속 흐른다.
+ *
+ *     반환값: ERR_NONE, 실패하면 원인 (200을 보내기 전이면 c->status가 0)
+ */
+int tunnel_splice(conn_t *c, int serverfd) {
+  splice_dir d[2] = {
+    { c->fd, serverfd, { -1, -1 }, 0, 0, 0, 0, ERR_CLIENT_READ, ERR_UPSTREAM_WRITE },
+    { serverfd, c->fd, { -1, -1 }, 0, 0, 0, 0, ERR_UPSTREAM_READ, ERR_CLIENT_WRITE },
+  };
+  struct pollfd pfd[2];
+  struct iovec iov;
+  int i, err = ERR_NONE;
+
+  if (pipe_open(&d[0]) < 0 || pipe_open(&d[1]) < 0)
+    err = ERR_NOMEM;
+  else if (rio_writev(c->fd, &iov, tunnel_reply(c, &iov)) < 0)
+    err = ERR_CLIENT_WRITE;
+  else if (c->rio.rio_cnt > 0 && rio_writen(serverfd, c->rio.rio_bufptr, c->rio.rio_cnt) < 0)
+    err = ERR_UPSTREAM_WRITE;
+  else {
+    tunnel_count(c, 0, c->rio.rio_cnt);
+    c->rio.rio_cnt = 0;
+  }
+
+  pfd[0].fd = c->fd;
+  pfd[1].fd = serverfd;
+  for (i = 0; i < 2; i++)
+    fcntl(pfd[i].fd, F_SETFL, fcntl(pfd[i].fd, F_GETFL) | O_NONBLOCK);
+  while (err == ERR_NONE && !(d[0].done && d[1].done)) {
+    pfd[0].events = pfd[1].events = 0;
+    for (i = 0; i < 2; i++) {
+      if (!d[i].eof && d[i].queued < d[i].room)
+        pfd[i].events |= POLLIN;
+      if (d[i].queued)
+        pfd[1 - i].events |= POLLOUT;
+    }
+    /* 마감 시간은 타이머가 소켓을 shutdown해서 poll을 깨운다 */
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      err = ERR_TUNNEL;           // 200은 이미 보냈으므로 연결을 끊는 것으로만 알린다
+      break;
+    }
+    for (i = 0; i < 2 && err == ERR_NONE; i++)
+      err = splice_step(c, &d[i], pfd[i].revents & (POLLIN | POLLHUP | POLLERR),
+                        pfd[1 - i].revents & (POLLOUT | POLLHUP | POLLERR), i == 1);
+  }
+
+  for (i = 0; i < 2; i++) {
+    if (d[i].pipe[0] >= 0) {
+      close(d[i].pipe[0]);
+      close(d[i].pipe[1]);
+    }
+  }
+  if (c->timed_out == CONN_IDLE)
+    return ERR_IDLE_TIMEOUT;      // 양쪽이 닫힌 것처럼 보여도 타이머가 끊은 것
+  return err;
+}
@@ -0,0 +1,15 @@
+#ifndef __TUNNEL_H__
+#define __TUNNEL_H__
+
+#include "conn.h"
+
+#define TUNNEL_REPLY     "HTTP/1.1 200 Connection established\r\n\r\n"
+#define TUNNEL_PIPE_SIZE (256 * 1024)   // splice 파이프 하나의 크기 (안 되면 커널 기본값)
+
+int tunnel_request(conn_t *c);
+int tunnel_allowed(conn_t *c);
+int tunnel_reply(conn_t *c, struct iovec *iov);
+void tunnel_count(conn_t *c, int to_client, size_t n);
+int tunnel_splice(conn_t *c, int serverfd);
+
+#endif /* __TUNNEL_H__ */
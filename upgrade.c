@@ -0,0 +1,272 @@
+/*
+ * upgrade.c - 끊김 없는 바이너리 업그레이드 (-u path).
+ *
+ *     -u로 띄운 프록시는 path에 unix 소켓을 열어 두고 UPGRADE_POLL_MS마다
+ *     새 프로세스가 왔는지 본다. 새 바이너리를 같은 -u로 띄우면 그 소켓에
+ *     연결하고, 지금 프로세스는
+ *
+ *         1. listen 소켓을 SCM_RIGHTS로 넘기고
+ *         2. 캐시의 객체를 뒤(오래된 것)부터 다시 넣을 수 있게 이어서 보낸 뒤
+ *         3. 새 프로세스가 그 소켓으로 받기 시작했다는 1바이트를 기다린다.
+ *
+ *     그다음 지금 프로세스는 받기를 멈추고 처리 중인 요청이 끝나면
+ *     (drain_timeout_ms까지) 끝난다. listen 소켓은 한 번도 닫히지 않으므로
+ *     그동안 들어온 연결은 listen 큐에서 둘 중 하나가 받는다.
+ *
+ *     넘기는 동안 지금 프로세스의 accept 루프는 멈춘다 (캐시를 보내고 새
+ *     프로세스가 엔진을 준비하는 시간, 보통 수 ms). 새 프로세스가 제때
+ *     답하지 않으면 넘기기를 그만두고 계속 받는다.
+ */
+#include <limits.h>
+#include <sys/un.h>
+#include "upgrade.h"
+
+/* csapp.h와 겹치는 gai_error 때문에 _GNU_SOURCE 없이 직접 선언 */
+int accept4(int fd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
+#define MSG_LISTENER 'L'            // listen 소켓을 실은 메시지
+#define MSG_READY    'R'            // 새 프로세스가 받기 시작함
+
+/* 캐시 객체 하나. 뒤에 key(keylen)와 value(size)가 온다. keylen이 0이면 끝 */
+typedef struct {
+  int keylen;
+  int size, hdrlen;
+  long age, max_age;                // age는 보낼 때까지 지난 시간을 더한 것
+} upgrade_rec;
+
+/* 받은 객체. 다 받은 뒤 오래된 것부터 캐시에 넣는다 */
+typedef struct upgrade_obj {
+  upgrade_rec rec;
+  struct upgrade_obj *next;
+  char data[];                      // key, '\0', value
+} upgrade_obj;
+
+/* 보내는 중인 연결. 실패하면 남은 객체는 건너뛴다 */
+typedef struct {
+  int fd;
+  int failed;
+} upgrade_send;
+
+/* 보내고 받는 데 UPGRADE_TIMEOUT_MS보다 오래 걸리면 실패로 본다 */
+static void set_timeout(int fd) {
+  struct timeval tv = { UPGRADE_TIMEOUT_MS / 1000, (UPGRADE_TIMEOUT_MS % 1000) * 1000 };
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int unix_addr(struct sockaddr_un *addr, const char *path) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+static int send_fd(int fd, int passfd) {
+  char byte = MSG_LISTENER, ctrl[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = { &byte, 1 };
+  struct msghdr msg;
+  struct cmsghdr *cm;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(ctrl, 0, sizeof(ctrl));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cm), &passfd, sizeof(int));
+  return sendmsg(fd, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+/* 넘겨받은 소켓. 반환값: fd, 실패하면 -1 */
+static int recv_fd(int fd) {
+  char byte, ctrl[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = { &byte, 1 };
+  struct msghdr msg;
+  struct cmsghdr *cm;
+  int passfd;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != 1 || byte != MSG_LISTENER
+      || !(cm = CMSG_FIRSTHDR(&msg)) || cm->cmsg_level != SOL_SOCKET
+      || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(int)))
+    return -1;
+  memcpy(&passfd, CMSG_DATA(cm), sizeof(int));
+  return passfd;
+}
+
+/* cache_walk 콜백: 아직 신선한 객체를 하나 보낸다 (잠금을 잡은 채이지만
+ * 받는 쪽이 바로 읽으므로 오래 막히지 않는다) */
+static int send_node(Node *node, void *arg) {
+  upgrade_send *s = arg;
+  upgrade_rec rec;
+  struct iovec iov[3];
+
+  rec.age = node->age + (long)(time(NULL) - node->stored_at);
+  if (s->failed || (node->max_age >= 0 && rec.age > node->max_age))
+    return 0;
+  rec.keylen = strlen(node->key);
+  rec.size = node->size;
+  rec.hdrlen = node->hdrlen;
+  rec.max_age = node->max_age;
+  iov[0].iov_base = &rec;
+  iov[0].iov_len = sizeof(rec);
+  iov[1].iov_base = node->key;
+  iov[1].iov_len = rec.keylen;
+  iov[2].iov_base = node->value;
+  iov[2].iov_len = node->size;
+  if (rio_writev(s->fd, iov, 3) < 0)
+    s->failed = 1;
+  return 0;
+}
+
+/* 캐시 객체를 끝 표시까지 받아 오래된 것부터 넣는다. 반환값: 넣은 수, 실패하면 -1 */
+static int recv_cache(int fd, LRU_Cache *cache) {
+  upgrade_obj *list = NULL, *o;
+  upgrade_rec rec;
+  long total = 0;
+  int n = 0, err = 0;
+
+  while (1) {
+    if (rio_readn(fd, &rec, sizeof(rec)) != sizeof(rec)) {
+      err = -1;
+      break;
+    }
+    if (rec.keylen == 0)
+      break;
+    if (rec.keylen < 0 || rec.keylen >= MAXLINE || rec.size <= 0 || rec.size > MAX_OBJECT_SIZE
+        || rec.hdrlen < 0 || rec.hdrlen + 2 > rec.size || (total += rec.size) > INT_MAX
+        || !(o = malloc(sizeof(upgrade_obj) + rec.keylen + 1 + rec.size))) {
+      err = -1;
+      break;
+    }
+    o->rec = rec;
+    o->next = list;               // 가장 최근 것부터 오므로 거꾸로 쌓는다
+    list = o;
+    if (rio_readn(fd, o->data, rec.keylen) != rec.keylen
+        || rio_readn(fd, o->data + rec.keylen + 1, rec.size) != rec.size) {
+      err = -1;
+      break;
+    }
+    o->data[rec.keylen] = '\0';
+  }
+  while ((o = list)) {
+    list = o->next;
+    if (!err) {
+      add_cache(cache, o->data, o->data + o->rec.keylen + 1, o->rec.size, o->rec.hdrlen,
+                o->rec.age, o->rec.max_age);
+      n++;
+    }
+    free(o);
+  }
+  return err ? -1 : n;
+}
+
+/*
+ * upgrade_takeover - path에서 기다리는 이전 프로세스가 있으면 listen
+ *     소켓을 *listenfd로 넘겨받고 캐시 객체를 cache에 넣는다. 받기 시작한
+ *     뒤에 반환값의 fd로 upgrade_ready()를 불러야 이전 프로세스가 물러난다.
+ *
+ *     반환값: 이전 프로세스와의 연결, 이전 프로세스가 없거나 받지 못했으면 -1
+ */
+int upgrade_takeover(const char *path, int *listenfd, LRU_Cache *cache) {
+  struct sockaddr_un addr;
+  int fd, lfd, n;
+
+  if (unix_addr(&addr, path) < 0 || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+  if (connect(fd, (SA *)&addr, sizeof(addr)) < 0) {
+    close(fd);                    // 처음 띄우는 것 (또는 이전 프로세스가 이미 없음)
+    return -1;
+  }
+  set_timeout(fd);
+  if ((lfd = recv_fd(fd)) < 0) {
+    fprintf(stderr, "%s: no listener from the running proxy\n", path);
+    close(fd);
+    return -1;
+  }
+  if ((n = recv_cache(fd, cache)) < 0) {
+    fprintf(stderr, "%s: cache transfer failed, starting with what arrived\n", path);
+    n = 0;
+  }
+  *listenfd = lfd;
+  printf("Took over the listener and %d cached objects from the running proxy\n", n);
+  fflush(stdout);
+  return fd;
+}
+
+/* 받기 시작했다고 이전 프로세스에 알리고 연결을 닫는다 */
+void upgrade_ready(int fd) {
+  char byte = MSG_READY;
+
+  if (write(fd, &byte, 1) != 1)
+    fprintf(stderr, "upgrade: cannot notify the previous proxy: %s\n", strerror(errno));
+  close(fd);
+}
+
+/*
+ * upgrade_listen - 다음 업그레이드를 기다리는 unix 소켓을 path에 연다.
+ *     이전 프로세스의 소켓 파일은 지운다 (이미 넘겨받았거나 남은 것).
+ *
+ *     반환값: non-blocking 소켓, 실패하면 -1
+ */
+int upgrade_listen(const char *path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (unix_addr(&addr, path) < 0
+      || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+  unlink(path);
+  if (bind(fd, (SA *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * upgrade_handoff - 새 프로세스가 upfd에 와 있으면 listenfd와 캐시를
+ *     넘기고 준비를 기다린다 (accept 루프에서 UPGRADE_POLL_MS마다 호출).
+ *
+ *     반환값: 0이면 새 프로세스가 받기 시작했으니 받기를 멈춘다,
+ *     아무도 없거나 넘기지 못했으면 -1
+ */
+int upgrade_handoff(int upfd, int listenfd, LRU_Cache *cache) {
+  upgrade_send s = { -1, 0 };
+  upgrade_rec end;
+  char byte;
+
+  if ((s.fd = accept4(upfd, NULL, NULL, SOCK_CLOEXEC)) < 0)
+    return -1;
+  set_timeout(s.fd);
+  /* 두 프로세스가 같이 받는 동안에는 poll이 깨워도 상대가 먼저 가져갈 수
+   * 있으므로 accept가 막히지 않게 한다 (열린 파일을 공유하므로 양쪽 모두) */
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  if (send_fd(s.fd, listenfd) < 0) {
+    close(s.fd);
+    return -1;
+  }
+  cache_walk(cache, send_node, &s);
+  memset(&end, 0, sizeof(end));
+  if (s.failed || rio_writen(s.fd, &end, sizeof(end)) < 0
+      || read(s.fd, &byte, 1) != 1 || byte != MSG_READY) {
+    fprintf(stderr, "upgrade: new proxy did not take over, still accepting\n");
+    close(s.fd);
+    return -1;
+  }
+  close(s.fd);
+  return 0;
+}
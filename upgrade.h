@@ -0,0 +1,16 @@
+#ifndef __UPGRADE_H__
+#define __UPGRADE_H__
+
+#include "csapp.h"
+#include "cache.h"
+
+#define UPGRADE_POLL_MS    100      // 새 프로세스가 왔는지, drain이 끝났는지 보는 주기
+#define UPGRADE_TIMEOUT_MS 10000    // 넘겨받는 쪽이 준비될 때까지 기다리는 시간
+#define DRAIN_TIMEOUT_MS   30000    // 넘겨준 뒤 처리 중인 요청을 기다리는 시간 (drain_timeout_ms)
+
+int upgrade_takeover(const char *path, int *listenfd, LRU_Cache *cache);
+int upgrade_listen(const char *path);
+int upgrade_handoff(int upfd, int listenfd, LRU_Cache *cache);
+void upgrade_ready(int fd);
+
+#endif /* __UPGRADE_H__ */
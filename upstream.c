@@ -0,0 +1,405 @@
+/*
+ * upstream.c - 리버스 프록시: Host와 경로로 서버 풀을 고르고 나눠 보내기.
+ *
+ *     설정 파일의 "upstream 이름 lor|hash host:port ..."가 풀을, "route
+ *     [host]/prefix 이름"이 규칙을 만든다 (-R host:port,...는 "/"를 받는
+ *     lor 풀 하나). 규칙이 있으면 origin-form 요청("GET /path")은 리버스
+ *     프록시로 받는다. Host가 맞는 규칙이 모든 Host를 받는 규칙보다, 그다음은
+ *     긴 접두사가 앞선다. 캐시 키와 로그에는 "http://Host/path"를 쓰므로
+ *     포워드 프록시로 받은 요청과 같은 캐시를 쓴다.
+ *
+ *     lor는 처리 중인 요청이 가장 적은 서버를 (같으면 돌아가며), hash는 URI로
+ *     서버를 고른다. hash는 rendezvous hashing으로, 서버마다 hash(URI, 서버)를
+ *     매겨 가장 큰 곳에 보낸다. 같은 URI는 늘 같은 서버로 가서 그 서버의
+ *     캐시를 쓰고, 서버가 빠지거나 늘면 그 서버의 몫만 옮겨 간다.
+ *
+ *     상태 확인은 따로 요청을 보내지 않고 실제 요청의 결과로 한다 (passive).
+ *     연결이나 응답 헤더가 health_fails번 잇따라 실패한 서버는
+ *     health_down_ms 동안 고르지 않는다 (남은 서버가 모두 빠졌으면 그래도
+ *     보낸다). 그 뒤로 한 번 성공하면 돌아오고 실패하면 다시 빠진다.
+ *     연결하지 못했으면 아직 요청을 보내지 않았으므로 메서드와 상관없이 풀의
+ *     다른 서버로 retries번까지 다시 시도한다.
+ *
+ *     서버별 상태는 스냅샷이 아니라 이 파일의 표에 host:port로 두므로 SIGHUP
+ *     으로 다시 읽어도 이어진다. 표는 설정을 읽는 쪽(main, accept 루프)만
+ *     늘리고, 요청은 공개된 스냅샷에 적힌 번호로만 찾는다. -p면 워커마다 따로.
+ */
+#include <limits.h>
+#include "upstream.h"
+#include "trace.h"
+#include "err.h"
+
+/* 서버 하나의 상태. host, port, hash는 표에 넣은 뒤로 바꾸지 않는다 */
+typedef struct {
+  char host[UPSTREAM_HOST_MAX];
+  char port[NI_MAXSERV];
+  uint64_t hash;                // hash로 고를 때 서버 쪽 값 ("host:port"의 해시)
+  int active;                   // 처리 중인 요청 수
+  int fails;                    // 잇따라 실패한 횟수
+  long long down_until;         // 이 시각(timer_now)까지 고르지 않음
+  unsigned long requests, failures;
+} server_state;
+
+static server_state servers[UPSTREAM_STATES];
+static int nservers;
+static unsigned int turn;       // lor에서 수가 같을 때 돌아가며 고르는 시작점
+
+/* *p에서 공백이나 쉼표로 나눈 다음 낱말을 NUL로 끝내 돌려준다. 없으면 NULL */
+static char *next_word(char **p) {
+  char *w = *p + strspn(*p, " \t,");
+  size_t n = strcspn(w, " \t,");
+
+  if (!n)
+    return NULL;
+  *p = w + n + (w[n] != '\0');
+  w[n] = '\0';
+  return w;
+}
+
+/* "host:port" (포트가 없으면 80, IPv6는 "[addr]:port")를 s에 넣는다 */
+static int parse_server(upstream_server *s, char *w) {
+  char *colon = strrchr(w, ':'), *host = w;
+  size_t n;
+
+  if (w[0] == '[') {
+    host = w + 1;
+    if (!(colon = strchr(host, ']')) || (colon[1] && colon[1] != ':'))
+      return -1;
+    *colon++ = '\0';
+    colon = *colon ? colon : NULL;
+  } else if (colon) {
+    *colon = '\0';
+  }
+  if (!(n = strlen(host)) || n >= UPSTREAM_HOST_MAX)
+    return -1;
+  strcpy(s->host, host);
+  if (!colon)
+    strcpy(s->port, "80");
+  else if (!colon[1] || strlen(colon + 1) >= NI_MAXSERV
+           || colon[1 + strspn(colon + 1, "0123456789")])
+    return -1;
+  else
+    strcpy(s->port, colon + 1);
+  s->id = -1;
+  return 0;
+}
+
+/*
+ * upstream_parse_pool - 설정의 "upstream 이름 lor|hash host:port ..." 한 줄.
+ *     같은 이름이 다시 오면 서버를 더한다 (한 줄에 다 쓰기 길 때).
+ *
+ *     반환값: 0, 잘못되었으면 -1
+ */
+int upstream_parse_pool(config *cfg, const char *value) {
+  char line[CONFIG_STR_MAX + 64], *p = line, *name, *balance, *w;
+  upstream_pool *pool;
+  int i;
+
+  snprintf(line, sizeof(line), "%s", value);
+  if (!(name = next_word(&p)) || !(balance = next_word(&p)) || strlen(name) >= UPSTREAM_NAME_MAX)
+    return -1;
+  for (i = 0; i < cfg->npools && strcmp(cfg->pools[i].name, name); i++)
+    ;
+  if (i == UPSTREAM_MAX)
+    return -1;
+  pool = &cfg->pools[i];
+  if (i == cfg->npools) {
+    cfg->npools++;
+    strcpy(pool->name, name);
+    pool->nservers = 0;
+  }
+  if (!strcmp(balance, "lor"))
+    pool->balance = BALANCE_LOR;
+  else if (!strcmp(balance, "hash"))
+    pool->balance = BALANCE_HASH;
+  else
+    return -1;
+  while ((w = next_word(&p))) {
+    if (pool->nservers == UPSTREAM_SERVERS || parse_server(&pool->servers[pool->nservers], w) < 0)
+      return -1;
+    pool->nservers++;
+  }
+  return pool->nservers ? 0 : -1;
+}
+
+/* 설정의 "route [host]/prefix 이름" 한 줄 ("*"도 모든 Host). 반환값: 0, 잘못되었으면 -1 */
+int upstream_parse_route(config *cfg, const char *value) {
+  char line[CONFIG_STR_MAX + 64], *p = line, *target, *name, *slash;
+  route_rule *r;
+
+  snprintf(line, sizeof(line), "%s", value);
+  if (cfg->nroutes == ROUTE_MAX || !(target = next_word(&p)) || !(name = next_word(&p))
+      || next_word(&p) || !(slash = strchr(target, '/')) || strlen(name) >= UPSTREAM_NAME_MAX
+      || slash - target >= UPSTREAM_HOST_MAX || strlen(slash) >= CONFIG_STR_MAX)
+    return -1;
+  r = &cfg->routes[cfg->nroutes++];
+  snprintf(r->host, UPSTREAM_HOST_MAX, "%.*s", (int)(slash - target), target);
+  if (!strcmp(r->host, "*"))
+    r->host[0] = '\0';
+  strcpy(r->prefix, slash);
+  strcpy(r->pool_name, name);
+  r->pool = -1;
+  return 0;
+}
+
+/* host:port의 상태 번호. 처음 보면 표에 넣는다. 반환값: 번호, 표가 찼으면 -1 */
+static int server_id(const char *host, const char *port) {
+  char key[UPSTREAM_HOST_MAX + NI_MAXSERV];
+  int i;
+
+  for (i = 0; i < nservers; i++)
+    if (!strcmp(servers[i].host, host) && !strcmp(servers[i].port, port))
+      return i;
+  if (i == UPSTREAM_STATES)
+    return -1;
+  strcpy(servers[i].host, host);
+  strcpy(servers[i].port, port);
+  snprintf(key, sizeof(key), "%s:%s", host, port);
+  servers[i].hash = trace_hash(key);
+  __atomic_store_n(&nservers, i + 1, __ATOMIC_RELEASE);
+  return i;
+}
+
+/*
+ * upstream_config - 다 읽은 cfg에서 backends(-R)를 풀과 "/" 규칙으로 바꾸고,
+ *     규칙이 가리키는 풀을 찾고, 서버마다 상태 번호를 붙인다 (config_load).
+ *
+ *     반환값: 0, 없는 풀을 가리키는 규칙이 있거나 서버가 너무 많으면 -1
+ */
+int upstream_config(config *cfg) {
+  char line[CONFIG_STR_MAX + 64];
+  upstream_pool *pool;
+  route_rule *r;
+  int i, j;
+
+  if (cfg->backends[0]) {
+    snprintf(line, sizeof(line), "%s lor %s", UPSTREAM_DEFAULT_POOL, cfg->backends);
+    if (upstream_parse_pool(cfg, line) < 0
+        || upstream_parse_route(cfg, "/ " UPSTREAM_DEFAULT_POOL) < 0) {
+      fprintf(stderr, "bad backends: %s\n", cfg->backends);
+      return -1;
+    }
+  }
+  for (i = 0; i < cfg->nroutes; i++) {
+    r = &cfg->routes[i];
+    for (j = 0; j < cfg->npools && strcmp(cfg->pools[j].name, r->pool_name); j++)
+      ;
+    if (j == cfg->npools) {
+      fprintf(stderr, "route %s%s: no upstream %s\n", r->host, r->prefix, r->pool_name);
+      return -1;
+    }
+    r->pool = j;
+  }
+  for (i = 0; i < cfg->npools; i++) {
+    pool = &cfg->pools[i];
+    for (j = 0; j < pool->nservers; j++) {
+      if ((pool->servers[j].id = server_id(pool->servers[j].host, pool->servers[j].port)) < 0) {
+        fprintf(stderr, "more than %d upstream servers\n", UPSTREAM_STATES);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * upstream_route - 리버스 프록시로 받은 요청(c->reverse)의 규칙을 고른다.
+ *     c->hostname에는 Host 헤더의 값 (없으면 빈 문자열), c->path에는 요청
+ *     줄의 경로가 있다. c->uri는 "http://Host/path"로 바꾼다 (Host가
+ *     없으면 풀 이름). 원 서버는 연결할 때 upstream_pick()이 고른다.
+ *
+ *     반환값: ERR_NONE, 맞는 규칙이 없으면 ERR_NO_ROUTE
+ */
+int upstream_route(conn_t *c) {
+  config *cfg = c->cfg;
+  size_t n = strcspn(c->hostname, ":");   // 규칙과 비교할 때는 포트를 뗌
+  size_t hostlen, pathlen;
+  route_rule *r;
+  int i, best = -1, score, best_score = -1;
+
+  for (i = 0; i < cfg->nroutes; i++) {
+    r = &cfg->routes[i];
+    if (r->host[0] && (strlen(r->host) != n || strncasecmp(r->host, c->hostname, n)))
+      continue;
+    if (strncmp(c->path, r->prefix, strlen(r->prefix)))
+      continue;
+    score = (r->host[0] ? CONFIG_STR_MAX : 0) + strlen(r->prefix);
+    if (score > best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  if (best < 0)
+    return ERR_NO_ROUTE;
+  c->route = best;
+  if (!c->hostname[0])
+    strcpy(c->hostname, cfg->pools[cfg->routes[best].pool].name);
+  /* c->path는 c->uri를 가리키므로 경로를 뒤로 밀고 앞에 "http://Host"를 쓴다 */
+  hostlen = strlen(c->hostname);
+  pathlen = strlen(c->path) + 1;
+  if (7 + hostlen + pathlen > MAXLINE)
+    return ERR_URI_TOO_LONG;
+  memmove(c->uri + 7 + hostlen, c->path, pathlen);
+  memcpy(c->uri, "http://", 7);
+  memcpy(c->uri + 7, c->hostname, hostlen);
+  c->path = c->uri + 7 + hostlen;
+  return ERR_NONE;
+}
+
+static upstream_pool *route_pool(conn_t *c) {
+  return &c->cfg->pools[c->cfg->routes[c->route].pool];
+}
+
+/* splitmix64의 마무리: hash(URI) ^ hash(서버)를 고르게 흩는다 */
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* 이 요청에서 아직 시도하지 않은 서버 중 하나. healthy면 빼 둔 서버는 건너뛴다.
+ * 반환값: 풀 안의 번호, 없으면 -1 */
+static int choose(conn_t *c, upstream_pool *pool, int healthy) {
+  long long now = timer_now();
+  uint64_t key = 0, score, best_score = 0;
+  unsigned int start = 0;
+  int i, j, active, best = -1, best_active = INT_MAX;
+  server_state *s;
+
+  if (pool->balance == BALANCE_HASH)
+    key = trace_hash(c->uri);
+  else
+    start = __atomic_fetch_add(&turn, 1, __ATOMIC_RELAXED);
+  for (j = 0; j < pool->nservers; j++) {
+    i = (start + j) % pool->nservers;
+    s = &servers[pool->servers[i].id];
+    if ((c->tried & (1u << i))
+        || (healthy && __atomic_load_n(&s->down_until, __ATOMIC_RELAXED) > now))
+      continue;
+    if (pool->balance == BALANCE_HASH) {
+      score = mix(key ^ s->hash);
+      if (best < 0 || score > best_score) {
+        best = i;
+        best_score = score;
+      }
+    } else if ((active = __atomic_load_n(&s->active, __ATOMIC_RELAXED)) < best_active) {
+      best = i;
+      best_active = active;
+    }
+  }
+  return best;
+}
+
+/* 규칙의 풀에서 이번 요청을 보낼 서버를 골라 c->hostname, c->port에 넣는다.
+ * 리버스 프록시로 받은 요청이 아니면 아무것도 하지 않는다 */
+void upstream_pick(conn_t *c) {
+  upstream_pool *pool;
+  server_state *s;
+  int i;
+
+  if (c->route < 0)
+    return;
+  pool = route_pool(c);
+  if ((i = choose(c, pool, 1)) < 0)
+    i = choose(c, pool, 0);       // 남은 서버가 모두 빠져 있으면 상태를 보지 않고
+  c->backend = i;
+  c->tried |= 1u << i;
+  c->attempts++;
+  s = &servers[pool->servers[i].id];
+  __atomic_add_fetch(&s->active, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s->requests, 1, __ATOMIC_RELAXED);
+  strcpy(c->hostname, pool->servers[i].host);
+  strcpy(c->port, pool->servers[i].port);
+}
+
+/* 원 서버 쪽 실패인지: 연결, 요청 전송, 응답 헤더 */
+static int server_failure(int err) {
+  return err == ERR_DNS || err == ERR_CONNECT || err == ERR_CONNECT_TIMEOUT
+      || err == ERR_UPSTREAM_WRITE || err == ERR_FIRST_BYTE_TIMEOUT || err == ERR_BAD_RESPONSE;
+}
+
+/* 지금 서버에 보낸 요청 하나를 끝낸다. 성공이면 잇따른 실패를 지우고,
+ * 서버 쪽 실패면 더해서 health_fails에 닿으면 health_down_ms 동안 뺀다 */
+static void release(conn_t *c, int err) {
+  upstream_server *u = &route_pool(c)->servers[c->backend];
+  server_state *s = &servers[u->id];
+  int limit = c->cfg->health_fails, fails;
+
+  c->backend = -1;
+  __atomic_sub_fetch(&s->active, 1, __ATOMIC_RELAXED);
+  if (err == ERR_NONE) {
+    if ((fails = __atomic_exchange_n(&s->fails, 0, __ATOMIC_RELAXED)) && limit && fails >= limit) {
+      __atomic_store_n(&s->down_until, 0, __ATOMIC_RELAXED);
+      printf("Upstream %s:%s is back\n", u->host, u->port);
+      fflush(stdout);
+    }
+    return;
+  }
+  if (!server_failure(err))
+    return;
+  __atomic_add_fetch(&s->failures, 1, __ATOMIC_RELAXED);
+  fails = __atomic_add_fetch(&s->fails, 1, __ATOMIC_RELAXED);
+  if (!limit || fails < limit)
+    return;
+  __atomic_store_n(&s->down_until, timer_now() + c->cfg->health_down_ms, __ATOMIC_RELAXED);
+  if (fails == limit) {
+    printf("Upstream %s:%s is down after %d failures (%s)\n", u->host, u->port, fails,
+           err_name(err));
+    fflush(stdout);
+  }
+}
+
+/*
+ * upstream_retry - 지금 서버에 연결하지 못했다 (err). 리버스 프록시이고
+ *     다시 시도할 수 있으면 실패로 세고 풀의 다른 서버를 고른다. 시간
+ *     초과는 요청의 마감 시간을 다 쓴 것이므로 다시 시도하지 않는다.
+ *
+ *     반환값: 다른 서버를 골랐으면 1 (호출한 쪽이 다시 연결), 아니면 0
+ */
+int upstream_retry(conn_t *c, int err) {
+  if (c->backend < 0 || (err != ERR_CONNECT && err != ERR_DNS) || c->timed_out
+      || c->attempts > c->cfg->retries
+      || c->tried == (1u << route_pool(c)->nservers) - 1)
+    return 0;
+  release(c, err);
+  upstream_pick(c);
+  return 1;
+}
+
+/* 요청이 끝났다 (request_done). 서버에 보낸 요청이면 결과를 센다 */
+void upstream_done(conn_t *c, int err) {
+  if (c->backend >= 0)
+    release(c, err);
+}
+
+/* /metrics에 붙일 서버별 상태. 반환값: buf에 쓴 길이 (room 미만) */
+int upstream_metrics(char *buf, int room) {
+  static const struct {
+    const char *name, *type, *help;
+  } m[] = {
+    { "active", "gauge", "Requests in flight per reverse-proxy server." },
+    { "requests_total", "counter", "Requests sent per reverse-proxy server (retries included)." },
+    { "failures_total", "counter", "Connect, send and response-header failures per server." },
+    { "up", "gauge", "0 while passive health checks keep the server out." },
+  };
+  int count = __atomic_load_n(&nservers, __ATOMIC_ACQUIRE), n = 0, i, k;
+  long long now = timer_now(), v;
+  server_state *s;
+
+  for (k = 0; count && k < (int)(sizeof(m) / sizeof(m[0])) && n < room; k++) {
+    n += snprintf(buf + n, room - n, "# HELP proxy_backend_%s %s\n# TYPE proxy_backend_%s %s\n",
+                  m[k].name, m[k].help, m[k].name, m[k].type);
+    for (i = 0; i < count && n < room; i++) {
+      s = &servers[i];
+      v = k == 0 ? __atomic_load_n(&s->active, __ATOMIC_RELAXED)
+        : k == 1 ? (long long)__atomic_load_n(&s->requests, __ATOMIC_RELAXED)
+        : k == 2 ? (long long)__atomic_load_n(&s->failures, __ATOMIC_RELAXED)
+        : __atomic_load_n(&s->down_until, __ATOMIC_RELAXED) <= now;
+      n += snprintf(buf + n, room - n, "proxy_backend_%s{server=\"%s:%s\"} %lld\n",
+                    m[k].name, s->host, s->port, v);
+    }
+  }
+  return n < room ? n : room - 1;
+}
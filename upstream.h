@@ -0,0 +1,21 @@
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include "conn.h"
+
+#define UPSTREAM_STATES       64      // 상태를 기억하는 서버 수 (다시 읽어도 이어짐)
+#define UPSTREAM_DEFAULT_POOL "default"  // -R로 만든 풀의 이름
+#define UPSTREAM_RETRIES      1       // 기본 retries
+#define HEALTH_FAILS          3       // 기본 health_fails
+#define HEALTH_DOWN_MS        10000   // 기본 health_down_ms
+
+int upstream_parse_pool(config *cfg, const char *value);
+int upstream_parse_route(config *cfg, const char *value);
+int upstream_config(config *cfg);
+int upstream_route(conn_t *c);
+void upstream_pick(conn_t *c);
+int upstream_retry(conn_t *c, int err);
+void upstream_done(conn_t *c, int err);
+int upstream_metrics(char *buf, int room);
+
+#endif /* __UPSTREAM_H__ */